@@ -129,7 +129,7 @@ static int load_config(void)
   struct ast_config *cfg;
   struct ast_variable *var;
   char *tmp;
-  int level, reverse;
+  int level, reverse, percentile;
 
   cfg = (void *)ast_config_load(config);
   if (!cfg)
@@ -210,6 +210,26 @@ static int load_config(void)
 	  ast_log(LOG_WARNING, "Invalid reverse bit flag %s. Bits will be reversed.\n", tmp);
       }
    }
+
+   tmp = (void *)ast_variable_retrieve(cfg, "general", "jitterpercentile");
+   if (tmp)
+   {
+      if (sscanf(tmp, "%d", &percentile) >= 1 && percentile >= 0 && percentile < 100)
+      {
+          ast_verbose(VERBOSE_PREFIX_3 "Audio jitter buffer : %s\n",
+			(percentile == 0)?"fixed":"adaptive");
+	  H324MSetAudioJitterPercentile(percentile);
+      }
+      else
+      {
+	  ast_log(LOG_WARNING, "Invalid jitter percentile %s. Audio jitter buffer will be fixed.\n", tmp);
+	  H324MSetAudioJitterPercentile(0);
+      }
+   }
+   else
+   {
+      H324MSetAudioJitterPercentile(0);
+   }
    ast_config_destroy(cfg);
 
   if (level > 0)
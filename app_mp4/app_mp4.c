@@ -72,6 +72,14 @@
 #define NO_CODEC         -1
 #define MS_2_SEC         1000000   // Micro secondes -> Sec 
 #define MAX_DTMF_BUFFER_SIZE 25
+#define MP4_WRITER_THREADS   2
+#define MP4_WRITER_QUEUE     512
+/* threads sending the frames of all the mp4play channels */
+#define MP4_PLAY_THREADS     2
+/* duration of the fragments when recording fragmented files, in ms */
+#define MP4_FRAGMENT_MS      2000
+/* audio frames stored in each mp4 sample */
+#define MP4_AUDIO_AGGREGATION 5
 
 #define TIMEVAL_TO_MS( tv , ms ) \
   { \
@@ -106,13 +114,18 @@ static const char *des_play = "  mp4play(filename,[options]):  Play mp4 file to
         " 'n(x)': number of digits (x) to wait for \n"
         " 'S(x)': set variable of name x (with DTMFs) rather than go to extension \n"
         " 's(x)': set digits, which should stop playback \n"
+        " 'b(x)': start playing at x ms of the file, from the previous key frame \n"
+        " 'e(x)': stop playing at x ms of the file \n"
+        "\n"
+        "The time of the file played is set in MP4PLAY_POSITION, in ms, to resume it later.\n"
         "\n"
         "Examples:\n"
         " mp4play(/tmp/video.mp4)   					play video file to user\n"
         " mp4play(/tmp/test.mp4,'n(3)') 				play video file to user and wait for 3 digits \n"
         " mp4play(/tmp/test.mp4,'n(3)S(DTMF_INPUT)')	play video file to user and wait for 3 digits and \n"
         "							set them as value of variable DTMF_INPUT\n"
-        " mp4play(/tmp/test.mp4,'n(3)s(#)') 		play video file, wait for 3 digits or break on '#' \n";
+        " mp4play(/tmp/test.mp4,'n(3)s(#)') 		play video file, wait for 3 digits or break on '#' \n"
+        " mp4play(/tmp/test.mp4,'s(#)b(${MP4PLAY_POSITION})')	resume a file interrupted by '#' \n";
 
 
 static const char *app_save = "mp4save";
@@ -126,6 +139,7 @@ static const char *des_save = "  mp4save(filename,[options]):  Record mp4 file.
         " 'V': wait for first video I frame to start recording\n"
 		" '0'..'9','#','*': sets dtmf input to stop recording\n"
 		" 'T': do not record text separate text file\n"
+		" 'F': record a fragmented file, readable while it is recorded\n"
         "\n"
         "Note: waiting for video I frame also activate video loopback mode.\n"
         "\n"
@@ -142,12 +156,16 @@ enum _mp4play_exec_option_flags
         OPT_DFTMINTOVAR 	=	(1 << 0),
         OPT_NOOFDTMF 		=	(1 << 1),
 		OPT_STOPDTMF		=	(1 << 2),
+		OPT_BEGIN		=	(1 << 3),
+		OPT_END			=	(1 << 4),
 } mp4play_exec_option_flags;
 
 enum {
         OPT_ARG_DFTMINTOVAR =          0,
         OPT_ARG_NOOFDTMF,
 	OPT_ARG_STOPDTMF,
+	OPT_ARG_BEGIN,
+	OPT_ARG_END,
         /* note: this entry _MUST_ be the last one in the enum */
 	OPT_ARG_ARRAY_SIZE,
 } mp4play_exec_option_args;
@@ -156,6 +174,8 @@ AST_APP_OPTIONS(mp4play_exec_options, {
         AST_APP_OPTION_ARG('S', OPT_DFTMINTOVAR, OPT_ARG_DFTMINTOVAR),
         AST_APP_OPTION_ARG('n', OPT_NOOFDTMF, OPT_ARG_NOOFDTMF),
 	AST_APP_OPTION_ARG('s', OPT_STOPDTMF, OPT_ARG_STOPDTMF),
+	AST_APP_OPTION_ARG('b', OPT_BEGIN, OPT_ARG_BEGIN),
+	AST_APP_OPTION_ARG('e', OPT_END, OPT_ARG_END),
 });
 
 
@@ -251,7 +271,6 @@ static int mp4_play_process_frame(struct ast_channel * chan, struct ast_frame *f
 static int mp4_play(struct ast_channel *chan, void *data)
 {
 	struct ast_module_user *u = NULL;
-	MP4FileHandle mp4;
 	struct mp4play * player;
 	//const char *type = NULL;
 
@@ -260,6 +279,9 @@ static int mp4_play(struct ast_channel *chan, void *data)
 	char *varName = NULL;
 	char *stopChars = NULL;
 	char dtmfBuffer[MAX_DTMF_BUFFER_SIZE];
+	char position[32];
+	long begin = 0;
+	long endms = -1;
 	struct ast_flags opts = { 0, };
 	char *opt_args[OPT_ARG_ARRAY_SIZE];
 	
@@ -350,6 +372,26 @@ static int mp4_play(struct ast_channel *chan, void *data)
 			ast_verbose(VERBOSE_PREFIX_3 "Stop chars are %s.\n",stopChars);
         }
 
+	/* If we have start and end offsets check them */
+	if (ast_test_flag(&opts, OPT_BEGIN) && !ast_strlen_zero(opt_args[OPT_ARG_BEGIN])) {
+
+		begin = atol(opt_args[OPT_ARG_BEGIN]);
+
+		if (begin<0) {
+			ast_log(LOG_WARNING, "mp4play does not accept b(%s), playing from the start.\n", opt_args[OPT_ARG_BEGIN]);
+			begin = 0;
+		}
+	}
+
+	if (ast_test_flag(&opts, OPT_END) && !ast_strlen_zero(opt_args[OPT_ARG_END])) {
+
+		endms = atol(opt_args[OPT_ARG_END]);
+
+		if (endms<0) {
+			ast_log(LOG_WARNING, "mp4play does not accept e(%s), playing to the end.\n", opt_args[OPT_ARG_END]);
+			endms = -1;
+		}
+	}
 	
 	if (args.filename[0] != '/')
 	{
@@ -372,23 +414,14 @@ static int mp4_play(struct ast_channel *chan, void *data)
 	}
 	
 	ast_verbose(VERBOSE_PREFIX_3 "MP4Play [%s].\n", cformat1);
-	mp4 = MP4Read(cformat1);
-	
-	/* If not valid */
-	if (mp4 == MP4_INVALID_FILE_HANDLE)
-	{
-		ast_log(LOG_WARNING, "mp4play: failed to open file %s.\n", cformat1);
-		/* exit */
-		res = -1;
-		goto clean;
-	}
-	
-	player = Mp4PlayerCreate(chan, mp4, true, 0);
+
+	/* Shares the packets of the file with the other players */
+	player = Mp4PlayerCreateFromFile(chan, cformat1, true, 0);
 	if ( player == NULL)
 	{
 		ast_log(LOG_WARNING, "mp4play: failed to create MP4 player for file %s.\n", args.filename);
 		res = -1;
-		goto end;
+		goto clean;
 	}
 	
 	ast_log(LOG_DEBUG, "Native formats:%s , Channel capabilites ( videocaps.cap ):%s\n", 
@@ -396,7 +429,56 @@ static int mp4_play(struct ast_channel *chan, void *data)
 		ast_getformatname_multiple(cformat2,_STR_CODEC_SIZE, chan->channelcaps.cap));
 
 
+	if (endms >= 0)
+		Mp4PlayerSetEnd(player, endms);
+
+	if (begin > 0 && !Mp4PlayerSeek(player, begin))
+	{
+		ast_verbose(VERBOSE_PREFIX_3 " MP4Play [%s] stopped (nothing to play after %ld ms)\n", args.filename, begin);
+		res = 0;
+		goto end;
+	}
+
 	tv = ast_tvnow();
+
+	/* Frames are sent by the scheduler threads, only wait for dtmf and hangup */
+	if ( Mp4PlayerStart(chan, player) )
+	{
+	    while ( (ms = Mp4PlayerGetStatus(player)) == 0 )
+	    {
+		/* Woken up by a null frame when it ends */
+		if ( ast_waitfor(chan, 1000) > 0 )
+		{
+		    struct ast_frame * f = ast_read(chan);
+
+		    if (f == NULL)
+		    {
+		        ast_verbose(VERBOSE_PREFIX_3 " MP4Play [%s] stopped (hangup)\n", args.filename);
+		        res = 0;
+			goto end;
+		    }
+
+		    res = mp4_play_process_frame(chan, f, dtmfBuffer, stopChars, numberofDigits, varName);
+		    if (res < 0)
+		    {
+			goto end;
+		    }
+		}
+	    }
+
+	    if (ms == -1)
+	    {
+		ast_verbose(VERBOSE_PREFIX_3 " MP4Play [%s] stopped (end of file)\n", args.filename); 
+		res = 0;
+	    }
+	    else
+	    {
+		ast_log(LOG_ERROR, "mp4play: failed to play file %s. Error code=%d.\n", 
+			args.filename, ms);
+		res = -1;
+	    }
+	    goto end;
+	}
 	
 	while ( ms >= 0 )
 	{
@@ -458,9 +540,18 @@ static int mp4_play(struct ast_channel *chan, void *data)
 	}
 	
 end:
-	if (player != NULL) Mp4PlayerDestroy(player);
-	/* Close file */
-	MP4Close(mp4, 0);
+	if (player != NULL)
+	{
+		/* A scheduler thread may still be sending it */
+		Mp4PlayerStop(player);
+
+		/* Where to resume it */
+		snprintf(position, sizeof(position), "%lu", Mp4PlayerGetPosition(player));
+		pbx_builtin_setvar_helper(chan, "MP4PLAY_POSITION", position);
+
+		/* Closes the file */
+		Mp4PlayerDestroy(player);
+	}
 
 clean:
 	/* Unlock module*/
@@ -516,10 +607,12 @@ static int record_frames(struct AstFb * recQueues[], struct ast_channel * chan,
 						{
 							/* -- ast_write() destroys the frame -- */
 							ast_write(chan, fr);
+							/* -- but does not know about our pool -- */
+							AstFbRecycleFrame( recQueues[m], fr );
 						}
 						else
 						{			
-							ast_frfree(fr);
+							AstFbReleaseFrame( recQueues[m], fr );
 						}
 					}
 					else
@@ -558,6 +651,9 @@ static int mp4_save(struct ast_channel *chan, void *data)
 	/* whether we record chat in a separate text file */
 	int saveInTxtFile = 1;
 	
+	/* whether we write a fragmented mp4 file */
+	int fragmented = 0;
+	
 	/*  Recording is on man! */
 	int onrecord = 1;
 	int textfile = -1;
@@ -607,6 +703,12 @@ static int mp4_save(struct ast_channel *chan, void *data)
 			saveInTxtFile = 0;
 		}
 		
+		/* Check fragmented file */
+		if (strchr(params,'F'))
+		{
+			fragmented = 1;
+		}
+		
 		int i, j = strlen(stopDtmfs);
 		for (i=0; i < strlen(params); i++)
 		{
@@ -628,11 +730,14 @@ static int mp4_save(struct ast_channel *chan, void *data)
 	/* Lock module */
 	u = ast_module_user_add(chan);
 
-	/* Create mp4 file */
-	mp4 = MP4Create((char *) data,  0);
+	/* Create mp4 file, fragmented files are created by the recorder */
+	if (fragmented)
+		mp4 = MP4_INVALID_FILE_HANDLE;
+	else
+		mp4 = MP4Create((char *) data,  0);
 
 	/* If failed */
-	if (mp4 == MP4_INVALID_FILE_HANDLE)
+	if (mp4 == MP4_INVALID_FILE_HANDLE && !fragmented)
 	{
 	    ast_log(LOG_ERROR, "Fail to create MP4 file %s.\n", (char*) data);
 	    goto mp4_save_cleanup;
@@ -663,21 +768,28 @@ static int mp4_save(struct ast_channel *chan, void *data)
 
 	time_t now;
 	struct tm *tmvalue; 
-	MP4Tags * tags = MP4TagsAlloc();
+	MP4Tags * tags = fragmented ? NULL : MP4TagsAlloc();
 
 	time(&now);
 	tmvalue = localtime(&now);
-	MP4TagsSetEncodingTool(tags, "MP4Save asterisk application");
-	MP4TagsSetArtist(tags, chan->cid.cid_name );
-
     sprintf(metadata, "%04d/%02d/%02d %02d:%02d:%02d",
            tmvalue->tm_year+1900, tmvalue->tm_mon+1, tmvalue->tm_mday,
            tmvalue->tm_hour, tmvalue->tm_min, tmvalue->tm_sec);
 
-	MP4TagsSetReleaseDate (tags, metadata);
-	MP4TagsStore(tags, mp4);
+	if (fragmented)
+	{
+		/* no tags on fragmented files */
+		recorder = Mp4RecorderCreateFragmented(chan, (char *) data, MP4_FRAGMENT_MS, waitVideo, "h264@vga", chan->cid.cid_name, textfile);
+	}
+	else
+	{
+		MP4TagsSetEncodingTool(tags, "MP4Save asterisk application");
+		MP4TagsSetArtist(tags, chan->cid.cid_name );
+		MP4TagsSetReleaseDate (tags, metadata);
+		MP4TagsStore(tags, mp4);
 
-	recorder = Mp4RecorderCreate(chan, mp4, waitVideo, "h264@vga", chan->cid.cid_name, textfile);
+		recorder = Mp4RecorderCreate(chan, mp4, waitVideo, "h264@vga", chan->cid.cid_name, textfile);
+	}
 
 	if ( recorder == NULL )
 	{
@@ -686,6 +798,11 @@ static int mp4_save(struct ast_channel *chan, void *data)
 	}
 
 	Mp4RecorderEnableVideoPrologue(recorder, false);
+	Mp4RecorderSetAudioAggregation(recorder, MP4_AUDIO_AGGREGATION);
+
+	/* Write from the shared writer threads so disk stalls do not block the channel */
+	if ( !Mp4RecorderEnableAsync(recorder, MP4_WRITER_QUEUE) )
+	    ast_log(LOG_WARNING, "mp4_save: writer threads not running, writing from channel thread.\n");
 
 #ifdef VIDEOCAPS
 	int oldnative = chan->nativeformats;
@@ -724,9 +841,14 @@ static int mp4_save(struct ast_channel *chan, void *data)
 	/* Send video update */
 	ast_indicate(chan, AST_CONTROL_VIDUPDATE);
 
-	audioInQueue = AstFbCreate(60, 0, 0);
-	videoInQueue = AstFbCreate(60, 0, 0);
+	/* media queues are fed and read by this thread only */
+	audioInQueue = AstFbCreateRing(60, 0, 0, 256);
+	videoInQueue = AstFbCreateRing(60, 0, 0, 256);
 	textInQueue = AstFbCreate(40, 0, 0);
+
+	/* queues hold at most ~60 frames before releasing them */
+	AstFbEnablePool(audioInQueue, 96, 640);
+	AstFbEnablePool(videoInQueue, 96, 1500);
 	
 	queueTab[0] = audioInQueue;
 	queueTab[1] = videoInQueue;
@@ -773,16 +895,16 @@ static int mp4_save(struct ast_channel *chan, void *data)
 	    switch ( f->frametype )
 	    {
 		case AST_FRAME_VOICE:
-			AstFbAddFrame( audioInQueue, f );
+			AstFbTakeFrame( audioInQueue, f );
 			break;
 	       
 		case AST_FRAME_VIDEO:
 		    //ast_log(LOG_DEBUG, "video frame: ok.\n");
-	            AstFbAddFrame( videoInQueue, f );
+	            AstFbTakeFrame( videoInQueue, f );
 		    break;
 
 		case AST_FRAME_TEXT:
-			AstFbAddFrame( textInQueue, f );
+			AstFbTakeFrame( textInQueue, f );
 			break;
 	    
 		case AST_FRAME_DTMF:
@@ -822,9 +944,9 @@ mp4_save_cleanup:
 	if (videoInQueue) AstFbDestroy(videoInQueue);
 	if (textInQueue) AstFbDestroy(textInQueue);
 	
-	MP4TagsFree(tags);
+	if (tags) MP4TagsFree(tags);
 	/* Close file */
-	MP4Close(mp4, 0);
+	if (mp4 != MP4_INVALID_FILE_HANDLE) MP4Close(mp4, 0);
 	
 	/* Remove file if video had not started */
 	if (waitVideo == 0) 
@@ -838,7 +960,7 @@ mp4_save_cleanup:
 	    ast_log(LOG_DEBUG, "Closed text file fd %d\n", textfile);
 	    close(textfile);
 	}
-	if (option_verbose > 2)
+	if (option_verbose > 2 && !fragmented)
 	{
 	    char * inf = MP4FileInfo( (char *) data, MP4_INVALID_TRACK_ID );
 	    if (inf)
@@ -866,6 +988,9 @@ static int unload_module(void)
 
 	ast_module_user_hangup_all();
 
+	Mp4WriterPoolStop();
+	Mp4PlaySchedulerStop();
+
 	return res;
 	
 }
@@ -877,6 +1002,8 @@ static int load_module(void)
 	res = ast_register_application(app_save, mp4_save, syn_save, des_save);
 	res &= ast_register_application(app_play, mp4_play, syn_play, des_play);
 	RedirectLogToAsterisk(2);
+	Mp4WriterPoolStart(MP4_WRITER_THREADS);
+	Mp4PlaySchedulerStart(MP4_PLAY_THREADS, 1);
 	return 0;
 }
 
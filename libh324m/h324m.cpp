@@ -4,6 +4,7 @@ extern "C"
 }
 
 #include "src/H324MSession.h"
+#include "src/H324MSessionPool.h"
 
 static bool _reverseBits = true;
 
@@ -20,6 +21,11 @@ void H324MSetReverseBits(int reverse)
 	_reverseBits = (bool) reverse;
 }
 
+void H324MSetAudioJitterPercentile(int percentile)
+{
+	H245ChannelsFactory::SetAudioJitterPercentile(percentile);
+}
+
 void H324MLoggerSetCallback(int (*callback)  (const char *, va_list))
 {
 	Logger::SetCallback(callback);
@@ -93,6 +99,73 @@ int  H324MSessionGetState(void * id)
 	return ((H324MSession*)id)->GetState();
 }
 
+int  H324MSessionGetAudioJitterStats(void * id,int *depth,int *target,int *delay,int *late,int *dropped)
+{
+	jitterBuffer::Stats stats;
+	if (!((H324MSession*)id)->GetAudioJitterStats(&stats))
+		return 0;
+	*depth = stats.depth;
+	*target = stats.target;
+	//Ticks are bytes of the 64kbps line
+	*delay = stats.delay/8;
+	*late = stats.late;
+	*dropped = stats.dropped;
+	return 1;
+}
+
+void * H324MSessionPoolCreate(int workers,int tick)
+{
+	return (void *)new H324MSessionPool(workers,tick);
+}
+
+void H324MSessionPoolDestroy(void * pool)
+{
+	delete ((H324MSessionPool*)pool);
+}
+
+void * H324MSessionPoolAdd(void * pool,void * id)
+{
+	return (void *)((H324MSessionPool*)pool)->Add((H324MSession*)id);
+}
+
+int H324MSessionPoolRemove(void * pool,void * pooled)
+{
+	return ((H324MSessionPool*)pool)->Remove((H324MSessionPool::Session*)pooled);
+}
+
+int H324MSessionPoolRead(void * pooled,unsigned char *buffer,int len)
+{
+	if (_reverseBits) TIFFReverseBits(buffer,len);
+	return ((H324MSessionPool::Session*)pooled)->Read(buffer,len);
+}
+
+int H324MSessionPoolWrite(void * pooled,unsigned char *buffer,int len)
+{
+	int ret = ((H324MSessionPool::Session*)pooled)->Write(buffer,len);
+	if (_reverseBits) TIFFReverseBits(buffer,ret);
+	return ret;
+}
+
+void * H324MSessionPoolGetFrame(void * pooled)
+{
+	return (void *)((H324MSessionPool::Session*)pooled)->GetFrame();
+}
+
+int H324MSessionPoolSendFrame(void * pooled,void *frame)
+{
+	return ((H324MSessionPool::Session*)pooled)->SendFrame((Frame*)frame);
+}
+
+void H324MSessionPoolLock(void * pooled)
+{
+	((H324MSessionPool::Session*)pooled)->Lock();
+}
+
+void H324MSessionPoolUnlock(void * pooled)
+{
+	((H324MSessionPool::Session*)pooled)->Unlock();
+}
+
 void * FrameCreate(int type, int codec, unsigned char * data, int len)
 {
 	return (void*)new Frame((MediaType)type,(MediaCodec)codec,data,len);
@@ -19,6 +19,9 @@ extern "C"
 #endif
 void 	TIFFReverseBits(unsigned char* buffer,int length);
 void	H324MSetReverseBits(int reverse);
+/* Adaptive audio jitter buffer for the next sessions, buffering the percentile
+ * of the jitter (1-99), 0 for the fixed 500ms buffer */
+void	H324MSetAudioJitterPercentile(int percentile);
 void 	H324MLoggerSetLevel(int level);
 
 void*	H324MSessionCreate(void);
@@ -39,6 +42,24 @@ int  	H324MSessionSendUserInput(void * id,char *input);
 
 int	H324MSessionSendVideoFastUpdatePicture(void * id);
 int	H324MSessionGetState(void * id);
+/* Audio jitter buffer stats, delay is in ms */
+int	H324MSessionGetAudioJitterStats(void * id,int *depth,int *target,int *delay,int *late,int *dropped);
+
+/* Session pool: the workers demux and mux the sessions on each tick.
+ * Read, Write, GetFrame and SendFrame take the handle returned by Add,
+ * any other session function must be called between Lock and Unlock.
+ * As with the session functions, SendFrame copies the frame and the caller
+ * destroys it, and frames returned by GetFrame are destroyed by the caller. */
+void*	H324MSessionPoolCreate(int workers,int tick);
+void	H324MSessionPoolDestroy(void * pool);
+void*	H324MSessionPoolAdd(void * pool,void * id);
+int	H324MSessionPoolRemove(void * pool,void * pooled);
+int	H324MSessionPoolRead(void * pooled,unsigned char *buffer,int len);
+int	H324MSessionPoolWrite(void * pooled,unsigned char *buffer,int len);
+void*	H324MSessionPoolGetFrame(void * pooled);
+int	H324MSessionPoolSendFrame(void * pooled,void *frame);
+void	H324MSessionPoolLock(void * pooled);
+void	H324MSessionPoolUnlock(void * pooled);
 
 void* 	FrameCreate(int type,int codec, unsigned char * buffer, int len);
 int 	FrameGetType(void* frame);
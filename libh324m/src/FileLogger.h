@@ -8,6 +8,9 @@ class FileLogger :
 	public Logger
 {
 public:
+	//Per byte traces for the mux policy
+	enum { enabled = 1 };
+
 	//Constructor
 	FileLogger();
 	virtual ~FileLogger();
@@ -9,6 +9,12 @@ class H223ALReceiver
 public:
 	//H223ALReceiver interface
 	virtual void Send(BYTE b)=0;
+	virtual void Send(BYTE *data,int len)
+	{
+		//Byte by byte by default
+		for (int i=0;i<len;i++)
+			Send(data[i]);
+	}
 	virtual void SendClosingFlag()=0;
 	virtual int IsSegmentable() = 0;
 	virtual ~H223ALReceiver() {}
@@ -20,25 +20,29 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "H223Demuxer.h"
-#include "FileLogger.h"
 #define NONE  0
 #define HEAD  1
 #define PDU   2
 
-H223Demuxer::H223Demuxer()
+template<class Log>
+H223DemuxerT<Log>::H223DemuxerT()
 {
-	//Create logger
-	log = new FileLogger();
+	//No receivers
+	for (int i=0;i<16;i++)
+		receivers[i] = NULL;
 }
 
-H223Demuxer::~H223Demuxer()
+template<class Log>
+H223DemuxerT<Log>::~H223DemuxerT()
 {
-	//Delete logger
-	delete log;
 }
 
-int H223Demuxer::SetChannel(int num,H223ALReceiver *receiver)
+template<class Log>
+int H223DemuxerT<Log>::SetChannel(int num,H223ALReceiver *receiver)
 {
 	//Check for null channel
 	if (!receiver)
@@ -48,10 +52,15 @@ int H223Demuxer::SetChannel(int num,H223ALReceiver *receiver)
 	//Save the reciever
 	al[num] = receiver;
 
+	//And in the lookup table
+	if (num>=0 && num<16)
+		receivers[num] = receiver;
+
 	return 1;
 }
 
-int H223Demuxer::ReleaseChannel(int num)
+template<class Log>
+int H223DemuxerT<Log>::ReleaseChannel(int num)
 {
 	// Search channel
 	ALReceiversMap::iterator it = al.find(num);
@@ -64,11 +73,16 @@ int H223Demuxer::ReleaseChannel(int num)
 	// Delete from map
 	al.erase(it);
 
+	//And from lookup table
+	if (num>=0 && num<16)
+		receivers[num] = NULL;
+
 	// Exit
 	return 1;
 }
 
-int H223Demuxer::Open(H223MuxTable *table)
+template<class Log>
+int H223DemuxerT<Log>::Open(H223MuxTable *table)
 {
 	//Check for null table
 	if (!table)
@@ -91,13 +105,15 @@ int H223Demuxer::Open(H223MuxTable *table)
 	return true;
 }
 
-int H223Demuxer::Close()
+template<class Log>
+int H223DemuxerT<Log>::Close()
 {
 	//exit
 	return 1;
 }
 
-void H223Demuxer::StartPDU(H223Flag &flag)
+template<class Log>
+void H223DemuxerT<Log>::StartPDU(H223Flag &flag)
 {
 	//Copy the flag
 	begin = flag;
@@ -106,10 +122,11 @@ void H223Demuxer::StartPDU(H223Flag &flag)
 	//No channel
 	channel = -1;
 	//Log
-	log->SetDemuxInfo(-3,"flg");
+	log.SetDemuxInfo(-3,"flg");
 }
 
-void H223Demuxer::EndPDU(H223Flag &flag)
+template<class Log>
+void H223DemuxerT<Log>::EndPDU(H223Flag &flag)
 {
 
 	//Send closing flag to all non segmentable channels
@@ -127,7 +144,7 @@ void H223Demuxer::EndPDU(H223Flag &flag)
 	if (flag.IsValid() && flag.complement)
 	{
 		//Log
-		log->SetDemuxInfo(-6,"dne");
+		log.SetDemuxInfo(-6,"dne");
 		
 		//if there is channel
 		if ((channel!=-1) && (al[channel]!=NULL))
@@ -135,7 +152,7 @@ void H223Demuxer::EndPDU(H223Flag &flag)
 			al[channel]->SendClosingFlag();
 	} else {
 		//Log
-		log->SetDemuxInfo(-6,"end");
+		log.SetDemuxInfo(-6,"end");
 		//if there is non-segmentable channel
 		if ((channel!=-1) && (al[channel]!=NULL) && !al[channel]->IsSegmentable())
 			//Send the closing pdu to the last channel
@@ -144,8 +161,14 @@ void H223Demuxer::EndPDU(H223Flag &flag)
 		
 }
 
-int H223Demuxer::Demultiplex(BYTE *buffer,int length)
+template<class Log>
+int H223DemuxerT<Log>::Demultiplex(BYTE *buffer,int length)
 {
+	//If we don't have to log each byte
+	if (!Log::enabled || Logger::GetLevel()<5)
+		//Go the fast way
+		return DemultiplexBlock(buffer,length);
+
 	//DeMux
 	for (int i=0;i<length;i++)
 		Demultiplex(buffer[i]);
@@ -154,11 +177,227 @@ int H223Demuxer::Demultiplex(BYTE *buffer,int length)
 	return 1;
 }
 
+//Find the first flag or complement flag fully inside the buffer
+static int FindFlag(BYTE *data,int len)
+{
+	int i = 0;
+#ifdef __SSE2__
+	const __m128i f = _mm_set1_epi8((char)0xE1);
+	const __m128i c = _mm_set1_epi8((char)~0xE1);
+
+	//Look for first flag byte 16 at a time
+	for (;i+16<len;i+=16)
+	{
+		//Load
+		__m128i v = _mm_loadu_si128((__m128i*)(data+i));
+		//Get candidates
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v,f),_mm_cmpeq_epi8(v,c)));
+		//Check second byte of each one
+		while (mask)
+		{
+			int j = i+__builtin_ctz(mask);
+			if (data[j]==0xE1 && data[j+1]==0x4D)
+				return j;
+			if (data[j]==(BYTE)~0xE1 && data[j+1]==(BYTE)~0x4D)
+				return j;
+			mask &= mask-1;
+		}
+	}
+#endif
+	//Rest
+	for (;i+1<len;i++)
+	{
+		if (data[i]==0xE1 && data[i+1]==0x4D)
+			return i;
+		if (data[i]==(BYTE)~0xE1 && data[i+1]==(BYTE)~0x4D)
+			return i;
+	}
+
+	//Not found
+	return -1;
+}
+
+template<class Log>
+int H223DemuxerT<Log>::DemultiplexBlock(BYTE *buffer,int length)
+{
+	int i = 0;
+
+	//Same state machine than the byte one but whole spans at once
+	while (i<length)
+	{
+		switch(state)
+		{
+			case NONE:
+				//Look for flag
+				i = HuntFlag(buffer,i,length);
+				break;
+			case HEAD:
+				//Only three bytes
+				Demultiplex(buffer[i++]);
+				break;
+			case PDU:
+				//Send payload
+				i = DemultiplexPDU(buffer,i,length);
+				break;
+		}
+	}
+
+	//Ok
+	return 1;
+}
+
+template<class Log>
+int H223DemuxerT<Log>::HuntFlag(BYTE *buffer,int i,int length)
+{
+	int from = i;
+
+	//If there are bytes from previous buffer
+	if (flag.GetLength())
+	{
+		//Check flag split between both
+		Demultiplex(buffer[i++]);
+
+		//If found
+		if (state!=NONE)
+			return i;
+
+		//The last byte could start the flag
+		from = i-1;
+	}
+
+	//Search for it
+	int pos = FindFlag(buffer+from,length-from);
+
+	//If not found
+	if (pos==-1)
+	{
+		//Keep last two bytes as the byte state machine does
+		for (int j=(length-2>i?length-2:i);j<length;j++)
+			flag.Append(buffer[j]);
+		//All consumed
+		return length;
+	}
+
+	//Get position in buffer
+	pos += from;
+
+	//Set flag
+	flag.Clear();
+	flag.Append(buffer[pos]);
+	flag.Append(buffer[pos+1]);
+
+	//Check complement
+	flag.IsValid();
+
+	//Start the PDU
+	StartPDU(flag);
+
+	//Clear flag
+	flag.Clear();
+
+	//Header clear
+	header.Clear();
+
+	//Change state
+	state = HEAD;
+
+	//Continue after flag
+	return pos+2;
+}
+
+//Get byte k of the flag window followed by the buffer
+static inline BYTE GetStreamByte(BYTE *pending,int num,BYTE *data,int k)
+{
+	return k<num ? pending[k] : data[k-num];
+}
 
-inline void H223Demuxer::Demultiplex(BYTE b)
+template<class Log>
+int H223DemuxerT<Log>::DemultiplexPDU(BYTE *buffer,int i,int length)
+{
+	BYTE pending[2];
+	BYTE *data = buffer+i;
+
+	//Get bytes already in the flag window, not sent yet
+	int num = flag.GetLength();
+	for (int j=0;j<num;j++)
+		pending[j] = flag.Get(j);
+
+	//Bytes until the end of the closing flag
+	int left = header.mpl + 2 - counter - num;
+	int avail = length - i;
+
+	//If the pdu does not end in this buffer
+	if (avail<left)
+	{
+		//Bytes we have
+		int total = num + avail;
+
+		//Not enought to send anything
+		if (total<2)
+		{
+			//Append to window
+			flag.Append(data[0]);
+			//All consumed
+			return length;
+		}
+
+		//Send all but the two last ones
+		int send = total-2;
+		int fromPending = send<num ? send : num;
+		Send(pending,fromPending);
+		Send(data,send-fromPending);
+
+		//Keep them in the window
+		flag.Clear();
+		flag.Append(GetStreamByte(pending,num,data,total-2));
+		flag.Append(GetStreamByte(pending,num,data,total-1));
+
+		//All consumed
+		return length;
+	}
+
+	//Send the rest of the payload
+	int send = header.mpl - counter;
+	int fromPending = send<num ? send : num;
+	Send(pending,fromPending);
+	Send(data,send-fromPending);
+
+	//The closing flag
+	flag.Clear();
+	flag.Append(GetStreamByte(pending,num,data,send));
+	flag.Append(GetStreamByte(pending,num,data,send+1));
+
+	//End the pdu
+	EndPDU(flag);
+
+	//If the flag is valid
+	if (flag.IsValid())
+	{
+		//Start the next PDU
+		StartPDU(flag);
+
+		//Clear flag
+		flag.Clear();
+
+		//Clear the header 
+		header.Clear();
+
+		//Change state
+		state = HEAD;
+	} else 
+		//No header found
+		state = NONE;
+
+	//Continue after flag
+	return i+left;
+}
+
+
+template<class Log>
+void H223DemuxerT<Log>::Demultiplex(BYTE b)
 {
 	//Append to logger
-	log->SetDemuxByte(b);
+	log.SetDemuxByte(b);
 
 	//Depending on the state
 	switch(state)
@@ -202,7 +441,7 @@ inline void H223Demuxer::Demultiplex(BYTE b)
 			}
 
 			//Log header
-			log->SetDemuxInfo(-6,"mc%.1dl%.2x",header.mc,header.mpl);
+			log.SetDemuxInfo(-6,"mc%.1dl%.2x",header.mc,header.mpl);
 
 			//We have a good header go for the pdu
             		state = PDU;
@@ -250,10 +489,47 @@ inline void H223Demuxer::Demultiplex(BYTE b)
 }
 
 
-void H223Demuxer::Send(BYTE b)
+template<class Log>
+void H223DemuxerT<Log>::Send(BYTE *data,int len)
+{
+	while (len>0)
+	{
+		int chan;
+
+		//Get the number of bytes for the same channel from the mux table
+		int run = mux->GetRun(header.mc,counter,&chan);
+
+		//If no channel for the rest
+		if (!run)
+		{
+			//Invalid one
+			chan = -1;
+			run = len;
+		}
+
+		//Only what we have
+		if (run>len)
+			run = len;
+
+		//Update last channel and counter
+		channel = chan;
+		counter += run;
+
+		//Check channel and send span
+		if ((chan>=0) && (chan<=15) && receivers[chan])
+			receivers[chan]->Send(data,run);
+
+		//Next
+		data += run;
+		len -= run;
+	}
+}
+
+template<class Log>
+void H223DemuxerT<Log>::Send(BYTE b)
 {
 	//Log
-	log->SetDemuxInfo(-9," xx");
+	log.SetDemuxInfo(-9," xx");
 	
 	//Get the next channel from the mux table
 	channel = mux->GetChannel(header.mc,counter++);
@@ -264,7 +540,7 @@ void H223Demuxer::Send(BYTE b)
 		return;
 
 	//Log
-	log->SetDemuxInfo(-9," n%.1d",channel);
+	log.SetDemuxInfo(-9," n%.1d",channel);
 
 	//Get channel
 	ALReceiversMap::iterator it = al.find(channel);
@@ -274,7 +550,7 @@ void H223Demuxer::Send(BYTE b)
 		return;
 
 	//Log
-	log->SetDemuxInfo(-9," c%.1d",channel);
+	log.SetDemuxInfo(-9," c%.1d",channel);
 
 	//Get channel
 	H223ALReceiver *recv = it->second;
@@ -285,3 +561,6 @@ void H223Demuxer::Send(BYTE b)
 		recv->Send(b);
 }
 
+//Both logging policies
+template class H223DemuxerT<NullLogger>;
+template class H223DemuxerT<FileLogger>;
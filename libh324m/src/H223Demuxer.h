@@ -6,19 +6,20 @@
 #include "H223MuxTable.h"
 #include "H223Flag.h"
 #include "H223Header.h"
-#include "log.h"
+#include "MuxLogger.h"
 
 #include <map>
 
-class H223Demuxer
+template<class Log>
+class H223DemuxerT
 {
 private:
 	typedef map<int,H223ALReceiver*> ALReceiversMap;
 
 public:
 	//Constructors
-	H223Demuxer();
-	~H223Demuxer();
+	H223DemuxerT();
+	~H223DemuxerT();
 	
 	int Open(H223MuxTable *table);
 	int SetChannel(int num,H223ALReceiver *receiver);
@@ -31,7 +32,11 @@ private:
 	void StartPDU(H223Flag &flag);
 	void EndPDU(H223Flag &flag);
 	void Send(BYTE b);
+	void Send(BYTE *data,int len);
 	int  DecodeHeader(H223Header &header);
+	int  DemultiplexBlock(BYTE *buffer,int length);
+	int  HuntFlag(BYTE *buffer,int i,int length);
+	int  DemultiplexPDU(BYTE *buffer,int i,int length);
 
 private:
 	H223MuxTable		*mux;
@@ -39,13 +44,17 @@ private:
 	H223Flag		flag;
 	H223Header		header;
 	ALReceiversMap		al;
+	H223ALReceiver*		receivers[16];
 	
 	int state;
 	int counter;
 	int channel;
 
-	Logger *log;
+	Log log;
 };
 
+//Demuxer used by the sessions
+typedef H223DemuxerT<MuxLogger> H223Demuxer;
+
 #endif
 
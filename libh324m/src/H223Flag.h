@@ -9,6 +9,8 @@ public:
 	int  IsComplete();
 	int  IsValid();
 	void Clear();
+	int  GetLength()	{ return length;	}
+	BYTE Get(int i)		{ return buffer[i];	}
 	int		complement;
 private:
 	int		level;
@@ -123,6 +123,22 @@ BYTE H223MuxSDU::Pop()
 	return buffer[ini++];
 }
 
+int H223MuxSDU::Pop(BYTE *b,int len)
+{
+	//Check we have enought
+	if(ini+len>end)
+		*((BYTE*)0)=0;
+
+	//Copy
+	memcpy(b,buffer+ini,len);
+
+	//Move
+	ini += len;
+
+	//Return copied
+	return len;
+}
+
 int	 H223MuxSDU::Length()
 {
 	return end-ini;
@@ -16,6 +16,7 @@ public:
 	int  Push(BYTE b);
 	int  Push(BYTE *b,int len);
 	BYTE Pop();
+	int  Pop(BYTE *b,int len);
 	BYTE *GetPointer() {return buffer;}
 	int  Length();
 
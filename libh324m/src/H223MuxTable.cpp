@@ -39,6 +39,8 @@ H223MuxTableEntry::H223MuxTableEntry()
 	repeatLen = 0;
 	fixed = NULL;
 	repeat = NULL;
+	fixedRun = NULL;
+	repeatRun = NULL;
 }
 
 H223MuxTableEntry::H223MuxTableEntry(H223MuxTableEntry* entry)
@@ -54,6 +56,10 @@ H223MuxTableEntry::H223MuxTableEntry(H223MuxTableEntry* entry)
 	//Fill
 	memcpy(fixed,entry->fixed,fixedLen);
 	memcpy(repeat,entry->repeat,repeatLen);
+
+	//Not compiled
+	fixedRun = NULL;
+	repeatRun = NULL;
 }
 
 H223MuxTableEntry::H223MuxTableEntry(const char* f,const char *r)
@@ -77,6 +83,10 @@ H223MuxTableEntry::H223MuxTableEntry(const char* f,const char *r)
 	//Fill
 	for (int i=0; i<repeatLen; i++)
 		repeat[i]=r[i]-'0';
+
+	//Not compiled
+	fixedRun = NULL;
+	repeatRun = NULL;
 }
 H223MuxTableEntry::~H223MuxTableEntry()
 {
@@ -85,6 +95,32 @@ H223MuxTableEntry::~H223MuxTableEntry()
 		free(fixed);
 	if (repeat)
 		free(repeat);
+	if (fixedRun)
+		free(fixedRun);
+	if (repeatRun)
+		free(repeatRun);
+}
+
+static WORD* CompileRuns(BYTE *chans,int len,WORD *runs)
+{
+	//Reallocate
+	runs = (WORD*)realloc(runs,(len ? len : 1)*sizeof(WORD));
+
+	//From the end, count bytes until the channel changes
+	for (int i=len-1; i>=0; i--)
+		if (i<len-1 && chans[i]==chans[i+1] && runs[i+1]<0xFFFF)
+			runs[i] = runs[i+1]+1;
+		else
+			runs[i] = 1;
+
+	return runs;
+}
+
+void H223MuxTableEntry::Compile()
+{
+	//Build run lengths for both parts
+	fixedRun = CompileRuns(fixed,fixedLen,fixedRun);
+	repeatRun = CompileRuns(repeat,repeatLen,repeatRun);
 }
 
 H223MuxTable::H223MuxTable()
@@ -92,6 +128,9 @@ H223MuxTable::H223MuxTable()
 	//All tables to null
 	for (int i=0;i<16;i++)
 		entries[i] = NULL;
+
+	//No changes yet
+	version = 0;
 }
 
 H223MuxTable::~H223MuxTable()
@@ -119,6 +158,12 @@ int H223MuxTable::SetEntry(int mc,const char* f,const char *r)
 	//Create a new entrie
 	entries[mc] = new H223MuxTableEntry(f,r);
 
+	//Precalculate runs
+	entries[mc]->Compile();
+
+	//Table changed
+	version++;
+
 	//good
 	return 1;
 
@@ -138,6 +183,13 @@ int H223MuxTable::SetEntry(int mc,H223MuxTableEntry *entry)
 	//Create a new entrie
 	entries[mc] = entry;
 
+	//Precalculate runs
+	if (entry)
+		entry->Compile();
+
+	//Table changed
+	version++;
+
 	//good
 	return 1;
 }
@@ -159,6 +211,32 @@ int H223MuxTable::GetChannel(int mc,int count)
 	return -1;
 }
 
+int H223MuxTable::GetRun(int mc,int count,int *channel)
+{
+	//If the mc is valid
+	if (mc>=16 || !entries[mc])
+		return 0;
+
+	H223MuxTableEntry *entry = entries[mc];
+
+	//If it's in the fixed
+	if (count < entry->fixedLen)
+	{
+		*channel = entry->fixed[count];
+		return entry->fixedRun[count];
+	}
+
+	//It's in the repeating part
+	if(entry->repeatLen>0)
+	{
+		int pos = (count-entry->fixedLen) % entry->repeatLen;
+		*channel = entry->repeat[pos];
+		return entry->repeatRun[pos];
+	}
+
+	return 0;
+}
+
 int H223MuxTable::AppendEntries(H223MuxTable &table,H223MuxTableEntryList &list)
 {
 	//For each table
@@ -182,6 +260,9 @@ H223MuxTable::H223MuxTable(const H245_MultiplexEntrySend & pdu)
 	for (int i=0;i<16;i++)
 		entries[i] = NULL;
 
+	//No changes yet
+	version = 0;
+
 	//For each descriptor
 	for (int i=0;i<pdu.m_multiplexEntryDescriptors.GetSize();i++)
 	{
@@ -12,11 +12,15 @@ struct H223MuxTableEntry
 	H223MuxTableEntry(const char* f,const char *r);
 	H223MuxTableEntry(H223MuxTableEntry* entry);
 	~H223MuxTableEntry();
+	void Compile();
 
 	BYTE* fixed;
 	int	  fixedLen;
 	BYTE* repeat;
 	int   repeatLen;
+	//Bytes left in the same channel from each position, filled by Compile
+	WORD* fixedRun;
+	WORD* repeatRun;
 };
 
 
@@ -30,10 +34,13 @@ public:
 	int SetEntry(int mc,const char* f,const char *r);
 	int SetEntry(int mc,H223MuxTableEntry *entry);
 	int GetChannel(int mc,int count);
+	int GetRun(int mc,int count,int *channel);
+	int GetVersion()	{ return version; }
 	void BuildPDU(H245_MultiplexEntrySend & pdu);
 	int AppendEntries(H223MuxTable &table,H223MuxTableEntryList &list);
 protected:
 	H223MuxTableEntry*	entries[16];
+	int			version;
 };
 
 #endif
@@ -20,26 +20,30 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 #include "H223Muxer.h"
-#include "FileLogger.h"
 
 extern "C"
 {
 #include "golay.h"
 }
 
-H223Muxer::H223Muxer()
+template<class Log>
+H223MuxerT<Log>::H223MuxerT()
 {
-	//Create logger
-	log = new FileLogger();
+	//No plans yet
+	planVersion = -1;
+	planMax = 0;
+
+	//No sdus
+	memset(sduLen,0,sizeof(sduLen));
 }
 
-H223Muxer::~H223Muxer()
+template<class Log>
+H223MuxerT<Log>::~H223MuxerT()
 {
-	//Delete logger
-	delete log;
 }
 
-int H223Muxer::Open(H223MuxTable *muxTable)
+template<class Log>
+int H223MuxerT<Log>::Open(H223MuxTable *muxTable)
 {
 	//Check for null table
 	if (!muxTable)
@@ -53,17 +57,22 @@ int H223Muxer::Open(H223MuxTable *muxTable)
 	state = NONE;
 	pm = 0;
 
+	//Compile plans on first pdu
+	planVersion = -1;
+
 	return true;
 }
 
 
-int H223Muxer::Close()
+template<class Log>
+int H223MuxerT<Log>::Close()
 {
 	return 1;
 }
 
 
-int H223Muxer::SetChannel(int num,H223ALSender *sender)
+template<class Log>
+int H223MuxerT<Log>::SetChannel(int num,H223ALSender *sender)
 {
 	//Check for null channel
 	if (!sender)
@@ -81,7 +90,8 @@ int H223Muxer::SetChannel(int num,H223ALSender *sender)
 	return 1;
 }
 
-int H223Muxer::ReleaseChannel(int num)
+template<class Log>
+int H223MuxerT<Log>::ReleaseChannel(int num)
 {
 	// Find channel
 	ALSendersMap::iterator it = senders.find(num);
@@ -98,15 +108,74 @@ int H223Muxer::ReleaseChannel(int num)
 	return 1;
 }
 
+/**********************************
+* CompilePlans
+*	Expand the first slots of each mux table entry into channel runs
+***********************************/
+template<class Log>
+void H223MuxerT<Log>::CompilePlans(int max)
+{
+	//For each table
+	for (int i=0;i<16;i++)
+	{
+		Plan &plan = plans[i];
+		BYTE used[256];
+		int j = 0;
+
+		//Empty
+		plan.numRuns = 0;
+		plan.numChannels = 0;
+		memset(used,0,sizeof(used));
+
+		//While not done
+		while (j<max)
+		{
+			int c;
+
+			//Get bytes for the same channel
+			int run = table->GetRun(i,j,&c);
+
+			//If no more channels
+			if (!run)
+				break;
+
+			//Only up to max
+			if (run>max-j)
+				run = max-j;
+
+			//Append run
+			plan.channel[plan.numRuns] = c;
+			plan.length[plan.numRuns] = run;
+			plan.numRuns++;
+
+			//Channel used
+			used[c] = 1;
+
+			//Next
+			j += run;
+		}
+
+		//Store used channels in order, so ratios are summed as before
+		for (int k=0;k<256;k++)
+			if (used[k])
+				plan.channels[plan.numChannels++] = k;
+	}
+
+	//Save table version
+	planVersion = table->GetVersion();
+	planMax = max;
+}
+
 /**********************************
 * GetBestMC
 *	Search the best mc entry and calculate de mpl of the pdu
 *   Currently best result is the one that
 ***********************************/
-int H223Muxer::GetBestMC(int max)
+template<class Log>
+int H223MuxerT<Log>::GetBestMC(int max)
 {
 	H223MuxSDUMap::iterator itSDUS;
-	ALSendersMap::iterator itSenders;
+
 	//Reset
 	mc = -1;
 	mpl = 0;
@@ -115,6 +184,15 @@ int H223Muxer::GetBestMC(int max)
 	//best ratio
 	float best = 0;
 
+	//Mpl is only one byte
+	if (max>255)
+		max = 255;
+
+	//Check if the table has changed
+	if (planVersion!=table->GetVersion() || planMax!=max)
+		//Compile again
+		CompilePlans(max);
+
 	//Check for new request
 	for (ALSendersMap::iterator itSenders=senders.begin();itSenders!= senders.end();itSenders++)
 	{
@@ -133,64 +211,86 @@ int H223Muxer::GetBestMC(int max)
 				sdus[channel] = sdu;
 		}
 	}
-	
-	//Map and iterators
-	WORD len[256];
-	WORD sduLen[256];
-
-	//Reset length
-	memset(sduLen,0,256*sizeof(WORD));
 
 	//For each sdu
 	for (itSDUS=sdus.begin();itSDUS!=sdus.end();itSDUS++)
-		sduLen[itSDUS->first] = itSDUS->second->Length();
-	
+	{
+		//Get channel
+		int c = itSDUS->first & 0xFF;
+		//Get sender
+		ALSendersMap::iterator itSenders = senders.find(itSDUS->first);
+		//If we don't have a sender for it
+		if (itSenders==senders.end() || !itSenders->second)
+			continue;
+		//Set length and segmentation
+		sduLen[c] = itSDUS->second->Length();
+		segmentable[c] = itSenders->second->IsSegmentable();
+	}
+
 	//For each table
 	for (int i=0;i<16;i++)
 	{
+		Plan &plan = plans[i];
 		int j = 0;
 		int end = 0;
 
-		//Reset lengths
-		memset(len,0,256*sizeof(WORD));
+		//Reset lengths of the channels in the entry
+		for (int k=0;k<plan.numChannels;k++)
+			pduLen[plan.channels[k]] = 0;
 
-		//While not done
-		while(j<max)
+		//For each run of the entry
+		for (int r=0;r<plan.numRuns;r++)
 		{
-			//Get next channel for table
-			int c = table->GetChannel(i,j);
+			//Get channel and bytes
+			int c = plan.channel[r];
+			int n = plan.length[r];
 
 			//If we don't have a mux for that channel
-			if (c==-1 || sduLen[c]==0)
+			if (sduLen[c]==0)
 				break;
 
-			 //If channel is non-segmentble and it was already ended
-			if (!senders[c]->IsSegmentable() && (len[c] == sduLen[c]))
-				//Exit
-				break;
-			
-			//Increase counter
-			len[c]++;
-			j++;
-			
-			//If channel is segmentble and it has ended
-			if (senders[c]->IsSegmentable() && (len[c] == sduLen[c]))
+			//Bytes left in the sdu
+			int left = sduLen[c] - pduLen[c];
+
+			//If channel is non-segmentble
+			if (!segmentable[c])
 			{
+				//If the sdu ends before the run
+				if (n>left)
+				{
+					//Add what is left and exit
+					pduLen[c] += left;
+					j += left;
+					break;
+				}
+			//If channel is segmentble and it ends in this run
+			} else if (n>=left) {
+				//Add what is left
+				pduLen[c] += left;
+				j += left;
 				//Finish sdu
 				end = 1;
 				//Exit
 				break;
 			}
 
+			//Whole run
+			pduLen[c] += n;
+			j += n;
 		}
 
 		//Calculate ratio
 		float ratio = 0;
 
-		//For each sdu
-		for (int k=0;k<256;k++)
-			if (len[k]>0)
-				ratio +=  (float)len[k]/sduLen[k];
+		//For each channel of the entry
+		for (int k=0;k<plan.numChannels;k++)
+		{
+			//Get channel
+			int c = plan.channels[k];
+			//If used
+			if (pduLen[c]>0)
+				ratio +=  (float)pduLen[c]/sduLen[c];
+		}
 
 		//If the ratio is better
 		if (ratio>best)
@@ -203,83 +303,176 @@ int H223Muxer::GetBestMC(int max)
 		}
 	}
 
+	//Reset sdu lengths
+	for (itSDUS=sdus.begin();itSDUS!=sdus.end();itSDUS++)
+		sduLen[itSDUS->first & 0xFF] = 0;
+
 	//If we found something
 	return mc!=-1;
 }
 
-int H223Muxer::Multiplex(BYTE *buffer,int length)
+template<class Log>
+void H223MuxerT<Log>::StartPDU()
 {
-	//Mux
-	for (int i=0;i<length;i++)
-		buffer[i] = Multiplex();
+	//Reset channel
+	channel = -1;
+	//If we have to finish last packet
+	if (!pm)
+	{
+		//Create the flag
+		buffer[0] = 0xE1;
+		buffer[1] = 0x4D;
+
+		//Log
+		log.SetMuxInfo("endflg");
+	} else {
+		//Create the flag
+		buffer[0] = (BYTE)~0xE1;
+		buffer[1] = (BYTE)~0x4D;
+		//Log
+		log.SetMuxInfo("dneflg");
+	}
 
-	//Ok
-	return 1;
+	//Get the best mc & mpl from the table
+	if (GetBestMC(160))
+	{
+		//Calculate p bits
+		WORD data = (mc & 0x0F) | mpl << 4;
+		//Get the codeword
+		long code = golay_encode(data);
+
+		//Create the header
+		buffer[2] = ((BYTE *)&code)[0];//(mc & 0x0F) | (mpl &0x0F) << 4;
+		buffer[3] = ((BYTE *)&code)[1];//(mpl &0xF0) >> 4;
+		buffer[4] = ((BYTE *)&code)[2];//0x00;
+		//Log
+		log.SetMuxInfo("   mc%.1d %.2x",mc,mpl);
+	} else {
+		//Create the header
+		buffer[2] = 0x00;
+		buffer[3] = 0x00;
+		buffer[4] = 0x00;
+		//Log
+		log.SetMuxInfo("         ");
+	}
+	//Set pointers
+	i = 0;
+	j = 0;
+	size = 5;
+	//Send pdu
+	state = PDU;
 }
 
-inline BYTE H223Muxer::Multiplex()
+template<class Log>
+void H223MuxerT<Log>::EndPDU()
 {
-	//Multiplex
-	while (1)
+	//Remove all empty sdus
+	H223MuxSDUMap::iterator it = sdus.begin();
+	while(it!=sdus.end())
+	{
+		//Get channel and sdu
+		int number		= it->first;
+		H223MuxSDU* sdu = it->second;
+		//If it's empty
+		if ((sdu!=NULL) && (sdu->Length()==0))
+		{
+			//Erase
+			sdus.erase(it++);
+			//Set event
+			senders[number]->OnPDUCompleted();
+		} else
+			++it;
+	}
+
+	//No state
+	state = NONE;
+}
+
+template<class Log>
+int H223MuxerT<Log>::Multiplex(BYTE *out,int length)
+{
+	//If we have to log each byte
+	if (Log::enabled && Logger::GetLevel()>=5)
+	{
+		//Mux byte by byte
+		for (int n=0;n<length;n++)
+			out[n] = Multiplex();
+		//Ok
+		return 1;
+	}
+
+	int pos = 0;
+
+	//While there is room
+	while (pos<length)
 	{
 		//Depending on the state
 		switch(state)
 		{
 			case NONE:
-				//Reset channel
-				channel = -1;
-				//If we have to finish last packet
-				if (!pm)
+				//Begin next pdu
+				StartPDU();
+				break;
+			case PDU:
+				//If we still haven't sent the flag & header
+				if (i<size)
 				{
-					//Create the flag
-					buffer[0] = 0xE1;
-					buffer[1] = 0x4D;
-
-					//Log
-					log->SetMuxInfo("endflg");
+					//Copy as much as we can
+					int n = size-i;
+					if (n>length-pos)
+						n = length-pos;
+					memcpy(out+pos,buffer+i,n);
+					i += n;
+					pos += n;
+				//If we haven't finished
+				} else if (j<mpl) {
+					int c;
+					//Get bytes for the same channel
+					int n = table->GetRun(mc,j,&c);
+					//Only up to the end of the pdu and the buffer
+					if (n>mpl-j)
+						n = mpl-j;
+					if (n>length-pos)
+						n = length-pos;
+					//Set channel
+					channel = c;
+					//Copy the span from the sdu
+					sdus[channel]->Pop(out+pos,n);
+					j += n;
+					pos += n;
 				} else {
-					//Create the flag
-					buffer[0] = (BYTE)~0xE1;
-					buffer[1] = (BYTE)~0x4D;
-					//Log
-					log->SetMuxInfo("dneflg");
+					//Release sdus
+					EndPDU();
 				}
+				break;
+			default:
+				return 0;
+		}
+	}
 
-				//Get the best mc & mpl from the table
-				if (GetBestMC(160))
-				{
-					//Calculate p bits
-					WORD data = (mc & 0x0F) | mpl << 4;
-					//Get the codeword
-					long code = golay_encode(data);
-
-					//Create the header
-					buffer[2] = ((BYTE *)&code)[0];//(mc & 0x0F) | (mpl &0x0F) << 4;
-					buffer[3] = ((BYTE *)&code)[1];//(mpl &0xF0) >> 4;
-					buffer[4] = ((BYTE *)&code)[2];//0x00;
-					//Log
-					log->SetMuxInfo("   mc%.1d %.2x",mc,mpl);
-				} else {
-					//Create the header
-					buffer[2] = 0x00;
-					buffer[3] = 0x00;
-					buffer[4] = 0x00;
-					//Log
-					log->SetMuxInfo("         ");
-				}
-				//Set pointers
-				i = 0;
-				j = 0;
-				size = 5;
-				//Send pdu
-				state = PDU;
+	//Ok
+	return 1;
+}
+
+template<class Log>
+BYTE H223MuxerT<Log>::Multiplex()
+{
+	//Multiplex
+	while (1)
+	{
+		//Depending on the state
+		switch(state)
+		{
+			case NONE:
+				//Begin next pdu
+				StartPDU();
 				break;
 			case PDU:
 				//If we still haven't sent the flag & header
 				if (i<size)
 				{
 					//Log
-					log->SetMuxByte(buffer[i]);
+					log.SetMuxByte(buffer[i]);
 					//Return header byte
 					return buffer[i++];
 				}
@@ -292,33 +485,14 @@ inline BYTE H223Muxer::Multiplex()
 					//Get byte
 					BYTE b = sdus[channel]->Pop();
 					//Log
-					log->SetMuxByte(b);
-					log->SetMuxInfo(" c%.1d",channel);
+					log.SetMuxByte(b);
+					log.SetMuxInfo(" c%.1d",channel);
 					//Send the byte
 					return b;
 				}
-				//Remove all empty sdus
-				{
-					H223MuxSDUMap::iterator it = sdus.begin();
-					while(it!=sdus.end())
-					{
-						//Get channel and sdu
-						int number		= it->first;
-						H223MuxSDU* sdu = it->second;
-						//If it's empty
-						if ((sdu!=NULL) && (sdu->Length()==0))
-						{
-							//Erase
-							sdus.erase(it++);
-							//Set event
-							senders[number]->OnPDUCompleted();
-						} else
-							++it;
-					}
-				}
 
-				//No state
-				state = NONE;
+				//Release sdus
+				EndPDU();
 				break;
 			default:
 				return 0;
@@ -327,3 +501,7 @@ inline BYTE H223Muxer::Multiplex()
 
 	return 0;
 }
+
+//Both logging policies
+template class H223MuxerT<NullLogger>;
+template class H223MuxerT<FileLogger>;
@@ -5,17 +5,18 @@
 #include "H223MuxTable.h"
 #include "H223MuxSDU.h"
 #include "H223AL.h"
-#include "log.h"
+#include "MuxLogger.h"
 
-class H223Muxer
+template<class Log>
+class H223MuxerT
 {
 private:
 	typedef map<int,H223ALSender*> ALSendersMap;
 	typedef enum{NONE,PDU} State;
 public:
 	//Constructors
-	H223Muxer();
-	~H223Muxer();
+	H223MuxerT();
+	~H223MuxerT();
 
 	int Open(H223MuxTable *table);
 	int SetChannel(int num,H223ALSender *sender);
@@ -25,7 +26,20 @@ public:
 	int Close();
 
 private:
+	//Channel runs of the first slots of a mux table entry
+	struct Plan
+	{
+		int  numRuns;
+		BYTE channel[256];
+		BYTE length[256];
+		int  numChannels;
+		BYTE channels[256];
+	};
+
 	int GetBestMC(int max);
+	void CompilePlans(int max);
+	void StartPDU();
+	void EndPDU();
 
 private:
 	H223MuxTable* table;
@@ -33,6 +47,13 @@ private:
 	ALSendersMap  senders;
 	State state;
 
+	Plan plans[16];
+	int  planVersion;
+	int  planMax;
+	WORD sduLen[256];
+	WORD pduLen[256];
+	BYTE segmentable[256];
+
 	char buffer[5];
 	int mc;
 	int mpl;
@@ -43,9 +64,12 @@ private:
 	int len;
 	int channel;
 
-	Logger *log;
+	Log log;
 
 };
 
+//Muxer used by the sessions
+typedef H223MuxerT<MuxLogger> H223Muxer;
+
 #endif
 
@@ -21,6 +21,14 @@
  */
 #include "H245ChannelsFactory.h"
 
+int H245ChannelsFactory::audioJitterPercentile = 0;
+
+void H245ChannelsFactory::SetAudioJitterPercentile(int percentile)
+{
+	//Set it for the new channels
+	audioJitterPercentile = percentile;
+}
+
 H245ChannelsFactory::H245ChannelsFactory()
 {
 	//Set local capabilities only with layer 2
@@ -111,7 +119,8 @@ int H245ChannelsFactory::CreateChannel(MediaType type)
 	{
 		case e_Audio:
 			//New audio channel
-			chan = new H324MAudioChannel(25,160);
+			//Wait for 25 packets, or buffer the percentile of the jitter up to 25 packets
+			chan = new H324MAudioChannel(25,160,audioJitterPercentile);
 			break;
 		case e_Video:
 			//New audio channel
@@ -155,6 +164,15 @@ H223ALReceiver* H245ChannelsFactory::GetReceiver(int id)
 	return channels[id]->GetReceiver();
 }
 
+int H245ChannelsFactory::GetJitterStats(int id,jitterBuffer::Stats *stats)
+{
+	//If it exist
+	if (channels.find(id)==channels.end())
+		return 0;
+	//Get stats
+	return channels[id]->GetJitterStats(stats);
+}
+
 H223MuxTable* H245ChannelsFactory::GetLocalTable()
 {
 	return &localTable;
@@ -29,6 +29,7 @@ public:
 
 	H223ALSender*	GetSender(int channel);
 	H223ALReceiver* GetReceiver(int channel);
+	int GetJitterStats(int channel,jitterBuffer::Stats *stats);
 
 	H223MuxTable* GetLocalTable();
 	H223MuxTable* GetRemoteTable();
@@ -56,6 +57,9 @@ public:
 	Frame* GetFrame();
 	int SendFrame(Frame *frame);
 
+	//Percentile of the jitter buffered by the audio channels created after, 0 for a fixed buffer
+	static void SetAudioJitterPercentile(int percentile);
+
 private:
 	typedef std::map<int,H324MMediaChannel*> ChannelMap;
 
@@ -68,6 +72,8 @@ private:
 	ChannelMap			channels;
 	int					numChannels;
 	H245ChannelsFactoryListener *listener;
+
+	static int audioJitterPercentile;
 };
 
 
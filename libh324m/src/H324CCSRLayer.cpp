@@ -60,6 +60,14 @@ void H324CCSRLayer::Send(BYTE b)
 	sdu.SetAt(sdu.GetSize(),b);
 }
 
+void H324CCSRLayer::Send(BYTE *data,int len)
+{
+	//Get current size
+	PINDEX size = sdu.GetSize();
+	//Grow stream and append span
+	memcpy(sdu.GetPointer(size+len)+size,data,len);
+}
+
 void H324CCSRLayer::SendClosingFlag()
 {
 	//Check minimum length
@@ -17,6 +17,7 @@ public:
 
 	//H223ALReceiver interface
 	virtual void Send(BYTE b);
+	virtual void Send(BYTE *data,int len);
 	virtual void SendClosingFlag();
 
 	//H223ALSender interface
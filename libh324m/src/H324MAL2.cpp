@@ -48,6 +48,12 @@ void H223AL2Receiver::Send(BYTE b)
 	sdu.Push(b);
 }
 
+void H223AL2Receiver::Send(BYTE *data,int len)
+{
+	//Enque span in sdu
+	sdu.Push(data,len);
+}
+
 void H223AL2Receiver::SendClosingFlag()
 {
 	//Check empty
@@ -196,6 +202,18 @@ void H223AL2Sender::SetJitBuffer(int packets,int delay)
 	jitBuf.SetBuffer(packets,delay);
 }
 
+void H223AL2Sender::SetAdaptiveJitBuffer(int percentile)
+{
+	//Set the jitter buffer mode
+	jitBuf.SetAdaptive(percentile);
+}
+
+void H223AL2Sender::GetJitBufferStats(jitterBuffer::Stats *stats)
+{
+	//Get them from the jitter buffer
+	jitBuf.GetStats(stats);
+}
+
 void H223AL2Sender::Tick(DWORD len)
 {
 	//Set jitter tick
@@ -17,6 +17,7 @@ public:
 
 	//H223ALReceiver interface
 	virtual void Send(BYTE b);
+	virtual void Send(BYTE *data,int len);
 	virtual void SendClosingFlag();
 	virtual int IsSegmentable();
 
@@ -40,6 +41,8 @@ public:
 	//Methods
 	int SendPDU(BYTE *buffer,int len);
 	void SetJitBuffer(int packets, int delay);
+	void SetAdaptiveJitBuffer(int percentile);
+	void GetJitBufferStats(jitterBuffer::Stats *stats);
 	void Tick(DWORD len);
 	int Reset();
 
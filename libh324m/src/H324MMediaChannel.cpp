@@ -23,7 +23,7 @@
 #include "log.h"
 
 
-H324MMediaChannel::H324MMediaChannel(int jitter, int delay)
+H324MMediaChannel::H324MMediaChannel(int jitter, int delay, int percentile)
 {
 	state = e_AwaitingEstablishment;
 	localChannel = 0;
@@ -33,6 +33,8 @@ H324MMediaChannel::H324MMediaChannel(int jitter, int delay)
 	receiver = NULL;
 	jitterPackets = jitter;
 	jitterActive = false;
+	jitterPercentile = percentile;
+	jitterSender = NULL;
 	minDelay = delay;
 	nextPacket = 0;
 	ticks = 0;
@@ -82,6 +84,9 @@ int H324MMediaChannel::SetSenderLayer(AdaptationLayer layer, int segmentable)
 			sender = new H223AL2Sender(segmentable,false);
 			//Set jitterBuffer
 			((H223AL2Sender *)sender)->SetJitBuffer(jitterPackets, minDelay);
+			((H223AL2Sender *)sender)->SetAdaptiveJitBuffer(jitterPercentile);
+			//Keep it for the stats
+			jitterSender = (H223AL2Sender *)sender;
 			break;
 		case e_al2WithSequenceNumbers:
 			// AL 2
@@ -211,13 +216,27 @@ int H324MMediaChannel::SendFrame(Frame *frame)
 	return pos;
 }
 
-H324MAudioChannel::H324MAudioChannel(int jitter,int delay) : H324MMediaChannel(jitter,delay)
+int H324MMediaChannel::GetJitterStats(jitterBuffer::Stats *stats)
+{
+	//Check we have a jitter buffer
+	if (!jitterSender)
+		//Exit
+		return 0;
+
+	//Get them
+	jitterSender->GetJitBufferStats(stats);
+
+	//Got them
+	return 1;
+}
+
+H324MAudioChannel::H324MAudioChannel(int jitter,int delay,int percentile) : H324MMediaChannel(jitter,delay,percentile)
 {
 	//Set audio type
 	type = e_Audio;
 }
 
-H324MVideoChannel::H324MVideoChannel() : H324MMediaChannel(0,0)
+H324MVideoChannel::H324MVideoChannel() : H324MMediaChannel(0,0,0)
 {
 	//Set video type
 	type = e_Video;
@@ -21,7 +21,7 @@ public:
     };
 
 public:
-	H324MMediaChannel(int jitter,int delay);
+	H324MMediaChannel(int jitter,int delay,int percentile);
 	virtual ~H324MMediaChannel();
 
 	int Init();
@@ -41,6 +41,7 @@ public:
 	//Methods
 	Frame* GetFrame();
 	int SendFrame(Frame *frame);
+	int GetJitterStats(jitterBuffer::Stats *stats);
 
 	int localChannel;
 	int remoteChannel;
@@ -56,6 +57,8 @@ private:
 	list<Frame*> frameList;
 	int	jitterPackets;
 	int jitterActive;
+	int jitterPercentile;
+	H223AL2Sender *jitterSender;
 	DWORD ticks;
 	DWORD minDelay;
 	DWORD nextPacket;
@@ -65,7 +68,7 @@ class H324MAudioChannel :
 	public H324MMediaChannel
 {
 public:
-	H324MAudioChannel(int jitter,int delay);
+	H324MAudioChannel(int jitter,int delay,int percentile);
 };
 
 class H324MVideoChannel :
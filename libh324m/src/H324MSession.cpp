@@ -144,6 +144,12 @@ int H324MSession::OnChannelReleased(int channel, MediaType type)
 	return true;
 }
 
+int H324MSession::GetAudioJitterStats(jitterBuffer::Stats *stats)
+{
+	//Get them from the audio channel
+	return channels.GetJitterStats(audio,stats);
+}
+
 int H324MSession::ResetMediaQueue()
 {
 	//Call the media channels reset
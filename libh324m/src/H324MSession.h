@@ -38,6 +38,7 @@ public:
 	int		SendVideoFastUpdatePicture();
 	int		ResetMediaQueue();
 	CallState	GetState();
+	int		GetAudioJitterStats(jitterBuffer::Stats *stats);
 
 	//H245ChannelsFactoryListener
 	virtual int OnChannelStablished(int channel, MediaType type);
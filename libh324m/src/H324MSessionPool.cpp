@@ -0,0 +1,300 @@
+/* H324M library
+ *
+ * Copyright (C) 2006 Sergio Garcia Murillo
+ *
+ * sergio.garcia@fontventa.com
+ * http://sip.fontventa.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include "H324MSessionPool.h"
+
+//H.324 line rate is 64kbps
+#define BYTES_PER_MS	8
+
+H324MSessionPool::Session::Session(H324MSession *session,DWORD bytesPerTick)
+	: input(bytesPerTick*8>4096 ? bytesPerTick*8 : 4096),
+	  output(bytesPerTick*4),
+	  framesIn(256),
+	  framesOut(256)
+{
+	//Store session
+	this->session = session;
+	//Bytes to produce on each tick
+	this->bytesPerTick = bytesPerTick;
+	//No worker yet
+	worker = -1;
+	//Init mutex
+	pthread_mutex_init(&mutex,NULL);
+}
+
+H324MSessionPool::Session::~Session()
+{
+	Frame *frame;
+
+	//Delete pending frames
+	while (framesIn.Pop(&frame,1))
+		delete frame;
+	while (framesOut.Pop(&frame,1))
+		delete frame;
+
+	//Destroy mutex
+	pthread_mutex_destroy(&mutex);
+}
+
+int H324MSessionPool::Session::Read(BYTE *buffer,int length)
+{
+	//Queue for next tick
+	return input.Push(buffer,length);
+}
+
+int H324MSessionPool::Session::Write(BYTE *buffer,int length)
+{
+	//Get muxed data produced on last tick
+	return output.Pop(buffer,length);
+}
+
+Frame* H324MSessionPool::Session::GetFrame()
+{
+	Frame *frame;
+
+	//Get next received frame
+	if (!framesOut.Pop(&frame,1))
+		//Nothing
+		return NULL;
+
+	//Return it
+	return frame;
+}
+
+int H324MSessionPool::Session::SendFrame(Frame *frame)
+{
+	//Copy it, the caller keeps its frame as with H324MSession
+	Frame *copy = new Frame(frame->type,frame->codec,frame->data,frame->dataLength);
+
+	//Queue it for next tick
+	if (!framesIn.Push(&copy,1))
+	{
+		//Full, drop it
+		delete copy;
+		//Error
+		return 0;
+	}
+
+	//Queued
+	return 1;
+}
+
+void H324MSessionPool::Session::Process()
+{
+	BYTE buffer[1024];
+	Frame *frame;
+	DWORD len;
+
+	//Lock session
+	Lock();
+
+	//Demux all pending input at once
+	while ((len=input.Pop(buffer,sizeof(buffer)))>0)
+		session->Read(buffer,len);
+
+	//Send pending frames
+	while (framesIn.Pop(&frame,1))
+	{
+		//Send it
+		session->SendFrame(frame);
+		//Delete it
+		delete frame;
+	}
+
+	//Get received frames while there is room for them
+	while (framesOut.Free() && (frame=session->GetFrame())!=NULL)
+		//Queue it
+		framesOut.Push(&frame,1);
+
+	//Keep two ticks of muxed data ready for the channel
+	while (output.Length()<bytesPerTick*2)
+	{
+		//Get what is missing
+		len = bytesPerTick*2-output.Length();
+		//Up to buffer size
+		if (len>sizeof(buffer))
+			len = sizeof(buffer);
+		//Mux
+		session->Write(buffer,len);
+		//Append
+		output.Push(buffer,len);
+	}
+
+	//Unlock
+	Unlock();
+}
+
+H324MSessionPool::H324MSessionPool(int workers,int tick)
+{
+	//Store values
+	this->numWorkers = workers>0 ? workers : 1;
+	this->tick = tick>0 ? tick : 20;
+
+	//Running
+	running = 1;
+
+	//Number of cores
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	//Create workers
+	this->workers = new Worker[numWorkers];
+
+	//For each one
+	for (int i=0;i<numWorkers;i++)
+	{
+		Worker *worker = &this->workers[i];
+
+		//Init
+		worker->pool = this;
+		worker->num = 0;
+		pthread_mutex_init(&worker->mutex,NULL);
+
+		//Start thread
+		pthread_create(&worker->thread,NULL,Run,worker);
+
+#ifdef __linux__
+		//Pin it to a core
+		if (cores>0)
+		{
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(i % cores,&set);
+			pthread_setaffinity_np(worker->thread,sizeof(set),&set);
+		}
+#endif
+	}
+
+	Logger::Debug("-H324MSessionPool started [workers:%d,tick:%d]\n",numWorkers,this->tick);
+}
+
+H324MSessionPool::~H324MSessionPool()
+{
+	//Stop
+	running = 0;
+
+	//For each worker
+	for (int i=0;i<numWorkers;i++)
+	{
+		Worker *worker = &workers[i];
+
+		//Wait for it
+		pthread_join(worker->thread,NULL);
+
+		//Delete remaining sessions
+		for (Sessions::iterator it=worker->sessions.begin();it!=worker->sessions.end();++it)
+			delete *it;
+
+		//Destroy mutex
+		pthread_mutex_destroy(&worker->mutex);
+	}
+
+	//Free workers
+	delete[] workers;
+}
+
+H324MSessionPool::Session* H324MSessionPool::Add(H324MSession *h324m)
+{
+	//Check session
+	if (!h324m)
+		return NULL;
+
+	//Create pooled session
+	Session *session = new Session(h324m,tick*BYTES_PER_MS);
+
+	//Find the least loaded worker
+	int best = 0;
+	for (int i=1;i<numWorkers;i++)
+		if (workers[i].num<workers[best].num)
+			best = i;
+
+	Worker *worker = &workers[best];
+
+	//Add it
+	pthread_mutex_lock(&worker->mutex);
+	worker->sessions.push_back(session);
+	worker->num++;
+	session->worker = best;
+	pthread_mutex_unlock(&worker->mutex);
+
+	//Return it
+	return session;
+}
+
+int H324MSessionPool::Remove(Session *session)
+{
+	//Check session
+	if (!session || session->worker<0 || session->worker>=numWorkers)
+		return 0;
+
+	Worker *worker = &workers[session->worker];
+
+	//Remove it, once unlocked the worker is not using it
+	pthread_mutex_lock(&worker->mutex);
+	worker->sessions.remove(session);
+	worker->num--;
+	pthread_mutex_unlock(&worker->mutex);
+
+	//Delete it
+	delete session;
+
+	//Removed
+	return 1;
+}
+
+void* H324MSessionPool::Run(void *worker)
+{
+	//Run loop
+	((Worker*)worker)->pool->Loop((Worker*)worker);
+	//Exit
+	return NULL;
+}
+
+void H324MSessionPool::Loop(Worker *worker)
+{
+	struct timespec next;
+
+	//Get start time
+	clock_gettime(CLOCK_MONOTONIC,&next);
+
+	//While running
+	while (running)
+	{
+		//Process all sessions
+		pthread_mutex_lock(&worker->mutex);
+		for (Sessions::iterator it=worker->sessions.begin();it!=worker->sessions.end();++it)
+			(*it)->Process();
+		pthread_mutex_unlock(&worker->mutex);
+
+		//Calculate next tick
+		next.tv_nsec += tick*1000000;
+		while (next.tv_nsec>=1000000000)
+		{
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+
+		//Wait for it
+		clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&next,NULL);
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef _H324MSESSIONPOOL_H_
+#define _H324MSESSIONPOOL_H_
+
+#include "H324MSession.h"
+#include "SPSCRing.h"
+#include <pthread.h>
+#include <list>
+
+/*
+ * Runs many sessions on a few worker threads. Each worker is pinned to a
+ * core and, on every tick, demuxes all the input accumulated by its
+ * sessions, sends the queued frames and refills the muxed output. The
+ * channel threads only touch the lock free queues of their session.
+ */
+class H324MSessionPool
+{
+public:
+	class Session
+	{
+	public:
+		//Channel thread side
+		int	Read(BYTE *buffer,int length);
+		int	Write(BYTE *buffer,int length);
+		Frame*	GetFrame();
+		int	SendFrame(Frame *frame);
+
+		//For any other call to the session
+		void	Lock()		{ pthread_mutex_lock(&mutex);	}
+		void	Unlock()	{ pthread_mutex_unlock(&mutex);	}
+
+	private:
+		friend class H324MSessionPool;
+
+		Session(H324MSession *session,DWORD bytesPerTick);
+		~Session();
+		void Process();
+
+	private:
+		H324MSession*	session;
+		SPSCRing<BYTE>	input;
+		SPSCRing<BYTE>	output;
+		SPSCRing<Frame*> framesIn;
+		SPSCRing<Frame*> framesOut;
+		pthread_mutex_t	mutex;
+		DWORD		bytesPerTick;
+		int		worker;
+	};
+
+public:
+	H324MSessionPool(int workers,int tick);
+	~H324MSessionPool();
+
+	Session* Add(H324MSession *session);
+	int Remove(Session *session);
+
+private:
+	typedef std::list<Session*> Sessions;
+
+	struct Worker
+	{
+		H324MSessionPool* pool;
+		pthread_t	thread;
+		pthread_mutex_t	mutex;
+		Sessions	sessions;
+		int		num;
+	};
+
+	static void* Run(void *worker);
+	void Loop(Worker *worker);
+
+private:
+	Worker*	workers;
+	int	numWorkers;
+	int	tick;
+	volatile int running;
+};
+
+#endif
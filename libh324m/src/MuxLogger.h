@@ -0,0 +1,29 @@
+#ifndef _MUXLOGGER_H_
+#define _MUXLOGGER_H_
+
+#include "log.h"
+#include "FileLogger.h"
+
+/*
+ * Logging policies for the H.223 muxer and demuxer. The NullLogger one
+ * compiles the per byte traces away, FileLogger keeps them.
+ */
+class NullLogger
+{
+public:
+	enum { enabled = 0 };
+
+	void SetMuxByte(BYTE b)					{}
+	void SetMuxInfo(const char*info,...)			{}
+	void SetDemuxByte(BYTE b)				{}
+	void SetDemuxInfo(int offset,const char*info,...)	{}
+};
+
+//Build with H324M_MUX_LOG to get the mux traces in the session
+#ifdef H324M_MUX_LOG
+typedef FileLogger MuxLogger;
+#else
+typedef NullLogger MuxLogger;
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef _SPSCRING_H_
+#define _SPSCRING_H_
+
+#include "H324MConfig.h"
+
+/*
+ * Lock free ring for one producer thread and one consumer thread.
+ * The size is rounded up to a power of two.
+ */
+template<typename T>
+class SPSCRing
+{
+public:
+	SPSCRing(DWORD num)
+	{
+		//Round up size
+		size = 1;
+		while (size<num)
+			size <<= 1;
+		mask = size-1;
+		//Allocate
+		buffer = (T*)malloc(size*sizeof(T));
+		//Empty
+		head = 0;
+		tail = 0;
+	}
+
+	~SPSCRing()
+	{
+		//Free memory
+		free(buffer);
+	}
+
+	//Producer side, returns the number of items pushed
+	DWORD Push(const T *items,DWORD num)
+	{
+		DWORD t = tail;
+		//Get consumer position
+		DWORD h = head;
+		__sync_synchronize();
+		//Only what fits
+		if (num>size-(t-h))
+			num = size-(t-h);
+		//Copy
+		for (DWORD i=0;i<num;i++)
+			buffer[(t+i) & mask] = items[i];
+		//Publish
+		__sync_synchronize();
+		tail = t+num;
+		//Return pushed
+		return num;
+	}
+
+	//Consumer side, returns the number of items popped
+	DWORD Pop(T *items,DWORD num)
+	{
+		DWORD h = head;
+		//Get producer position
+		DWORD t = tail;
+		__sync_synchronize();
+		//Only what we have
+		if (num>t-h)
+			num = t-h;
+		//Copy
+		for (DWORD i=0;i<num;i++)
+			items[i] = buffer[(h+i) & mask];
+		//Release
+		__sync_synchronize();
+		head = h+num;
+		//Return popped
+		return num;
+	}
+
+	DWORD Length()	{ return tail-head;		}
+	DWORD Free()	{ return size-(tail-head);	}
+
+private:
+	T*		buffer;
+	DWORD		size;
+	DWORD		mask;
+	volatile DWORD	head;
+	volatile DWORD	tail;
+};
+
+#endif
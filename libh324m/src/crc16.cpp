@@ -68,6 +68,32 @@ static const WORD crc16_table[256] =
 };
 
 
+/*****************************************************************
+ *
+ * Slicing by 8 tables, crc16_slice[k][i] is the crc of byte i
+ * followed by k zero bytes. Filled once on library load.
+ *
+ *****************************************************************/
+
+static WORD crc16_slice[8][256];
+
+static struct CRC16Slices
+{
+	CRC16Slices()
+	{
+		//First one is the byte table
+		for (int i=0;i<256;i++)
+			crc16_slice[0][i] = crc16_table[i];
+		//Each one is the previous plus one zero byte
+		for (int k=1;k<8;k++)
+			for (int i=0;i<256;i++)
+				crc16_slice[k][i] = crc16_table[crc16_slice[k-1][i] & 0xff] ^ (crc16_slice[k-1][i] >> 8);
+	}
+} crc16_slices;
+
+//Below this length the byte loop is faster than the sliced one
+#define CRC16_SLICE_MIN	16
+
 CRC16::CRC16()
 {
 	//Initialize
@@ -75,7 +101,30 @@ CRC16::CRC16()
 }
 void CRC16::Add(BYTE *buffer,int len)
 {
-	for(int i=0;i<len;i++)
+	int i = 0;
+
+	//If it is worth it
+	if (len>=CRC16_SLICE_MIN)
+	{
+		//Eight bytes at a time
+		for (;i+8<=len;i+=8)
+		{
+			//Get the two first bytes with the crc
+			WORD x = crc ^ (buffer[i] | buffer[i+1]<<8);
+			//Get crc of all bytes at once
+			crc =	crc16_slice[7][x & 0xff] ^
+				crc16_slice[6][x >> 8] ^
+				crc16_slice[5][buffer[i+2]] ^
+				crc16_slice[4][buffer[i+3]] ^
+				crc16_slice[3][buffer[i+4]] ^
+				crc16_slice[2][buffer[i+5]] ^
+				crc16_slice[1][buffer[i+6]] ^
+				crc16_slice[0][buffer[i+7]];
+		}
+	}
+
+	//The rest byte by byte
+	for(;i<len;i++)
 		crc = crc16_table[(crc ^ buffer[i]) & 0xff] ^ (crc >> 8);
 }
 void CRC16::Add(BYTE b)
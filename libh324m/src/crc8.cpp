@@ -51,6 +51,29 @@ BYTE crc8_table[256] = {
 };
 
 
+/*
+ * Slicing by 8 tables, crc8_slice[k][i] is the crc of byte i followed by
+ * k zero bytes. Filled once on library load.
+ */
+static BYTE crc8_slice[8][256];
+
+static struct CRC8Slices
+{
+	CRC8Slices()
+	{
+		//First one is the byte table
+		for (int i=0;i<256;i++)
+			crc8_slice[0][i] = crc8_table[i];
+		//Each one is the previous plus one zero byte
+		for (int k=1;k<8;k++)
+			for (int i=0;i<256;i++)
+				crc8_slice[k][i] = crc8_table[crc8_slice[k-1][i]];
+	}
+} crc8_slices;
+
+//Below this length the byte loop is faster than the sliced one
+#define CRC8_SLICE_MIN	16
+
 CRC8::CRC8()
 {
 	crc = 0x00;
@@ -58,7 +81,25 @@ CRC8::CRC8()
 
 void CRC8::Add(BYTE *buffer,int len)
 {
-	for(int i=0;i<len;i++)
+	int i = 0;
+
+	//If it is worth it
+	if (len>=CRC8_SLICE_MIN)
+	{
+		//Eight bytes at a time
+		for (;i+8<=len;i+=8)
+			crc =	crc8_slice[7][crc ^ buffer[i]] ^
+				crc8_slice[6][buffer[i+1]] ^
+				crc8_slice[5][buffer[i+2]] ^
+				crc8_slice[4][buffer[i+3]] ^
+				crc8_slice[3][buffer[i+4]] ^
+				crc8_slice[2][buffer[i+5]] ^
+				crc8_slice[1][buffer[i+6]] ^
+				crc8_slice[0][buffer[i+7]];
+	}
+
+	//The rest byte by byte
+	for(;i<len;i++)
 		crc = crc8_table[(crc ^ buffer[i]) & 0xff];
 }
 void CRC8::Add(BYTE b)
@@ -70,4 +111,3 @@ BYTE CRC8::Calc()
 {
 	return crc;
 }
-
@@ -102,8 +102,17 @@ static guint weight12(guint vector)
     return w;
 }
 
-/* returns the golay coding of the given 12-bit word */
-static guint golay_coding(guint w)
+/* lookup tables, filled once by golay_init_tables():
+ *  - the coding is linear, so it is split in two 6-bit halves
+ *  - the error pattern only depends on the 12-bit syndrome
+ */
+static guint golay_coding_lo[64];
+static guint golay_coding_hi[64];
+static gint32 golay_syndrome_errors[4096];
+static volatile int golay_tables_ready = 0;
+
+/* returns the golay coding of the given 12-bit word, bit by bit */
+static guint golay_coding_bits(guint w)
 {
     guint out=0;
     guint i;
@@ -115,6 +124,33 @@ static guint golay_coding(guint w)
     return out;
 }
 
+static gint32 golay_errors_bits(guint syndrome);
+
+#ifdef __GNUC__
+__attribute__((constructor))
+#endif
+static void golay_init_tables(void)
+{
+    guint i;
+
+    for( i = 0; i<64; i++ ) {
+	golay_coding_lo[i] = golay_coding_bits(i);
+	golay_coding_hi[i] = golay_coding_bits(i<<6);
+    }
+    for( i = 0; i<4096; i++ )
+	golay_syndrome_errors[i] = golay_errors_bits(i);
+
+    golay_tables_ready = 1;
+}
+
+/* returns the golay coding of the given 12-bit word */
+static guint golay_coding(guint w)
+{
+    if( !golay_tables_ready )
+	golay_init_tables();
+    return golay_coding_lo[w & 0x3f] ^ golay_coding_hi[(w>>6) & 0x3f];
+}
+
 /* encodes a 12-bit word to a 24-bit codeword */
 guint32 golay_encode(guint w)
 {
@@ -144,12 +180,22 @@ gint32 golay_errors(guint32 codeword)
 {
     guint received_data, received_parity;
     guint syndrome;
-    guint w,i;
-    guint inv_syndrome = 0;
 
     received_parity = (guint)(codeword>>12);
     received_data   = (guint)codeword & 0xfff;
 
+    /* see golay_errors_bits() below */
+    syndrome = (received_parity ^ golay_coding(received_data)) & 0xfff;
+
+    return golay_syndrome_errors[syndrome];
+}
+
+/* computes the error mask of a syndrome, used to fill the lookup table */
+static gint32 golay_errors_bits(guint syndrome)
+{
+    guint w,i;
+    guint inv_syndrome = 0;
+
     /* We use the C notation ^ for XOR to represent addition modulo 2.
      *
      * Model the received codeword (r) as the transmitted codeword (u)
@@ -166,7 +212,6 @@ gint32 golay_errors(guint32 codeword)
      * data bits, and add them to the received parity bits)
      */
 
-    syndrome = received_parity ^ (golay_coding(received_data));
     w = weight12(syndrome);
     
     /*
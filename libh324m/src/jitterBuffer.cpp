@@ -19,6 +19,15 @@
  ***************************************************************************/
 #include "jitterBuffer.h"
 
+//Delay probabilities are Q24
+#define HIST_ONE	(1<<24)
+//Forget factor is 1-2^-9, about 10s of 20ms packets
+#define HIST_FORGET	9
+//Packets in each window of the minimum delay
+#define MIN_WINDOW	50
+//Minimum packets sent between drops when shrinking the buffer
+#define SHRINK_SLOTS	25
+
 jitterBuffer::jitterBuffer(int pack, int delay)
 {
 	//Initialize ticks
@@ -28,6 +37,22 @@ jitterBuffer::jitterBuffer(int pack, int delay)
 	size	= 0;
 	buffer	= 0;
 	last	= 0;
+	//Not adaptive
+	percentile = 0;
+	target = 1;
+	//All packets arrive on time
+	memset(hist,0,sizeof(hist));
+	hist[0] = HIST_ONE;
+	arrivals = 0;
+	minCur = 0;
+	minPrev = 0;
+	lastArrival = 0;
+	pendingJitter = 0;
+	level = 0;
+	sinceDrop = 0;
+	//No stats
+	late = 0;
+	dropped = 0;
 	//Set jitter parameters
 	SetBuffer(pack,delay);
 }
@@ -56,6 +81,23 @@ void jitterBuffer::Tick( DWORD len )
 
 void jitterBuffer::Push( H223MuxSDU *sdu )
 {
+	//If adaptive
+	if (percentile && minDelay)
+	{
+		//Update estimation
+		Estimate();
+		//Keep time
+		lastArrival = ticks;
+		//If the buffer is full
+		if (minPackets && size>=minPackets)
+		{
+			//Discard oldest
+			delete Pop();
+			//Dropped
+			dropped++;
+		}
+	}
+
 	//Create a new Envelop
 	struct env *newEl = (struct env *)malloc(sizeof(struct env));
 
@@ -79,28 +121,105 @@ void jitterBuffer::Push( H223MuxSDU *sdu )
 	size++;
 
 	//Check if there are the minimum packets in the queue
-	if(wait && size>=minPackets)
+	if(wait && size>=GetTarget())
 		//No more waiting
 		wait = false;
 }
 
-H223MuxSDU *jitterBuffer::GetSDU()
+void jitterBuffer::Estimate()
 {
-	//If buffer is locked wait for minPackets size
-	if(wait)
-		//Don't send
-		return 0;
+	//Delay of the packet relative to a constant rate
+	int delay = ticks-arrivals*minDelay;
 
-	//Loff if we have waited the minimun delay between packets yet
-	if(minDelay && nextPacket>ticks)
-		//Don't send yet
-		return 0;
+	//If the previous one came after a gap
+	if (pendingJitter)
+	{
+		//Packets held by the network arrive together, after a silence they keep the rate
+		if (ticks-lastArrival<(DWORD)minDelay/2)
+		{
+			//It was late
+			AddJitter(pendingJitter);
+			late++;
+		}
+		//Done
+		pendingJitter = 0;
+	}
 
-	//Check size
-	if(!size)
-		//Don't send
-		return 0;
+	//If it comes after a gap, it is a late packet or a talkspurt after a silence
+	if (arrivals && ticks-lastArrival>(DWORD)minDelay*3/2)
+	{
+		//Jitter if it was late, checked with the next one
+		int jitter = delay - (minCur<minPrev ? minCur : minPrev);
+		pendingJitter = jitter>0 ? jitter : 1;
+		//Measure from it, so a silence does not move the delay of the next packets
+		arrivals = 0;
+		delay = ticks;
+	}
+
+	//Each window starts a new minimum, so pauses and drift are forgotten
+	if (arrivals%MIN_WINDOW==0)
+	{
+		//Move window
+		minPrev = arrivals ? minCur : delay;
+		minCur = delay;
+	} else if (delay<minCur) {
+		//New minimum
+		minCur = delay;
+	}
+
+	//Increase arrivals
+	arrivals++;
+
+	//Not known yet
+	if (pendingJitter)
+		return;
+
+	//Get jitter from the fastest packet in the last two windows
+	AddJitter(delay - (minCur<minPrev ? minCur : minPrev));
+}
+
+void jitterBuffer::AddJitter(int jitter)
+{
+	//Bin width
+	int width = minDelay>=4 ? minDelay/4 : 1;
+
+	//Get bin
+	int n = jitter/width;
+
+	//Check max
+	if (n>=JITTER_BINS)
+		n = JITTER_BINS-1;
+
+	//Forget old packets
+	DWORD sum = 0;
+	for (int i=0;i<JITTER_BINS;i++)
+	{
+		//Decrease probability
+		hist[i] -= hist[i]>>HIST_FORGET;
+		//Sum
+		sum += hist[i];
+	}
+
+	//Add the new one so they still add up to one
+	hist[n] += HIST_ONE-sum;
+
+	//Get the jitter for the percentile
+	DWORD limit = (DWORD)(((unsigned long long)HIST_ONE*percentile)/100);
+	int k = 0;
+	sum = hist[0];
+	while (k<JITTER_BINS-1 && sum<limit)
+		sum += hist[++k];
 
+	//Buffer one packet plus the ones that fit on the jitter
+	target = 1 + (k*width+minDelay-1)/minDelay;
+
+	//Check max size
+	if (minPackets && target>minPackets)
+		target = minPackets;
+}
+
+H223MuxSDU *jitterBuffer::Pop()
+{
 	//Get sdu
 	H223MuxSDU *sdu = buffer->sdu;
 	
@@ -116,6 +235,49 @@ H223MuxSDU *jitterBuffer::GetSDU()
 	//Descrease size
 	size--;
 
+	//Return it
+	return sdu;
+}
+
+H223MuxSDU *jitterBuffer::GetSDU()
+{
+	//If buffer is locked wait for minPackets size
+	if(wait)
+		//Don't send
+		return 0;
+
+	//Loff if we have waited the minimun delay between packets yet
+	if(minDelay && nextPacket>ticks)
+		//Don't send yet
+		return 0;
+
+	//Check size
+	if(!size)
+		//Don't send
+		return 0;
+
+	//If adaptive
+	if (percentile && minDelay)
+	{
+		//Filter buffer level in Q8
+		level = (level*15 + (size<<8))/16;
+		//Increase sent since last drop
+		sinceDrop++;
+		//If the buffer has been over the target for a while
+		if (size>1 && level>(DWORD)(target+1)<<8 && sinceDrop>SHRINK_SLOTS)
+		{
+			//Shrink it
+			delete Pop();
+			//Dropped
+			dropped++;
+			//Start again
+			sinceDrop = 0;
+		}
+	}
+
+	//Get sdu
+	H223MuxSDU *sdu = Pop();
+
 	//If there is delay set
 	if(minDelay)
 		//Calculate next send time
@@ -143,12 +305,44 @@ int jitterBuffer::GetSize()
 	return size;
 }
 
+int jitterBuffer::GetTarget()
+{
+	//In adaptive mode minPackets is the max size
+	if (percentile && minDelay)
+		return target;
+	//Fixed
+	return minPackets;
+}
+
+void jitterBuffer::GetStats(Stats *stats)
+{
+	//Current state
+	stats->depth	= size;
+	stats->target	= GetTarget();
+	stats->delay	= size*minDelay;
+	//Counters
+	stats->late	= late;
+	stats->dropped	= dropped;
+}
+
 void jitterBuffer::SetBuffer(int packets,int delay )
 {
 	//Set minimun delay and minimun packets in jitter
 	minDelay = delay;
 	minPackets = packets;
 	//We need to wait if there are not enougth packets in the list
-	wait = (minPackets>size);
+	wait = (GetTarget()>size);
 }
 
+void jitterBuffer::SetAdaptive(int percentile)
+{
+	//Check range
+	if (percentile<0)
+		percentile = 0;
+	else if (percentile>100)
+		percentile = 100;
+	//Store it, 0 disables it
+	this->percentile = percentile;
+	//Check if we need to wait
+	wait = (GetTarget()>size);
+}
@@ -22,17 +22,32 @@
 
 #include "H223MuxSDU.h"
 
+//Delay histogram bins, each one a quarter of the packet delay
+#define JITTER_BINS	128
+
 class jitterBuffer {
+public:
+	struct Stats {
+		int	depth;		//SDUs in the buffer
+		int	target;		//SDUs to buffer before sending
+		DWORD	delay;		//Latency added by the buffer, in ticks
+		DWORD	late;		//SDUs held by the network, not the ones after a silence
+		DWORD	dropped;	//SDUs discarded to shrink the buffer or on overflow
+	};
+
 public:
 	//Construtors
 	jitterBuffer(int minPackets, int minDelay);
 	~jitterBuffer();
 
 	void SetBuffer(int minPackets, int minDelay);
+	//Buffer the percentile of the arrival jitter, minPackets is then the max
+	void SetAdaptive(int percentile);
 	void Tick(DWORD len);
 	void Push(H223MuxSDU *sdu);
 	H223MuxSDU *GetSDU();
 	int GetSize();
+	void GetStats(Stats *stats);
 
 private:
 	struct env {
@@ -40,6 +55,11 @@ private:
 		struct env *next;
 	};
 
+	H223MuxSDU *Pop();
+	void Estimate();
+	void AddJitter(int jitter);
+	int GetTarget();
+
 	int minPackets;
 	int minDelay;
 	bool wait;
@@ -48,6 +68,20 @@ private:
 	struct env *buffer;
 	struct env *last;
 	int size;
+
+	//Adaptive mode
+	int percentile;
+	int target;
+	DWORD hist[JITTER_BINS];
+	DWORD arrivals;
+	int minCur;
+	int minPrev;
+	DWORD lastArrival;
+	int pendingJitter;
+	DWORD level;
+	DWORD sinceDrop;
+	DWORD late;
+	DWORD dropped;
 };
 
 #endif
@@ -0,0 +1,183 @@
+#include "../crc16.h"
+#include "../crc8.h"
+extern "C"
+{
+#include "../golay.h"
+}
+#include <sys/time.h>
+
+/*
+ * Checks the table driven golay decoder and the sliced crcs against the
+ * bit and byte at a time versions and measures them.
+ */
+
+static unsigned long long GetTime()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return ((unsigned long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
+static const unsigned int encodeMatrix[12] = { 0xC75,0x49F,0xD4B,0x6E3,0x9B3,0xB66,0xECC,0x1ED,0x3DA,0x7B4,0xB1D,0xE3A };
+static const unsigned int decodeMatrix[12] = { 0x49F,0x93E,0x6E3,0xDC6,0xF13,0xAB9,0x1ED,0x3DA,0x7B4,0xF68,0xA4F,0xC75 };
+
+static int Weight(unsigned int v)
+{
+	int w = 0;
+	for (int i=0;i<12;i++)
+		if (v & 1<<i)
+			w++;
+	return w;
+}
+
+static unsigned int Mul(const unsigned int *matrix,unsigned int v)
+{
+	unsigned int out = 0;
+	for (int i=0;i<12;i++)
+		if (v & 1<<i)
+			out ^= matrix[i];
+	return out;
+}
+
+//Golay decoder as it was, bit at a time
+static int RefGolayDecode(unsigned int codeword)
+{
+	unsigned int data = codeword & 0xFFF;
+	unsigned int syndrome = ((codeword>>12) ^ Mul(encodeMatrix,data)) & 0xFFF;
+	unsigned int inv;
+	int errors = -1;
+
+	if (Weight(syndrome)<=3)
+		return data;
+
+	for (int i=0;i<12;i++)
+		if (Weight(syndrome^encodeMatrix[i])<=2)
+			return data ^ (1<<i);
+
+	inv = Mul(decodeMatrix,syndrome);
+
+	if (Weight(inv)<=3)
+		return data ^ inv;
+
+	for (int i=0;i<12;i++)
+		if (Weight(inv^decodeMatrix[i])<=2)
+			return data ^ (inv^decodeMatrix[i]);
+
+	return errors;
+}
+
+//Byte at a time crcs
+static WORD RefCRC16(BYTE *buffer,int len)
+{
+	CRC16 crc;
+	for (int i=0;i<len;i++)
+		crc.Add(buffer[i]);
+	return crc.Calc();
+}
+
+static BYTE RefCRC8(BYTE *buffer,int len)
+{
+	CRC8 crc;
+	for (int i=0;i<len;i++)
+		crc.Add(buffer[i]);
+	return crc.Calc();
+}
+
+int main(int argc,char **argv)
+{
+	int iterations = argc>1 ? atoi(argv[1]) : 2000;
+	BYTE buffer[2048];
+	unsigned long long ini;
+	unsigned int sum = 0;
+
+	//Check all codewords
+	for (unsigned int w=0;w<(1<<24);w++)
+	{
+		if (golay_decode(w)!=RefGolayDecode(w))
+		{
+			printf("golay mismatch for %.6x [%d!=%d]\n",w,golay_decode(w),RefGolayDecode(w));
+			return 1;
+		}
+	}
+	printf("golay: 16777216 codewords ok\n");
+
+	//Check random buffers of random sizes and alignments
+	srand(1);
+	for (int n=0;n<100000;n++)
+	{
+		int len = rand()%1024;
+		int offset = rand()%16;
+
+		for (int i=0;i<len;i++)
+			buffer[offset+i] = rand();
+
+		CRC16 crc16;
+		CRC8 crc8;
+		//Split in two adds to check state is kept
+		int split = len ? rand()%len : 0;
+		crc16.Add(buffer+offset,split);
+		crc16.Add(buffer+offset+split,len-split);
+		crc8.Add(buffer+offset,split);
+		crc8.Add(buffer+offset+split,len-split);
+
+		if (crc16.Calc()!=RefCRC16(buffer+offset,len) || crc8.Calc()!=RefCRC8(buffer+offset,len))
+		{
+			printf("crc mismatch len %d offset %d split %d\n",len,offset,split);
+			return 1;
+		}
+	}
+	printf("crc: 100000 random buffers ok\n");
+
+	for (int i=0;i<(int)sizeof(buffer);i++)
+		buffer[i] = rand();
+
+	//Headers
+	ini = GetTime();
+	for (int n=0;n<iterations;n++)
+		for (unsigned int w=0;w<4096;w++)
+			sum += RefGolayDecode(golay_encode(w) ^ (n*0x10101));
+	double ref = (GetTime()-ini)*1000.0/iterations/4096;
+	ini = GetTime();
+	for (int n=0;n<iterations;n++)
+		for (unsigned int w=0;w<4096;w++)
+			sum += golay_decode(golay_encode(w) ^ (n*0x10101));
+	double lut = (GetTime()-ini)*1000.0/iterations/4096;
+	printf("golay decode: %.1f ns bit loop, %.1f ns lookup\n",ref,lut);
+
+	//Typical AL2 and CCSRL sizes
+	int sizes[] = {2,20,160,1024};
+	for (unsigned int s=0;s<sizeof(sizes)/sizeof(int);s++)
+	{
+		int len = sizes[s];
+		int times = iterations*2048/len;
+
+		ini = GetTime();
+		for (int n=0;n<times;n++)
+			sum += RefCRC16(buffer,len);
+		double ref16 = (GetTime()-ini)*1000.0/times/len;
+		ini = GetTime();
+		for (int n=0;n<times;n++)
+		{
+			CRC16 crc;
+			crc.Add(buffer,len);
+			sum += crc.Calc();
+		}
+		double sliced16 = (GetTime()-ini)*1000.0/times/len;
+		ini = GetTime();
+		for (int n=0;n<times;n++)
+			sum += RefCRC8(buffer,len);
+		double ref8 = (GetTime()-ini)*1000.0/times/len;
+		ini = GetTime();
+		for (int n=0;n<times;n++)
+		{
+			CRC8 crc;
+			crc.Add(buffer,len);
+			sum += crc.Calc();
+		}
+		double sliced8 = (GetTime()-ini)*1000.0/times/len;
+		printf("%4d bytes: crc16 %.2f -> %.2f ns/byte, crc8 %.2f -> %.2f ns/byte\n",len,ref16,sliced16,ref8,sliced8);
+	}
+
+	//Avoid optimizing it out
+	return sum==0x12345678;
+}
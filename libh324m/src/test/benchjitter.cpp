@@ -0,0 +1,117 @@
+#include "../jitterBuffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <deque>
+
+/*
+ * Plays 20ms audio SDUs through the AL2 jitter buffer over a simulated
+ * network, with talk periods and AMR DTX periods (one SID every 160ms, or
+ * nothing at all), and prints the target and the stats after each period.
+ * Fails if a silence leaves the adaptive target below the one it had before.
+ */
+
+//Ticks are bytes of the 64kbps line
+#define TICKS_MS	8
+#define PACKET		(20*TICKS_MS)
+
+struct Period
+{
+	const char *name;
+	int ms;
+	int every;	//Packets sent every this number of 20ms slots, 0 for none
+};
+
+static Period periods[] = {
+	{"talk",	10000,	1},
+	{"dtx sid",	10000,	8},
+	{"talk",	10000,	1},
+	{"silence",	5000,	0},
+	{"talk",	10000,	1},
+	{"dtx sid",	20000,	8},
+	{"talk",	2000,	1},
+};
+
+static int Run(int percentile,int maxJitter)
+{
+	jitterBuffer jitBuf(25,PACKET);
+	jitterBuffer::Stats stats;
+	std::deque<DWORD> network;
+	DWORD now = 0;
+	int targetBefore = 0;
+	int fail = 0;
+
+	if (percentile)
+		jitBuf.SetAdaptive(percentile);
+
+	srand(1);
+
+	printf("%s, network jitter up to %dms\n",percentile?"adaptive":"fixed",maxJitter);
+	printf("%-10s %8s %8s %8s %8s %8s %8s\n","period","target","min","max","delay","late","dropped");
+
+	for (unsigned p=0;p<sizeof(periods)/sizeof(Period);p++)
+	{
+		int min = 1000;
+		int max = 0;
+
+		for (int slot=0;slot<periods[p].ms/20;slot++)
+		{
+			//Send, in order, each one after the previous one
+			if (periods[p].every && slot%periods[p].every==0)
+			{
+				DWORD arrival = now + (maxJitter ? (rand()%maxJitter)*TICKS_MS : 0);
+				if (!network.empty() && network.back()>arrival)
+					arrival = network.back();
+				network.push_back(arrival);
+			}
+
+			for (int ms=0;ms<20;ms++)
+			{
+				//Arrive
+				while (!network.empty() && network.front()<=now)
+				{
+					jitBuf.Push(new H223MuxSDU());
+					network.pop_front();
+				}
+				//Muxer asks for one each ms
+				H223MuxSDU *sdu = jitBuf.GetSDU();
+				if (sdu)
+					delete sdu;
+				jitBuf.Tick(TICKS_MS);
+				now += TICKS_MS;
+			}
+
+			jitBuf.GetStats(&stats);
+			if (stats.target<min) min = stats.target;
+			if (stats.target>max) max = stats.target;
+		}
+
+		jitBuf.GetStats(&stats);
+		printf("%-10s %8d %8d %8d %6dms %8u %8u\n",periods[p].name,stats.target,min,max,stats.delay/TICKS_MS,stats.late,stats.dropped);
+
+		//A silence must not shrink what the talk before needed
+		if (periods[p].every==1)
+			targetBefore = stats.target;
+		else if (percentile && stats.target<targetBefore)
+			fail = 1;
+	}
+
+	printf("\n");
+
+	return fail;
+}
+
+int main(int argc,char *argv[])
+{
+	int percentile = argc>1 ? atoi(argv[1]) : 95;
+	int fail = 0;
+
+	fail |= Run(0,60);
+	fail |= Run(percentile,0);
+	fail |= Run(percentile,60);
+	fail |= Run(percentile,150);
+
+	if (fail)
+		printf("the target shrank during a silence\n");
+
+	return fail;
+}
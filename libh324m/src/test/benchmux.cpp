@@ -0,0 +1,133 @@
+#include "../H324MSession.h"
+#include "../H223Demuxer.h"
+#include "../H223Muxer.h"
+#include "../H324MAL2.h"
+#include <sys/time.h>
+
+/*
+ * Measures the bytes per second through the H.223 muxer and demuxer with
+ * both logging policies, and through a pair of sessions with the policy the
+ * library was built with (H324M_MUX_LOG or not).
+ */
+
+static unsigned long long GetTime()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return ((unsigned long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
+class NullReceiver :
+	public H223ALReceiver
+{
+public:
+	virtual void Send(BYTE b)		{}
+	virtual void Send(BYTE *data,int len)	{}
+	virtual void SendClosingFlag()		{}
+	virtual int IsSegmentable()		{ return 0; }
+};
+
+template<class Log>
+static double MuxDemux(int level,DWORD bytes)
+{
+	H223MuxTable table;
+	H223MuxerT<Log> muxer;
+	H223DemuxerT<Log> demuxer;
+	H223AL2Sender audio(0,0);
+	H223AL2Sender video(1,0);
+	NullReceiver receiver;
+	BYTE frame[160];
+	BYTE buffer[160];
+
+	//Audio and video as the sessions
+	table.SetEntry(0,"","0");
+	table.SetEntry(1,"","1");
+	table.SetEntry(2,"","2");
+	table.SetEntry(3,"1","2");
+
+	muxer.SetChannel(1,&audio);
+	muxer.SetChannel(2,&video);
+	demuxer.SetChannel(1,&receiver);
+	demuxer.SetChannel(2,&receiver);
+	muxer.Open(&table);
+	demuxer.Open(&table);
+
+	memset(frame,0x55,sizeof(frame));
+
+	Logger::SetLevel(level);
+
+	unsigned long long ini = GetTime();
+
+	for (DWORD n=0;n<bytes;n+=sizeof(buffer))
+	{
+		//Keep the channels busy without growing the queues
+		audio.SendPDU(frame,32);
+		if (n%320==0)
+			video.SendPDU(frame,100);
+		//Mux
+		muxer.Multiplex(buffer,sizeof(buffer));
+		//And demux
+		demuxer.Demultiplex(buffer,sizeof(buffer));
+	}
+
+	unsigned long long end = GetTime();
+
+	Logger::SetLevel(0);
+
+	return bytes*1000000.0/(end-ini);
+}
+
+static double Session(DWORD bytes)
+{
+	H324MSession a;
+	H324MSession b;
+	BYTE ab[160];
+	BYTE ba[160];
+	BYTE data[32];
+	Frame *frame;
+
+	memset(data,0x55,sizeof(data));
+
+	a.Init();
+	b.Init();
+
+	unsigned long long ini = GetTime();
+
+	for (DWORD n=0;n<bytes;n+=sizeof(ab))
+	{
+		//One audio frame each way
+		Frame audio(e_Audio,e_AMR,data,sizeof(data));
+		a.SendFrame(&audio);
+		b.SendFrame(&audio);
+		//Exchange
+		a.Write(ab,sizeof(ab));
+		b.Read(ab,sizeof(ab));
+		b.Write(ba,sizeof(ba));
+		a.Read(ba,sizeof(ba));
+		//Drain
+		while ((frame=a.GetFrame())!=NULL)
+			delete frame;
+		while ((frame=b.GetFrame())!=NULL)
+			delete frame;
+	}
+
+	unsigned long long end = GetTime();
+
+	a.End();
+	b.End();
+
+	//Two sessions each way
+	return bytes*2*1000000.0/(end-ini);
+}
+
+int main(int argc,char **argv)
+{
+	DWORD bytes = argc>1 ? atoi(argv[1]) : 16000000;
+
+	printf("mux+demux null logger:          %10.0f bytes/s\n",MuxDemux<NullLogger>(0,bytes));
+	printf("mux+demux file logger level 0:  %10.0f bytes/s\n",MuxDemux<FileLogger>(0,bytes));
+	printf("mux+demux file logger level 5:  %10.0f bytes/s\n",MuxDemux<FileLogger>(5,bytes/16));
+	printf("session read/write (%s):  %10.0f bytes/s\n",MuxLogger::enabled ? "file logger" : "null logger",Session(bytes));
+
+	return 0;
+}
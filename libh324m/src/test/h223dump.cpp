@@ -38,7 +38,7 @@ int main(int argc,char **argv)
 
 	H223MuxTable localTable;
 	DumpChannel dumpChannel;
-	H223Demuxer demuxer;
+	H223DemuxerT<FileLogger> demuxer;
 	
 	//Set entry
 	localTable.SetEntry(0,"","0");
@@ -0,0 +1,339 @@
+#include "../H223Demuxer.h"
+#include "../H223Muxer.h"
+extern "C"
+{
+#include "../golay.h"
+}
+
+#include <vector>
+
+/*
+ * Replays the PDUs of recorded h223dump captures through the multiplexer and
+ * checks that the output is byte identical to the original byte by byte one.
+ */
+
+typedef std::vector<BYTE> Bytes;
+
+class RecordChannel :
+	public H223ALReceiver
+{
+public:
+	//Store each pdu as an sdu
+	virtual void Send(BYTE b)
+	{
+		sdu.push_back(b);
+	}
+	virtual void SendClosingFlag()
+	{
+		if (sdu.size())
+			sdus.push_back(sdu);
+		sdu.clear();
+	}
+	virtual int IsSegmentable()
+	{
+		return 0;
+	}
+public:
+	std::vector<Bytes> sdus;
+	Bytes sdu;
+};
+
+class ReplayChannel :
+	public H223ALSender
+{
+public:
+	ReplayChannel(int segmentable)
+	{
+		this->segmentable = segmentable;
+	}
+	void Push(Bytes &sdu)
+	{
+		queue.push_back(new H223MuxSDU(&sdu[0],sdu.size()));
+	}
+	virtual H223MuxSDU* GetNextPDU()
+	{
+		if (queue.empty())
+			return NULL;
+		return queue.front();
+	}
+	virtual void OnPDUCompleted()
+	{
+		delete queue.front();
+		queue.pop_front();
+	}
+	virtual int IsSegmentable()
+	{
+		return segmentable;
+	}
+private:
+	std::list<H223MuxSDU*> queue;
+	int segmentable;
+};
+
+//Byte by byte multiplexer as it was before the span one
+class ReferenceMuxer
+{
+public:
+	ReferenceMuxer(H223MuxTable *table)
+	{
+		this->table = table;
+		state = 0;
+		pm = 0;
+	}
+	void SetChannel(int num,H223ALSender *sender)
+	{
+		senders[num] = sender;
+	}
+	void Multiplex(BYTE *data,int length)
+	{
+		for (int n=0;n<length;n++)
+			data[n] = Multiplex();
+	}
+private:
+	int GetBestMC(int max)
+	{
+		mc = -1;
+		mpl = 0;
+		pm = 0;
+		float best = 0;
+		for (std::map<int,H223ALSender*>::iterator it=senders.begin();it!=senders.end();it++)
+		{
+			if(it->second && sdus.find(it->first)==sdus.end())
+			{
+				H223MuxSDU *sdu = it->second->GetNextPDU();
+				if (sdu!=NULL)
+					sdus[it->first] = sdu;
+			}
+		}
+		WORD len[256];
+		WORD sduLen[256];
+		memset(sduLen,0,256*sizeof(WORD));
+		for (H223MuxSDUMap::iterator it=sdus.begin();it!=sdus.end();it++)
+			sduLen[it->first] = it->second->Length();
+		for (int i=0;i<16;i++)
+		{
+			int j = 0;
+			int end = 0;
+			memset(len,0,256*sizeof(WORD));
+			while(j<max)
+			{
+				int c = table->GetChannel(i,j);
+				if (c==-1 || sduLen[c]==0)
+					break;
+				if (!senders[c]->IsSegmentable() && (len[c] == sduLen[c]))
+					break;
+				len[c]++;
+				j++;
+				if (senders[c]->IsSegmentable() && (len[c] == sduLen[c]))
+				{
+					end = 1;
+					break;
+				}
+			}
+			float ratio = 0;
+			for (int k=0;k<256;k++)
+				if (len[k]>0)
+					ratio +=  (float)len[k]/sduLen[k];
+			if (ratio>best)
+			{
+				mc = i;
+				mpl = j;
+				pm = end;
+				best = ratio;
+			}
+		}
+		return mc!=-1;
+	}
+	BYTE Multiplex()
+	{
+		while (1)
+		{
+			if (state==0)
+			{
+				buffer[0] = pm ? (BYTE)~0xE1 : 0xE1;
+				buffer[1] = pm ? (BYTE)~0x4D : 0x4D;
+				if (GetBestMC(160))
+				{
+					WORD data = (mc & 0x0F) | mpl << 4;
+					long code = golay_encode(data);
+					buffer[2] = ((BYTE *)&code)[0];
+					buffer[3] = ((BYTE *)&code)[1];
+					buffer[4] = ((BYTE *)&code)[2];
+				} else {
+					buffer[2] = 0x00;
+					buffer[3] = 0x00;
+					buffer[4] = 0x00;
+				}
+				i = 0;
+				j = 0;
+				state = 1;
+			}
+			if (i<5)
+				return buffer[i++];
+			if (j<mpl)
+				return sdus[table->GetChannel(mc,j++)]->Pop();
+			H223MuxSDUMap::iterator it = sdus.begin();
+			while(it!=sdus.end())
+			{
+				int number = it->first;
+				if (it->second->Length()==0)
+				{
+					sdus.erase(it++);
+					senders[number]->OnPDUCompleted();
+				} else
+					++it;
+			}
+			state = 0;
+		}
+	}
+private:
+	H223MuxTable *table;
+	std::map<int,H223ALSender*> senders;
+	H223MuxSDUMap sdus;
+	BYTE buffer[5];
+	int state;
+	int mc;
+	int mpl;
+	int pm;
+	int i;
+	int j;
+};
+
+static void SetTable(H223MuxTable &table)
+{
+	//Control, single channels and mixed ones
+	table.SetEntry(0,"","0");
+	table.SetEntry(1,"","1");
+	table.SetEntry(2,"","2");
+	table.SetEntry(3,"1","2");
+	table.SetEntry(4,"","12");
+	table.SetEntry(5,"11","2");
+	table.SetEntry(6,"2222","1");
+}
+
+static int Replay(std::vector<Bytes> &sdus,int chunk)
+{
+	H223MuxTable refTable;
+	H223MuxTable table;
+	ReplayChannel refChannels[3] = {ReplayChannel(0),ReplayChannel(0),ReplayChannel(1)};
+	ReplayChannel channels[3] = {ReplayChannel(0),ReplayChannel(0),ReplayChannel(1)};
+	H223Muxer muxer;
+
+	//Same tables
+	SetTable(refTable);
+	SetTable(table);
+
+	//Set channels
+	ReferenceMuxer ref(&refTable);
+	for (int c=0;c<3;c++)
+	{
+		ref.SetChannel(c,&refChannels[c]);
+		muxer.SetChannel(c,&channels[c]);
+	}
+
+	//Open
+	muxer.Open(&table);
+
+	BYTE *a = (BYTE*)malloc(chunk);
+	BYTE *b = (BYTE*)malloc(chunk);
+	DWORD total = 0;
+	unsigned int k = 0;
+
+	//Until all sdus have been sent and some more time
+	for (int n=0;n<(int)sdus.size()*4;n++)
+	{
+		//Spread the sdus through the channels
+		if (k<sdus.size())
+		{
+			refChannels[k%3].Push(sdus[k]);
+			channels[k%3].Push(sdus[k]);
+			k++;
+		}
+
+		//Multiplex with both
+		ref.Multiplex(a,chunk);
+		muxer.Multiplex(b,chunk);
+
+		//Compare
+		if (memcmp(a,b,chunk))
+		{
+			for (int m=0;m<chunk;m++)
+				if (a[m]!=b[m])
+				{
+					printf("mismatch at byte %d [%.2x!=%.2x] chunk size %d\n",total+m,a[m],b[m],chunk);
+					break;
+				}
+			free(a);
+			free(b);
+			return 0;
+		}
+
+		total += chunk;
+	}
+
+	free(a);
+	free(b);
+
+	printf("%d sdus %d bytes chunk size %d ok\n",(int)sdus.size(),total,chunk);
+
+	return 1;
+}
+
+int main(int argc,char **argv)
+{
+	// Check number of parameters
+	if (argc<2)
+	{
+		printf("usage: h223replay <filename> [filename...]\n");
+		return 1;
+	}
+
+	for (int n=1;n<argc;n++)
+	{
+		//Open file
+		int f = open(argv[n],O_RDONLY);
+
+		//Check
+		if (f==-1)
+		{
+			printf("unable to open [%s]\n",argv[n]);
+			return 2;
+		}
+
+		H223MuxTable localTable;
+		RecordChannel recordChannel;
+		H223Demuxer demuxer;
+
+		//Set entry
+		localTable.SetEntry(0,"","0");
+
+		//Set demuxer channels
+		demuxer.SetChannel(0,&recordChannel);
+
+		//Open demuxer
+		demuxer.Open(&localTable);
+
+		//Read
+		unsigned char buffer[160];
+		int len;
+
+		//Until end of file
+		while ((len=read(f,buffer,160))>0)
+			//Demux
+			demuxer.Demultiplex(buffer,len);
+
+		//Close demuxer
+		demuxer.Close();
+
+		//Close file
+		close(f);
+
+		printf("%s\n",argv[n]);
+
+		//Replay with different output sizes
+		if (!Replay(recordChannel.sdus,160) || !Replay(recordChannel.sdus,1) || !Replay(recordChannel.sdus,37))
+			return 3;
+	}
+
+	return 0;
+}
@@ -10,22 +10,54 @@
 
 #include <errno.h>
 #include <asterisk/frame.h>
+#include <asterisk/linkedlists.h>
 
 
 #ifdef __cplusplus
 #include <medkit/astcpp.h>
 #include <medkit/config.h>
 #include <map>
+#include <set>
+#include <vector>
+#include <sys/epoll.h>
 
 class AstFrameBuffer 
 {
 public:
-	AstFrameBuffer(bool blocking, bool fifo);
+	/**
+	 *  @param window: if not 0, frames are reordered in a circular array of window
+	 *                 slots (rounded up to a power of two) indexed by sequence number
+	 *                 instead of a std::map. In this mode Add() never takes the mutex,
+	 *                 but only one producer thread and one consumer thread are allowed.
+	 **/
+	AstFrameBuffer(bool blocking, bool fifo, DWORD window = 0);
 
 	virtual ~AstFrameBuffer();
 
 	bool Add(const ast_frame * f, bool ignore_cseq = false);
 
+	/**
+	 *  Same as Add() but the buffer gets the ownership of the frame, which is freed
+	 *  if rejected. Frames whose header and data are malloc'ed are queued as is,
+	 *  others are copied to the pool if any.
+	 **/
+	bool Take(ast_frame * f, bool ignore_cseq = false);
+
+	/**
+	 *  Preallocate frames copies of maxDataLen bytes each. Frames returned by Wait()
+	 *  may then belong to the pool and must be given back with Release() instead of
+	 *  ast_frfree(), before the buffer is destroyed. Must be called before adding frames.
+	 **/
+	bool EnablePool(DWORD frames, DWORD maxDataLen);
+
+	//Give back a frame returned by Wait(), ast_frfree() it if it is not from the pool
+	void Release(struct ast_frame * f);
+
+	//Give back a frame to the pool, returns false if it is not from the pool
+	bool Recycle(struct ast_frame * f);
+
+	DWORD GetPoolMisses() { return poolMisses; }
+
 	void Cancel();
 
 	struct ast_frame * Wait(bool block);
@@ -68,6 +100,9 @@ public:
 
 	DWORD Length()
 	{
+		//Ring counter is atomic
+		if (ring) return ringCount;
+
 		pthread_mutex_lock(&mutex);
 		DWORD l = packets.size();
 		pthread_mutex_unlock(&mutex);
@@ -76,6 +111,8 @@ public:
 	}
 	
 	int GetLoss() { return nbLost; }
+
+	DWORD GetOverflows() { return ringOverflows; }
 	
 	void SetMaxWaitTime(DWORD maxWaitTime)
 	{
@@ -92,11 +129,30 @@ public:
 		
 	static int WaitMulti(AstFrameBuffer * jbTab[], unsigned long nbFb, DWORD maxWaitTime, AstFrameBuffer * jbTabOut[]);
 
+	/**
+	 *  Create the readiness eventfd of the buffer if not already done. The fd is
+	 *  readable while a packet may be ready, IsReady() rearms it when it is not.
+	 **/
+	int EnableEventFd();
+
+	int GetEventFd() { return efd; }
+
+	bool IsReady();
+
 	bool OpenTraceFile(const char * filename);
 	
 private:
 	void ClearPackets();
 	void Notify();
+	void Signal();
+	bool NextSeq(const ast_frame * f, bool ignore_cseq, DWORD & seq);
+	bool IsPast(DWORD seq);
+	bool Push(const ast_frame * f, bool ignore_cseq, bool owned);
+	bool PushRing(const ast_frame * f, bool ignore_cseq, bool owned);
+	struct ast_frame * Store(const ast_frame * f, bool owned);
+	bool PeekPacket(DWORD & seq);
+	bool PeekRing(DWORD & seq);
+	struct ast_frame * PopPacket(DWORD seq);
 
 	inline bool HasPacketReady(DWORD seq)
 	{
@@ -105,7 +161,7 @@ private:
 
 		if (next==(DWORD)-1 || seq==next || hurryUp) return true;
 		
-		sz = packets.size();
+		sz = ring ? ringCount : packets.size();
 		if (blocking)
 		{
 			packready = (sz > (maxWaitTime/20) ); 
@@ -122,18 +178,42 @@ private:
 private:
 	typedef std::map<DWORD,struct ast_frame *> RTPOrderedPackets;
 
+	//Room kept for the frame source name in pool slabs
+	static const DWORD POOL_SRC_LEN = 32;
+
+	//Slot of the circular backend. frame is written by the producer only when
+	//it is NULL and reset to NULL by the consumer only.
+	struct RingSlot
+	{
+		struct ast_frame * volatile	frame;
+		DWORD				seq;
+	};
+
 private:
 	//The event list
 	RTPOrderedPackets	packets;
-	bool			cancel;
-	bool			signalled;
-	bool			hurryUp;
-	DWORD			next;
+	//Circular backend, NULL if the map is used
+	RingSlot *		ring;
+	DWORD			ringMask;
+	volatile DWORD		ringCount;
+	volatile int		ringWaiters;
+	DWORD			ringOverflows;
+	//Frame slabs, free ones are chained by their first word
+	BYTE *			pool;
+	void * volatile		poolFree;
+	DWORD			poolSlabSize;
+	DWORD			poolDataSize;
+	DWORD			poolLength;
+	DWORD			poolMisses;
+	volatile bool		cancel;
+	volatile int		signalled;
+	volatile bool		hurryUp;
+	volatile DWORD		next;
 	DWORD			dummyCseq;
 	DWORD			cycle;
 	DWORD			maxWaitTime;
 	DWORD			prevTs;
-	int				bigJumps;
+	volatile int		bigJumps;
 	bool			blocking;
 	bool			isfifo;
 	
@@ -143,6 +223,32 @@ private:
 
 	int				nbLost;
 	FILE *			traceFile;
+	int				efd;
+};
+
+/**
+ *  Set of frame buffers read by a single thread. Each buffer signals its own
+ *  eventfd so Wait() only looks at the buffers that were notified.
+ **/
+class AstFrameBufferSet
+{
+public:
+	AstFrameBufferSet();
+	~AstFrameBufferSet();
+
+	bool Add(AstFrameBuffer * fb);
+	//Must be called before destroying a buffer of the set
+	bool Remove(AstFrameBuffer * fb);
+	int Wait(DWORD maxWaitTime, AstFrameBuffer * fbOut[], unsigned long maxOut);
+
+private:
+	typedef std::set<AstFrameBuffer *> Buffers;
+
+private:
+	int				epfd;
+	Buffers				buffers;
+	std::vector<struct epoll_event>	events;
+	pthread_mutex_t			mutex;
 };
 
 #endif
@@ -169,6 +275,16 @@ extern "C"
 	  *  @param [in] fifo: if true, sequence number of packets are not considered and jb behaves like a fifo packet queue.
      **/
      struct AstFb *AstFbCreate(unsigned long maxWaitTime, int blocking, int fifo);
+
+	/**
+      *  Same as AstFbCreate() but packets are reordered in a lock-free circular array
+	  *  instead of a tree. Only one thread may add frames and only one thread may read them.
+      *  
+      *  @param [in] window: number of slots, rounded up to a power of two. A packet whose
+	  *             slot is still held by the packet one window before is dropped and the
+	  *             reader is hurried up.
+     **/
+     struct AstFb *AstFbCreateRing(unsigned long maxWaitTime, int blocking, int fifo, unsigned long window);
 	
      /**
       *  Add an ast_frame into the jitterbuffer. Frame is duplicated.
@@ -187,6 +303,34 @@ extern "C"
 	 
      int AstFbAddFrameNoCseq( struct AstFb *fb, const struct ast_frame *f );
 
+     /**
+      *  Add an ast_frame into the jitterbuffer and give it the ownership of the frame.
+	  *  It is freed by the jitterbuffer if rejected. Frame is copied only if its header
+	  *  or its data are not malloc'ed.
+      *  
+      *  @param fb: jitterbuffer instance to consider
+      *  @param [in] f: frame to post, caller must not use it anymore.
+     **/
+     int AstFbTakeFrame( struct AstFb *fb, struct ast_frame *f );
+
+     /**
+      *  Preallocate copies of frames in the jitterbuffer, so no memory is allocated per frame
+	  *  in steady state. Must be called before the first frame is added. Frames returned by
+	  *  AstFbGetFrame() or AstFbWaitFrame() must then be freed by AstFbReleaseFrame().
+      *  
+      *  @param fb: jitterbuffer instance to consider
+      *  @param [in] frames: number of frames in the pool
+      *  @param [in] maxDataLen: max payload size. Bigger frames are duplicated as before.
+     **/
+     int AstFbEnablePool( struct AstFb *fb, unsigned long frames, unsigned long maxDataLen );
+
+	// Free a frame read from the jitterbuffer
+     void AstFbReleaseFrame( struct AstFb *fb, struct ast_frame *f );
+
+	// Give back a frame to the jitterbuffer pool without freeing it otherwise.
+	// Returns 0 if the frame is not from the pool.
+     int AstFbRecycleFrame( struct AstFb *fb, struct ast_frame *f );
+
 	void AstFbUnblock(struct AstFb *fb);
 	 
 	// Always non blocking
@@ -259,6 +403,31 @@ extern "C"
 	
 	
 	void AstFbTrace(struct AstFb * fb, const char * filename);
+
+	struct AstFbSet;
+
+    /**
+      *  Create a set of jitterbuffers waited on with epoll. Unlike AstFbWaitMulti() there is
+	  *  no limit on the number of jitterbuffers and only the ready ones are reported.
+     **/
+	struct AstFbSet * AstFbSetCreate(void);
+
+	int AstFbSetAdd(struct AstFbSet * set, struct AstFb * fb);
+
+	int AstFbSetRemove(struct AstFbSet * set, struct AstFb * fb);
+
+    /**
+      *  Wait for packets on a set of jitterbuffers.
+      *  
+	  *  @param maxWaitTime: maximum time to wait in ms. On timeout, jitterbuffers holding
+	  *                      more than 2 packets are hurried up.
+	  *  @param [out] fbOut: jitterbuffers ready to be read with AstFbGetFrame().
+	  *  @param maxOut: size of fbOut.
+	  *  @return number of jitterbuffers returned in fbOut, or -1 on error.
+     **/
+	int AstFbSetWait(struct AstFbSet * set, unsigned long maxWaitTime, struct AstFb * fbOut[], unsigned long maxOut);
+
+	void AstFbSetDestroy(struct AstFbSet * set);
 	
 #ifdef __cplusplus
 }
@@ -1,4 +1,5 @@
 #include <mp4v2/mp4v2.h>
+#include <pthread.h>
 
 #ifdef __cplusplus
 
@@ -9,6 +10,10 @@ class Mp4Basetrack;
 class H264Depacketizer;
 class RTPRedundantEncoder;
 class PictureStreamer;
+class Mp4FrameQueue;
+class Mp4FragmentWriter;
+class Mp4PlayIndex;
+class Mp4ScheduledPlay;
 
 #define MP4_AUDIO_TRACK		0
 #define MP4_VIDEO_TRACK		1
@@ -21,7 +26,12 @@ class PictureStreamer;
 class mp4recorder 
 {
 public:
-    mp4recorder(void * ctxdata, MP4FileHandle mp4, bool waitVideo);
+    /**
+     * @param fragments: if set, the tracks are written to this fragmented file
+     * instead of the mp4 handle, which may be invalid. It is closed and
+     * deleted by the recorder.
+     */
+    mp4recorder(void * ctxdata, MP4FileHandle mp4, bool waitVideo, Mp4FragmentWriter * fragments = NULL);
     ~mp4recorder();
     
     /**
@@ -108,14 +118,55 @@ public:
 	 */
 	void EnableVideoPrologue(bool prologueEnabled) { addVideoPrologue = prologueEnabled; }
 	
+	/**
+	 * Store several audio frames in each sample, with a hint packet per frame.
+	 * Must be set before the first audio frame.
+	 * @param frames: max number of frames per sample, 1 to disable
+	 */
+	void SetAudioAggregation(DWORD frames) { audioAggregation = frames; }
+	
 	void Flush();
 
     void DumpInfo();
 	
+	/**
+	 * Write the frames from the shared writer threads instead of the caller thread.
+	 * Frames are copied to a queue and dropped when it is full. The initial delay
+	 * must be set before. Only one thread may process frames.
+	 * @param queueSize: max number of frames waiting to be written
+	 * @return false if the writer threads are not running
+	 */
+	bool EnableAsync(DWORD queueSize);
+	
+	/**
+	 * Remove the recorder from its writer thread and write the queued frames
+	 */
+	void DisableAsync();
+	
+	/**
+	 * Write up to max queued frames, called from the writer thread
+	 * @return number of frames written
+	 */
+	int WriteQueued(DWORD max);
+	
+	/**
+	 * Check if the writer thread has something to do for this recorder
+	 */
+	bool HasQueued();
+	
+	void GetAsyncStats(DWORD & queued, DWORD & dropped, DWORD & maxDepth);
+	
+private:
+	int WriteFrame(int trackidx, const MediaFrame * f);
+	int CreateTrack(int trackidx, const char * trackName, int codec, DWORD rate);
+	void CreateQueued(int trackidx);
+	bool IsTrackEmpty(int trackidx);
+	
 private:
     char partName[80];
     
     MP4FileHandle mp4;
+    Mp4FragmentWriter * fragments;
     Mp4Basetrack * mediatracks[5];
         
     int length;
@@ -146,6 +197,24 @@ private:
 	
 	bool saveTxtInComment;
 	bool addVideoPrologue;
+	DWORD audioAggregation;
+	
+	// asynchronous writing
+	Mp4FrameQueue * queue;
+	pthread_mutex_t writelock;
+	int writer;
+	DWORD queued;
+	DWORD dropped;
+	DWORD maxDepth;
+	bool queuedTrack[MP4_TEXT_TRACK + 1];
+	bool queuedIntra;
+	volatile int flushPending;
+	// tracks created by the writer thread
+	volatile int createPending[MP4_TEXT_TRACK + 1];
+	bool createFailed[MP4_TEXT_TRACK + 1];
+	const char * createName[MP4_TEXT_TRACK + 1];
+	int createCodec[MP4_TEXT_TRACK + 1];
+	DWORD createRate[MP4_TEXT_TRACK + 1];
 };
 
 /**
@@ -155,7 +224,16 @@ private:
 class mp4player 
 {
 public:
-    mp4player(void * ctxdata, MP4FileHandle mp4);
+    /**
+     * @param closeFile: close the mp4 handle when destroyed
+     */
+    mp4player(void * ctxdata, MP4FileHandle mp4, bool closeFile = false);
+
+    /**
+     * Play the hinted tracks of a shared play index instead of reading the file
+     * @param index: index with a reference, released when destroyed
+     */
+    mp4player(void * ctxdata, Mp4PlayIndex * index);
     virtual ~mp4player();
 
     int OpenTrack(AudioCodec::Type outputCodecs[], unsigned int nbCodecs, AudioCodec::Type prefCodec, bool cantranscode );
@@ -183,23 +261,51 @@ public:
 	 * Reset MP4 stream to read
 	 **/
     int Rewind();
+
+	/**
+	 * Play from the nearest video sync sample at or before a time of the file,
+	 * now, the other tracks from their first sample after it
+	 * @return -1 if it is after the end of all the tracks
+	 */
+    int Seek(QWORD ms);
+
+	/**
+	 * Stop at a time of the file, as if it ended there
+	 */
+    void SetEnd(QWORD ms);
+
+	/**
+	 * @return time of the file being played, in ms, the time sought if nothing was left to play
+	 */
+    QWORD GetPosition();
     
     bool Eof();
 
     BYTE buffer[2000];
 
 	bool GetCodec(AudioCodec::Type & codec) const;
+
+	// Set while sent by the scheduler threads
+	Mp4ScheduledPlay * scheduled;
 	
 protected:
     //MP4TrackId IterateTracks(int trackIdx, const char * trackType, bool useHint = true);
 	bool GetNextTrackAndTs(int & trackId, QWORD & ts);
+	QWORD GetNextTime(int trackId);
     
+private:
+	void Init(void * ctxdata);
+	
 private:
     void * ctxdata;
     Mp4Basetrack * mediatracks[5];
 	QWORD next[5];
 	QWORD nextBOMorRepeat;
+	QWORD end;
+	QWORD position;
     MP4FileHandle mp4;
+	bool closeFile;
+	Mp4PlayIndex * index;
     
     RTPRedundantEncoder * redenc;
 
@@ -229,6 +335,15 @@ extern "C"
  */
     struct mp4rec * Mp4RecorderCreate(struct ast_channel * chan, MP4FileHandle mp4, bool waitVideo, const char * videoformat, const char * partName, int textfile);
 
+/**
+ * Same as Mp4RecorderCreate but records a fragmented MP4 file, which can be read while
+ * it is recorded and is not rewritten when closed. Text is not saved in the comment tag.
+ * @param filename: file to create
+ * @param fragmentMs: max duration of each fragment, video key frames also start a new one
+ * @return NULL if the file cannot be created
+ */
+    struct mp4rec * Mp4RecorderCreateFragmented(struct ast_channel * chan, const char * filename, unsigned long fragmentMs, bool waitVideo, const char * videoformat, const char * partName, int textfile);
+
 /**
  * Process one ast_frame and record it into the MP4 file. Warning: packets must be reordered
  * before being posted to the recorder.
@@ -257,6 +372,38 @@ extern "C"
 	
 	void Mp4RecorderEnableVideoPrologue( struct mp4rec * r, bool yesno );
 
+	/**
+	 * Store several audio frames in each MP4 sample to reduce the size of the sample
+	 * tables and the number of writes. Must be called before recording.
+	 *
+	 * @param r: instance of mp4 recorder
+	 * @param frames: max number of frames per sample, 1 to disable
+	 */
+	void Mp4RecorderSetAudioAggregation( struct mp4rec * r, unsigned long frames );
+
+	/**
+	 * Let the writer threads write the frames of this recorder, so a slow disk
+	 * does not block the caller. Mp4RecorderDestroy writes what is still queued.
+	 *
+	 * @param r: instance of mp4 recorder
+	 * @param queueSize: max number of frames waiting to be written, others are dropped
+	 * @return 1 on success, 0 if the writer threads are not started
+	 */
+	int Mp4RecorderEnableAsync( struct mp4rec * r, unsigned long queueSize );
+
+	void Mp4RecorderGetAsyncStats( struct mp4rec * r, unsigned long * queued, unsigned long * dropped, unsigned long * maxDepth );
+
+	/**
+	 * Start the writer threads shared by all the asynchronous recorders
+	 * @param threads: number of writer threads
+	 */
+	int Mp4WriterPoolStart( int threads );
+
+	/**
+	 * Stop the writer threads. Recorders still using them write their frames on destroy.
+	 */
+	void Mp4WriterPoolStop();
+
     /**
      *  destoy one instance of mp4 recorder
      *  
@@ -273,7 +420,67 @@ extern "C"
 	 */
     struct mp4play * Mp4PlayerCreate(struct ast_channel * chan, MP4FileHandle mp4, bool transcodeVideo, int renderText);
 
+	/**
+	 * Create an instance of MP4 player for a file. Files with only audio and video tracks,
+	 * hinted or H.264 and audio without hint, are played from an index shared by all the
+	 * players of the file, built on its first play and rebuilt when it changes. Tracks
+	 * without hint are packetized there once. Other files are opened and closed by the player.
+	 * @param chan asterisk channel to associate with this player, as in Mp4PlayerCreate
+	 * @param filename file to play
+	 * @return NULL if the file can not be opened or the player can not be created
+	 */
+    struct mp4play * Mp4PlayerCreateFromFile(struct ast_channel * chan, const char * filename, bool transcodeVideo, int renderText);
+
     int Mp4PlayerPlayNextFrame(struct ast_channel * chan, struct mp4play * p);
+
+	/**
+	 * Play from a time of the file instead of its start, from the previous video sync
+	 * sample. Must be called before playing starts.
+	 * @return 1 on success, 0 if it is after the end of the file
+	 */
+	int Mp4PlayerSeek(struct mp4play * p, unsigned long ms);
+
+	/**
+	 * Stop playing at a time of the file instead of its end
+	 */
+	void Mp4PlayerSetEnd(struct mp4play * p, unsigned long ms);
+
+	/**
+	 * @return time of the file played so far in ms, to resume from it
+	 */
+	unsigned long Mp4PlayerGetPosition(struct mp4play * p);
+
+	/**
+	 * Start the threads sending the frames of all the players started with Mp4PlayerStart
+	 * @param threads: number of scheduler threads
+	 * @param pin: bind each thread to a cpu
+	 */
+	int Mp4PlaySchedulerStart( int threads, int pin );
+
+	/**
+	 * Stop the scheduler threads, the players they send end with status -7
+	 */
+	void Mp4PlaySchedulerStop();
+
+	/**
+	 * Let the scheduler threads send the frames of this player to its channel, instead of
+	 * calling Mp4PlayerPlayNextFrame. The channel is woken up with a null frame when it ends.
+	 * Mp4PlayerStop or Mp4PlayerDestroy stops it.
+	 * @return 1 on success, 0 if the scheduler threads are not started or the audio
+	 * is transcoded by the channel, then the caller sends the frames
+	 */
+	int Mp4PlayerStart(struct ast_channel * chan, struct mp4play * p);
+
+	/**
+	 * Stop the scheduler threads sending the player, once it returns its position can be read
+	 */
+	void Mp4PlayerStop(struct mp4play * p);
+
+	/**
+	 * @return 0 while the scheduler plays it, else the error code of Mp4PlayerPlayNextFrame
+	 * it ended with, -1 at the end of the file
+	 */
+	int Mp4PlayerGetStatus(struct mp4play * p);
     
     void Mp4PlayerDestroy( struct mp4play * p );
 #ifdef __cplusplus
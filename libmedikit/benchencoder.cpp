@@ -0,0 +1,159 @@
+/*
+ * File:   benchencoder.cpp
+ *
+ * Count the allocations of the encode and packetize loop of many channels,
+ * taking a copy of the frame returned by the encoder, as callers keeping it
+ * had to, and encoding into a frame owned by the caller reused every time.
+ * Allocations done inside the codec libraries are not counted.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+#include <medkit/log.h>
+#include <medkit/video.h>
+
+/* Allocations done with new */
+static QWORD allocs = 0;
+
+void * operator new(size_t size)
+{
+	__sync_add_and_fetch(&allocs, 1);
+	return malloc(size);
+}
+
+void operator delete(void * p) throw()
+{
+	free(p);
+}
+
+static int Quiet(const char *msg, va_list ap)
+{
+	return 1;
+}
+
+enum Mode { Clone, Reuse };
+
+static const char * modeNames[] = { "clone", "reuse" };
+
+struct Result
+{
+	double	usPerFrame;
+	double	allocsPerFrame;
+	DWORD	packets;
+};
+
+/* Moving gradient, so there is something to encode on each frame */
+static void Fill(BYTE * pic, DWORD width, DWORD height, DWORD n)
+{
+	DWORD numPixels = width*height;
+
+	for (DWORD y=0; y<height; y++)
+		for (DWORD x=0; x<width; x++)
+			pic[y*width+x] = (x+y+n*3) & 0xFF;
+	memset(pic+numPixels, (n*5) & 0xFF, numPixels/4);
+	memset(pic+numPixels*5/4, 128, numPixels/4);
+}
+
+static Result Run(Mode mode, VideoCodec::Type codec, DWORD channels, DWORD frames, DWORD width, DWORD height, DWORD fps)
+{
+	Result res;
+	std::vector<VideoEncoder *> encoders(channels);
+	std::vector<VideoFrame *> outs(channels);
+	DWORD len = width*height*3/2;
+	BYTE * pic = (BYTE *) malloc(len);
+
+	for (DWORD i=0; i<channels; i++)
+	{
+		encoders[i] = VideoCodecFactory::CreateEncoder(codec);
+		encoders[i]->SetSize(width, height);
+		encoders[i]->SetFrameRate(fps, 256, fps*10);
+		outs[i] = new VideoFrame(codec, 0);
+	}
+
+	//First second out of the count, buffers grow to their size there
+	DWORD warmup = frames<fps ? 0 : fps;
+	QWORD count = 0;
+	QWORD ini = 0;
+
+	res.packets = 0;
+	for (DWORD n=0; n<frames; n++)
+	{
+		Fill(pic, width, height, n);
+
+		if (n==warmup)
+		{
+			allocs = 0;
+			ini = getTime();
+		}
+
+		for (DWORD i=0; i<channels; i++)
+		{
+			VideoFrame * f = NULL;
+
+			if (mode==Clone)
+			{
+				VideoFrame * enc = encoders[i]->EncodeFrame(pic, len);
+				if (enc) f = (VideoFrame *) enc->Clone();
+			}
+			else if (encoders[i]->EncodeFrame(pic, len, *outs[i]))
+			{
+				f = outs[i];
+			}
+
+			if (!f)
+				continue;
+
+			res.packets += f->GetRtpPacketizationInfo().size();
+
+			if (mode==Clone)
+				delete f;
+		}
+
+		if (n>=warmup)
+			count += channels;
+	}
+
+	res.usPerFrame = count ? (double)(getTime()-ini)/count : 0;
+	res.allocsPerFrame = count ? (double) allocs/count : 0;
+
+	for (DWORD i=0; i<channels; i++)
+	{
+		delete encoders[i];
+		delete outs[i];
+	}
+	free(pic);
+
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	DWORD channels = argc>1 ? atoi(argv[1]) : 100;
+	DWORD seconds = argc>2 ? atoi(argv[2]) : 3;
+	const char * name = argc>3 ? argv[3] : "H263_1998";
+	DWORD width = 176;
+	DWORD height = 144;
+	DWORD fps = 30;
+	VideoCodec::Type codec;
+
+	if (!VideoCodec::GetCodecFor(name, codec))
+	{
+		printf("Unknown codec %s\n", name);
+		return 1;
+	}
+
+	SetLogFunctions(Quiet, Quiet, Quiet);
+
+	printf("%s qcif, %u channels at %u fps\n", VideoCodec::GetNameFor(codec), channels, fps);
+	printf("%-8s %10s %12s %12s %10s\n", "mode", "us/frame", "allocs/frame", "allocs/s", "packets");
+	for (int m=Clone; m<=Reuse; m++)
+	{
+		Result res = Run((Mode) m, codec, channels, seconds*fps, width, height, fps);
+		printf("%-8s %10.1f %12.2f %12.0f %10u\n", modeNames[m], res.usPerFrame, res.allocsPerFrame, res.allocsPerFrame*channels*fps, res.packets);
+	}
+
+	return 0;
+}
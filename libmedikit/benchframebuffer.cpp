@@ -0,0 +1,157 @@
+/*
+ * File:   benchframebuffer.cpp
+ *
+ * Compare the std::map and circular backends of AstFrameBuffer, with and
+ * without frame pool, on in-order, reordered and lossy streams. The producer
+ * and the consumer run on the same thread, as in mp4save.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <new>
+#include <medkit/log.h>
+#include <astmedkit/framebuffer.h>
+
+/* Allocations done by the frame buffer */
+static QWORD allocs = 0;
+
+void * operator new(size_t size)
+{
+	allocs++;
+	return malloc(size);
+}
+
+void operator delete(void * p) throw()
+{
+	free(p);
+}
+
+/* Asterisk symbols normally resolved by the asterisk binary */
+extern "C" struct ast_frame *ast_frdup(const struct ast_frame *f)
+{
+	allocs++;
+	struct ast_frame * f2 = (struct ast_frame *) malloc(sizeof(struct ast_frame) + f->datalen);
+	memcpy(f2, f, sizeof(struct ast_frame));
+	f2->data = ((BYTE *) f2) + sizeof(struct ast_frame);
+	memcpy(f2->data, f->data, f->datalen);
+	f2->mallocd = AST_MALLOCD_HDR;
+	return f2;
+}
+
+extern "C" void ast_frfree(struct ast_frame *f)
+{
+	if (f->mallocd & AST_MALLOCD_HDR)
+		free(f);
+}
+
+extern "C" void ast_log(int level, const char *file, int line, const char *function, const char *fmt, ...)
+{
+}
+
+static int Quiet(const char *msg, va_list ap)
+{
+	return 1;
+}
+
+enum Stream { InOrder, Reordered, Lossy };
+
+static const char * streamNames[] = { "in-order", "reordered", "lossy" };
+
+static DWORD MakeStream(Stream type, WORD * seqs, DWORD num)
+{
+	DWORD n = 0;
+
+	srand(1234);
+	for (DWORD i=0; i<num; i++)
+	{
+		WORD seq = (WORD) i;
+
+		//Swap with previous one every ~8 packets
+		if (type==Reordered && n>0 && (rand()%8)==0)
+		{
+			seqs[n] = seqs[n-1];
+			seqs[n-1] = seq;
+			n++;
+			continue;
+		}
+		//Drop 2% of packets
+		if (type==Lossy && (rand()%50)==0)
+			continue;
+		seqs[n++] = seq;
+	}
+	return n;
+}
+
+struct Result
+{
+	double	nsPerPacket;
+	double	allocsPerPacket;
+	DWORD	got;
+};
+
+static Result Run(DWORD window, DWORD poolFrames, const WORD * seqs, DWORD num)
+{
+	Result res;
+	AstFrameBuffer fb(false, false, window);
+	struct ast_frame f;
+	BYTE payload[160];
+
+	memset(&f, 0, sizeof(f));
+	memset(payload, 0xFF, sizeof(payload));
+	f.frametype = AST_FRAME_VOICE;
+	f.data = payload;
+	f.datalen = sizeof(payload);
+	f.samples = 160;
+
+	//Same watermark than mp4save
+	fb.SetMaxWaitTime(60);
+	if (poolFrames) fb.EnablePool(poolFrames, sizeof(payload));
+
+	res.got = 0;
+	allocs = 0;
+	QWORD ini = getTime();
+	for (DWORD i=0; i<num; i++)
+	{
+		struct ast_frame * out;
+
+		f.seqno = seqs[i];
+		fb.Add(&f);
+		while ((out = fb.Wait(false)))
+		{
+			fb.Release(out);
+			res.got++;
+		}
+	}
+	QWORD end = getTime();
+
+	res.nsPerPacket = (end-ini)*1000.0/num;
+	res.allocsPerPacket = (double) allocs/num;
+
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	DWORD num = argc>1 ? atoi(argv[1]) : 2000000;
+	WORD * seqs = (WORD *) malloc(num*sizeof(WORD));
+
+	SetLogFunctions(Quiet, Quiet, Quiet);
+
+	//64 channels of 20ms packets
+	const double pps = 64*50;
+
+	printf("%-10s %-10s %10s %10s %12s %10s\n", "stream", "backend", "ns/pkt", "allocs/pkt", "allocs/s@64", "out");
+	for (int t=InOrder; t<=Lossy; t++)
+	{
+		DWORD n = MakeStream((Stream) t, seqs, num);
+		Result map = Run(0, 0, seqs, n);
+		Result ring = Run(256, 0, seqs, n);
+		Result pool = Run(256, 128, seqs, n);
+		printf("%-10s %-10s %10.1f %10.2f %12.0f %10u\n", streamNames[t], "map", map.nsPerPacket, map.allocsPerPacket, map.allocsPerPacket*pps, map.got);
+		printf("%-10s %-10s %10.1f %10.2f %12.0f %10u\n", streamNames[t], "ring", ring.nsPerPacket, ring.allocsPerPacket, ring.allocsPerPacket*pps, ring.got);
+		printf("%-10s %-10s %10.1f %10.2f %12.0f %10u\n", streamNames[t], "ring+pool", pool.nsPerPacket, pool.allocsPerPacket, pool.allocsPerPacket*pps, pool.got);
+	}
+
+	free(seqs);
+	return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * File:   benchframescaler.cpp
+ *
+ * Compare FrameScaler writing through its intermediate buffer, forced with a
+ * destination not aligned, and writing directly to an aligned destination.
+ * Both must give the same picture.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <medkit/tools.h>
+#include <medkit/framescaler.h>
+
+struct Size
+{
+	const char *	name;
+	int		width;
+	int		height;
+};
+
+static Size sizes[] = {
+	{ "qcif",	176,	144 },
+	{ "cif",	352,	288 },
+	{ "vga",	640,	480 },
+	{ "720p",	1280,	720 }
+};
+
+#define NUM_SIZES	(sizeof(sizes)/sizeof(sizes[0]))
+
+/* Scale iterations and return the time per picture in us */
+static double Scale(FrameScaler & scaler, BYTE * src, const Size & in, BYTE * dst, const Size & out, int iterations)
+{
+	DWORD srcPixels = in.width*in.height;
+	DWORD dstPixels = out.width*out.height;
+
+	QWORD ini = getTime();
+
+	for (int i=0;i<iterations;i++)
+		scaler.Resize(src,src+srcPixels,src+srcPixels*5/4,dst,dst+dstPixels,dst+dstPixels*5/4);
+
+	return (double)(getTime()-ini)/iterations;
+}
+
+int main(int argc, char ** argv)
+{
+	int iterations = argc>1 ? atoi(argv[1]) : 200;
+	int errors = 0;
+
+	printf("%-6s -> %-6s %10s %10s %8s\n","src","dst","tmp(us)","direct(us)","direct");
+
+	for (unsigned int i=0;i<NUM_SIZES;i++)
+	{
+		for (unsigned int j=0;j<NUM_SIZES;j++)
+		{
+			const Size & in = sizes[i];
+			const Size & out = sizes[j];
+
+			if (i==j)
+				continue;
+
+			DWORD srcSize = in.width*in.height*3/2;
+			DWORD dstSize = out.width*out.height*3/2;
+
+			/* Source with some detail */
+			BYTE * src = (BYTE*)malloc(srcSize);
+			for (DWORD k=0;k<srcSize;k++)
+				src[k] = (k*7 + k/in.width*3 + rand()%16) & 0xFF;
+
+			/* Aligned destination and one starting at an odd address */
+			BYTE * alignedBuffer = (BYTE*)malloc(dstSize+32);
+			BYTE * oddBuffer = (BYTE*)malloc(dstSize+33);
+			BYTE * aligned = ALIGNTO32(alignedBuffer);
+			BYTE * odd = ALIGNTO32(oddBuffer);
+			odd++;
+
+			FrameScaler scaler;
+			scaler.SetResize(in.width,in.height,in.width,out.width,out.height,out.width);
+
+			DWORD dstPixels = out.width*out.height;
+			bool direct = scaler.IsDirect(aligned,aligned+dstPixels,aligned+dstPixels*5/4);
+
+			double tmp = Scale(scaler,src,in,odd,out,iterations);
+			double dir = Scale(scaler,src,in,aligned,out,iterations);
+
+			if (memcmp(odd,aligned,dstSize))
+			{
+				printf("%-6s -> %-6s pictures differ\n",in.name,out.name);
+				errors++;
+			}
+
+			printf("%-6s -> %-6s %10.1f %10.1f %8s\n",in.name,out.name,tmp,dir,direct ? "yes" : "no");
+
+			free(src);
+			free(alignedBuffer);
+			free(oddBuffer);
+		}
+	}
+
+	return errors;
+}
@@ -0,0 +1,139 @@
+/*
+ * File:   benchg711.cpp
+ *
+ * Convert 20 ms frames of noise with the g711.c functions one sample at a
+ * time, as the PCMU and PCMA codecs did before, and with the batch functions,
+ * checking both give the same output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <medkit/tools.h>
+#include "g711/g711.h"
+#include "g711/g711batch.h"
+
+#define FRAME 160
+
+enum Test
+{
+	ULawSample, ULawTable, ULawBatch,
+	ALawSample, ALawTable, ALawBatch,
+	ULawDecodeSample, ULawDecodeBatch,
+	ALawDecodeSample, ALawDecodeBatch,
+	ULawToALawSample, ULawToALawBatch,
+	NumTests
+};
+
+static const char * names[NumTests] =
+{
+	"linear2ulaw", "G711LinearToULawTable", "G711LinearToULaw",
+	"linear2alaw", "G711LinearToALawTable", "G711LinearToALaw",
+	"ulaw2linear", "G711ULawToLinear",
+	"alaw2linear", "G711ALawToLinear",
+	"ulaw2alaw", "G711ULawToALaw"
+};
+
+static void Run(int test, const SWORD * pcm, const BYTE * law, SWORD * out, BYTE * codes)
+{
+	switch (test)
+	{
+		case ULawSample:
+			for (int j=0; j<FRAME; j++) codes[j] = linear2ulaw(pcm[j]);
+			break;
+		case ULawTable:
+			G711LinearToULawTable(pcm, codes, FRAME);
+			break;
+		case ULawBatch:
+			G711LinearToULaw(pcm, codes, FRAME);
+			break;
+		case ALawSample:
+			for (int j=0; j<FRAME; j++) codes[j] = linear2alaw(pcm[j]);
+			break;
+		case ALawTable:
+			G711LinearToALawTable(pcm, codes, FRAME);
+			break;
+		case ALawBatch:
+			G711LinearToALaw(pcm, codes, FRAME);
+			break;
+		case ULawDecodeSample:
+			for (int j=0; j<FRAME; j++) out[j] = ulaw2linear(law[j]);
+			break;
+		case ULawDecodeBatch:
+			G711ULawToLinear(law, out, FRAME);
+			break;
+		case ALawDecodeSample:
+			for (int j=0; j<FRAME; j++) out[j] = alaw2linear(law[j]);
+			break;
+		case ALawDecodeBatch:
+			G711ALawToLinear(law, out, FRAME);
+			break;
+		case ULawToALawSample:
+			for (int j=0; j<FRAME; j++) codes[j] = ulaw2alaw(law[j]);
+			break;
+		case ULawToALawBatch:
+			G711ULawToALaw(law, codes, FRAME);
+			break;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	DWORD frames = argc>1 ? atoi(argv[1]) : 50000;
+	std::vector<SWORD> pcm(frames*FRAME);
+	std::vector<BYTE> law(frames*FRAME);
+	std::vector<SWORD> out(FRAME);
+	std::vector<BYTE> codes(FRAME);
+	std::vector<BYTE> expected(frames*FRAME);
+
+	srand(1);
+
+	/* Mostly quiet with some loud samples, all segments are used */
+	for (DWORD i=0; i<pcm.size(); i++)
+	{
+		int amplitude = rand() % 8 ? 2048 : 32768;
+		pcm[i] = (SWORD) (rand() % (2*amplitude) - amplitude);
+		law[i] = rand();
+	}
+
+	printf("%u frames of %u samples\n", frames, FRAME);
+	printf("%-24s %12s\n", "function", "Msamples/s");
+
+	for (int test=0; test<NumTests; test++)
+	{
+		QWORD ini = getTime();
+
+		for (DWORD i=0; i<frames; i++)
+			Run(test, &pcm[i*FRAME], &law[i*FRAME], &out[0], &codes[0]);
+
+		QWORD us = getTime() - ini;
+		printf("%-24s %12.1f\n", names[test], us ? (double) frames*FRAME/us : 0);
+	}
+
+	/* Same codes as the g711.c functions */
+	for (DWORD i=0; i<pcm.size(); i++)
+		expected[i] = linear2ulaw(pcm[i]);
+	for (DWORD i=0; i<frames; i++)
+	{
+		G711LinearToULaw(&pcm[i*FRAME], &codes[0], FRAME);
+		if (memcmp(&codes[0], &expected[i*FRAME], FRAME))
+		{
+			printf("G711LinearToULaw differs from linear2ulaw in frame %u\n", i);
+			return 1;
+		}
+	}
+
+	for (DWORD i=0; i<pcm.size(); i++)
+		expected[i] = linear2alaw(pcm[i]);
+	for (DWORD i=0; i<frames; i++)
+	{
+		G711LinearToALaw(&pcm[i*FRAME], &codes[0], FRAME);
+		if (memcmp(&codes[0], &expected[i*FRAME], FRAME))
+		{
+			printf("G711LinearToALaw differs from linear2alaw in frame %u\n", i);
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * File:   benchstartcode.cpp
+ *
+ * Split an H.264 Annex B stream in NAL units with the byte by byte loop
+ * VideoFrame used before and with H264FindStartCode, checking the kernel
+ * finds every NAL unit of the stream.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <medkit/tools.h>
+#include "h264/h264startcode.h"
+
+/* Previous VideoFrame::DetectNaluBoundary */
+static DWORD DetectNaluBoundary(BYTE * p, DWORD sz)
+{
+	DWORD l;
+
+	for (l = 0; l+4 < sz; l++)
+	{
+		if (p[l] == 0 && p[l+1] == 0)
+		{
+			if (p[l+2] == 1)
+			{
+				return l;
+			}
+		}
+		else if(p[l+2] == 0 && p[l+3] == 1)
+		{
+			return l;;
+		}
+	}
+
+	if (l+3 < sz)
+	{
+		if (p[l] == 0 && p[l+1] == 0)
+		{
+			if (p[l+2] == 1)
+			{
+				return l;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* NAL units of random sizes with emulation prevention, so only start codes have 00 00 0x */
+static void Generate(std::vector<BYTE> & stream, std::vector<DWORD> & starts, DWORD size)
+{
+	srand(1);
+
+	while (stream.size() < size)
+	{
+		DWORD len = 20 + rand() % 1500;
+		DWORD zeros = 0;
+
+		starts.push_back(stream.size());
+		stream.push_back(0);
+		stream.push_back(0);
+		stream.push_back(0);
+		stream.push_back(1);
+		stream.push_back(0x41);
+
+		for (DWORD i=0; i<len; i++)
+		{
+			// Mostly small values as in CAVLC residuals
+			BYTE b = rand() % 4 ? rand() % 4 : rand();
+
+			if (zeros == 2 && b <= 3)
+			{
+				stream.push_back(3);
+				zeros = 0;
+			}
+			stream.push_back(b);
+			zeros = b ? 0 : zeros+1;
+		}
+
+		// No trailing zero
+		if (stream.back() == 0)
+			stream.push_back(0x80);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	DWORD megabytes = argc>1 ? atoi(argv[1]) : 16;
+	DWORD loops = argc>2 ? atoi(argv[2]) : 10;
+	std::vector<BYTE> stream;
+	std::vector<DWORD> starts;
+
+	Generate(stream, starts, megabytes*1024*1024);
+
+	BYTE * p = &stream[0];
+	DWORD size = stream.size();
+
+	/* Kernel must find every start code */
+	DWORD n = 0;
+	for (DWORD l = H264FindStartCode(p, size); l < size; n++)
+	{
+		if (n >= starts.size() || l != starts[n])
+		{
+			printf("Start code %u found at %u instead of %u\n", n, l, n < starts.size() ? starts[n] : size);
+			return 1;
+		}
+		l += 4;
+		l += H264FindStartCode(p + l, size - l);
+	}
+	if (n != starts.size())
+	{
+		printf("Found %u start codes instead of %u\n", n, (DWORD) starts.size());
+		return 1;
+	}
+
+	DWORD last = starts.back();
+
+	/* The loop also stops on xx yy 00 01 inside NAL units */
+	printf("%u MB, %u NAL units, %u loops\n", megabytes, n, loops);
+	printf("%-8s %10s %10s\n", "scan", "MB/s", "nalus");
+
+	for (int m=0; m<2; m++)
+	{
+		QWORD ini = getTime();
+		DWORD nalus = 0;
+
+		for (DWORD i=0; i<loops; i++)
+		{
+			DWORD l = 4;
+
+			// Up to the last NAL unit
+			while (l < last)
+			{
+				DWORD sz = m == 0 ? DetectNaluBoundary(p + l, size - l) : H264FindStartCode(p + l, size - l);
+
+				// The loop also returns 0 when there is none
+				if (sz == 0)
+				{
+					l++;
+					continue;
+				}
+
+				// Next NAL unit after its start code
+				while (p[l+sz] == 0) sz++;
+				l += sz + 1;
+				nalus++;
+			}
+		}
+
+		QWORD us = getTime() - ini;
+		printf("%-8s %10.1f %10u\n", m == 0 ? "loop" : "kernel", us ? (double) size*loops/us : 0, nalus/loops);
+	}
+
+	return 0;
+}
@@ -1,10 +1,19 @@
 #include <poll.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include <stdio.h>
 #include <medkit/log.h>
 #include <astmedkit/framebuffer.h>
 
-AstFrameBuffer::AstFrameBuffer(bool blocking, bool fifo)
+static DWORD RoundToPowerOfTwo(DWORD n)
+{
+	DWORD size = 1;
+	while (size < n) size <<= 1;
+	return size;
+}
+
+AstFrameBuffer::AstFrameBuffer(bool blocking, bool fifo, DWORD window)
 {
 	int flags;
 	//NO wait time
@@ -32,6 +41,31 @@ AstFrameBuffer::AstFrameBuffer(bool blocking, bool fifo)
 	signalled = false;
 	
 	traceFile = NULL;
+	efd = FD_INVALID;
+	nbLost = 0;
+
+	//Circular backend
+	ring = NULL;
+	ringMask = 0;
+	ringCount = 0;
+	ringWaiters = 0;
+	ringOverflows = 0;
+
+	//No frame pool
+	pool = NULL;
+	poolFree = NULL;
+	poolSlabSize = 0;
+	poolDataSize = 0;
+	poolLength = 0;
+	poolMisses = 0;
+	
+	if (window)
+	{
+		DWORD size = RoundToPowerOfTwo(window);
+		//Allocate empty slots
+		ring = (RingSlot *) calloc(size, sizeof(RingSlot));
+		ringMask = size - 1;
+	}
 }
 
 AstFrameBuffer::~AstFrameBuffer()
@@ -39,98 +73,165 @@ AstFrameBuffer::~AstFrameBuffer()
 	pthread_mutex_destroy(&mutex);
 	pthread_cond_destroy(&cond);
     Clear();
+	if (ring) free(ring);
+	if (pool) free(pool);
 	if (traceFile) fclose(traceFile);
+	if (efd != FD_INVALID) close(efd);
 }
 
-void AstFrameBuffer::Notify()
+void AstFrameBuffer::Signal()
 {
-	pthread_cond_signal(pcond);
+	//Only one write until the reader rearms it
+	if (__sync_bool_compare_and_swap(&signalled, false, true))
+	{
+		uint64_t one = 1;
+		if (write(efd, &one, sizeof(one)) < 0)
+			Error("-Failed to signal frame buffer eventfd [%d]\n", errno);
+	}
 }
 
-
-bool AstFrameBuffer::Add(const ast_frame * f, bool ignore_cseq)
+void AstFrameBuffer::Notify()
 {
-	DWORD seq;
-	ast_frame * f2;
-	
-	pthread_mutex_lock(&mutex);
-	if (cancel) 
+	//Wake up set waiting on us
+	if (efd != FD_INVALID) Signal();
+
+	if (ring)
 	{
-		pthread_mutex_unlock(&mutex);
-		return false;
+		//Producer does not hold the mutex, only wake up readers that may sleep.
+		//External conditions are shared by readers we do not know of.
+		if (ringWaiters || pcond != &cond)
+		{
+			pthread_mutex_lock(&mutex);
+			pthread_cond_signal(pcond);
+			pthread_mutex_unlock(&mutex);
+		}
+		return;
 	}
-	
+	pthread_cond_signal(pcond);
+}
+
+bool AstFrameBuffer::NextSeq(const ast_frame * f, bool ignore_cseq, DWORD & seq)
+{
 	if (ignore_cseq || isfifo)
 	{
 		seq = dummyCseq;
 		dummyCseq++;
+		return true;
 	}
-	else
-	{
-		seq = f->seqno + cycle*0x10000;
-		
-		// Ignoring strange frames
-		if (f->seqno > 0xFFFF)
-		{
-			ast_log(LOG_NOTICE, "Invalid seqno %d for frame.\n", f->seqno);
-			pthread_mutex_unlock(&mutex);
-			return false;
-		}
-		
-		if (f->seqno == 0xFFFF)
-		{
-			cycle++;
-		}
-		else if (seq < dummyCseq && dummyCseq-seq > 0xF000 )
-		{
-			// We missed the cycle because of packet loss ... 
-			cycle++;
-			// We need to reecompute seq
-			seq = f->seqno + cycle*0x10000;
-		}
-		dummyCseq = seq + 1;
 
-		if (packets.find(seq) != packets.end())
-		{
-			//ast_log(LOG_DEBUG, "Received duplicate packet %ld.\n", seq);
-			if (traceFile) fprintf(traceFile, "ADD: duplicate packet seq %lu\n", seq);
-			pthread_mutex_unlock(&mutex);
-			return false;
-		}
+	// Ignoring strange frames
+	if (f->seqno > 0xFFFF)
+	{
+		ast_log(LOG_NOTICE, "Invalid seqno %d for frame.\n", f->seqno);
+		return false;
 	}
+
+	seq = f->seqno + cycle*0x10000;
 		
-	//ast_log(LOG_DEBUG, "Adding packet %p seq=%ld, isfifo=%d, ignorecseq=%d.\n", this, seq, isfifo, ignore_cseq);
+	if (f->seqno == 0xFFFF)
+	{
+		cycle++;
+	}
+	else if (seq < dummyCseq && dummyCseq-seq > 0xF000 )
+	{
+		// We missed the cycle because of packet loss ... 
+		cycle++;
+		// We need to reecompute seq
+		seq = f->seqno + cycle*0x10000;
+	}
+	dummyCseq = seq + 1;
+	return true;
+}
+
+bool AstFrameBuffer::IsPast(DWORD seq)
+{
+	DWORD first = next;
 
 	//If already past
-	if (next != (DWORD)-1 && seq < next && isfifo == 0)
+	if (first != (DWORD)-1 && seq < first && isfifo == 0)
 	{
 		//Delete pacekt
 		//Skip it and lost forever
 		if ( bigJumps > 20)
 		{
 			ast_log(LOG_WARNING, "Too many out of sequence packet. Resyncing.\n");
-			if (traceFile) fprintf(traceFile,  "ADD: seq=%lu < next=%lu: too many out of sequence packet\n", seq, next);
+			if (traceFile) fprintf(traceFile,  "ADD: seq=%lu < next=%lu: too many out of sequence packet\n", seq, first);
 			hurryUp  = true;
 			bigJumps = 0;
 			
 		}
 		else 
 		{
-			DWORD diff = next-seq;
+			DWORD diff = first-seq;
 
 			if (diff > 10)
 			{
-				Log("-Out of order non recoverable packet: %p seq=%u, next=%u diff=%u\n", this, seq, next, diff);
+				Log("-Out of order non recoverable packet: %p seq=%u, next=%u diff=%u\n", this, seq, first, diff);
 				bigJumps++;
 			}
-			if (traceFile) fprintf(traceFile, "ADD: seq=%lu < next=%lu: out of sequence packet. dropping it\n", seq, next);
-			pthread_mutex_unlock(&mutex);
-			return false;
+			if (traceFile) fprintf(traceFile, "ADD: seq=%lu < next=%lu: out of sequence packet. dropping it\n", seq, first);
+			return true;
 		}
 	}
+	return false;
+}
+
+
+bool AstFrameBuffer::Add(const ast_frame * f, bool ignore_cseq)
+{
+	return Push(f, ignore_cseq, false);
+}
+
+bool AstFrameBuffer::Take(ast_frame * f, bool ignore_cseq)
+{
+	//We own it even if rejected
+	if (!Push(f, ignore_cseq, true))
+	{
+		ast_frfree(f);
+		return false;
+	}
+	return true;
+}
+
+bool AstFrameBuffer::Push(const ast_frame * f, bool ignore_cseq, bool owned)
+{
+	DWORD seq;
+	ast_frame * f2;
+	
+	//Lock-free path
+	if (ring) return PushRing(f, ignore_cseq, owned);
+
+	pthread_mutex_lock(&mutex);
+	if (cancel) 
+	{
+		pthread_mutex_unlock(&mutex);
+		return false;
+	}
+	
+	if (!NextSeq(f, ignore_cseq, seq))
+	{
+		pthread_mutex_unlock(&mutex);
+		return false;
+	}
+
+	if (!ignore_cseq && !isfifo && packets.find(seq) != packets.end())
+	{
+		//ast_log(LOG_DEBUG, "Received duplicate packet %ld.\n", seq);
+		if (traceFile) fprintf(traceFile, "ADD: duplicate packet seq %lu\n", seq);
+		pthread_mutex_unlock(&mutex);
+		return false;
+	}
+		
+	//ast_log(LOG_DEBUG, "Adding packet %p seq=%ld, isfifo=%d, ignorecseq=%d.\n", this, seq, isfifo, ignore_cseq);
+
+	if (IsPast(seq))
+	{
+		pthread_mutex_unlock(&mutex);
+		return false;
+	}
 
 	//Add event
-	f2 = ast_frdup(f);
+	f2 = Store(f, owned);
 	
 	// 0 = use native CSEQ
 	// 1 = overwrite CSEQ
@@ -147,6 +248,59 @@ bool AstFrameBuffer::Add(const ast_frame * f, bool ignore_cseq)
 	return true;
 }
 
+bool AstFrameBuffer::PushRing(const ast_frame * f, bool ignore_cseq, bool owned)
+{
+	DWORD seq;
+	ast_frame * f2;
+
+	if (cancel) return false;
+
+	//Sequence state is only touched by the producer
+	if (!NextSeq(f, ignore_cseq, seq)) return false;
+
+	RingSlot * slot = &ring[seq & ringMask];
+	//Get slot state released by the consumer
+	bool busy = (slot->frame != NULL);
+	__sync_synchronize();
+
+	if (busy && !ignore_cseq && !isfifo && slot->seq == seq)
+	{
+		if (traceFile) fprintf(traceFile, "ADD: duplicate packet seq %lu\n", seq);
+		return false;
+	}
+
+	if (IsPast(seq)) return false;
+
+	//Slot still used by a packet one window away, reader is too late
+	if (busy)
+	{
+		ringOverflows++;
+		if (traceFile) fprintf(traceFile, "ADD: seq=%lu next=%lu: ring overflow. dropping it\n", seq, next);
+		//Let the reader catch up
+		hurryUp = true;
+		Notify();
+		return false;
+	}
+
+	//Add event
+	f2 = Store(f, owned);
+
+	if (ignore_cseq) f2->seqno = (seq & 0xFFFF);
+
+	//Publish frame after its seq
+	slot->seq = seq;
+	__sync_synchronize();
+	slot->frame = f2;
+	//Full barrier, see Wait()
+	__sync_fetch_and_add(&ringCount, 1);
+	if (traceFile) fprintf(traceFile, "ADD: seq=%lu - normal case\n", seq);
+
+	//Signal
+	Notify();
+
+	return true;
+}
+
 void  AstFrameBuffer::Cancel()
 {
 	//Lock
@@ -206,19 +360,19 @@ struct ast_frame * AstFrameBuffer::Wait(bool block)
 	//Lock
 	pthread_mutex_lock(&mutex);
 	
+	//Tell the ring producer we may sleep on the condition. It is done before
+	//looking at the slots so either we see its frame or it sees us waiting.
+	if (ring && blocking && block) __sync_fetch_and_add(&ringWaiters, 1);
+
 	len = 0;
 	//While we have to wait
 	while (!cancel)
 	{
 		//Check if we have somethin in queue. In non blocking mode
 		//we need three packets at least
-		if ( ! packets.empty() )
+		DWORD seq;
+		if ( PeekPacket(seq) )
 		{
-			RTPOrderedPackets::iterator it = packets.begin();
-			//Get first seq num
-			DWORD seq = it->first;
-			//Get packet
-			struct ast_frame * candidate = it->second;
 			//Get time of the packet
 /*
 			if (seq != next)
@@ -228,7 +382,6 @@ struct ast_frame * AstFrameBuffer::Wait(bool block)
 			if (HasPacketReady(seq))
 			{
 				//We have it!
-				rtp = it->second;
 				nbLost = 0;
 
 				if (seq==next) 
@@ -260,7 +413,7 @@ struct ast_frame * AstFrameBuffer::Wait(bool block)
 				
 			        //Log("Got packet buff=%p seq=%lu, next=%lu, blocking=%d\n", this, seq, next, blocking);
 				//Remove it
-				packets.erase(it);
+				rtp = PopPacket(seq);
 				//Return it!
 				break;
 			}
@@ -268,7 +421,7 @@ struct ast_frame * AstFrameBuffer::Wait(bool block)
 			if (seq < next)
 			{
 				if (traceFile) fprintf(traceFile, "GET: dropping paquet seq=%lu, next=%lu\n", seq, next);
-				packets.erase(it);
+				Release(PopPacket(seq));
 				continue;
 			}
 		} 
@@ -307,19 +460,116 @@ struct ast_frame * AstFrameBuffer::Wait(bool block)
 		}
 	}
 	
+	if (ring && blocking && block) __sync_fetch_and_sub(&ringWaiters, 1);
+
 	pthread_mutex_unlock(&mutex);
 	
 	//canceled
 	return rtp;
 }
 
+bool AstFrameBuffer::PeekPacket(DWORD & seq)
+{
+	if (ring) return PeekRing(seq);
+
+	if (packets.empty()) return false;
+
+	//Get first seq num
+	seq = packets.begin()->first;
+	return true;
+}
+
+bool AstFrameBuffer::PeekRing(DWORD & seq)
+{
+	bool found = false;
+
+	if (!ringCount) return false;
+
+	DWORD first = next;
+	//When resyncing or starting we need the lowest seq of all, as the map does
+	bool lowest = (first == (DWORD)-1 || hurryUp);
+	DWORD start = lowest ? 0 : first;
+
+	//Walk slots in sequence order from the one expected
+	for (DWORD i=0; i<=ringMask; i++)
+	{
+		RingSlot * slot = &ring[(start+i) & ringMask];
+
+		if (!slot->frame) continue;
+		//Read seq after the frame was published
+		__sync_synchronize();
+		DWORD s = slot->seq;
+
+		if (!lowest)
+		{
+			if (s < first)
+			{
+				//Added after we had gone past it
+				if (traceFile) fprintf(traceFile, "GET: dropping paquet seq=%lu, next=%lu\n", s, first);
+				Release(PopPacket(s));
+				continue;
+			}
+			//First one in window is the lowest one
+			if (s - first <= ringMask)
+			{
+				seq = s;
+				return true;
+			}
+		}
+
+		if (!found || s < seq)
+		{
+			seq = s;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+struct ast_frame * AstFrameBuffer::PopPacket(DWORD seq)
+{
+	struct ast_frame * f;
+
+	if (ring)
+	{
+		RingSlot * slot = &ring[seq & ringMask];
+		f = slot->frame;
+		//Release slot to the producer
+		__sync_synchronize();
+		slot->frame = NULL;
+		__sync_fetch_and_sub(&ringCount, 1);
+		return f;
+	}
+
+	//Always called on first one
+	RTPOrderedPackets::iterator it = packets.begin();
+	f = it->second;
+	packets.erase(it);
+	return f;
+}
+
 void AstFrameBuffer::ClearPackets()
 {
+	if (ring)
+	{
+		//Only release slots published by the producer
+		for (DWORD i=0; i<=ringMask; i++)
+		{
+			if (ring[i].frame)
+			{
+				__sync_synchronize();
+				Release(PopPacket(ring[i].seq));
+			}
+		}
+		return;
+	}
+
        //For each item, list shall be locked before
         for (RTPOrderedPackets::iterator it=packets.begin(); it!=packets.end(); ++it)
         {
                 //Delete rtp
-                ast_frfree(it->second);
+                Release(it->second);
         }
 
         //Clear all list
@@ -354,11 +604,11 @@ int AstFrameBuffer::WaitMulti(AstFrameBuffer * jbTab[], unsigned long nbjb, DWOR
 				{
 					if (jbTab[i])
 					{
+						DWORD seq;
 						pthread_mutex_lock(&jbTab[i]->mutex);
-						if (! jbTab[i]->packets.empty() )
+						if ( jbTab[i]->PeekPacket(seq) )
 						{
-							RTPOrderedPackets::iterator it = jbTab[i]->packets.begin();
-							if ( jbTab[i]->HasPacketReady(it->first) )
+							if ( jbTab[i]->HasPacketReady(seq) )
 							{
 								jbTabOut[i] = jbTab[i];
 								ret++;
@@ -381,6 +631,160 @@ int AstFrameBuffer::WaitMulti(AstFrameBuffer * jbTab[], unsigned long nbjb, DWOR
 	return -5;
 }
 
+static bool IsMalloced(const ast_frame * f)
+{
+	if (!(f->mallocd & AST_MALLOCD_HDR)) return false;
+	if (f->mallocd & AST_MALLOCD_DATA) return true;
+	//Data copied after the header by ast_frdup()
+	return !f->datalen || ( (BYTE *) f->data >= (BYTE *) f && (BYTE *) f->data < ((BYTE *) f) + f->mallocd_hdr_len );
+}
+
+bool AstFrameBuffer::EnablePool(DWORD frames, DWORD maxDataLen)
+{
+	//Only before adding the first frame
+	if (pool || !frames) return false;
+
+	//Header, source name and room for asterisk to prepend headers
+	poolDataSize = maxDataLen;
+	poolSlabSize = (sizeof(struct ast_frame) + POOL_SRC_LEN + AST_FRIENDLY_OFFSET + maxDataLen + 15) & ~15;
+	poolLength = frames*poolSlabSize;
+	pool = (BYTE *) malloc(poolLength);
+
+	if (!pool)
+	{
+		Error("-Failed to allocate frame pool of %u bytes\n", poolLength);
+		return false;
+	}
+
+	//Chain all slabs
+	for (DWORD i=0; i<frames; i++)
+	{
+		BYTE * slab = pool + i*poolSlabSize;
+		*(void **) slab = (i+1<frames) ? pool + (i+1)*poolSlabSize : NULL;
+	}
+	poolFree = pool;
+
+	return true;
+}
+
+struct ast_frame * AstFrameBuffer::Store(const ast_frame * f, bool owned)
+{
+	//Already a full copy we can keep
+	if (owned && IsMalloced(f))
+		return (ast_frame *) f;
+
+	struct ast_frame * f2 = NULL;
+
+	if (pool && f->datalen >= 0 && (DWORD) f->datalen <= poolDataSize)
+	{
+		void * slab;
+		void * rest;
+		//Only the producer pops, so no ABA here
+		do {
+			slab = poolFree;
+			if (!slab) break;
+			rest = *(void **) slab;
+		} while (!__sync_bool_compare_and_swap(&poolFree, slab, rest));
+
+		if (slab)
+		{
+			char * src = ((char *) slab) + sizeof(struct ast_frame);
+			BYTE * data = ((BYTE *) src) + POOL_SRC_LEN + AST_FRIENDLY_OFFSET;
+
+			f2 = (struct ast_frame *) slab;
+			memcpy(f2, f, sizeof(struct ast_frame));
+			AST_LIST_NEXT(f2, frame_list) = NULL;
+			//Not owned by asterisk, ast_frfree() leaves it alone
+			f2->mallocd = 0;
+			f2->mallocd_hdr_len = 0;
+			f2->offset = AST_FRIENDLY_OFFSET;
+			f2->data = data;
+			if (f->datalen) memcpy(data, f->data, f->datalen);
+			f2->src = NULL;
+			if (f->src && strlen(f->src) < POOL_SRC_LEN)
+			{
+				strcpy(src, f->src);
+				f2->src = src;
+			}
+		}
+	}
+
+	if (!f2)
+	{
+		//Pool empty or too big
+		if (pool) poolMisses++;
+		f2 = ast_frdup(f);
+	}
+
+	//Free the original header or data
+	if (owned) ast_frfree((ast_frame *) f);
+
+	return f2;
+}
+
+bool AstFrameBuffer::Recycle(struct ast_frame * f)
+{
+	BYTE * slab = (BYTE *) f;
+
+	if (!pool || slab < pool || slab >= pool+poolLength)
+		return false;
+
+	void * head;
+	//Several readers may give back frames
+	do {
+		head = poolFree;
+		*(void **) slab = head;
+	} while (!__sync_bool_compare_and_swap(&poolFree, head, (void *) slab));
+
+	return true;
+}
+
+void AstFrameBuffer::Release(struct ast_frame * f)
+{
+	if (!f) return;
+	if (!Recycle(f)) ast_frfree(f);
+}
+
+int AstFrameBuffer::EnableEventFd()
+{
+	pthread_mutex_lock(&mutex);
+	if (efd == FD_INVALID)
+	{
+		//Created signalled so first wait checks packets already queued
+		signalled = true;
+		efd = eventfd(1, EFD_NONBLOCK);
+		if (efd == FD_INVALID)
+			Error("-Failed to create frame buffer eventfd [%d]\n", errno);
+	}
+	pthread_mutex_unlock(&mutex);
+	return efd;
+}
+
+bool AstFrameBuffer::IsReady()
+{
+	DWORD seq;
+	uint64_t count;
+
+	pthread_mutex_lock(&mutex);
+
+	bool ready = PeekPacket(seq) && HasPacketReady(seq);
+
+	if (!ready && efd != FD_INVALID)
+	{
+		//Rearm before draining, so a producer adding now will signal again
+		signalled = false;
+		__sync_synchronize();
+		read(efd, &count, sizeof(count));
+		//Check frames added in between
+		ready = PeekPacket(seq) && HasPacketReady(seq);
+		if (ready) Signal();
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	return ready;
+}
+
 bool AstFrameBuffer::OpenTraceFile(const char * filename)
 {
 	if (traceFile == NULL)
@@ -398,6 +802,95 @@ bool AstFrameBuffer::OpenTraceFile(const char * filename)
 }
 			
 		
+AstFrameBufferSet::AstFrameBufferSet()
+{
+	epfd = epoll_create(64);
+	if (epfd == FD_INVALID)
+		Error("-Failed to create frame buffer set [%d]\n", errno);
+	pthread_mutex_init(&mutex,NULL);
+}
+
+AstFrameBufferSet::~AstFrameBufferSet()
+{
+	if (epfd != FD_INVALID) close(epfd);
+	pthread_mutex_destroy(&mutex);
+}
+
+bool AstFrameBufferSet::Add(AstFrameBuffer * fb)
+{
+	struct epoll_event ev;
+	int fd = fb->EnableEventFd();
+
+	if (epfd == FD_INVALID || fd == FD_INVALID) return false;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = fb;
+
+	pthread_mutex_lock(&mutex);
+	bool ok = (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0);
+	if (ok) 
+		buffers.insert(fb);
+	else
+		Error("-Failed to add frame buffer %p to set [%d]\n", fb, errno);
+	pthread_mutex_unlock(&mutex);
+
+	return ok;
+}
+
+bool AstFrameBufferSet::Remove(AstFrameBuffer * fb)
+{
+	struct epoll_event ev;
+
+	pthread_mutex_lock(&mutex);
+	bool ok = buffers.erase(fb) > 0;
+	//Event is ignored but needed by old kernels
+	if (ok) epoll_ctl(epfd, EPOLL_CTL_DEL, fb->GetEventFd(), &ev);
+	pthread_mutex_unlock(&mutex);
+
+	return ok;
+}
+
+int AstFrameBufferSet::Wait(DWORD maxWaitTime, AstFrameBuffer * fbOut[], unsigned long maxOut)
+{
+	int num = 0;
+
+	if (epfd == FD_INVALID || !maxOut) return -1;
+
+	//Only one reader, no need to lock
+	if (events.size() < maxOut) events.resize(maxOut);
+
+	int ret = epoll_wait(epfd, &events[0], maxOut, maxWaitTime);
+
+	if (ret < 0)
+	{
+		//Signal received
+		if (errno == EINTR) return 0;
+		Error("-Frame buffer set wait error [%d]\n", errno);
+		return -1;
+	}
+
+	if (ret == 0)
+	{
+		//Timeout, same as WaitMulti
+		pthread_mutex_lock(&mutex);
+		for (Buffers::iterator it=buffers.begin(); it!=buffers.end(); ++it)
+			if ((*it)->Length() > 2) (*it)->HurryUp();
+		pthread_mutex_unlock(&mutex);
+		return 0;
+	}
+
+	//Only check notified buffers
+	for (int i=0; i<ret; i++)
+	{
+		AstFrameBuffer * fb = (AstFrameBuffer *) events[i].data.ptr;
+		if (fb->IsReady())
+			fbOut[num++] = fb;
+	}
+
+	return num;
+}
+
 /* ------------------------ C API ------------------------------------ */
 
 struct AstFb *AstFbCreate(unsigned long maxWaitTime, int blocking, int fifo)
@@ -410,6 +903,16 @@ struct AstFb *AstFbCreate(unsigned long maxWaitTime, int blocking, int fifo)
 	return (struct AstFb *) fb;
 }
 
+struct AstFb *AstFbCreateRing(unsigned long maxWaitTime, int blocking, int fifo, unsigned long window)
+{
+	AstFrameBuffer * fb = new AstFrameBuffer((bool) blocking, (bool) fifo, window);
+	if (fb)
+	{
+		fb->SetMaxWaitTime(maxWaitTime);
+	}
+	return (struct AstFb *) fb;
+}
+
 int AstFbAddFrame( struct AstFb *fb, const struct ast_frame *f )
 {
 	return ((AstFrameBuffer *) fb)->Add( f, false );
@@ -420,6 +923,26 @@ int AstFbAddFrameNoCseq( struct AstFb *fb, const struct ast_frame *f )
 	return ((AstFrameBuffer *) fb)->Add( f, true );
 }
 
+int AstFbTakeFrame( struct AstFb *fb, struct ast_frame *f )
+{
+	return ((AstFrameBuffer *) fb)->Take( f, false );
+}
+
+int AstFbEnablePool( struct AstFb *fb, unsigned long frames, unsigned long maxDataLen )
+{
+	return ((AstFrameBuffer *) fb)->EnablePool( frames, maxDataLen );
+}
+
+void AstFbReleaseFrame( struct AstFb *fb, struct ast_frame *f )
+{
+	((AstFrameBuffer *) fb)->Release( f );
+}
+
+int AstFbRecycleFrame( struct AstFb *fb, struct ast_frame *f )
+{
+	return ((AstFrameBuffer *) fb)->Recycle( f );
+}
+
 struct ast_frame * AstFbGetFrame(struct AstFb *fb)
 {
 	return ((AstFrameBuffer *) fb)->Wait(false);
@@ -477,3 +1000,29 @@ void AstFbTrace(struct AstFb * fb, const char * filename)
 		fb2->OpenTraceFile(filename);
 	}
 }
+
+struct AstFbSet * AstFbSetCreate(void)
+{
+	return (struct AstFbSet *) new AstFrameBufferSet();
+}
+
+int AstFbSetAdd(struct AstFbSet * set, struct AstFb * fb)
+{
+	return ((AstFrameBufferSet *) set)->Add( (AstFrameBuffer *) fb );
+}
+
+int AstFbSetRemove(struct AstFbSet * set, struct AstFb * fb)
+{
+	return ((AstFrameBufferSet *) set)->Remove( (AstFrameBuffer *) fb );
+}
+
+int AstFbSetWait(struct AstFbSet * set, unsigned long maxWaitTime, struct AstFb * fbOut[], unsigned long maxOut)
+{
+	return ((AstFrameBufferSet *) set)->Wait( maxWaitTime, (AstFrameBuffer **) fbOut, maxOut );
+}
+
+void AstFbSetDestroy(struct AstFbSet * set)
+{
+	AstFrameBufferSet * set2 = (AstFrameBufferSet *) set;
+	if (set2) delete set2;
+}
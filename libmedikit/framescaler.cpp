@@ -19,13 +19,9 @@ FrameScaler::FrameScaler()
 	resizeHeight	= 0;
 	resizeDstWidth	= 0;
 	resizeDstHeight = 0;
-	resizeDstLineWidth = 0;
 
 	//tmp buffer
-	tmpWidth  	= 0;
-	tmpHeight 	= 0;
-	tmpBuffer	= NULL;
-	tmpBufferSize	= 0;
+	tmp		= NULL;
 	tmpY		= NULL;
 	tmpU		= NULL;
 	tmpV		= NULL;
@@ -36,9 +32,9 @@ FrameScaler::FrameScaler()
 FrameScaler::~FrameScaler()
 {
 	//Free mem
-	if (tmpBuffer)
-		//free
-		free(tmpBuffer);
+	if (tmp)
+		//Back to the pool
+		tmp->Release();
 	//If we got a context
 	if (resizeCtx)
 		//Closse context
@@ -46,9 +42,19 @@ FrameScaler::~FrameScaler()
 }
 
 int FrameScaler::SetResize(int srcWidth,int srcHeight,int srcLineWidth,int dstWidth,int dstHeight,int dstLineWidth)
+{
+	//Planar strides
+	int srcStride[3] = { srcLineWidth, srcLineWidth/2, srcLineWidth/2 };
+	int dstStride[3] = { dstLineWidth, dstLineWidth/2, dstLineWidth/2 };
+
+	//Set them
+	return SetResize(srcWidth,srcHeight,srcStride,dstWidth,dstHeight,dstStride);
+}
+
+int FrameScaler::SetResize(int srcWidth,int srcHeight,const int srcStride[3],int dstWidth,int dstHeight,const int dstStride[3])
 {
 	// Check Size
-	if (!srcWidth || !srcHeight || !srcLineWidth || !dstWidth || !dstHeight || !dstLineWidth)
+	if (!srcWidth || !srcHeight || !srcStride[0] || !dstWidth || !dstHeight || !dstStride[0])
 	{
 		//If we got a context
 		if (resizeCtx)
@@ -60,6 +66,13 @@ int FrameScaler::SetResize(int srcWidth,int srcHeight,int srcLineWidth,int dstWi
 		return 0;
 	}
 
+	// Set values for line sizes, they may change without changing the context
+	for (int i=0;i<3;++i)
+	{
+		resizeSrc[i] = srcStride[i];
+		resizeDst[i] = dstStride[i];
+	}
+
 	// Check if we already have a scaler for this
 	if (resizeCtx && (resizeWidth==srcWidth) && (srcHeight==resizeHeight) && (dstWidth==resizeDstWidth) && (dstHeight==resizeDstHeight))
 		//Done
@@ -101,43 +114,53 @@ int FrameScaler::SetResize(int srcWidth,int srcHeight,int srcLineWidth,int dstWi
 	resizeHeight 	= srcHeight;
 	resizeDstWidth	= dstWidth;
 	resizeDstHeight = dstHeight;
-	resizeDstLineWidth = dstLineWidth;
 
-	//to use MM2 we need the width and heinght to be multiple of 32
-	tmpWidth = (resizeDstWidth/32 +1)*32;
-	tmpHeight = (resizeDstHeight/32 +1)*32;
+	//Check if we had a tmp buffer for the previous size
+	if (tmp)
+		//Back to the pool
+		tmp->Release();
 
-	//Get tmp buffer size
-	tmpBufferSize = tmpWidth*tmpHeight*3/2+FF_INPUT_BUFFER_PADDING_SIZE+32;
+	//It is taken the first time the destination is not aligned
+	tmp = NULL;
 
-	//Check if we had it already
-	if (tmpBuffer)
-		//Free it
-		free(tmpBuffer);
+	// exit 
+	return 1;
+}
 
-	//Allocate it
-	tmpBuffer = (BYTE*)malloc(tmpBufferSize);
+int FrameScaler::AllocTmp()
+{
+	//to use MM2 we need aligned planes and lines
+	tmp = YUVPicturePool::Acquire(resizeDstWidth,resizeDstHeight,false);
 
 	// Set values for line sizes
-	resizeSrc[0] = srcLineWidth;
-	resizeSrc[1] = srcLineWidth/2;
-	resizeSrc[2] = srcLineWidth/2;
-	/*resizeDst[0] = dstLineWidth;
-	resizeDst[1] = dstLineWidth/2;
-	resizeDst[2] = dstLineWidth/2;*/
-	resizeDst[0] = tmpWidth;
-	resizeDst[1] = tmpWidth/2;
-	resizeDst[2] = tmpWidth/2;
+	tmpStride[0] = tmp->GetStride(0);
+	tmpStride[1] = tmp->GetStride(1);
+	tmpStride[2] = tmp->GetStride(2);
 
 	//Get tmp planes
-	tmpY = ALIGNTO32(tmpBuffer);
-	tmpU = tmpY+tmpWidth*tmpHeight;
-	tmpV = tmpU+tmpWidth*tmpHeight/4;
+	tmpY = tmp->GetPlane(0);
+	tmpU = tmp->GetPlane(1);
+	tmpV = tmp->GetPlane(2);
 
-	// exit 
+	//Done
 	return 1;
 }
 
+bool FrameScaler::IsDirect(BYTE *dstY, BYTE *dstU, BYTE *dstV)
+{
+	BYTE* dst[3] = { dstY, dstU, dstV };
+
+	//The SIMD code of swscale needs aligned lines
+	for (int i=0;i<3;++i)
+		//Check pointer and stride
+		if ((((QWORD)dst[i]) & 15) || (resizeDst[i] & 15))
+			//Use tmp buffer
+			return false;
+
+	//Scale in place
+	return true;
+}
+
 int FrameScaler::Resize(BYTE *srcY,BYTE *srcU,BYTE *srcV,BYTE *dstY, BYTE *dstU, BYTE *dstV)
 {
 	// src & dst 
@@ -153,27 +176,43 @@ int FrameScaler::Resize(BYTE *srcY,BYTE *srcU,BYTE *srcV,BYTE *dstY, BYTE *dstU,
 	src[0] = srcY;
 	src[1] = srcU;
 	src[2] = srcV;
-	/*dst[0] = dstY;
+	dst[0] = dstY;
 	dst[1] = dstU;
-	dst[2] = dstV;*/
+	dst[2] = dstV;
+
+	//If destination is aligned
+	if (IsDirect(dstY,dstU,dstV))
+	{
+		// Resize frame into destination
+		sws_scale(resizeCtx, src, resizeSrc, 0, resizeHeight, dst, resizeDst);
+		//Done
+		return 1;
+	}
+
+	//Check tmp buffer
+	if (!tmp && !AllocTmp())
+		//Error
+		return 0;
+
+	//Set tmp planes
 	dst[0] = tmpY;
 	dst[1] = tmpU;
 	dst[2] = tmpV;
 
 	// Resize frame 
-	sws_scale(resizeCtx, src, resizeSrc, 0, resizeHeight, dst, resizeDst);
+	sws_scale(resizeCtx, src, resizeSrc, 0, resizeHeight, dst, tmpStride);
 
 	//Copy to destination
 	for (int i=0;i<resizeDstHeight;++i)
 		//Copy
-		memcpy(dstY+resizeDstLineWidth*i,tmpY+tmpWidth*i,resizeDstWidth);
+		memcpy(dstY+resizeDst[0]*i,tmpY+tmpStride[0]*i,resizeDstWidth);
 
 	//Copy to destination
 	for (int i=0;i<resizeDstHeight/2;++i)
 	{
 		//Copy
-		memcpy(dstU+resizeDstLineWidth*i/2,tmpU+tmpWidth*i/2,resizeDstWidth/2);
-		memcpy(dstV+resizeDstLineWidth*i/2,tmpV+tmpWidth*i/2,resizeDstWidth/2);
+		memcpy(dstU+resizeDst[1]*i,tmpU+tmpStride[1]*i,resizeDstWidth/2);
+		memcpy(dstV+resizeDst[2]*i,tmpV+tmpStride[2]*i,resizeDstWidth/2);
 	}
 
 	//Done
@@ -0,0 +1,244 @@
+/*
+ * File:   g711batch.cpp
+ *
+ * G.711 conversion of whole buffers. The decoders and the transcoders are
+ * 256 entry lookups. The encoders compute the segment of 8 or 16 samples at
+ * once with SSE2 or AVX2, and use a 64 KiB table indexed by the sample for
+ * the tail and on other targets. The tables are filled from g711.c, so both
+ * paths give the same codes.
+ */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <pthread.h>
+#include "g711.h"
+#include "g711batch.h"
+
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+static BYTE linearToULaw[65536];
+static BYTE linearToALaw[65536];
+static SWORD ulawToLinear[256];
+static SWORD alawToLinear[256];
+static BYTE ulawToALaw[256];
+static BYTE alawToULaw[256];
+
+static void BuildTables()
+{
+	for (DWORD i=0; i<65536; i++)
+	{
+		//Indexed by the sample bits
+		linearToULaw[i] = linear2ulaw((SWORD) i);
+		linearToALaw[i] = linear2alaw((SWORD) i);
+	}
+
+	for (DWORD i=0; i<256; i++)
+	{
+		ulawToLinear[i] = ulaw2linear(i);
+		alawToLinear[i] = alaw2linear(i);
+		ulawToALaw[i] = ulaw2alaw(i);
+		alawToULaw[i] = alaw2ulaw(i);
+	}
+}
+
+static inline void InitTables()
+{
+	pthread_once(&tablesOnce, BuildTables);
+}
+
+#ifdef __SSE2__
+/*
+ * The segment is the number of thresholds below the magnitude, and the
+ * quantization bits are the magnitude shifted right by a per sample count,
+ * done as the high half of a multiply by 0x8000 halved once per threshold.
+ */
+static inline __m128i EncodeULaw(__m128i x)
+{
+	static const short ends[7] = {0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF};
+	__m128i v = _mm_srai_epi16(x, 2);
+	__m128i neg = _mm_cmplt_epi16(v, _mm_setzero_si128());
+	__m128i seg = _mm_setzero_si128();
+	__m128i mul = _mm_set1_epi16((short) 0x8000);
+
+	//Magnitude, clipped so the last segment gives 0x7F as g711.c does, and biased
+	__m128i mag = _mm_sub_epi16(_mm_xor_si128(v, neg), neg);
+	mag = _mm_add_epi16(_mm_min_epi16(mag, _mm_set1_epi16(8158)), _mm_set1_epi16(33));
+
+	for (int i=0; i<7; i++)
+	{
+		__m128i m = _mm_cmpgt_epi16(mag, _mm_set1_epi16(ends[i]));
+		seg = _mm_sub_epi16(seg, m);
+		mul = _mm_sub_epi16(mul, _mm_and_si128(_mm_srli_epi16(mul, 1), m));
+	}
+
+	//seg << 4 | (mag >> (seg + 1)) & 0xF, complemented, sign bit cleared for negatives
+	__m128i u = _mm_or_si128(_mm_slli_epi16(seg, 4), _mm_and_si128(_mm_mulhi_epu16(mag, mul), _mm_set1_epi16(0xF)));
+	return _mm_xor_si128(u, _mm_xor_si128(_mm_set1_epi16(0xFF), _mm_and_si128(neg, _mm_set1_epi16(0x80))));
+}
+
+static inline __m128i EncodeALaw(__m128i x)
+{
+	static const short ends[7] = {0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF};
+	__m128i v = _mm_srai_epi16(x, 3);
+	__m128i neg = _mm_cmplt_epi16(v, _mm_setzero_si128());
+	__m128i seg = _mm_setzero_si128();
+	__m128i mul = _mm_set1_epi16((short) 0x8000);
+
+	//Magnitude as -v-1 for negatives, up to 0xFFF so never out of range
+	__m128i mag = _mm_xor_si128(v, neg);
+
+	for (int i=0; i<7; i++)
+	{
+		__m128i m = _mm_cmpgt_epi16(mag, _mm_set1_epi16(ends[i]));
+		seg = _mm_sub_epi16(seg, m);
+		//The first two segments are both shifted by 1
+		if (i > 0)
+			mul = _mm_sub_epi16(mul, _mm_and_si128(_mm_srli_epi16(mul, 1), m));
+	}
+
+	__m128i a = _mm_or_si128(_mm_slli_epi16(seg, 4), _mm_and_si128(_mm_mulhi_epu16(mag, mul), _mm_set1_epi16(0xF)));
+	return _mm_xor_si128(a, _mm_xor_si128(_mm_set1_epi16(0xD5), _mm_and_si128(neg, _mm_set1_epi16(0x80))));
+}
+#endif
+
+#ifdef __AVX2__
+static inline __m256i EncodeULaw(__m256i x)
+{
+	static const short ends[7] = {0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF};
+	__m256i v = _mm256_srai_epi16(x, 2);
+	__m256i neg = _mm256_cmpgt_epi16(_mm256_setzero_si256(), v);
+	__m256i seg = _mm256_setzero_si256();
+	__m256i mul = _mm256_set1_epi16((short) 0x8000);
+
+	__m256i mag = _mm256_sub_epi16(_mm256_xor_si256(v, neg), neg);
+	mag = _mm256_add_epi16(_mm256_min_epi16(mag, _mm256_set1_epi16(8158)), _mm256_set1_epi16(33));
+
+	for (int i=0; i<7; i++)
+	{
+		__m256i m = _mm256_cmpgt_epi16(mag, _mm256_set1_epi16(ends[i]));
+		seg = _mm256_sub_epi16(seg, m);
+		mul = _mm256_sub_epi16(mul, _mm256_and_si256(_mm256_srli_epi16(mul, 1), m));
+	}
+
+	__m256i u = _mm256_or_si256(_mm256_slli_epi16(seg, 4), _mm256_and_si256(_mm256_mulhi_epu16(mag, mul), _mm256_set1_epi16(0xF)));
+	return _mm256_xor_si256(u, _mm256_xor_si256(_mm256_set1_epi16(0xFF), _mm256_and_si256(neg, _mm256_set1_epi16(0x80))));
+}
+
+static inline __m256i EncodeALaw(__m256i x)
+{
+	static const short ends[7] = {0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF};
+	__m256i v = _mm256_srai_epi16(x, 3);
+	__m256i neg = _mm256_cmpgt_epi16(_mm256_setzero_si256(), v);
+	__m256i seg = _mm256_setzero_si256();
+	__m256i mul = _mm256_set1_epi16((short) 0x8000);
+
+	__m256i mag = _mm256_xor_si256(v, neg);
+
+	for (int i=0; i<7; i++)
+	{
+		__m256i m = _mm256_cmpgt_epi16(mag, _mm256_set1_epi16(ends[i]));
+		seg = _mm256_sub_epi16(seg, m);
+		if (i > 0)
+			mul = _mm256_sub_epi16(mul, _mm256_and_si256(_mm256_srli_epi16(mul, 1), m));
+	}
+
+	__m256i a = _mm256_or_si256(_mm256_slli_epi16(seg, 4), _mm256_and_si256(_mm256_mulhi_epu16(mag, mul), _mm256_set1_epi16(0xF)));
+	return _mm256_xor_si256(a, _mm256_xor_si256(_mm256_set1_epi16(0xD5), _mm256_and_si256(neg, _mm256_set1_epi16(0x80))));
+}
+
+// Pack 16 codes to bytes, packus works on each 128 bit lane
+static inline void Store16(BYTE * out, __m256i codes)
+{
+	__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(codes, codes), 0x08);
+	_mm_storeu_si128((__m128i *) out, _mm256_castsi256_si128(packed));
+}
+#endif
+
+void G711LinearToULawTable(const SWORD * in, BYTE * out, DWORD num)
+{
+	InitTables();
+
+	for (DWORD i=0; i<num; i++)
+		out[i] = linearToULaw[(WORD) in[i]];
+}
+
+void G711LinearToALawTable(const SWORD * in, BYTE * out, DWORD num)
+{
+	InitTables();
+
+	for (DWORD i=0; i<num; i++)
+		out[i] = linearToALaw[(WORD) in[i]];
+}
+
+void G711LinearToULaw(const SWORD * in, BYTE * out, DWORD num)
+{
+	DWORD i = 0;
+
+#ifdef __AVX2__
+	for (; i+16 <= num; i+=16)
+		Store16(out+i, EncodeULaw(_mm256_loadu_si256((const __m256i *) (in+i))));
+#elif defined(__SSE2__)
+	for (; i+16 <= num; i+=16)
+	{
+		__m128i lo = EncodeULaw(_mm_loadu_si128((const __m128i *) (in+i)));
+		__m128i hi = EncodeULaw(_mm_loadu_si128((const __m128i *) (in+i+8)));
+		_mm_storeu_si128((__m128i *) (out+i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	//The rest from the table
+	if (i < num)
+		G711LinearToULawTable(in+i, out+i, num-i);
+}
+
+void G711LinearToALaw(const SWORD * in, BYTE * out, DWORD num)
+{
+	DWORD i = 0;
+
+#ifdef __AVX2__
+	for (; i+16 <= num; i+=16)
+		Store16(out+i, EncodeALaw(_mm256_loadu_si256((const __m256i *) (in+i))));
+#elif defined(__SSE2__)
+	for (; i+16 <= num; i+=16)
+	{
+		__m128i lo = EncodeALaw(_mm_loadu_si128((const __m128i *) (in+i)));
+		__m128i hi = EncodeALaw(_mm_loadu_si128((const __m128i *) (in+i+8)));
+		_mm_storeu_si128((__m128i *) (out+i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	if (i < num)
+		G711LinearToALawTable(in+i, out+i, num-i);
+}
+
+void G711ULawToLinear(const BYTE * in, SWORD * out, DWORD num)
+{
+	InitTables();
+
+	for (DWORD i=0; i<num; i++)
+		out[i] = ulawToLinear[in[i]];
+}
+
+void G711ALawToLinear(const BYTE * in, SWORD * out, DWORD num)
+{
+	InitTables();
+
+	for (DWORD i=0; i<num; i++)
+		out[i] = alawToLinear[in[i]];
+}
+
+void G711ULawToALaw(const BYTE * in, BYTE * out, DWORD num)
+{
+	InitTables();
+
+	for (DWORD i=0; i<num; i++)
+		out[i] = ulawToALaw[in[i]];
+}
+
+void G711ALawToULaw(const BYTE * in, BYTE * out, DWORD num)
+{
+	InitTables();
+
+	for (DWORD i=0; i<num; i++)
+		out[i] = alawToULaw[in[i]];
+}
@@ -0,0 +1,30 @@
+/*
+ * File:   g711batch.h
+ */
+
+#ifndef G711BATCH_H
+#define	G711BATCH_H
+
+#include <medkit/config.h>
+
+/*
+ * Conversion of whole buffers, with the same output as linear2ulaw,
+ * ulaw2linear and the other functions of g711.h applied sample by sample.
+ * Encoding is done 8 or 16 samples at a time when SSE2 or AVX2 are
+ * available, everything else with lookup tables built on first use.
+ */
+void G711LinearToULaw(const SWORD * in, BYTE * out, DWORD num);
+void G711LinearToALaw(const SWORD * in, BYTE * out, DWORD num);
+void G711ULawToLinear(const BYTE * in, SWORD * out, DWORD num);
+void G711ALawToLinear(const BYTE * in, SWORD * out, DWORD num);
+void G711ULawToALaw(const BYTE * in, BYTE * out, DWORD num);
+void G711ALawToULaw(const BYTE * in, BYTE * out, DWORD num);
+
+/*
+ * Encoding with the 64 KiB tables only, used for the samples left by the
+ * vector loop and on targets without SSE2
+ */
+void G711LinearToULawTable(const SWORD * in, BYTE * out, DWORD num);
+void G711LinearToALawTable(const SWORD * in, BYTE * out, DWORD num);
+
+#endif	/* G711BATCH_H */
@@ -1,4 +1,4 @@
-#include "g711.h"
+#include "g711batch.h"
 #include <string.h>
 #include "g711codec.h"
 
@@ -34,8 +34,7 @@ int PCMAEncoder::Encode (SWORD *in,int inLen,BYTE* out,int outLen)
 		return 0;
 
 	//Y codificamos
-	for (int j = 0; j< inLen ;j++)
-		out[j]=linear2alaw(in[j]);
+	G711LinearToALaw(in,out,inLen);
 
 	return inLen;
 }
@@ -47,8 +46,7 @@ int PCMADecoder::Decode (BYTE *in,int inLen,SWORD* out,int outLen)
 		return 0;
 
 	//Decodificamos
-	for (int j = 0; j< inLen ;j++)
-		out[j]=alaw2linear(in[j]);
+	G711ALawToLinear(in,out,inLen);
 
 	return inLen;	
 }
@@ -1,4 +1,4 @@
-#include "g711.h"
+#include "g711batch.h"
 #include <string.h>
 #include "g711codec.h"
 
@@ -33,8 +33,7 @@ int PCMUEncoder::Encode (SWORD *in,int inLen,BYTE* out,int outLen)
 		return 0;
 
 	//Y codificamos
-	for (int j = 0; j< inLen ;j++)
-		out[j]=linear2ulaw(in[j]);
+	G711LinearToULaw(in,out,inLen);
 
 	return inLen;
 }
@@ -46,8 +45,7 @@ int PCMUDecoder::Decode (BYTE *in,int inLen,SWORD* out,int outLen)
 		return 0;
 
 	//Decodificamos
-	for (int j = 0; j< inLen ;j++)
-		out[j]=ulaw2linear(in[j]);
+	G711ULawToLinear(in,out,inLen);
 
 	return inLen;	
 }
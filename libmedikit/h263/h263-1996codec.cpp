@@ -47,6 +47,7 @@ H263Decoder1996::H263Decoder1996()
 	buffer = (BYTE *)malloc(bufSize);
 	frame = NULL;
 	frameSize = 0;
+	decoded = NULL;
 	src = 0;
 	
 	//Lo abrimos
@@ -60,8 +61,8 @@ H263Decoder1996::H263Decoder1996()
 H263Decoder1996::~H263Decoder1996()
 {
 	free(buffer);
-	if (frame!=NULL)
-		free(frame);
+	if (decoded)
+		decoded->Release();
 	avcodec_close(ctx);
 	free(picture);
 	free(ctx);
@@ -193,10 +194,11 @@ int H263Decoder1996::Decode(BYTE *buffer,DWORD size)
 		{
 			Log("-Frame size %dx%d\n",w,h);
 			//Liberamos si habia
-			if(frame!=NULL)
-				free(frame);
-			//Y allocamos de nuevo
-			frame = (BYTE*) malloc(size);
+			if(decoded!=NULL)
+				decoded->Release();
+			//Y cogemos otra del pool
+			decoded = YUVPicturePool::Acquire(w,h);
+			frame = decoded->GetData();
 			frameSize = size;
 		}
 
@@ -390,22 +392,41 @@ int H263Encoder1996::OpenCodec()
 *	Codifica un frame
 ************************/
 VideoFrame* H263Encoder1996::EncodeFrame(BYTE *in,DWORD len)
+{
+	//Check if we are opened
+	if (!opened)
+		return NULL;
+
+	//Encode in our own frame
+	return EncodeFrame(in,len,*frame) ? frame : NULL;
+}
+
+/***********************
+* EncodeFrame
+*	Codifica un frame en el frame dado, sin reservar memoria si ya tiene sitio
+************************/
+bool H263Encoder1996::EncodeFrame(BYTE *in,DWORD len,VideoFrame &out)
 {
 	//Check we are opened
 	if (!opened)
 		//Error
-		return NULL;
+		return false;
+
+	//Check output size
+	if (out.GetMaxMediaLength()<frame->GetMaxMediaLength())
+		//Allocate as much as ours
+		out.Alloc(frame->GetMaxMediaLength());
         AVPacket pkt;
         av_init_packet(&pkt);
-        pkt.data = frame->GetData();
-        pkt.size = frame->GetMaxMediaLength();
+        pkt.data = out.GetData();
+        pkt.size = out.GetMaxMediaLength();
 	//Get number of pixels in image
 	int numPixels = ctx->width*ctx->height;
 
 	//Comprobamos el tama�o
 	if (numPixels*3/2 != len)
 		//Error
-		return NULL;
+		return false;
 
 	//POnemos los valores
 	picture->data[0] = in;
@@ -413,7 +434,7 @@ VideoFrame* H263Encoder1996::EncodeFrame(BYTE *in,DWORD len)
 	picture->data[2] = in+numPixels*5/4;
 
 	//Clean all previous packets
-	frame->ClearRTPPacketizationInfo();
+	out.ClearRTPPacketizationInfo();
 
 	//Codificamos
         int got_pkt;
@@ -421,28 +442,28 @@ VideoFrame* H263Encoder1996::EncodeFrame(BYTE *in,DWORD len)
 
         //Check
         if (ret<0 || got_pkt == 0)
-        	return (VideoFrame*) Error("%d\n",ret);
+        	return Error("%d\n",ret);
 	//Set length
-	frame->SetLength(pkt.size);
+	out.SetLength(pkt.size);
 
 	//Set width and height
-	frame->SetWidth(ctx->width);
-	frame->SetHeight(ctx->height);
+	out.SetWidth(ctx->width);
+	out.SetHeight(ctx->height);
 
 	//Is intra
-	frame->SetIntra( (pkt.flags & AV_PKT_FLAG_KEY) != 0 );
+	out.SetIntra( (pkt.flags & AV_PKT_FLAG_KEY) != 0 );
 
 	//Unset fpu
 	picture->key_frame = 0;
 	picture->pict_type = AV_PICTURE_TYPE_NONE;
 
 	//Paquetize
-	paquetizer.PaquetizeFrame(frame);
+	paquetizer.PaquetizeFrame(&out);
 	
 	//From the first
 	num = 0;
 	
-	return frame;
+	return true;
 }
 
 /***********************
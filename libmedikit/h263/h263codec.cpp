@@ -173,16 +173,35 @@ VideoFrame* H263Encoder::EncodeFrame(BYTE *in,DWORD len)
 	//Check if we are opened
 	if (!opened)
 		return NULL;
+
+	//Encode in our own frame
+	return EncodeFrame(in,len,*frame) ? frame : NULL;
+}
+
+/***********************
+* EncodeFrame
+*	Codifica un frame en el frame dado, sin reservar memoria si ya tiene sitio
+************************/
+bool H263Encoder::EncodeFrame(BYTE *in,DWORD len,VideoFrame &out)
+{
+	//Check if we are opened
+	if (!opened)
+		return false;
+
+	//Check output size
+	if (out.GetMaxMediaLength()<frame->GetMaxMediaLength())
+		//Allocate as much as ours
+		out.Alloc(frame->GetMaxMediaLength());
 	AVPacket pkt;
 	av_init_packet(&pkt);
-	pkt.data = frame->GetData();
-	pkt.size = frame->GetMaxMediaLength();
+	pkt.data = out.GetData();
+	pkt.size = out.GetMaxMediaLength();
 	
 	int numPixels = ctx->width*ctx->height;
 
 	//Comprobamos el tama�o
 	if (numPixels*3/2 != len)
-		return NULL;
+		return false;
 
 	//POnemos los valores
 	picture->data[0] = in;
@@ -196,17 +215,17 @@ VideoFrame* H263Encoder::EncodeFrame(BYTE *in,DWORD len)
 	//Check
 	if (ret<0 || got_pkt == 0)
 		//Exit
-		return (VideoFrame*) Error("%d\n",ret);
+		return Error("%d\n",ret);
 
 	//Set length
-	frame->SetLength(pkt.size);
+	out.SetLength(pkt.size);
 
 	//Set width and height
-	frame->SetWidth(ctx->width);
-	frame->SetHeight(ctx->height);
+	out.SetWidth(ctx->width);
+	out.SetHeight(ctx->height);
 
 	//Is intra
-	frame->SetIntra( (pkt.flags & AV_PKT_FLAG_KEY) != 0 );
+	out.SetIntra( (pkt.flags & AV_PKT_FLAG_KEY) != 0 );
 
 	//Unset fpu
 	picture->key_frame = 0;
@@ -222,7 +241,7 @@ VideoFrame* H263Encoder::EncodeFrame(BYTE *in,DWORD len)
 	prefix[1] = 0x00;
 	
 	//Clean all previous packets
-	frame->ClearRTPPacketizationInfo();
+	out.ClearRTPPacketizationInfo();
 
 	//Copy all
 	DWORD lenpkt;
@@ -242,7 +261,7 @@ VideoFrame* H263Encoder::EncodeFrame(BYTE *in,DWORD len)
 		}
 		
 		//Add rtp packet
-		frame->AddRtpPacket(ini,lenpkt,prefix,2, mark );
+		out.AddRtpPacket(ini,lenpkt,prefix,2, mark );
 
 		//If it is first
 		if (ini==2)
@@ -256,7 +275,7 @@ VideoFrame* H263Encoder::EncodeFrame(BYTE *in,DWORD len)
 		ini += lenpkt;
 	}
 	
-	return frame;
+	return true;
 }
 
 /***********************
@@ -318,6 +337,7 @@ H263Decoder::H263Decoder()
 	buffer = (BYTE *)malloc(bufSize);
 	frame = NULL;
 	frameSize = 0;
+	decoded = NULL;
 	src = 0;
 	
 	//Lo abrimos
@@ -331,8 +351,8 @@ H263Decoder::H263Decoder()
 H263Decoder::~H263Decoder()
 {
 	free(buffer);
-	if (frame!=NULL)
-		free(frame);
+	if (decoded)
+		decoded->Release();
 	avcodec_close(ctx);
 	free(picture);
 	free(ctx);
@@ -480,10 +500,11 @@ int H263Decoder::Decode(BYTE *buffer,DWORD size)
 		{
 			Log("-Frame size %dx%d\n",w,h);
 			//Liberamos si habia
-			if(frame!=NULL)
-				free(frame);
-			//Y allocamos de nuevo
-			frame = (BYTE*) malloc(size);
+			if(decoded!=NULL)
+				decoded->Release();
+			//Y cogemos otra del pool
+			decoded = YUVPicturePool::Acquire(w,h);
+			frame = decoded->GetData();
 			frameSize = size;
 		}
 
@@ -7,6 +7,7 @@ extern "C" {
 #include "../medkit/h263packet.h"
 #include "../medkit/codecs.h"
 #include "../medkit/video.h"
+#include "../medkit/picturepool.h"
 #include <list>
 
 class H263Encoder : public VideoEncoder
@@ -15,6 +16,7 @@ public:
 	H263Encoder(const Properties& properties);
 	virtual ~H263Encoder();
 	virtual VideoFrame* EncodeFrame(BYTE *in,DWORD len);
+	virtual bool EncodeFrame(BYTE *in,DWORD len,VideoFrame &out);
 	virtual int FastPictureUpdate();
 	virtual int SetSize(int width,int height);
 	virtual int SetFrameRate(int fps,int kbits,int intraPeriod);
@@ -53,6 +55,7 @@ private:
 	DWORD 		bufSize;
 	BYTE*		frame;
 	DWORD		frameSize;
+	YUVPicture*	decoded;
 	BYTE		src;
 };
 
@@ -75,6 +78,7 @@ public:
 	H263Encoder1996(const Properties& properties);
 	virtual ~H263Encoder1996();
 	virtual VideoFrame* EncodeFrame(BYTE *in,DWORD len);
+	virtual bool EncodeFrame(BYTE *in,DWORD len,VideoFrame &out);
 	virtual int FastPictureUpdate();
 	virtual int SetSize(int width,int height);
 	virtual int SetFrameRate(int fps,int kbits,int intraPeriod);
@@ -115,6 +119,7 @@ private:
 	static DWORD 	bufSize;
 	BYTE*		frame;
 	DWORD		frameSize;
+	YUVPicture*	decoded;
 	BYTE		src;
 };
 
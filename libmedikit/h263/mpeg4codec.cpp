@@ -48,6 +48,7 @@ Mpeg4Decoder::Mpeg4Decoder()
 	buffer = (BYTE *)malloc(bufSize);
 	frame = NULL;
 	frameSize = 0;
+	decoded = NULL;
 	src = 0;
 
 	//Lo abrimos
@@ -61,8 +62,8 @@ Mpeg4Decoder::Mpeg4Decoder()
 Mpeg4Decoder::~Mpeg4Decoder()
 {
 	free(buffer);
-	if (frame!=NULL)
-		free(frame);
+	if (decoded)
+		decoded->Release();
 	avcodec_close(ctx);
 	free(picture);
 	free(ctx);
@@ -129,10 +130,11 @@ int Mpeg4Decoder::Decode(BYTE* buffer,DWORD size)
 		{
 			Log("-Frame size %dx%d\n",w,h);
 			//Liberamos si habia
-			if(frame!=NULL)
-				free(frame);
-			//Y allocamos de nuevo
-			frame = (BYTE*) malloc(size);
+			if(decoded!=NULL)
+				decoded->Release();
+			//Y cogemos otra del pool
+			decoded = YUVPicturePool::Acquire(w,h);
+			frame = decoded->GetData();
 			frameSize = size;
 		}
 
@@ -291,16 +293,31 @@ int Mpeg4Encoder::OpenCodec()
 *	Codifica un frame
 ************************/
 VideoFrame* Mpeg4Encoder::EncodeFrame(BYTE *in,DWORD len)
+{
+	//Encode in our own frame
+	return EncodeFrame(in,len,*frame) ? frame : NULL;
+}
+
+/***********************
+* EncodeFrame
+*	Codifica un frame en el frame dado, sin reservar memoria si ya tiene sitio
+************************/
+bool Mpeg4Encoder::EncodeFrame(BYTE *in,DWORD len,VideoFrame &out)
 {
 	int numPixels = ctx->width*ctx->height;
 
 	//Comprobamos el tama�o
 	if (numPixels*3/2 != len)
-		return NULL;
+		return false;
+
+	//Check output size
+	if (out.GetMaxMediaLength()<frame->GetMaxMediaLength())
+		//Allocate as much as ours
+		out.Alloc(frame->GetMaxMediaLength());
         AVPacket pkt;
         av_init_packet(&pkt);
-        pkt.data = frame->GetData();
-        pkt.size = frame->GetMaxMediaLength();
+        pkt.data = out.GetData();
+        pkt.size = out.GetMaxMediaLength();
 	//POnemos los valores
 	picture->data[0] = in;
 	picture->data[1] = in+numPixels;
@@ -312,23 +329,23 @@ VideoFrame* Mpeg4Encoder::EncodeFrame(BYTE *in,DWORD len)
 
         //Check
         if (ret<0 || got_pkt == 0)
-        	return (VideoFrame*) Error("%d\n",ret);
+        	return Error("%d\n",ret);
 
 	//Set length
-	frame->SetLength(pkt.size);
+	out.SetLength(pkt.size);
 
 	//Set width and height
-	frame->SetWidth(ctx->width);
-	frame->SetHeight(ctx->height);
+	out.SetWidth(ctx->width);
+	out.SetHeight(ctx->height);
 
 	//Is intra
-	frame->SetIntra( (pkt.flags & AV_PKT_FLAG_KEY) != 0 );
+	out.SetIntra( (pkt.flags & AV_PKT_FLAG_KEY) != 0 );
 
 	//Unset fpu
 	picture->key_frame = 0;
 	picture->pict_type = AV_PICTURE_TYPE_NONE;
 	//Clean all previous packets
-	frame->ClearRTPPacketizationInfo();
+	out.ClearRTPPacketizationInfo();
 
 	//From the begining
 	DWORD ini = 0;
@@ -349,7 +366,7 @@ VideoFrame* Mpeg4Encoder::EncodeFrame(BYTE *in,DWORD len)
 		}
 
 		//Add rtp packet
-		frame->AddRtpPacket(ini,len,NULL,0,mark);
+		out.AddRtpPacket(ini,lenpkt,NULL,0,mark);
 
 		//Increase pointer
 		ini += lenpkt;
@@ -358,7 +375,7 @@ VideoFrame* Mpeg4Encoder::EncodeFrame(BYTE *in,DWORD len)
 	//Y ponemos a cero el comienzo
 	bufIni=0;
 
-	return frame;
+	return true;
 }
 
 /***********************
@@ -5,6 +5,7 @@ extern "C" {
 } 
 #include "../medkit/codecs.h"
 #include "../medkit/video.h"
+#include "../medkit/picturepool.h"
 
 class Mpeg4Decoder : public VideoDecoder
 {
@@ -26,6 +27,7 @@ private:
 	static DWORD 	bufSize;
 	BYTE*		frame;
 	DWORD		frameSize;
+	YUVPicture*	decoded;
 	BYTE		src;
 };
 
@@ -36,6 +38,7 @@ public:
 	virtual ~Mpeg4Encoder();
 
 	virtual VideoFrame* EncodeFrame(BYTE *in,DWORD len);
+	virtual bool EncodeFrame(BYTE *in,DWORD len,VideoFrame &out);
 	virtual int FastPictureUpdate();
 	virtual int SetSize(int width,int height);
 	virtual int SetFrameRate(int fps,int kbits,int intraPeriod);
@@ -48,6 +48,7 @@ H264Decoder::H264Decoder()
 	buffer = (BYTE *)malloc(bufSize);
 	frame = NULL;
 	frameSize = 0;
+	decoded = NULL;
 	src = 0;
 	
 	//Lo abrimos
@@ -62,8 +63,8 @@ H264Decoder::~H264Decoder()
 {
 	if (buffer)
 		free(buffer);
-	if (frame)
-		free(frame);
+	if (decoded)
+		decoded->Release();
 	if (ctx)
 	{
 		avcodec_close(ctx);
@@ -368,10 +369,11 @@ int H264Decoder::Decode(BYTE *buffer,DWORD size)
 		{
 			Log("-Frame size %dx%d\n",w,h);
 			//Liberamos si habia
-			if(frame!=NULL)
-				free(frame);
-			//Y allocamos de nuevo
-			frame = (BYTE*) malloc(size);
+			if(decoded!=NULL)
+				decoded->Release();
+			//Y cogemos otra del pool
+			decoded = YUVPicturePool::Acquire(w,h);
+			frame = decoded->GetData();
 			frameSize = size;
 		}
 		
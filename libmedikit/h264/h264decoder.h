@@ -5,6 +5,7 @@ extern "C" {
 } 
 #include "../medkit/codecs.h"
 #include "../medkit/video.h"
+#include "../medkit/picturepool.h"
 
 class H264Decoder : public VideoDecoder
 {
@@ -26,6 +27,7 @@ private:
 	DWORD 		bufSize;
 	BYTE*		frame;
 	DWORD		frameSize;
+	YUVPicture*	decoded;
 	BYTE		src;
 };
 #endif
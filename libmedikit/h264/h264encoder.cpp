@@ -279,11 +279,32 @@ VideoFrame* H264Encoder::EncodeFrame(BYTE *buffer,DWORD bufferSize)
 		return NULL;
 	}
 
+	//Check frame
+	if (!frame)
+		//Create new frame
+		frame = new VideoFrame(type,0);
+
+	//Encode in our own frame
+	return EncodeFrame(buffer,bufferSize,*frame) ? frame : NULL;
+}
+
+/**********************
+* EncodeFrame
+*	Codifica un frame en el frame dado, sin reservar memoria si ya tiene sitio
+***********************/
+bool H264Encoder::EncodeFrame(BYTE *buffer,DWORD bufferSize,VideoFrame &out)
+{
+	if(!opened)
+	{
+		Error("-Codec not opened\n");
+		return false;
+	}
+
 	//Comprobamos el tama�o
 	if (numPixels*3/2 != bufferSize)
 	{
 		Error("-EncodeFrame length error [%d,%d]\n",numPixels*3/2,bufferSize);
-		return NULL;
+		return false;
 	}
 
 	//POnemos los valores
@@ -312,28 +333,23 @@ VideoFrame* H264Encoder::EncodeFrame(BYTE *buffer,DWORD bufferSize)
 	{
 		//Error
 		Error("Error encoding frame [len:%d]\n",len);
-		return NULL;
+		return false;
 	}
-	//Check size
-	if (!frame)
-		//Create new frame
-		frame = new VideoFrame(type,len);
-
 	//Set the media
-	frame->SetMedia(nals[0].p_payload,len);
+	out.SetMedia(nals[0].p_payload,len);
 
 	//Set width and height
-	frame->SetWidth(width);
-	frame->SetHeight(height);
+	out.SetWidth(width);
+	out.SetHeight(height);
 
 	//Set intra
-	frame->SetIntra(pic_out.b_keyframe);
+	out.SetIntra(pic_out.b_keyframe);
 
 	//Unset type
 	pic.i_type = X264_TYPE_AUTO;
 
 	//Emtpy rtp info
-	frame->ClearRTPPacketizationInfo();
+	out.ClearRTPPacketizationInfo();
 
 	//Add packetization
 	for (DWORD i=0;i<numNals;i++)
@@ -355,13 +371,13 @@ VideoFrame* H264Encoder::EncodeFrame(BYTE *buffer,DWORD bufferSize)
 			set3(nalData,1,profileLevel);
 		}
 		//Add rtp packet
-		frame->AddRtpPacket(pos,nalSize,NULL,0, i+1 >= numNals);
+		out.AddRtpPacket(pos,nalSize,NULL,0, i+1 >= numNals);
 	}
 
 	//Set first nal
 	curNal = 0;
 	
-	return frame;
+	return true;
 }
 
 /**********************
@@ -12,6 +12,7 @@ public:
 	H264Encoder(const Properties& properties);
 	virtual ~H264Encoder();
 	virtual VideoFrame* EncodeFrame(BYTE *in,DWORD len);
+	virtual bool EncodeFrame(BYTE *in,DWORD len,VideoFrame &out);
 	virtual int FastPictureUpdate();
 	virtual int SetSize(int width,int height);
 	virtual int SetFrameRate(int fps,int kbits,int intraPeriod);
@@ -0,0 +1,93 @@
+/*
+ * File:   h264startcode.cpp
+ *
+ * Annex B start code scan, 16 or 32 bytes at a time when SSE2 or AVX2 are
+ * available, with a scalar loop for the tail.
+ */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "h264startcode.h"
+
+// First 00 00 01 from i, size if there is none
+static DWORD ScanScalar(const BYTE * p, DWORD i, DWORD size)
+{
+	while (i+2 < size)
+	{
+		//Third byte of a start code is 1, skip up to three bytes when it is not
+		if (p[i+2] > 1)
+			i += 3;
+		else if (p[i+2] == 0)
+			i++;
+		else if (p[i] == 0 && p[i+1] == 0)
+			return i;
+		else
+			i += 3;
+	}
+
+	return size;
+}
+
+DWORD H264FindStartCode(const BYTE * p, DWORD size)
+{
+	DWORD i = 0;
+
+#ifdef __AVX2__
+	const __m256i zero32 = _mm256_setzero_si256();
+	const __m256i one32 = _mm256_set1_epi8(1);
+
+	//Compare 32 positions at once, the last one reads up to i+33
+	for (; i+34 <= size; i+=32)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i *) (p+i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (p+i+1));
+		__m256i c = _mm256_loadu_si256((const __m256i *) (p+i+2));
+		__m256i m = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(a, b), zero32), _mm256_cmpeq_epi8(c, one32));
+		DWORD mask = _mm256_movemask_epi8(m);
+
+		if (mask)
+		{
+			i += __builtin_ctz(mask);
+			goto found;
+		}
+	}
+#endif
+#ifdef __SSE2__
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi8(1);
+
+		//Compare 16 positions at once, the last one reads up to i+17
+		for (; i+18 <= size; i+=16)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i *) (p+i));
+			__m128i b = _mm_loadu_si128((const __m128i *) (p+i+1));
+			__m128i c = _mm_loadu_si128((const __m128i *) (p+i+2));
+			__m128i m = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(a, b), zero), _mm_cmpeq_epi8(c, one));
+			DWORD mask = _mm_movemask_epi8(m);
+
+			if (mask)
+			{
+				i += __builtin_ctz(mask);
+				goto found;
+			}
+		}
+	}
+#endif
+	i = ScanScalar(p, i, size);
+
+	if (i == size)
+		return size;
+
+#if defined(__SSE2__) || defined(__AVX2__)
+found:
+#endif
+	//The zero before a 3 byte start code makes it a 4 byte one
+	if (i > 0 && p[i-1] == 0)
+		i--;
+
+	return i;
+}
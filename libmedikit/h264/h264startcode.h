@@ -0,0 +1,16 @@
+/* 
+ * File:   h264startcode.h
+ */
+
+#ifndef H264STARTCODE_H
+#define	H264STARTCODE_H
+
+#include <medkit/config.h>
+
+/**
+ * Find the next Annex B start code, 00 00 01 or 00 00 00 01
+ * @return offset of its first byte, size if there is none
+ */
+DWORD H264FindStartCode(const BYTE * data, DWORD size);
+
+#endif	/* H264STARTCODE_H */
@@ -1,6 +1,11 @@
 #include "medkit/log.h"
 #include "medkit/logo.h"
+#include "medkit/picturepool.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <list>
 extern "C" {
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
@@ -8,12 +13,152 @@ extern "C" {
 #include <libavutil/opt.h>
 }
 
+// Default memory used by the decoded pictures
+#define LOGO_CACHE_SIZE	(32*1024*1024)
+
+struct LogoPicture
+{
+	std::string key;
+	YUVPicture * yuv;
+	int width;
+	int height;
+	DWORD size;
+	int refs;
+	// Position in the unused list
+	std::list<LogoPicture *>::iterator unused;
+};
+
+typedef std::map<std::string, LogoPicture *> LogoPictures;
+typedef std::list<LogoPicture *> LogoUnused;
+
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+static LogoPictures pictures;
+// Least recently used at the end
+static LogoUnused unused;
+static QWORD cacheMax = LOGO_CACHE_SIZE;
+static LogoCache::Stats cacheStats;
+
+// Free unused pictures until the cache fits, called with the lock
+static void Evict()
+{
+	while ( cacheStats.bytes > cacheMax && !unused.empty() )
+	{
+		LogoPicture * p = unused.back();
+		unused.pop_back();
+		pictures.erase(p->key);
+		cacheStats.bytes -= p->size;
+		cacheStats.entries--;
+		cacheStats.evictions++;
+		p->yuv->Release();
+		delete p;
+	}
+}
+
+static LogoPicture * AcquirePicture(const std::string & key)
+{
+	LogoPicture * p = NULL;
+	
+	pthread_mutex_lock(&cacheLock);
+	
+	LogoPictures::iterator it = pictures.find(key);
+	
+	if (it != pictures.end())
+	{
+		p = it->second;
+		// Not unused anymore
+		if (p->refs++ == 0) unused.erase(p->unused);
+		cacheStats.hits++;
+	}
+	else
+	{
+		cacheStats.misses++;
+	}
+	
+	pthread_mutex_unlock(&cacheLock);
+	
+	return p;
+}
+
+// Insert a decoded picture, returns the one already there if other thread was faster
+static LogoPicture * InsertPicture(const std::string & key, YUVPicture * yuv, int width, int height, DWORD size)
+{
+	LogoPicture * p;
+	
+	pthread_mutex_lock(&cacheLock);
+	
+	LogoPictures::iterator it = pictures.find(key);
+	
+	if (it != pictures.end())
+	{
+		p = it->second;
+		if (p->refs++ == 0) unused.erase(p->unused);
+		yuv->Release();
+	}
+	else
+	{
+		p = new LogoPicture();
+		p->key = key;
+		p->yuv = yuv;
+		p->width = width;
+		p->height = height;
+		p->size = size;
+		p->refs = 1;
+		pictures[key] = p;
+		cacheStats.bytes += size;
+		cacheStats.entries++;
+		Evict();
+	}
+	
+	pthread_mutex_unlock(&cacheLock);
+	
+	return p;
+}
+
+static void RetainPicture(LogoPicture * p)
+{
+	pthread_mutex_lock(&cacheLock);
+	p->refs++;
+	pthread_mutex_unlock(&cacheLock);
+}
+
+static void ReleasePicture(LogoPicture * p)
+{
+	pthread_mutex_lock(&cacheLock);
+	
+	if (--p->refs == 0)
+	{
+		// Keep it for next load
+		unused.push_front(p);
+		p->unused = unused.begin();
+		Evict();
+	}
+	
+	pthread_mutex_unlock(&cacheLock);
+}
+
+void LogoCache::SetMaxSize(QWORD bytes)
+{
+	pthread_mutex_lock(&cacheLock);
+	cacheMax = bytes;
+	Evict();
+	pthread_mutex_unlock(&cacheLock);
+}
+
+void LogoCache::GetStats(Stats & stats)
+{
+	pthread_mutex_lock(&cacheLock);
+	stats = cacheStats;
+	pthread_mutex_unlock(&cacheLock);
+}
+
 Logo::Logo()
 {
 	//No logo
 	frame = NULL;
 	width = 0;
 	height = 0;
+	yuv = NULL;
+	picture = NULL;
 }
 
 /***********************
@@ -22,34 +167,119 @@ Logo::Logo()
 ************************/
 Logo::~Logo()
 {
+	//If it is shared
+	if (picture)
+		Detach();
 	//If we have open a gile
-	if(frame)
+	else
 		//Free it
-		free(frame);
+		Free();
+}
+
+void Logo::Alloc()
+{
+	//Get it from the pool with the padding
+	yuv = YUVPicturePool::Acquire(width, height, true, GetSize());
+	frame = yuv->GetData();
+}
+
+void Logo::Free()
+{
+	//Give it back to the pool
+	if (yuv)
+		yuv->Release();
+	yuv = NULL;
+	frame = NULL;
+}
+
+void Logo::Detach()
+{
+	//Release shared picture without freeing it
+	ReleasePicture(picture);
+	picture = NULL;
+	frame = NULL;
 }
 
 Logo & Logo::operator =(const Logo& l)
 {
-	if (frame)
+	if (picture)
+	{
+		Detach();
+	}
+	else
 	{
 		//Free it
-		free(frame);
-		frame = NULL;
+		Free();
 	}
 	
     width = l.width;
     height= l.height;
-	//Get size with padding
-	DWORD size = (((width/32+1)*32)*((height/32+1)*32)*3)/2;
 	
+	//Share the same picture
+	if (l.picture)
+	{
+		RetainPicture(l.picture);
+		picture = l.picture;
+		frame = l.frame;
+		return *this;
+	}
+	//Nothing to copy
+	if (l.frame == NULL)
+		return *this;
+
 	//Allocate frame
-	if (frame == NULL) frame = (BYTE*)malloc(size); /* size for YUV 420 */
+	Alloc();
 	
-	memcpy(frame,l.frame, size);
+	memcpy(frame,l.frame, GetSize());
    
+	return *this;
 }
 
 int Logo::Load(const char* fileName, unsigned int pwidth, unsigned int pheight)
+{
+	struct stat st;
+	char buffer[64];
+	
+	//Do not write on the shared one
+	if (picture) Detach();
+	
+	//Get modification time so changed files are decoded again
+	if (stat(fileName, &st) < 0)
+		//Not a file, do not cache it
+		return Decode(fileName, pwidth, pheight);
+	
+	snprintf(buffer, sizeof(buffer), "|%lu|%lu|%ux%u", (unsigned long) st.st_mtime, (unsigned long) st.st_size, pwidth, pheight);
+	
+	std::string key = std::string(fileName) + buffer;
+	
+	//Check if already decoded
+	LogoPicture * p = AcquirePicture(key);
+	
+	if (p == NULL)
+	{
+		//Decode it
+		if (!Decode(fileName, pwidth, pheight))
+			return 0;
+		
+		//Share it, the cache owns it now
+		p = InsertPicture(key, yuv, width, height, GetSize());
+		yuv = NULL;
+	}
+	else
+	{
+		//Free previous one
+		Free();
+	}
+	
+	picture = p;
+	frame = p->yuv->GetData();
+	width = p->width;
+	height = p->height;
+	
+	return 1;
+}
+
+int Logo::Decode(const char* fileName, unsigned int pwidth, unsigned int pheight)
 {
 	AVFormatContext *fctx = NULL;
 	AVCodecContext *ctx = NULL;
@@ -208,9 +438,7 @@ int Logo::Load(const char* fileName, unsigned int pwidth, unsigned int pheight)
 	}
 
 	//Check if we already had one
-	if (frame)
-		//Free memory
-		free(frame);
+	Free();
 
 	//Get size with padding
 	size = GetSize();
@@ -219,7 +447,7 @@ int Logo::Load(const char* fileName, unsigned int pwidth, unsigned int pheight)
 	numpixels = width*height;
 
 	//Allocate frame
-	frame = (BYTE*)malloc(size); /* size for YUV 420 */
+	Alloc();
 
 	//Alloc data
 	logo->data[0] = frame;
@@ -274,13 +502,13 @@ BYTE* Logo::GetFrame()
 
 void Logo::Clean()
 {
+	//Do not write on the shared one
+	if (picture)
+		Detach();
+	
 	if ( width == 0 || height == 0 )
 	{
-		if (frame != NULL)
-		{
-			free(frame);
-			frame = NULL;
-		}
+		Free();
 		return;
 	}
 	else
@@ -289,7 +517,7 @@ void Logo::Clean()
 		//DWORD size = (((width/32+1)*32)*((height/32+1)*32)*3)/2;
 		DWORD size =  GetSize();
 		//Allocate frame
-		if (frame == NULL) frame = (BYTE*)malloc(size); /* size for YUV 420 */
+		if (frame == NULL) Alloc();
 		memset(frame, 0, size);
 	}
 }
@@ -301,17 +529,19 @@ void Logo::PaintBlackRectangle(unsigned int pwidth, unsigned int pheight)
 		return;
 	}
 
-	if (frame != NULL)
+	if (picture)
+	{
+		Detach();
+	}
+	else
 	{
-		free(frame);
-		frame = NULL;
+		Free();
 	}
 	
 	width = pwidth;
 	height = pheight;
-	unsigned int size =  GetSize();
 	unsigned int numPixels = pwidth*pheight;
-	frame = (BYTE*)malloc(size); /* size for YUV 420 */
+	Alloc();
 	
 	if ( frame )
 	{
@@ -9,7 +9,10 @@ bool MediaFrame::PrependWithFrame(MediaFrame * f)
 
 	DWORD oldSz = GetLength();
 	DWORD newSz = f->GetLength() + oldSz;
-	RtpPacketizationInfo oldRtpInfo = rtpInfo;
+	//Copy them, the store is going to be overwritten
+	RtpPacketizationStore oldRtpInfo;
+	for (RtpPacketizationInfo::iterator it = rtpInfo.begin(); it != rtpInfo.end(); it++)
+		oldRtpInfo.push_back(**it);
 		
 	if ( newSz > GetMaxMediaLength() )
 	{
@@ -28,9 +31,7 @@ bool MediaFrame::PrependWithFrame(MediaFrame * f)
 	if ( HasRtpPacketizationInfo() )
 	{
 		// If frame has packetization, merge it
-		// do not use ClearTypPacketizationInfo() as we reuse the ptr
-		int i = 0;
-		rtpInfo.clear();
+		ClearRTPPacketizationInfo();
 			
 		if ( f->HasRtpPacketizationInfo() )
 		{
@@ -47,13 +48,12 @@ bool MediaFrame::PrependWithFrame(MediaFrame * f)
 			AddRtpPacket(0, f->GetLength(), NULL, 0, false);
 		}
 		
-		for (RtpPacketizationInfo::iterator it = oldRtpInfo.begin(); it != oldRtpInfo.end(); it++)
+		for (RtpPacketizationStore::iterator it = oldRtpInfo.begin(); it != oldRtpInfo.end(); it++)
 		{
-			MediaFrame::RtpPacketization * rtp = (*it);
+			MediaFrame::RtpPacketization * rtp = &(*it);
                         AddRtpPacket(rtp->GetPos() + f->GetLength(),
                                      rtp->GetSize(), rtp->GetPrefixData(), rtp->GetPrefixLen(),
                                      rtp->IsMark());
-			delete rtp;
 		}
 	}
 	return true;
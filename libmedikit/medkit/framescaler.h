@@ -7,6 +7,7 @@ extern "C"
 #include <libavutil/opt.h>
 }
 #include <medkit/config.h>
+#include <medkit/picturepool.h>
 
 class FrameScaler
 {
@@ -14,8 +15,15 @@ public:
 	FrameScaler();
 	~FrameScaler();
 	int SetResize(int srcWidth,int srcHeight,int srcLineWidth,int dstWidth,int dstHeight,int dstLineWidth);
+	//Strides of the Y, U and V planes
+	int SetResize(int srcWidth,int srcHeight,const int srcStride[3],int dstWidth,int dstHeight,const int dstStride[3]);
 	int Resize(BYTE *srcY,BYTE *srcU,BYTE *srcV,BYTE *dstY, BYTE *dstU, BYTE *dstV);
 	int Resize(BYTE *src,DWORD srcWidth,DWORD srcHeight,BYTE *dst,DWORD dstWidth,DWORD dstHeight);
+	//Check if it can scale into the destination planes without the intermediate buffer
+	bool IsDirect(BYTE *dstY, BYTE *dstU, BYTE *dstV);
+
+private:
+	int AllocTmp();
 
 private:
 	struct SwsContext* resizeCtx;
@@ -23,14 +31,11 @@ private:
 	int     resizeHeight;
 	int     resizeDstWidth;
 	int     resizeDstHeight;
-	int	resizeDstLineWidth;
 	int     resizeSrc[3];
 	int     resizeDst[3];
 	int     resizeFlags;
-	int	tmpWidth;
-	int	tmpHeight;
-	int	tmpBufferSize;
-	BYTE*	tmpBuffer;
+	int	tmpStride[3];
+	YUVPicture* tmp;
 	BYTE*	tmpY;
 	BYTE* 	tmpU;
 	BYTE* 	tmpV;
@@ -2,6 +2,9 @@
 #define _LOGO_H_
 #include "config.h"
 
+struct LogoPicture;
+class YUVPicture;
+
 class Logo
 {
 public:
@@ -18,10 +21,39 @@ public:
 	unsigned int GetSize() { return (((width/32+1)*32)*((height/32+1)*32)*3)/2; }
 
 	void PaintBlackRectangle(unsigned int width, unsigned int height);
+private:
+	int Decode(const char *filename, unsigned int width, unsigned int height);
+	void Detach();
+	void Alloc();
+	void Free();
 private:
 	BYTE*	 frame;
 	int width;
 	int height;
+	// Own picture from the pool
+	YUVPicture * yuv;
+	// Shared decoded picture, frame points to it and must not be written
+	LogoPicture * picture;
+};
+
+/**
+ *  Decoded pictures shared by all the logos loaded from the same file with the
+ *  same size. Pictures no longer used are kept until the cache is full.
+ */
+class LogoCache
+{
+public:
+	struct Stats
+	{
+		DWORD hits;
+		DWORD misses;
+		DWORD evictions;
+		DWORD entries;
+		QWORD bytes;
+	};
+	
+	static void SetMaxSize(QWORD bytes);
+	static void GetStats(Stats & stats);
 };
 
 #endif
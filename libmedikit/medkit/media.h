@@ -5,6 +5,9 @@
 #include <vector>
 #include <string.h>
 
+//Packets reserved the first time a frame is packetized
+#define MEDIA_RTP_PACKETS	16
+
 class MediaFrame
 {
 public:
@@ -47,6 +50,7 @@ public:
 	};
 
 	typedef std::vector<RtpPacketization*> RtpPacketizationInfo;
+	typedef std::vector<RtpPacketization> RtpPacketizationStore;
 public:
 	enum Type {Audio=0,Video=1,Text=2,Application=3};
 	enum MediaRole {VIDEO_MAIN=0,VIDEO_SLIDES=1 };
@@ -112,19 +116,34 @@ public:
 
 	void	ClearRTPPacketizationInfo()
 	{
-		//Emtpy
-		while (!rtpInfo.empty())
-		{
-			//Delete
-			delete(rtpInfo.back());
-			//remove
-			rtpInfo.pop_back();
-		}
+		//Emtpy, packets are kept in the store for the next frame
+		rtpInfo.clear();
 	}
 	
 	void	AddRtpPacket(DWORD pos,DWORD size,const BYTE* prefix,DWORD prefixLen, bool mark)
 	{
-		rtpInfo.push_back(new RtpPacketization(pos,size,prefix,prefixLen, mark));
+		DWORD num = rtpInfo.size();
+
+		//Reuse a packet from a previous frame
+		if (num<rtpStore.size())
+		{
+			//Overwrite it
+			rtpStore[num] = RtpPacketization(pos,size,prefix,prefixLen, mark);
+		} else {
+			//Check if the store is going to move
+			bool moved = rtpStore.size()==rtpStore.capacity();
+			//Reserve some at once
+			if (rtpStore.empty())
+				rtpStore.reserve(MEDIA_RTP_PACKETS);
+			//Add it
+			rtpStore.push_back(RtpPacketization(pos,size,prefix,prefixLen, mark));
+			//Update previous pointers
+			if (moved)
+				for (DWORD i=0;i<num;++i)
+					rtpInfo[i] = &rtpStore[i];
+		}
+		//Add it to the list
+		rtpInfo.push_back(&rtpStore[num]);
 	}
 	
 	Type	GetType() const		{ return type;	}
@@ -222,6 +241,8 @@ protected:
 	Type type;
 	DWORD ts;
 	RtpPacketizationInfo rtpInfo;
+	//Flat storage of the packets pointed by rtpInfo
+	RtpPacketizationStore rtpStore;
 	BYTE	*buffer;
 	DWORD	length;
 	DWORD	bufferSize;
@@ -0,0 +1,88 @@
+#ifndef _PICTUREPOOL_H_
+#define _PICTUREPOOL_H_
+
+#include <pthread.h>
+#include <map>
+#include "config.h"
+
+/**
+ *  I420 picture taken from the YUVPicturePool. The Y plane is 32 aligned.
+ *  Packed pictures have the three planes contiguous, as the codecs use them,
+ *  otherwise every plane starts 32 aligned and lines are padded to 32.
+ */
+class YUVPicture
+{
+public:
+	DWORD GetWidth()	{ return width;		}
+	DWORD GetHeight()	{ return height;	}
+	BYTE* GetPlane(int i)	{ return planes[i];	}
+	int   GetStride(int i)	{ return strides[i];	}
+	// Whole picture, contiguous I420 when packed
+	BYTE* GetData()		{ return planes[0];	}
+	DWORD GetSize()		{ return size;		}
+
+	void AddRef();
+	// Gives it back to the pool when the last reference is released
+	void Release();
+
+private:
+	friend class YUVPicturePool;
+
+	YUVPicture() {}
+	~YUVPicture() {}
+
+private:
+	BYTE *	buffer;
+	DWORD	capacity;
+	DWORD	width;
+	DWORD	height;
+	BYTE *	planes[3];
+	int	strides[3];
+	DWORD	size;
+	volatile int refs;
+};
+
+/**
+ *  Pictures released are kept for the next picture of a similar size, so
+ *  decoders, scalers and transcoders do not go to the heap on each size
+ *  change and the memory in use stays flat when sources change resolution.
+ */
+class YUVPicturePool
+{
+public:
+	struct Stats
+	{
+		QWORD allocs;
+		QWORD reuses;
+		DWORD used;
+		DWORD free;
+		QWORD freeBytes;
+	};
+
+	/**
+	 * Get a picture with one reference
+	 * @param minSize: allocate at least this size, for callers reading past the picture
+	 */
+	static YUVPicture * Acquire(DWORD width, DWORD height, bool packed = true, DWORD minSize = 0);
+
+	// Memory kept in free pictures, 64MB by default
+	static void SetMaxFree(QWORD bytes);
+	static void GetStats(Stats & stats);
+	// Free all the pictures not used
+	static void Purge();
+
+private:
+	typedef std::multimap<DWORD, YUVPicture *> Pictures;
+
+	friend class YUVPicture;
+	static void Recycle(YUVPicture * picture);
+	static void Evict();
+
+private:
+	static pthread_mutex_t lock;
+	static Pictures pictures;
+	static QWORD maxFree;
+	static Stats stats;
+};
+
+#endif
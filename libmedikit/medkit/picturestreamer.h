@@ -1,9 +1,12 @@
+#include <string>
 #include "medkit/logo.h"
 #include "medkit/video.h"
 
 #ifndef PICTURESTREAMER_H
 #define PICTURESTREAMER_H
 
+struct PictureSequence;
+
 class PictureStreamer : public Logo
 {
 public:
@@ -14,18 +17,12 @@ public:
 	 * Create an encoder and configure it to stream the pricture
 	 **/
 	
-	int Load(const char *filename, unsigned int pwidth = 0, unsigned int pheight = 0)
-	{
-		if (Logo::Load(filename, pwidth, pheight))
-		{
-			if ( HandleSizeChange() ) return 1;
-		}
-		return 0;
-	}
+	int Load(const char *filename, unsigned int pwidth = 0, unsigned int pheight = 0);
 	
 	void PaintBlackRectangle(unsigned int pwidth, unsigned int pheight)
 	{
 		Logo::PaintBlackRectangle(pwidth, pheight);
+		source = "black";
 		HandleSizeChange();
 	}
 	
@@ -41,14 +38,30 @@ public:
 	bool SetFrameRate(int fps,int kbits,int intraPeriod);
 	
 	/**
-	 * Create an encoded videoframe
+	 * Get the next encoded videoframe. The picture is encoded once for all the
+	 * streamers with the same picture and settings, the frame is shared and 
+	 * must not be modified.
+	 * @param askiframe: restart from the I frame
 	 **/
 	VideoFrame* Stream(bool askiframe = false);
 	
 private:
-	VideoEncoder * encoder;
-	
 	bool HandleSizeChange();
+	bool Acquire();
+	bool Encode(PictureSequence * s);
+	void Release();
+	
+private:
+	std::string source;
+	VideoCodec::Type codec;
+	Properties properties;
+	bool hasCodec;
+	int fps;
+	int kbits;
+	int intraPeriod;
+	
+	PictureSequence * sequence;
+	DWORD pos;
 };
 
 #endif
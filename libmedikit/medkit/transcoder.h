@@ -26,6 +26,65 @@ struct VideoTranscoder * VideoTranscoderCreate(void * ctxdata,char *format, Vide
  */
 int VideoTranscoderDestroy(struct VideoTranscoder *vtc);
 
+/**
+ * Add another output to a video transcoder. The input is decoded once for
+ * all the outputs, outputs with the same format share the scaler and the
+ * encoder.
+ *
+ * @param vtc: video transcoder instance
+ * @param ctxdata: context data to be passed to callbacks
+ * @param format: description of expected encoder output, as in VideoTranscoderCreate
+ * @param cb: callback function to return each frame.
+ * @return output id, -1 if it fails. The output created with the transcoder is 0.
+ */
+int VideoTranscoderAddOutput(struct VideoTranscoder *vtc, void * ctxdata, char *format, VideoTranscoderCb cb);
+
+/**
+ * Remove an output from a video transcoder
+ *
+ * @param vtc: video transcoder instance
+ * @param output: id returned by VideoTranscoderAddOutput
+ * @return 1 if removed, 0 if not found
+ */
+int VideoTranscoderRemoveOutput(struct VideoTranscoder *vtc, int output);
+
+/**
+ * Encode in a separate thread. Decoded pictures are copied to a ring of
+ * recycled buffers and encoded there, so callbacks are called from that
+ * thread. When the encoder falls behind the oldest picture waiting is
+ * replaced by the new one.
+ * Must not be called while a frame is being processed.
+ *
+ * @param vtc: video transcoder instance
+ * @param pictures: number of picture buffers (at least 2), 0 to encode in
+ *		    the caller thread again
+ * @return 1 on success, 0 if the thread could not be started
+ */
+int VideoTranscoderSetPipeline(struct VideoTranscoder *vtc, int pictures);
+
+/**
+ * Per stage counters, times are accumulated in microseconds
+ */
+struct VideoTranscoderStats
+{
+    unsigned int decoded;		/* pictures decoded */
+    unsigned int encoded;		/* pictures encoded, once per output format */
+    unsigned int dropped;		/* pictures not encoded because the encoder was behind */
+    unsigned long long decodeTime;
+    unsigned long long queueTime;	/* waiting for the encoder thread */
+    unsigned long long scaleTime;
+    unsigned long long encodeTime;
+};
+
+/**
+ * Get the counters since the transcoder was created
+ *
+ * @param vtc: video transcoder instance
+ * @param stats: filled with the counters
+ * @return 1
+ */
+int VideoTranscoderGetStats(struct VideoTranscoder *vtc, struct VideoTranscoderStats * stats);
+
 /**
  * Process one ast_frame
  *
@@ -34,7 +93,7 @@ int VideoTranscoderDestroy(struct VideoTranscoder *vtc);
  * @return 	0 frame was processed,
  *		1 picture is complete
  *		-1 could not decode
- *		-2
+ *		-2 not a video frame or unknown codec
  *
  */
 int VideoTranscoderProcessFrame(struct VideoTranscoder *vtc, const ast_frame * f);
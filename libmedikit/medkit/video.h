@@ -99,9 +99,6 @@ private:
 	// If NALU size is stored in data (MP4 file)
 	DWORD ReadNaluSize(BYTE * data);
 	
-	//If butstream contains H.264 sync codes
-	DWORD DetectNaluBoundary(BYTE * p, DWORD sz);
-	
 	// Handle fragmentation
 	void PacketizeH264Nalu(unsigned int mtu, DWORD offset, DWORD naluSz, bool last);
 };
@@ -115,6 +112,8 @@ public:
 
 	virtual int SetSize(int width,int height)=0;
 	virtual VideoFrame* EncodeFrame(BYTE *in,DWORD len)=0;
+	//Encode into a frame owned by the caller, so it can be reused without allocating
+	virtual bool EncodeFrame(BYTE *in,DWORD len,VideoFrame &out);
 	virtual int FastPictureUpdate()=0;
 	virtual int SetFrameRate(int fps,int kbits,int intraPeriod)=0;
 public:
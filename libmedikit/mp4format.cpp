@@ -13,11 +13,15 @@ extern "C"
 #include "medkit/textencoder.h"
 #include "medkit/avcdescriptor.h"
 #include "h264/h264depacketizer.h"
+#include "mp4writer.h"
+#include "mp4fragment.h"
+#include "mp4scheduler.h"
 
-mp4recorder::mp4recorder(void * ctxdata, MP4FileHandle mp4, bool waitVideo)
+mp4recorder::mp4recorder(void * ctxdata, MP4FileHandle mp4, bool waitVideo, Mp4FragmentWriter * fragments)
 {
     this->ctxdata = ctxdata;
     this->mp4 = mp4;
+    this->fragments = fragments;
     textSeqNo = 0xFFFF;
     videoSeqNo = 0xFFFF;
     vtc = NULL;
@@ -37,6 +41,21 @@ mp4recorder::mp4recorder(void * ctxdata, MP4FileHandle mp4, bool waitVideo)
     waitNextVideoFrame = false;
 	saveTxtInComment = true;
 	addVideoPrologue = true;
+	audioAggregation = 1;
+	queue = NULL;
+	writer = -1;
+	queued = 0;
+	dropped = 0;
+	maxDepth = 0;
+	for (int i =0; i < MP4_TEXT_TRACK + 1; i++)
+	{
+		queuedTrack[i] = false;
+		createPending[i] = 0;
+		createFailed[i] = false;
+	}
+	queuedIntra = false;
+	flushPending = 0;
+	pthread_mutex_init(&writelock, NULL);
 }
 
 const char * idxToMedia(int i)
@@ -62,31 +81,47 @@ const char * idxToMedia(int i)
 
 mp4recorder::~mp4recorder()
 {
-	const MP4Tags * tags = MP4TagsAlloc();  
-
-	MP4TagsSetEncodingTool(tags, "MP4Save asterisk application");
-	MP4TagsSetArtist(tags, partName );
+	// Write what is still queued before closing the tracks
+	DisableAsync();
+	
+	if (mediatracks[MP4_AUDIO_TRACK])
+		((Mp4AudioTrack *) mediatracks[MP4_AUDIO_TRACK])->WritePending();
 
-	if (mediatracks[MP4_TEXT_TRACK] != NULL)
+	if (fragments)
 	{
-		Mp4TextTrack * txttrack = (Mp4TextTrack *) mediatracks[MP4_TEXT_TRACK];
-		std::string texte;
-		txttrack->GetSavedTextForVm(texte);
-		
-		if (saveTxtInComment && texte.length() > 0)
+		// Tags are not written on fragmented files
+		fragments->Close();
+		Log("-mp4recorder: fragmented file closed with %u fragments.\n", fragments->GetFragments());
+		delete fragments;
+	}
+	else
+	{
+		const MP4Tags * tags = MP4TagsAlloc();  
+
+		MP4TagsSetEncodingTool(tags, "MP4Save asterisk application");
+		MP4TagsSetArtist(tags, partName );
+
+		if (mediatracks[MP4_TEXT_TRACK] != NULL)
 		{
+			Mp4TextTrack * txttrack = (Mp4TextTrack *) mediatracks[MP4_TEXT_TRACK];
+			std::string texte;
+			txttrack->GetSavedTextForVm(texte);
+		
+			if (saveTxtInComment && texte.length() > 0)
+			{
 
 			
-			if ( ! MP4TagsSetComments(tags, texte.c_str())  )
-			{
-				ast_log(LOG_WARNING, "mp4recorder: Save text inside mp4 comment tag failed.\n");
-			}
+				if ( ! MP4TagsSetComments(tags, texte.c_str())  )
+				{
+					ast_log(LOG_WARNING, "mp4recorder: Save text inside mp4 comment tag failed.\n");
+				}
 
+			}
 		}
-	}
 	
-	MP4TagsStore(tags, mp4);
-	MP4TagsFree( tags );
+		MP4TagsStore(tags, mp4);
+		MP4TagsFree( tags );
+	}
 	
     for (int i =0; i < MP4_TEXT_TRACK + 1; i++)
     {
@@ -96,6 +131,8 @@ mp4recorder::~mp4recorder()
     if (audioencoder) delete audioencoder;
     if (depak) delete depak;
     if (pcstream) delete pcstream;
+    
+    pthread_mutex_destroy(&writelock);
 }
 
 void mp4recorder::DumpInfo()
@@ -121,7 +158,16 @@ int mp4recorder::AddTrack(AudioCodec::Type codec, DWORD samplerate, const char *
 	mediatracks[MP4_AUDIO_TRACK] = new Mp4AudioTrack(mp4, initialDelay);
 	if ( mediatracks[MP4_AUDIO_TRACK] != NULL )
 	{
-	    mediatracks[MP4_AUDIO_TRACK]->Create( trackName, (int) codec, samplerate );
+	    mediatracks[MP4_AUDIO_TRACK]->SetFragmentWriter(fragments);
+	    ((Mp4AudioTrack *) mediatracks[MP4_AUDIO_TRACK])->SetAggregation(audioAggregation);
+	    if ( !CreateTrack( MP4_AUDIO_TRACK, trackName, (int) codec, samplerate ) )
+	    {
+		// Fragmented files cannot add it after the first fragment
+		Error("-mp4recorder: could not create audio track, audio is not recorded.\n");
+		delete mediatracks[MP4_AUDIO_TRACK];
+		mediatracks[MP4_AUDIO_TRACK] = NULL;
+		return -1;
+	    }
 	    return 1;
 	}
 	else
@@ -143,7 +189,8 @@ int mp4recorder::AddTrack(VideoCodec::Type codec, DWORD width, DWORD height, DWO
 	if ( mediatracks[trackidx] != NULL )
 	{
 	    vtr->SetSize(width, height);
-	    vtr->Create( trackName, codec, bitrate );
+	    vtr->SetFragmentWriter(fragments);
+	    CreateTrack( trackidx, trackName, codec, bitrate );
 	    return 1;
 	}
 	else
@@ -163,13 +210,22 @@ int mp4recorder::AddTrack(TextCodec::Type codec, const char * trackName, int tex
 	{
 	    char introsubtitle[200];
 	    
-	    mediatracks[MP4_TEXT_TRACK]->Create( trackName, codec, 1000 );
+	    mediatracks[MP4_TEXT_TRACK]->SetFragmentWriter(fragments);
+	    if ( !CreateTrack( MP4_TEXT_TRACK, trackName, codec, 1000 ) )
+	    {
+		// Fragmented files cannot add it after the first fragment
+		Error("-mp4recorder: could not create text track, text is not recorded.\n");
+		delete mediatracks[MP4_TEXT_TRACK];
+		mediatracks[MP4_TEXT_TRACK] = NULL;
+		return -1;
+	    }
 	    sprintf(introsubtitle, "[%s]\n", trackName);
 	    TextFrame tf(false);
 	    
 	    tf.SetMedia((const uint8_t*) introsubtitle, strlen(introsubtitle) );
 	    
-	    mediatracks[MP4_TEXT_TRACK]->ProcessFrame(&tf);
+	    // Queued after the track creation
+	    WriteFrame(MP4_TEXT_TRACK, &tf);
 	    
 	    return 1;
 	}
@@ -187,7 +243,8 @@ int mp4recorder::IsVideoStarted()
     if ( vt != NULL )
     {
 		if (waitVideo == 0) return 1;
-		if ( vt->IsVideoStarted() ) return 1;
+		// Track is updated by the writer thread, check if we have queued an I frame
+		if ( queue ? queuedIntra : vt->IsVideoStarted() ) return 1;
 		if (depak != NULL && depak->MayBeIntra() ) return 1;
 		return 0;
     }
@@ -212,7 +269,7 @@ int mp4recorder::ProcessFrame( const MediaFrame * f, bool secondary )
 		{
 			if (waitVideo) return 0;
 	    
-			if ( mediatracks[MP4_AUDIO_TRACK]->IsEmpty() )
+			if ( IsTrackEmpty(MP4_AUDIO_TRACK) )
 			{
 				
 				// adjust initial delay
@@ -239,7 +296,7 @@ int mp4recorder::ProcessFrame( const MediaFrame * f, bool secondary )
 				//}
 			}
 
-			int ret = mediatracks[MP4_AUDIO_TRACK]->ProcessFrame(f);
+			int ret = WriteFrame(MP4_AUDIO_TRACK, f);
 			//Log("Audio: track duration %u, real duration %u.\n", mediatracks[MP4_AUDIO_TRACK]->GetRecordedDuration(), 
 			//    getDifTime(&firstframets)/1000);
 			return ret;
@@ -255,7 +312,7 @@ int mp4recorder::ProcessFrame( const MediaFrame * f, bool secondary )
 			VideoFrame * f2 = (VideoFrame *) f;
 			Mp4VideoTrack * tr = (Mp4VideoTrack *)  mediatracks[trackidx];
 		
-			if ( tr->IsEmpty() )
+			if ( IsTrackEmpty(trackidx) )
 			{
 				Properties properties;
 
@@ -316,7 +373,7 @@ int mp4recorder::ProcessFrame( const MediaFrame * f, bool secondary )
 						if (f4) 
 						{
 							f4->SetTimestamp(ts);
-							tr->ProcessFrame(f4);
+							WriteFrame(trackidx, f4);
 						}
 					}
 				}
@@ -346,7 +403,7 @@ int mp4recorder::ProcessFrame( const MediaFrame * f, bool secondary )
 
 			//Log("Video: track duration %u, real duration %u.\n",tr->GetRecordedDuration(), 
 			//    getDifTime(&firstframets)/1000);
-			int ret = tr->ProcessFrame(f2);
+			int ret = WriteFrame(trackidx, f2);
 			return ret;
 		}
 	    else
@@ -367,7 +424,7 @@ int mp4recorder::ProcessFrame( const MediaFrame * f, bool secondary )
 	    {
 			if (waitVideo) return 0;
 
-			if ( mediatracks[MP4_TEXT_TRACK]->IsEmpty() )
+			if ( IsTrackEmpty(MP4_TEXT_TRACK) )
 			{
 				// adjust initial delay
 				if ( mediatracks[MP4_VIDEO_TRACK] )
@@ -382,7 +439,7 @@ int mp4recorder::ProcessFrame( const MediaFrame * f, bool secondary )
 				}
 			}
 			
-			return mediatracks[MP4_TEXT_TRACK]->ProcessFrame(f);			
+			return WriteFrame(MP4_TEXT_TRACK, f);
 	    }
 		return -3;
 	
@@ -659,10 +716,59 @@ int mp4recorder::ProcessFrame(struct ast_frame * f, bool secondary )
     }
 }
 
-mp4player::mp4player(void * ctxdata, MP4FileHandle mp4)
+/**
+ *  Player sent by the scheduler threads to its channel
+ */
+class Mp4ScheduledPlay : public Mp4PlayScheduler::Listener
 {
+public:
+	Mp4ScheduledPlay(struct ast_channel * chan, struct mp4play * player)
+	{
+		this->chan = chan;
+		this->player = player;
+		status = 0;
+		thread = -1;
+	}
+
+	virtual int onPlay()
+	{
+		return Mp4PlayerPlayNextFrame(chan, player);
+	}
+
+	virtual void onPlayEnd(int code)
+	{
+		status = code;
+		//Wake up the channel thread waiting for it
+		ast_queue_frame(chan, &ast_null_frame);
+	}
+
+public:
+	struct ast_channel * chan;
+	struct mp4play * player;
+	volatile int status;
+	int thread;
+};
+
+mp4player::mp4player(void * ctxdata, MP4FileHandle mp4, bool closeFile)
+{
+	Init(ctxdata);
 	this->mp4 = mp4;
+	this->closeFile = closeFile;
+}
+
+mp4player::mp4player(void * ctxdata, Mp4PlayIndex * index)
+{
+	Init(ctxdata);
+	this->index = index;
+}
+
+void mp4player::Init(void * ctxdata)
+{
 	this->ctxdata = ctxdata;
+	mp4 = MP4_INVALID_FILE_HANDLE;
+	closeFile = false;
+	index = NULL;
+	scheduled = NULL;
 	mediatracks[MP4_AUDIO_TRACK] = NULL;
 	next[MP4_AUDIO_TRACK] = MP4_INVALID_TIMESTAMP;
 	mediatracks[MP4_VIDEO_TRACK] = NULL;
@@ -674,11 +780,62 @@ mp4player::mp4player(void * ctxdata, MP4FileHandle mp4)
 	redenc = NULL;	
 	gettimeofday(&startPlaying,0);
 	nextBOMorRepeat = MP4_INVALID_TIMESTAMP;
+	end = MP4_INVALID_TIMESTAMP;
+	position = MP4_INVALID_TIMESTAMP;
 }
 
 
+/**
+ * Find the indexed track of a media with the preferred codec, or the first one
+ * with a supported codec, as done with the hint tracks of the file
+ */
+template <typename Codec>
+static int FindIndexTrack(Mp4PlayIndex * index, char media, Codec outputCodecs[], unsigned int nbCodecs, Codec prefCodec)
+{
+	int match = -1;
+
+	for (DWORD i=0; i<index->GetNumTracks(); i++)
+	{
+		const Mp4PlayIndex::Track * track = index->GetTrack(i);
+
+		if (track->media != media)
+			continue;
+
+		if (track->codec == prefCodec)
+		{
+			match = i;
+			break;
+		}
+
+		if (match == -1)
+			for (unsigned int j=0; j<nbCodecs; j++)
+				if (outputCodecs[j] == track->codec)
+					match = i;
+	}
+
+	return match;
+}
+
 int mp4player::OpenTrack(AudioCodec::Type outputCodecs[], unsigned int nbCodecs, AudioCodec::Type prefCodec, bool cantranscode )
 {
+    if (nbCodecs > 0 && index)
+    {
+		if (mediatracks[MP4_AUDIO_TRACK] != NULL)
+		{
+			Error("Audio track is already open.\n");
+			return 0;
+		}
+
+		int track = FindIndexTrack(index, 'a', outputCodecs, nbCodecs, prefCodec);
+
+		if (track < 0)
+			return -1;
+
+		mediatracks[MP4_AUDIO_TRACK] = new Mp4IndexTrack(index, track);
+		next[MP4_AUDIO_TRACK] = GetNextTime(MP4_AUDIO_TRACK);
+		return 1;
+    }
+
     if (nbCodecs > 0)
     {
 		MP4TrackId hintId = -1 ;
@@ -846,7 +1003,7 @@ audio_track_loop2:
 		if ( lastTrackMatch != MP4_INVALID_TRACK_ID)
 		{
 			mediatracks[MP4_AUDIO_TRACK] = new Mp4AudioTrack(mp4, lastTrackMatch, lastHintMatch, lastCodecMatch);
-			next[MP4_AUDIO_TRACK] = mediatracks[MP4_AUDIO_TRACK]->GetNextFrameTime();
+			next[MP4_AUDIO_TRACK] = GetNextTime(MP4_AUDIO_TRACK);
 			Log("Opened audio track ID %d.\n", lastTrackMatch);
 			return 1;
 		}
@@ -859,6 +1016,26 @@ audio_track_loop2:
 
 int mp4player::OpenTrack(VideoCodec::Type outputCodecs[], unsigned int nbCodecs, VideoCodec::Type prefCodec, bool cantranscode, bool secondary )
 {
+    if (nbCodecs > 0 && index)
+    {
+		int idx = secondary ? MP4_VIDEODOC_TRACK : MP4_VIDEO_TRACK;
+
+		if (mediatracks[idx] != NULL)
+		{
+			Error("Video track is already open.\n");
+			return 0;
+		}
+
+		int track = FindIndexTrack(index, 'v', outputCodecs, nbCodecs, prefCodec);
+
+		if (track < 0)
+			return 0;
+
+		mediatracks[idx] = new Mp4IndexTrack(index, track);
+		next[idx] = GetNextTime(idx);
+		return 1;
+    }
+
     if (nbCodecs > 0)
     {
 		MP4TrackId hintId = MP4_INVALID_TRACK_ID ;
@@ -959,12 +1136,12 @@ video_track_loop:
 			if (secondary)
 			{
 				mediatracks[MP4_VIDEODOC_TRACK] = new Mp4VideoTrack(mp4, lastTrackMatch, lastHintMatch, c);
-				next[MP4_VIDEODOC_TRACK] = mediatracks[MP4_VIDEODOC_TRACK]->GetNextFrameTime();
+				next[MP4_VIDEODOC_TRACK] = GetNextTime(MP4_VIDEODOC_TRACK);
 			}
 			else
 			{
 				mediatracks[MP4_VIDEO_TRACK] = new Mp4VideoTrack(mp4, lastTrackMatch, lastHintMatch, c);
-				next[MP4_VIDEO_TRACK] = mediatracks[MP4_VIDEO_TRACK]->GetNextFrameTime();
+				next[MP4_VIDEO_TRACK] = GetNextTime(MP4_VIDEO_TRACK);
 			}
 			Log("Opened video track ID %d hint track %d.\n", lastTrackMatch, lastHintMatch);
 			return 1;
@@ -989,12 +1166,13 @@ int mp4player::OpenTrack(TextCodec::Type c, BYTE pt, int rendering)
 		redenc = new RTPRedundantEncoder(pt);
     }
     
-    MP4TrackId textId = MP4FindTrackId(mp4, 0, MP4_SUBTITLE_TRACK_TYPE, 0);
+    // Indexed files have no text track
+    MP4TrackId textId = index ? MP4_INVALID_TRACK_ID : MP4FindTrackId(mp4, 0, MP4_SUBTITLE_TRACK_TYPE, 0);
     
     if (textId != MP4_INVALID_TRACK_ID)
     {
 		mediatracks[MP4_TEXT_TRACK] = new Mp4TextTrack(mp4, textId);
-		next[MP4_TEXT_TRACK] = mediatracks[MP4_TEXT_TRACK]->GetNextFrameTime();
+		next[MP4_TEXT_TRACK] = GetNextTime(MP4_TEXT_TRACK);
 		Log("Opened text track ID %d.\n", textId);
 		if ( next[MP4_TEXT_TRACK] == MP4_INVALID_TIMESTAMP)
 		{
@@ -1027,6 +1205,12 @@ bool mp4player::Eof(void)
 
 bool mp4player::GetCodec(AudioCodec::Type & codec) const
 {
+	if ( mediatracks[MP4_AUDIO_TRACK] && index )
+	{
+		codec = (AudioCodec::Type) ((Mp4IndexTrack *) mediatracks[MP4_AUDIO_TRACK])->GetCodec();
+		return true;
+	}
+
 	if ( mediatracks[MP4_AUDIO_TRACK] )
 	{
 		 Mp4AudioTrack * audiot = (Mp4AudioTrack *) mediatracks[MP4_AUDIO_TRACK];
@@ -1040,12 +1224,13 @@ bool mp4player::GetCodec(AudioCodec::Type & codec) const
 int mp4player::Rewind()
 {
 	gettimeofday(&startPlaying,0);
+	position = MP4_INVALID_TIMESTAMP;
 	for (int i=0; i<4; i++)
 	{
 		if ( mediatracks[i] )
 		{
 			mediatracks[i]->Reset();
-			next[i] = mediatracks[i]->GetNextFrameTime();
+			next[i] = GetNextTime(i);
 		}
 		else
 		{
@@ -1054,6 +1239,92 @@ int mp4player::Rewind()
 	}
 }
 
+int mp4player::Seek(QWORD ms)
+{
+	static const int order[4] = { MP4_VIDEO_TRACK, MP4_AUDIO_TRACK, MP4_VIDEODOC_TRACK, MP4_TEXT_TRACK };
+	QWORD start = MP4_INVALID_TIMESTAMP;
+	int first = -1;
+
+	//Start from the video sync sample before it, text only if there is nothing else
+	for (int i=0; i<4 && first<0; i++)
+	{
+		if ( mediatracks[order[i]] )
+		{
+			start = mediatracks[order[i]]->Seek(ms);
+			if (start != MP4_INVALID_TIMESTAMP) first = order[i];
+		}
+	}
+
+	if (start == MP4_INVALID_TIMESTAMP || start >= end)
+	{
+		for (int i=0; i<4; i++)
+			next[i] = MP4_INVALID_TIMESTAMP;
+		//Reported as played up to there
+		position = ms < end ? ms : end;
+		return -1;
+	}
+
+	//The others from their first sample after it, so no old frame is sent late
+	for (int i=0; i<4; i++)
+	{
+		if ( mediatracks[i] )
+		{
+			if (i != first)
+				mediatracks[i]->SeekAfter(start);
+			next[i] = GetNextTime(i);
+		}
+		else
+		{
+			next[i] = MP4_INVALID_TIMESTAMP;
+		}
+	}
+
+	position = MP4_INVALID_TIMESTAMP;
+
+	//It is due now
+	gettimeofday(&startPlaying,0);
+	startPlaying.tv_sec -= start/1000;
+	startPlaying.tv_usec -= (start%1000)*1000;
+	if (startPlaying.tv_usec < 0)
+	{
+		startPlaying.tv_usec += 1000000;
+		startPlaying.tv_sec--;
+	}
+
+	return 0;
+}
+
+void mp4player::SetEnd(QWORD ms)
+{
+	end = ms;
+
+	for (int i=0; i<4; i++)
+		if ( next[i] != MP4_INVALID_TIMESTAMP && next[i] >= end )
+			next[i] = MP4_INVALID_TIMESTAMP;
+}
+
+QWORD mp4player::GetPosition()
+{
+	//Nothing played after a seek
+	if (position != MP4_INVALID_TIMESTAMP)
+		return position;
+
+	QWORD pos = getDifTime(&startPlaying)/1000;
+
+	return pos < end ? pos : end;
+}
+
+QWORD mp4player::GetNextTime(int trackId)
+{
+	QWORD ts = mediatracks[trackId]->GetNextFrameTime();
+
+	//Frames from the end are not played
+	if ( ts != MP4_INVALID_TIMESTAMP && ts >= end )
+		return MP4_INVALID_TIMESTAMP;
+
+	return ts;
+}
+
 bool mp4player::GetNextTrackAndTs(int & trackId, QWORD & ts)
 {
 	ts = MP4_INVALID_TIMESTAMP;
@@ -1135,7 +1406,7 @@ MediaFrame * mp4player::GetNextFrame( int & errcode, unsigned long & waittime )
 			}
 			
 			//Debug("mp4play: got frame from media %d\n", trackId);
-			next[trackId] = mediatracks[trackId]->GetNextFrameTime();
+			next[trackId] = GetNextTime(trackId);
 			
 			if ( trackId == MP4_TEXT_TRACK )
 			{
@@ -1211,23 +1482,219 @@ MediaFrame * mp4player::GetNextFrame( int & errcode, unsigned long & waittime )
 
 mp4player::~mp4player()
 {
+	//Stop the scheduler before the tracks go
+	if (scheduled)
+	{
+		Mp4PlayScheduler::Remove(scheduled, scheduled->thread);
+		delete scheduled;
+	}
+
     for (int i =0; i < MP4_TEXT_TRACK + 1; i++)
     {
         if ( mediatracks[i] ) delete mediatracks[i];
     }
 
 	if (redenc) delete redenc;	
+	if (index) index->Release();
+	if (closeFile) MP4Close(mp4, 0);
 }
 
 void mp4recorder::Flush()
 {
 	if (mediatracks[MP4_VIDEO_TRACK])
 	{
+		if (queue)
+		{
+			// Writer thread will write it after the queued frames, or after its next batch if full
+			if ( !queue->Push(MP4_VIDEO_TRACK, NULL) )
+			{
+				__sync_synchronize();
+				flushPending = 1;
+			}
+			Mp4WriterPool::Wake(writer);
+			return;
+		}
 		Mp4VideoTrack * tr = (Mp4VideoTrack *)  mediatracks[MP4_VIDEO_TRACK];
 		tr->WriteLastFrame();
 	}
 }
 
+bool mp4recorder::IsTrackEmpty(int trackidx)
+{
+	// Track is updated by the writer thread, check what we have queued
+	if (queue) return !queuedTrack[trackidx] && mediatracks[trackidx]->IsEmpty();
+	
+	return mediatracks[trackidx]->IsEmpty();
+}
+
+int mp4recorder::CreateTrack(int trackidx, const char * trackName, int codec, DWORD rate)
+{
+	// No writer thread using the file
+	if (queue == NULL)
+		return mediatracks[trackidx]->Create(trackName, codec, rate);
+	
+	// Created by the writer thread before the first queued frame of the track, name must stay valid
+	createName[trackidx] = trackName;
+	createCodec[trackidx] = codec;
+	createRate[trackidx] = rate;
+	__sync_synchronize();
+	createPending[trackidx] = 1;
+	Mp4WriterPool::Wake(writer);
+	
+	return 1;
+}
+
+void mp4recorder::CreateQueued(int trackidx)
+{
+	// Called from WriteQueued
+	if ( !__sync_bool_compare_and_swap(&createPending[trackidx], 1, 0) ) return;
+	
+	if ( !mediatracks[trackidx]->Create(createName[trackidx], createCodec[trackidx], createRate[trackidx]) )
+	{
+		// Fragmented files cannot add it after the first fragment
+		Error("-mp4recorder: could not create %s track, it is not recorded.\n", idxToMedia(trackidx));
+		createFailed[trackidx] = true;
+	}
+}
+
+int mp4recorder::WriteFrame(int trackidx, const MediaFrame * f)
+{
+	if (queue == NULL)
+		return mediatracks[trackidx]->ProcessFrame(f);
+
+	// Keep a copy until the writer thread gets it
+	MediaFrame * copy = ((MediaFrame *) f)->Clone();
+	
+	if ( !queue->Push(trackidx, copy) )
+	{
+		// Writer is late, do not block the channel
+		delete copy;
+		dropped++;
+		if ( (dropped & 0xFF) == 1 )
+			Log("-mp4recorder: write queue full, %u frames dropped.\n", dropped);
+		return 0;
+	}
+	
+	queuedTrack[trackidx] = true;
+	queued++;
+	if ( trackidx == MP4_VIDEO_TRACK && ((VideoFrame *) f)->IsIntra() && ((VideoFrame *) f)->GetCodec() == ((Mp4VideoTrack *) mediatracks[trackidx])->GetCodec() )
+		queuedIntra = true;
+	if ( queue->Length() > maxDepth ) maxDepth = queue->Length();
+	
+	Mp4WriterPool::Wake(writer);
+	
+	return 1;
+}
+
+bool mp4recorder::EnableAsync(DWORD queueSize)
+{
+	if (queue) return true;
+	
+	queue = new Mp4FrameQueue(queueSize);
+	
+	// Not written by any other thread yet
+	if ( mediatracks[MP4_VIDEO_TRACK] )
+		queuedIntra = ((Mp4VideoTrack *) mediatracks[MP4_VIDEO_TRACK])->IsVideoStarted();
+	
+	writer = Mp4WriterPool::Add(this);
+	if ( writer < 0 )
+	{
+		// No writer threads running
+		delete queue;
+		queue = NULL;
+		return false;
+	}
+	
+	Log("-mp4recorder: frames will be written by writer thread %d.\n", writer);
+	return true;
+}
+
+void mp4recorder::DisableAsync()
+{
+	if (queue == NULL) return;
+	
+	// Once removed the writer thread does not use the queue anymore
+	Mp4WriterPool::Remove(this, writer);
+	
+	// Write the remaining frames
+	while ( WriteQueued(0xFFFFFFFF) > 0 );
+	
+	Log("-mp4recorder: %u frames written by writer thread %d, %u dropped, max queue depth %u.\n",
+	    queued, writer, dropped, maxDepth);
+
+	delete queue;
+	queue = NULL;
+	writer = -1;
+}
+
+int mp4recorder::WriteQueued(DWORD max)
+{
+	Mp4FrameQueue::Item item;
+	int num = 0;
+	
+	pthread_mutex_lock(&writelock);
+	
+	while ( num < max && queue->Pop(item) )
+	{
+		// Set before the frame was queued
+		CreateQueued(item.track);
+		
+		if ( createFailed[item.track] )
+		{
+			if (item.frame) delete item.frame;
+		}
+		else if (item.frame)
+		{
+			mediatracks[item.track]->ProcessFrame(item.frame);
+			delete item.frame;
+		}
+		else
+		{
+			// Flush
+			((Mp4VideoTrack *) mediatracks[item.track])->WriteLastFrame();
+		}
+		num++;
+	}
+	
+	// Flush that did not fit in the queue, once what was queued before is written
+	if ( queue->Length() == 0 && __sync_bool_compare_and_swap(&flushPending, 1, 0) )
+	{
+		((Mp4VideoTrack *) mediatracks[MP4_VIDEO_TRACK])->WriteLastFrame();
+		num++;
+	}
+	
+	// Tracks without queued frames yet
+	for (int i = 0; i < MP4_TEXT_TRACK + 1; i++)
+	{
+		if ( createPending[i] )
+		{
+			CreateQueued(i);
+			num++;
+		}
+	}
+	
+	pthread_mutex_unlock(&writelock);
+	
+	return num;
+}
+
+bool mp4recorder::HasQueued()
+{
+	if ( queue->Length() > 0 || flushPending ) return true;
+	
+	for (int i = 0; i < MP4_TEXT_TRACK + 1; i++)
+		if ( createPending[i] ) return true;
+	
+	return false;
+}
+
+void mp4recorder::GetAsyncStats(DWORD & queued, DWORD & dropped, DWORD & maxDepth)
+{
+	queued = this->queued;
+	dropped = this->dropped;
+	maxDepth = this->maxDepth;
+}
+
 /* ---- callbeck used for video transcoding --- */
 
 void Mp4RecoderVideoCb(void * ctxdata, int outputcodec, const char *output, size_t outputlen)
@@ -1243,7 +1710,7 @@ void Mp4RecoderVideoCb(void * ctxdata, int outputcodec, const char *output, size
     }
 }    
 
-struct mp4rec * Mp4RecorderCreate(struct ast_channel * chan, MP4FileHandle mp4, bool waitVideo, 
+static struct mp4rec * CreateRecorder(struct ast_channel * chan, MP4FileHandle mp4, Mp4FragmentWriter * fragments, bool waitVideo, 
 				  const char * videoformat, const char * partName, int textfile)
 {
     if ( (chan->nativeformats & AST_FORMAT_VIDEO_MASK) == 0 )
@@ -1253,7 +1720,7 @@ struct mp4rec * Mp4RecorderCreate(struct ast_channel * chan, MP4FileHandle mp4,
 	    chan->name);
     }
     
-    mp4recorder * r = new mp4recorder(chan, mp4, waitVideo);
+    mp4recorder * r = new mp4recorder(chan, mp4, waitVideo, fragments);
     if ( partName == NULL ) partName = chan->cid.cid_name ? chan->cid.cid_name: "unknown";
     if ( r != NULL)
     {
@@ -1269,19 +1736,45 @@ struct mp4rec * Mp4RecorderCreate(struct ast_channel * chan, MP4FileHandle mp4,
 		}
 		
         r->SetParticipantName( partName );
+
+		// The audio track is created on the first audio frame, after the init segment if not waited for
+		if ( fragments != NULL && audio != 0 )
+			fragments->ExpectTrack('a');
+
         if ( videoformat != NULL && strlen(videoformat) > 0 && (chan->nativeformats & AST_FORMAT_VIDEO_MASK) != 0 )
         {
             // Hardcoded for now
 			r->AddTrack(VideoCodec::H264, 640, 480, 256, partName, false );		
 		}
 	
-		if ( chan->nativeformats & AST_FORMAT_TEXT_MASK )
+		// Fragmented files cannot add it later on the first text frame
+		if ( (chan->nativeformats & AST_FORMAT_TEXT_MASK) || fragments != NULL )
 	        r->AddTrack( TextCodec::T140, partName, textfile );
     }
     
     return (struct mp4rec *) r;
 }
 
+struct mp4rec * Mp4RecorderCreate(struct ast_channel * chan, MP4FileHandle mp4, bool waitVideo, 
+				  const char * videoformat, const char * partName, int textfile)
+{
+    return CreateRecorder(chan, mp4, NULL, waitVideo, videoformat, partName, textfile);
+}
+
+struct mp4rec * Mp4RecorderCreateFragmented(struct ast_channel * chan, const char * filename, unsigned long fragmentMs, bool waitVideo, 
+				  const char * videoformat, const char * partName, int textfile)
+{
+    Mp4FragmentWriter * fragments = new Mp4FragmentWriter(fragmentMs);
+    
+    if ( !fragments->Open(filename) )
+    {
+	delete fragments;
+	return NULL;
+    }
+    
+    return CreateRecorder(chan, MP4_INVALID_FILE_HANDLE, fragments, waitVideo, videoformat, partName, textfile);
+}
+
 void Mp4RecorderDestroy( struct mp4rec * r )
 {
     mp4recorder * r2 = (mp4recorder *) r;
@@ -1345,10 +1838,41 @@ void Mp4RecorderEnableVideoPrologue( struct mp4rec * r, bool yesno )
 	r2->EnableVideoPrologue(yesno);
 }
 
-struct mp4play * Mp4PlayerCreate(struct ast_channel * chan, MP4FileHandle mp4, bool transcodeVideo, int renderText)
+void Mp4RecorderSetAudioAggregation( struct mp4rec * r, unsigned long frames )
 {
-	mp4player * p = new mp4player(chan, mp4);
+	mp4recorder * r2 = (mp4recorder *) r;
+	r2->SetAudioAggregation(frames);
+}
+
+int Mp4RecorderEnableAsync( struct mp4rec * r, unsigned long queueSize )
+{
+	mp4recorder * r2 = (mp4recorder *) r;
+	return r2->EnableAsync(queueSize) ? 1 : 0;
+}
+
+void Mp4RecorderGetAsyncStats( struct mp4rec * r, unsigned long * queued, unsigned long * dropped, unsigned long * maxDepth )
+{
+	mp4recorder * r2 = (mp4recorder *) r;
+	DWORD q, d, m;
 	
+	r2->GetAsyncStats(q, d, m);
+	*queued = q;
+	*dropped = d;
+	*maxDepth = m;
+}
+
+int Mp4WriterPoolStart( int threads )
+{
+	return Mp4WriterPool::Start(threads) ? 1 : 0;
+}
+
+void Mp4WriterPoolStop()
+{
+	Mp4WriterPool::Stop();
+}
+
+static struct mp4play * OpenPlayerTracks(mp4player * p, struct ast_channel * chan, bool transcodeVideo, int renderText)
+{
 	if (p)
 	{
 	    int haveAudio           =  chan->nativeformats & AST_FORMAT_AUDIO_MASK ;
@@ -1434,6 +1958,29 @@ struct mp4play * Mp4PlayerCreate(struct ast_channel * chan, MP4FileHandle mp4, b
     return (mp4play *) p;
 }
 
+struct mp4play * Mp4PlayerCreate(struct ast_channel * chan, MP4FileHandle mp4, bool transcodeVideo, int renderText)
+{
+	return OpenPlayerTracks(new mp4player(chan, mp4), chan, transcodeVideo, renderText);
+}
+
+struct mp4play * Mp4PlayerCreateFromFile(struct ast_channel * chan, const char * filename, bool transcodeVideo, int renderText)
+{
+	Mp4PlayIndex * index = Mp4PlayIndexCache::Get(filename);
+
+	// Play the shared index when it has all the media of the file
+	if (index && index->IsComplete())
+		return OpenPlayerTracks(new mp4player(chan, index), chan, transcodeVideo, renderText);
+
+	if (index) index->Release();
+
+	MP4FileHandle mp4 = MP4Read(filename);
+
+	if (mp4 == MP4_INVALID_FILE_HANDLE)
+		return NULL;
+
+	return OpenPlayerTracks(new mp4player(chan, mp4, true), chan, transcodeVideo, renderText);
+}
+
 
 
 
@@ -1507,6 +2054,83 @@ int Mp4PlayerPlayNextFrame(struct ast_channel * chan, struct mp4play * p)
 
 }
 
+int Mp4PlaySchedulerStart( int threads, int pin )
+{
+	return Mp4PlayScheduler::Start(threads, pin) ? 1 : 0;
+}
+
+void Mp4PlaySchedulerStop()
+{
+	Mp4PlayScheduler::Stop();
+}
+
+int Mp4PlayerStart(struct ast_channel * chan, struct mp4play * p)
+{
+	mp4player * p2 = (mp4player *) p;
+
+	if (p2->scheduled)
+		return 1;
+
+	// Translated by ast_write, would delay the other players of the thread
+	if ( chan->writeformat && (chan->writeformat & chan->nativeformats) == 0 )
+	{
+		Log("mp4play: [%s] audio is transcoded, not played by the scheduler threads.\n", chan->name);
+		return 0;
+	}
+
+	p2->scheduled = new Mp4ScheduledPlay(chan, p);
+	p2->scheduled->thread = Mp4PlayScheduler::Add(p2->scheduled);
+
+	if (p2->scheduled->thread < 0)
+	{
+		delete p2->scheduled;
+		p2->scheduled = NULL;
+		return 0;
+	}
+
+	return 1;
+}
+
+void Mp4PlayerStop(struct mp4play * p)
+{
+	mp4player * p2 = (mp4player *) p;
+
+	if (p2->scheduled == NULL)
+		return;
+
+	// Not sent anymore, the destructor does not remove it again
+	Mp4PlayScheduler::Remove(p2->scheduled, p2->scheduled->thread);
+	p2->scheduled->thread = -1;
+}
+
+int Mp4PlayerGetStatus(struct mp4play * p)
+{
+	mp4player * p2 = (mp4player *) p;
+
+	return p2->scheduled ? p2->scheduled->status : 0;
+}
+
+int Mp4PlayerSeek(struct mp4play * p, unsigned long ms)
+{
+	mp4player * p2 = (mp4player *) p;
+
+	return p2->Seek(ms) < 0 ? 0 : 1;
+}
+
+void Mp4PlayerSetEnd(struct mp4play * p, unsigned long ms)
+{
+	mp4player * p2 = (mp4player *) p;
+
+	p2->SetEnd(ms);
+}
+
+unsigned long Mp4PlayerGetPosition(struct mp4play * p)
+{
+	mp4player * p2 = (mp4player *) p;
+
+	return p2->GetPosition();
+}
+
 void Mp4PlayerDestroy( struct mp4play * p )
 {
 	mp4player * p2 = (mp4player *) p;
@@ -0,0 +1,684 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include "medkit/log.h"
+#include "medkit/codecs.h"
+#include "mp4fragment.h"
+
+// Longest media buffered waiting for the tracks and the H.264 parameter sets before writing the init segment
+#define MP4_FRAG_MAX_INIT_WAIT	10000
+
+// Sample flags for trun
+#define MP4_FRAG_SYNC		0x02000000
+#define MP4_FRAG_NON_SYNC	0x01010000
+
+static void Put8(std::vector<BYTE> & out, BYTE v)
+{
+	out.push_back(v);
+}
+
+static void Put16(std::vector<BYTE> & out, WORD v)
+{
+	out.push_back(v >> 8);
+	out.push_back(v);
+}
+
+static void Put32(std::vector<BYTE> & out, DWORD v)
+{
+	out.push_back(v >> 24);
+	out.push_back(v >> 16);
+	out.push_back(v >> 8);
+	out.push_back(v);
+}
+
+static void Put64(std::vector<BYTE> & out, QWORD v)
+{
+	Put32(out, v >> 32);
+	Put32(out, v);
+}
+
+static void PutZeros(std::vector<BYTE> & out, DWORD num)
+{
+	out.insert(out.end(), num, 0);
+}
+
+static void PutBytes(std::vector<BYTE> & out, const BYTE * data, DWORD size)
+{
+	out.insert(out.end(), data, data + size);
+}
+
+static void Set32(std::vector<BYTE> & out, DWORD pos, DWORD v)
+{
+	out[pos] = v >> 24;
+	out[pos + 1] = v >> 16;
+	out[pos + 2] = v >> 8;
+	out[pos + 3] = v;
+}
+
+// Start a box, returns its position to end it
+static DWORD BeginBox(std::vector<BYTE> & out, const char * type)
+{
+	DWORD pos = out.size();
+	Put32(out, 0);
+	PutBytes(out, (const BYTE *) type, 4);
+	return pos;
+}
+
+static DWORD BeginFullBox(std::vector<BYTE> & out, const char * type, BYTE version, DWORD flags)
+{
+	DWORD pos = BeginBox(out, type);
+	Put32(out, (version << 24) | flags);
+	return pos;
+}
+
+static void EndBox(std::vector<BYTE> & out, DWORD pos)
+{
+	Set32(out, pos, out.size() - pos);
+}
+
+static void PutMatrix(std::vector<BYTE> & out)
+{
+	Put32(out, 0x00010000); Put32(out, 0); Put32(out, 0);
+	Put32(out, 0); Put32(out, 0x00010000); Put32(out, 0);
+	Put32(out, 0); Put32(out, 0); Put32(out, 0x40000000);
+}
+
+Mp4FragmentWriter::Mp4FragmentWriter(DWORD fragmentMs)
+{
+	fd = -1;
+	this->fragmentMs = fragmentMs ? fragmentMs : 2000;
+	sequence = 0;
+	initWritten = false;
+	closing = false;
+}
+
+Mp4FragmentWriter::~Mp4FragmentWriter()
+{
+	Close();
+}
+
+bool Mp4FragmentWriter::Open(const char * filename)
+{
+	fd = open(filename, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+
+	if (fd < 0)
+	{
+		Error("-mp4fragment: cannot create file %s.\n", filename);
+		return false;
+	}
+
+	return true;
+}
+
+void Mp4FragmentWriter::Close()
+{
+	if (fd < 0) return;
+
+	// Write the last fragment, with the init segment if it was still waiting
+	closing = true;
+	Flush();
+
+	Log("-mp4fragment: closed file after %u fragments.\n", sequence);
+
+	close(fd);
+	fd = -1;
+}
+
+Mp4FragmentWriter::Track * Mp4FragmentWriter::GetTrack(DWORD id)
+{
+	if (id == 0 || id > tracks.size()) return NULL;
+	return &tracks[id - 1];
+}
+
+DWORD Mp4FragmentWriter::AddTrack(char media, int codec, DWORD timescale, DWORD width, DWORD height)
+{
+	if (initWritten)
+	{
+		Error("-mp4fragment: cannot add a track after the first fragment.\n");
+		return 0;
+	}
+
+	Track track;
+
+	track.id = tracks.size() + 1;
+	track.media = media;
+	track.codec = codec;
+	track.timescale = timescale;
+	track.width = width;
+	track.height = height;
+	track.framesPerSample = 1;
+	track.decodeTime = 0;
+	track.duration = 0;
+
+	tracks.push_back(track);
+
+	// No longer waiting for it
+	for (std::vector<char>::iterator it = expected.begin(); it != expected.end(); ++it)
+	{
+		if (*it == media)
+		{
+			expected.erase(it);
+			break;
+		}
+	}
+
+	return track.id;
+}
+
+DWORD Mp4FragmentWriter::AddAudioTrack(int codec, DWORD rate, DWORD framesPerSample)
+{
+	DWORD id;
+
+	switch (codec)
+	{
+		case AudioCodec::PCMU:
+		case AudioCodec::PCMA:
+			return AddTrack('a', codec, rate, 0, 0);
+		case AudioCodec::AMR:
+			id = AddTrack('a', codec, rate, 0, 0);
+			// Written in the damr box
+			if (id) tracks[id - 1].framesPerSample = framesPerSample;
+			return id;
+		default:
+			Error("-mp4fragment: unsupported audio codec %s.\n", AudioCodec::GetNameFor((AudioCodec::Type) codec));
+			return 0;
+	}
+}
+
+DWORD Mp4FragmentWriter::AddVideoTrack(int codec, DWORD width, DWORD height)
+{
+	switch (codec)
+	{
+		case VideoCodec::H263_1996:
+		case VideoCodec::H263_1998:
+		case VideoCodec::H264:
+			return AddTrack('v', codec, 90000, width, height);
+		default:
+			Error("-mp4fragment: unsupported video codec %s.\n", VideoCodec::GetNameFor((VideoCodec::Type) codec));
+			return 0;
+	}
+}
+
+DWORD Mp4FragmentWriter::AddTextTrack(DWORD width, DWORD height)
+{
+	return AddTrack('t', 0, 1000, width, height);
+}
+
+void Mp4FragmentWriter::ExpectTrack(char media)
+{
+	if (!initWritten)
+		expected.push_back(media);
+}
+
+void Mp4FragmentWriter::SetVideoSize(DWORD id, DWORD width, DWORD height)
+{
+	Track * track = GetTrack(id);
+
+	// Only before it is written in the init segment
+	if (track && !initWritten)
+	{
+		track->width = width;
+		track->height = height;
+	}
+}
+
+void Mp4FragmentWriter::AddH264SequenceParameterSet(DWORD id, const BYTE * data, DWORD size)
+{
+	Track * track = GetTrack(id);
+
+	if (track && track->sps.empty() && size >= 4)
+		track->sps.assign(data, data + size);
+}
+
+void Mp4FragmentWriter::AddH264PictureParameterSet(DWORD id, const BYTE * data, DWORD size)
+{
+	Track * track = GetTrack(id);
+
+	if (track && track->pps.empty())
+		track->pps.assign(data, data + size);
+}
+
+bool Mp4FragmentWriter::WriteSample(DWORD id, const BYTE * data, DWORD size, DWORD duration, bool sync)
+{
+	Track * track = GetTrack(id);
+
+	if (track == NULL || fd < 0) return false;
+
+	// Video key frames start a new fragment so it can be played from there
+	if (track->media == 'v' && sync && !track->samples.empty())
+		if ( !Flush() ) return false;
+
+	Sample sample;
+	sample.size = size;
+	sample.duration = duration;
+	sample.flags = (sync || track->media != 'v') ? MP4_FRAG_SYNC : MP4_FRAG_NON_SYNC;
+
+	track->samples.push_back(sample);
+	PutBytes(track->data, data, size);
+	track->duration += duration;
+
+	// Check fragment length
+	if ( (QWORD) track->duration * 1000 / track->timescale >= fragmentMs )
+		return Flush();
+
+	return true;
+}
+
+bool Mp4FragmentWriter::IsReady()
+{
+	// Last chance to make the file playable
+	if (closing) return true;
+
+	// Do not wait forever, even if the track waited for never gets media
+	for (DWORD i = 0; i < tracks.size(); i++)
+		if ( (QWORD) tracks[i].duration * 1000 / tracks[i].timescale >= MP4_FRAG_MAX_INIT_WAIT )
+			return true;
+
+	// Tracks not added yet
+	if (!expected.empty()) return false;
+
+	for (DWORD i = 0; i < tracks.size(); i++)
+	{
+		Track & track = tracks[i];
+
+		if (track.codec == VideoCodec::H264 && track.media == 'v' && (track.sps.empty() || track.pps.empty()))
+			return false;
+	}
+
+	return true;
+}
+
+bool Mp4FragmentWriter::Flush()
+{
+	if (fd < 0) return false;
+
+	if (!initWritten)
+	{
+		// Keep the samples until we know the tracks and the parameter sets
+		if ( !IsReady() ) return true;
+
+		std::vector<BYTE> init;
+		WriteInit(init);
+		initWritten = true;
+
+		if (!expected.empty())
+			Log("-mp4fragment: init segment written without %u expected tracks.\n", (DWORD) expected.size());
+		expected.clear();
+
+		if ( !Write(&init[0], init.size()) ) return false;
+	}
+
+	DWORD total = 0;
+	std::vector<DWORD> offsets;
+
+	moof.clear();
+
+	DWORD moofPos = BeginBox(moof, "moof");
+
+	DWORD mfhd = BeginFullBox(moof, "mfhd", 0, 0);
+	Put32(moof, sequence + 1);
+	EndBox(moof, mfhd);
+
+	for (DWORD i = 0; i < tracks.size(); i++)
+	{
+		Track & track = tracks[i];
+
+		if (track.samples.empty()) continue;
+
+		DWORD traf = BeginBox(moof, "traf");
+
+		// Data offsets are relative to the moof
+		DWORD tfhd = BeginFullBox(moof, "tfhd", 0, 0x020000);
+		Put32(moof, track.id);
+		EndBox(moof, tfhd);
+
+		DWORD tfdt = BeginFullBox(moof, "tfdt", 1, 0);
+		Put64(moof, track.decodeTime);
+		EndBox(moof, tfdt);
+
+		// Data offset, duration, size and flags for each sample
+		DWORD trun = BeginFullBox(moof, "trun", 0, 0x000701);
+		Put32(moof, track.samples.size());
+		offsets.push_back(moof.size());
+		Put32(moof, total);
+		for (DWORD j = 0; j < track.samples.size(); j++)
+		{
+			Put32(moof, track.samples[j].duration);
+			Put32(moof, track.samples[j].size);
+			Put32(moof, track.samples[j].flags);
+		}
+		EndBox(moof, trun);
+
+		EndBox(moof, traf);
+
+		total += track.data.size();
+	}
+
+	// Nothing to write
+	if (offsets.empty()) return true;
+
+	EndBox(moof, moofPos);
+
+	// Data starts after the moof and the mdat header
+	for (DWORD i = 0; i < offsets.size(); i++)
+	{
+		DWORD pos = offsets[i];
+		DWORD rel = (moof[pos] << 24) | (moof[pos + 1] << 16) | (moof[pos + 2] << 8) | moof[pos + 3];
+		Set32(moof, pos, moof.size() + 8 + rel);
+	}
+
+	Put32(moof, total + 8);
+	PutBytes(moof, (const BYTE *) "mdat", 4);
+
+	bool ok = Write(&moof[0], moof.size());
+
+	for (DWORD i = 0; i < tracks.size(); i++)
+	{
+		Track & track = tracks[i];
+
+		if (track.samples.empty()) continue;
+
+		if (ok && !track.data.empty()) ok = Write(&track.data[0], track.data.size());
+
+		// Start next fragment keeping the allocated memory
+		track.decodeTime += track.duration;
+		track.duration = 0;
+		track.samples.clear();
+		track.data.clear();
+	}
+
+	sequence++;
+
+	return ok;
+}
+
+bool Mp4FragmentWriter::Write(const BYTE * data, DWORD size)
+{
+	while (size > 0)
+	{
+		ssize_t len = write(fd, data, size);
+
+		if (len < 0)
+		{
+			Error("-mp4fragment: write failed.\n");
+			return false;
+		}
+
+		data += len;
+		size -= len;
+	}
+
+	return true;
+}
+
+void Mp4FragmentWriter::WriteInit(std::vector<BYTE> & out)
+{
+	DWORD ftyp = BeginBox(out, "ftyp");
+	PutBytes(out, (const BYTE *) "isom", 4);
+	Put32(out, 0x200);
+	PutBytes(out, (const BYTE *) "isomiso6mp41", 12);
+	EndBox(out, ftyp);
+
+	DWORD moov = BeginBox(out, "moov");
+
+	DWORD mvhd = BeginFullBox(out, "mvhd", 0, 0);
+	Put32(out, 0);			// creation time
+	Put32(out, 0);			// modification time
+	Put32(out, 1000);		// timescale
+	Put32(out, 0);			// duration, it is in the fragments
+	Put32(out, 0x00010000);		// rate
+	Put16(out, 0x0100);		// volume
+	PutZeros(out, 10);
+	PutMatrix(out);
+	PutZeros(out, 24);
+	Put32(out, tracks.size() + 1);	// next track id
+	EndBox(out, mvhd);
+
+	for (DWORD i = 0; i < tracks.size(); i++)
+		WriteTrack(out, tracks[i]);
+
+	DWORD mvex = BeginBox(out, "mvex");
+	for (DWORD i = 0; i < tracks.size(); i++)
+	{
+		DWORD trex = BeginFullBox(out, "trex", 0, 0);
+		Put32(out, tracks[i].id);
+		Put32(out, 1);		// sample description index
+		Put32(out, 0);		// duration
+		Put32(out, 0);		// size
+		Put32(out, 0);		// flags
+		EndBox(out, trex);
+	}
+	EndBox(out, mvex);
+
+	EndBox(out, moov);
+}
+
+void Mp4FragmentWriter::WriteTrack(std::vector<BYTE> & out, Track & track)
+{
+	DWORD trak = BeginBox(out, "trak");
+
+	// Enabled and in movie
+	DWORD tkhd = BeginFullBox(out, "tkhd", 0, 3);
+	Put32(out, 0);
+	Put32(out, 0);
+	Put32(out, track.id);
+	Put32(out, 0);
+	Put32(out, 0);			// duration
+	PutZeros(out, 8);
+	Put16(out, 0);			// layer
+	Put16(out, 0);			// alternate group
+	Put16(out, track.media == 'a' ? 0x0100 : 0);
+	Put16(out, 0);
+	PutMatrix(out);
+	Put32(out, track.width << 16);
+	Put32(out, track.height << 16);
+	EndBox(out, tkhd);
+
+	DWORD mdia = BeginBox(out, "mdia");
+
+	DWORD mdhd = BeginFullBox(out, "mdhd", 0, 0);
+	Put32(out, 0);
+	Put32(out, 0);
+	Put32(out, track.timescale);
+	Put32(out, 0);
+	Put16(out, 0x55C4);		// und
+	Put16(out, 0);
+	EndBox(out, mdhd);
+
+	DWORD hdlr = BeginFullBox(out, "hdlr", 0, 0);
+	Put32(out, 0);
+	switch (track.media)
+	{
+		case 'a':
+			PutBytes(out, (const BYTE *) "soun", 4);
+			break;
+		case 'v':
+			PutBytes(out, (const BYTE *) "vide", 4);
+			break;
+		default:
+			PutBytes(out, (const BYTE *) "sbtl", 4);
+			break;
+	}
+	PutZeros(out, 12);
+	PutBytes(out, (const BYTE *) "mp4save", 8);
+	EndBox(out, hdlr);
+
+	DWORD minf = BeginBox(out, "minf");
+
+	DWORD mhd;
+	switch (track.media)
+	{
+		case 'a':
+			mhd = BeginFullBox(out, "smhd", 0, 0);
+			Put32(out, 0);
+			break;
+		case 'v':
+			mhd = BeginFullBox(out, "vmhd", 0, 1);
+			PutZeros(out, 8);
+			break;
+		default:
+			mhd = BeginFullBox(out, "nmhd", 0, 0);
+			break;
+	}
+	EndBox(out, mhd);
+
+	DWORD dinf = BeginBox(out, "dinf");
+	DWORD dref = BeginFullBox(out, "dref", 0, 0);
+	Put32(out, 1);
+	DWORD url = BeginFullBox(out, "url ", 0, 1);
+	EndBox(out, url);
+	EndBox(out, dref);
+	EndBox(out, dinf);
+
+	// Empty sample tables, samples are in the fragments
+	DWORD stbl = BeginBox(out, "stbl");
+
+	DWORD stsd = BeginFullBox(out, "stsd", 0, 0);
+	Put32(out, 1);
+	WriteSampleEntry(out, track);
+	EndBox(out, stsd);
+
+	DWORD stts = BeginFullBox(out, "stts", 0, 0);
+	Put32(out, 0);
+	EndBox(out, stts);
+
+	DWORD stsc = BeginFullBox(out, "stsc", 0, 0);
+	Put32(out, 0);
+	EndBox(out, stsc);
+
+	DWORD stsz = BeginFullBox(out, "stsz", 0, 0);
+	Put32(out, 0);
+	Put32(out, 0);
+	EndBox(out, stsz);
+
+	DWORD stco = BeginFullBox(out, "stco", 0, 0);
+	Put32(out, 0);
+	EndBox(out, stco);
+
+	EndBox(out, stbl);
+	EndBox(out, minf);
+	EndBox(out, mdia);
+	EndBox(out, trak);
+}
+
+void Mp4FragmentWriter::WriteSampleEntry(std::vector<BYTE> & out, Track & track)
+{
+	DWORD entry;
+
+	if (track.media == 'a')
+	{
+		switch (track.codec)
+		{
+			case AudioCodec::PCMU:
+				entry = BeginBox(out, "ulaw");
+				break;
+			case AudioCodec::PCMA:
+				entry = BeginBox(out, "alaw");
+				break;
+			default:
+				entry = BeginBox(out, "samr");
+				break;
+		}
+		PutZeros(out, 6);
+		Put16(out, 1);			// data reference index
+		PutZeros(out, 8);
+		Put16(out, 1);			// channels
+		Put16(out, track.codec == AudioCodec::AMR ? 16 : 8);
+		Put32(out, 0);
+		Put32(out, track.timescale << 16);
+		if (track.codec == AudioCodec::AMR)
+		{
+			DWORD damr = BeginBox(out, "damr");
+			Put32(out, 0);		// vendor
+			Put8(out, 0);		// decoder version
+			Put16(out, 0);		// mode set
+			Put8(out, 0);		// mode change period
+			Put8(out, track.framesPerSample);	// frames per sample
+			EndBox(out, damr);
+		}
+		EndBox(out, entry);
+	}
+	else if (track.media == 'v')
+	{
+		// Without the parameter sets they can only be in the samples
+		if (track.codec == VideoCodec::H264)
+			entry = BeginBox(out, track.sps.empty() || track.pps.empty() ? "avc3" : "avc1");
+		else
+			entry = BeginBox(out, "s263");
+		PutZeros(out, 6);
+		Put16(out, 1);			// data reference index
+		PutZeros(out, 16);
+		Put16(out, track.width);
+		Put16(out, track.height);
+		Put32(out, 0x00480000);		// 72 dpi
+		Put32(out, 0x00480000);
+		Put32(out, 0);
+		Put16(out, 1);			// frame count
+		PutZeros(out, 32);		// compressor name
+		Put16(out, 0x0018);		// depth
+		Put16(out, 0xFFFF);
+		if (track.codec == VideoCodec::H264)
+		{
+			DWORD avcc = BeginBox(out, "avcC");
+			Put8(out, 1);
+			// Profile, compatibility and level from the SPS
+			Put8(out, track.sps.size() >= 4 ? track.sps[1] : 0x42);
+			Put8(out, track.sps.size() >= 4 ? track.sps[2] : 0xC0);
+			Put8(out, track.sps.size() >= 4 ? track.sps[3] : 0x0D);
+			// 4 bytes NAL lengths
+			Put8(out, 0xFF);
+			Put8(out, 0xE0 | (track.sps.empty() ? 0 : 1));
+			if (!track.sps.empty())
+			{
+				Put16(out, track.sps.size());
+				PutBytes(out, &track.sps[0], track.sps.size());
+			}
+			Put8(out, track.pps.empty() ? 0 : 1);
+			if (!track.pps.empty())
+			{
+				Put16(out, track.pps.size());
+				PutBytes(out, &track.pps[0], track.pps.size());
+			}
+			EndBox(out, avcc);
+		}
+		else
+		{
+			DWORD d263 = BeginBox(out, "d263");
+			PutBytes(out, (const BYTE *) "    ", 4);	// vendor
+			Put8(out, 0);		// decoder version
+			Put8(out, 10);		// level
+			Put8(out, 0);		// profile
+			EndBox(out, d263);
+		}
+		EndBox(out, entry);
+	}
+	else
+	{
+		entry = BeginBox(out, "tx3g");
+		PutZeros(out, 6);
+		Put16(out, 1);			// data reference index
+		Put32(out, 0);			// display flags
+		Put8(out, 1);			// centered
+		Put8(out, 0xFF);		// bottom
+		Put32(out, 0x000000FF);		// background
+		// Text box
+		Put16(out, 0);
+		Put16(out, 0);
+		Put16(out, track.height);
+		Put16(out, track.width);
+		// Default style
+		Put16(out, 0);
+		Put16(out, 0);
+		Put16(out, 1);			// font id
+		Put8(out, 0);			// face
+		Put8(out, 24);			// size
+		Put32(out, 0xFFFFFFFF);		// color
+		DWORD ftab = BeginBox(out, "ftab");
+		Put16(out, 1);
+		Put16(out, 1);
+		Put8(out, 10);
+		PutBytes(out, (const BYTE *) "Sans-Serif", 10);
+		EndBox(out, ftab);
+		EndBox(out, entry);
+	}
+}
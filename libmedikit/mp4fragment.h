@@ -0,0 +1,95 @@
+#ifndef _MP4FRAGMENT_H_
+#define _MP4FRAGMENT_H_
+
+#include <vector>
+#include "medkit/config.h"
+
+/**
+ *  Writes a fragmented MP4 file: an init segment (ftyp and a moov without
+ *  samples) followed by a moof+mdat fragment every few seconds and on each
+ *  video key frame. Only the current fragment is kept in memory, the file can
+ *  be read while it is recorded and closing it does not rewrite anything.
+ */
+class Mp4FragmentWriter
+{
+public:
+	Mp4FragmentWriter(DWORD fragmentMs);
+	~Mp4FragmentWriter();
+
+	bool Open(const char * filename);
+	void Close();
+
+	/**
+	 * Add a track, must be done before the first fragment is written
+	 * @return track id, 0 on error
+	 */
+	DWORD AddAudioTrack(int codec, DWORD rate, DWORD framesPerSample = 1);
+	DWORD AddVideoTrack(int codec, DWORD width, DWORD height);
+	DWORD AddTextTrack(DWORD width, DWORD height);
+
+	/**
+	 * Keep the init segment until a track of this media is added, tracks
+	 * cannot be added once it is written
+	 * @param media: 'a', 'v' or 't'
+	 */
+	void ExpectTrack(char media);
+
+	void SetVideoSize(DWORD track, DWORD width, DWORD height);
+	void AddH264SequenceParameterSet(DWORD track, const BYTE * data, DWORD size);
+	void AddH264PictureParameterSet(DWORD track, const BYTE * data, DWORD size);
+
+	/**
+	 * Append a sample to the current fragment
+	 * @param duration: in the track time scale
+	 * @param sync: key frame, starts a new fragment on video tracks
+	 */
+	bool WriteSample(DWORD track, const BYTE * data, DWORD size, DWORD duration, bool sync);
+
+	DWORD GetFragments() { return sequence; }
+
+private:
+	struct Sample
+	{
+		DWORD size;
+		DWORD duration;
+		DWORD flags;
+	};
+
+	struct Track
+	{
+		DWORD id;
+		char media;
+		int codec;
+		DWORD timescale;
+		DWORD width;
+		DWORD height;
+		DWORD framesPerSample;
+		std::vector<BYTE> sps;
+		std::vector<BYTE> pps;
+		QWORD decodeTime;
+		DWORD duration;
+		std::vector<Sample> samples;
+		std::vector<BYTE> data;
+	};
+
+	Track * GetTrack(DWORD id);
+	DWORD AddTrack(char media, int codec, DWORD timescale, DWORD width, DWORD height);
+	bool Flush();
+	bool IsReady();
+	void WriteInit(std::vector<BYTE> & out);
+	void WriteTrack(std::vector<BYTE> & out, Track & track);
+	void WriteSampleEntry(std::vector<BYTE> & out, Track & track);
+	bool Write(const BYTE * data, DWORD size);
+
+private:
+	int fd;
+	DWORD fragmentMs;
+	DWORD sequence;
+	bool initWritten;
+	bool closing;
+	std::vector<Track> tracks;
+	std::vector<char> expected;
+	std::vector<BYTE> moof;
+};
+
+#endif
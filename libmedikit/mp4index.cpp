@@ -0,0 +1,646 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <set>
+#include <vector>
+#include "medkit/log.h"
+#include "medkit/codecs.h"
+#include "medkit/video.h"
+#include "mp4index.h"
+
+// Indexes not played kept by default
+#define MP4_INDEX_MAX_UNUSED	(128*1024*1024)
+
+// Bigger files are indexed on their second play only
+#define MP4_INDEX_MAX_FIRST	(16*1024*1024)
+
+// Files played once remembered
+#define MP4_INDEX_MAX_PLAYED	1024
+
+// Max size of the packets of tracks without hint
+#define MP4_INDEX_MTU		1400
+
+// Align to 8
+#define ALIGN8(x)	((((x)+7)>>3)<<3)
+
+typedef std::vector<Mp4PlayIndex::Track>	Tracks;
+typedef std::vector<Mp4PlayIndex::Frame>	Frames;
+typedef std::vector<Mp4PlayIndex::Packet>	Packets;
+typedef std::vector<BYTE>			Payload;
+
+static void AddPacket(const BYTE * data, DWORD len, bool mark, Packets & packets, Payload & payload)
+{
+	Mp4PlayIndex::Packet packet;
+
+	packet.offset = payload.size();
+	packet.length = len;
+	packet.mark = mark;
+	packets.push_back(packet);
+	payload.insert(payload.end(), data, data + len);
+}
+
+static bool ReadPacket(MP4FileHandle mp4, MP4TrackId hintId, WORD index, bool mark, Packets & packets, Payload & payload)
+{
+	BYTE * data = NULL;
+	u_int32_t len = 0;
+
+	// Payload only, as when playing from the file
+	if ( !MP4ReadRtpPacket(mp4, hintId, index, (u_int8_t **) &data, &len, 0, 0, 1) )
+		return Error("-Mp4PlayIndex: error reading packet %d from hint track %d\n", index, hintId);
+
+	if (data != NULL && len > 0)
+		AddPacket(data, len, mark, packets, payload);
+
+	if (data) free(data);
+
+	return true;
+}
+
+// Get the media and the codec of a hint track
+static bool GetHintedTrack(MP4FileHandle mp4, MP4TrackId hintId, Mp4PlayIndex::Track & track)
+{
+	char * name = NULL;
+	bool ok = false;
+
+	track.hintTrack = hintId;
+	track.mediaTrack = MP4GetHintTrackReferenceTrackId(mp4, hintId);
+
+	if (track.mediaTrack == MP4_INVALID_TRACK_ID)
+		return false;
+
+	const char * type = MP4GetTrackType(mp4, track.mediaTrack);
+
+	if (type == NULL)
+		return false;
+
+	MP4GetHintTrackRtpPayload(mp4, hintId, &name, NULL, NULL, NULL);
+
+	if (strcmp(type, MP4_AUDIO_TRACK_TYPE) == 0)
+	{
+		// No payload name is AMR
+		AudioCodec::Type c = AudioCodec::AMR;
+		ok = name == NULL || AudioCodec::GetCodecFor(name, c);
+		track.media = 'a';
+		track.codec = c;
+	}
+	else if (strcmp(type, MP4_VIDEO_TRACK_TYPE) == 0)
+	{
+		VideoCodec::Type c;
+		ok = name != NULL && VideoCodec::GetCodecFor(name, c);
+		track.media = 'v';
+		track.codec = c;
+	}
+
+	if (name) MP4Free(name);
+
+	return ok;
+}
+
+// Get the H.264 parameter sets sent before each intra frame
+static void GetH264Params(MP4FileHandle mp4, MP4TrackId trackId, Payload & params, std::vector<DWORD> & sizes)
+{
+	uint8_t **seqheader = NULL, **pictheader = NULL;
+	uint32_t *seqheadersize = NULL, *pictheadersize = NULL;
+
+	MP4GetTrackH264SeqPictHeaders(mp4, trackId, &seqheader, &seqheadersize, &pictheader, &pictheadersize);
+
+	if (seqheader != NULL && seqheadersize != NULL)
+	{
+		for (DWORD i = 0; seqheadersize[i] != 0; i++)
+		{
+			params.insert(params.end(), seqheader[i], seqheader[i] + seqheadersize[i]);
+			sizes.push_back(seqheadersize[i]);
+			free(seqheader[i]);
+		}
+	}
+
+	if (pictheader != NULL && pictheadersize != NULL)
+	{
+		for (DWORD i = 0; pictheadersize[i] != 0; i++)
+		{
+			params.insert(params.end(), pictheader[i], pictheader[i] + pictheadersize[i]);
+			sizes.push_back(pictheadersize[i]);
+			free(pictheader[i]);
+		}
+	}
+
+	if (pictheader) MP4Free(pictheader);
+	if (pictheadersize) MP4Free(pictheadersize);
+	if (seqheader) MP4Free(seqheader);
+	if (seqheadersize) MP4Free(seqheadersize);
+}
+
+// Read all the packets of a hint track, one frame per sample or per packet of aggregated audio
+static void ReadHintTrack(MP4FileHandle mp4, const Mp4PlayIndex::Track & track, Frames & frames, Packets & packets, Payload & payload)
+{
+	Payload params;
+	std::vector<DWORD> paramSizes;
+
+	MP4SampleId numSamples = MP4GetTrackNumberOfSamples(mp4, track.hintTrack);
+	DWORD timeScale = MP4GetTrackTimeScale(mp4, track.hintTrack);
+	DWORD clock = (track.media == 'v') ? 90000 : 8000;
+
+	if (track.media == 'v' && track.codec == VideoCodec::H264)
+		GetH264Params(mp4, track.mediaTrack, params, paramSizes);
+
+	for (MP4SampleId sampleId = 1; sampleId <= numSamples; sampleId++)
+	{
+		Mp4PlayIndex::Frame frame;
+		WORD numHintSamples = 0;
+
+		if (!MP4ReadRtpHint(mp4, track.hintTrack, sampleId, &numHintSamples))
+		{
+			// Playing the file stops here too
+			Error("-Mp4PlayIndex: error reading hint track ID %d sample %d\n", track.hintTrack, sampleId);
+			return;
+		}
+
+		MP4Timestamp start = MP4GetSampleTime(mp4, track.hintTrack, sampleId);
+		MP4Duration duration = MP4GetSampleDuration(mp4, track.hintTrack, sampleId);
+
+		// Aggregated audio frames are played one packet at a time
+		if (track.media == 'a' && numHintSamples > 1)
+		{
+			for (WORD i = 0; i < numHintSamples; i++)
+			{
+				frame.time = MP4ConvertFromTrackTimestamp(mp4, track.hintTrack, start + duration * i / numHintSamples, 1000);
+				frame.ts = (start + duration / numHintSamples * i) * clock / timeScale;
+				frame.duration = duration / numHintSamples / timeScale;
+				frame.intra = 0;
+				frame.packet = packets.size();
+				ReadPacket(mp4, track.hintTrack, i, true, packets, payload);
+				frame.numPackets = packets.size() - frame.packet;
+				frames.push_back(frame);
+			}
+			continue;
+		}
+
+		// Timestamp and duration come from the media sample
+		MP4Timestamp mediaStart = MP4GetSampleTime(mp4, track.mediaTrack, sampleId);
+		MP4Duration mediaDuration = MP4GetSampleDuration(mp4, track.mediaTrack, sampleId);
+
+		frame.time = MP4ConvertFromTrackTimestamp(mp4, track.hintTrack, start, 1000);
+		frame.ts = mediaStart * clock / timeScale;
+		frame.duration = mediaDuration / timeScale;
+		frame.intra = (track.media == 'v' && MP4GetSampleSync(mp4, track.mediaTrack, sampleId) > 0);
+		frame.packet = packets.size();
+
+		// Intra frames start with the parameter sets
+		if (frame.intra)
+		{
+			DWORD pos = 0;
+			for (DWORD i = 0; i < paramSizes.size(); i++)
+			{
+				AddPacket(&params[pos], paramSizes[i], false, packets, payload);
+				pos += paramSizes[i];
+			}
+		}
+
+		for (WORD i = 0; i < numHintSamples; i++)
+			if (!ReadPacket(mp4, track.hintTrack, i, i+1 == numHintSamples, packets, payload))
+				break;
+
+		frame.numPackets = packets.size() - frame.packet;
+		frames.push_back(frame);
+	}
+}
+
+// Get the codec of an audio or video track without hint, packetized when indexed
+static bool GetMediaTrack(MP4FileHandle mp4, MP4TrackId trackId, Mp4PlayIndex::Track & track)
+{
+	const char * type = MP4GetTrackType(mp4, trackId);
+	const char * name = MP4GetTrackMediaDataName(mp4, trackId);
+
+	track.mediaTrack = trackId;
+	track.hintTrack = MP4_INVALID_TRACK_ID;
+
+	if (type == NULL || name == NULL)
+		return false;
+
+	if (strcmp(type, MP4_AUDIO_TRACK_TYPE) == 0)
+	{
+		AudioCodec::Type c;
+		if (!AudioCodec::GetCodecFor(name, c))
+			return false;
+		track.media = 'a';
+		track.codec = c;
+		return true;
+	}
+
+	// Only H.264 is packetized
+	if (strcmp(type, MP4_VIDEO_TRACK_TYPE) == 0 && strcmp(name, "avc1") == 0)
+	{
+		track.media = 'v';
+		track.codec = VideoCodec::H264;
+		return true;
+	}
+
+	return false;
+}
+
+// Read all the samples of a track without hint and packetize them, one frame per sample
+static bool ReadMediaTrack(MP4FileHandle mp4, const Mp4PlayIndex::Track & track, Frames & frames, Packets & packets, Payload & payload)
+{
+	Payload params;
+	std::vector<DWORD> paramSizes;
+	VideoFrame video((VideoCodec::Type) track.codec, 0);
+	Payload buffer;
+
+	MP4SampleId numSamples = MP4GetTrackNumberOfSamples(mp4, track.mediaTrack);
+	DWORD timeScale = MP4GetTrackTimeScale(mp4, track.mediaTrack);
+	DWORD clock = (track.media == 'v') ? 90000 : 8000;
+
+	if (track.media == 'v')
+	{
+		uint32_t lengthSize = 4;
+		MP4GetTrackH264LengthSize(mp4, track.mediaTrack, &lengthSize);
+		video.SetH264NalSizeLength(lengthSize);
+		GetH264Params(mp4, track.mediaTrack, params, paramSizes);
+	}
+
+	for (MP4SampleId sampleId = 1; sampleId <= numSamples; sampleId++)
+	{
+		Mp4PlayIndex::Frame frame;
+		BYTE * data = NULL;
+		u_int32_t len = 0;
+		MP4Timestamp start;
+		MP4Duration duration;
+		MP4Duration renderingOffset;
+		bool isSyncSample;
+
+		if (!MP4ReadSample(mp4, track.mediaTrack, sampleId, (u_int8_t **) &data, &len, &start, &duration, &renderingOffset, &isSyncSample))
+			return Error("-Mp4PlayIndex: error reading sample %d of track %d\n", sampleId, track.mediaTrack);
+
+		frame.time = MP4ConvertFromTrackTimestamp(mp4, track.mediaTrack, start, 1000);
+		frame.ts = start * clock / timeScale;
+		frame.duration = duration / timeScale;
+		frame.intra = (track.media == 'v' && isSyncSample);
+		frame.packet = packets.size();
+
+		if (track.media == 'a')
+		{
+			// Whole sample in one packet
+			if (len > 0)
+				AddPacket(data, len, true, packets, payload);
+		}
+		else
+		{
+			// Intra frames start with the parameter sets
+			if (frame.intra)
+			{
+				DWORD pos = 0;
+				for (DWORD i = 0; i < paramSizes.size(); i++)
+				{
+					AddPacket(&params[pos], paramSizes[i], false, packets, payload);
+					pos += paramSizes[i];
+				}
+			}
+
+			video.SetMedia(data, len);
+
+			if (!video.Packetize(MP4_INDEX_MTU))
+			{
+				free(data);
+				return Error("-Mp4PlayIndex: could not packetize sample %d of track %d\n", sampleId, track.mediaTrack);
+			}
+
+			// Payload of each packet with its FU-A header
+			MediaFrame::RtpPacketizationInfo & info = video.GetRtpPacketizationInfo();
+			for (MediaFrame::RtpPacketizationInfo::iterator it = info.begin(); it != info.end(); ++it)
+			{
+				MediaFrame::RtpPacketization * rtp = *it;
+				buffer.assign(rtp->GetPrefixData(), rtp->GetPrefixData() + rtp->GetPrefixLen());
+				buffer.insert(buffer.end(), video.GetData() + rtp->GetPos(), video.GetData() + rtp->GetPos() + rtp->GetSize());
+				AddPacket(&buffer[0], buffer.size(), rtp->IsMark(), packets, payload);
+			}
+		}
+
+		free(data);
+
+		frame.numPackets = packets.size() - frame.packet;
+		frames.push_back(frame);
+	}
+
+	return true;
+}
+
+Mp4PlayIndex::Mp4PlayIndex()
+{
+	map = NULL;
+	size = 0;
+	tracks = NULL;
+	numTracks = 0;
+	frames = NULL;
+	packets = NULL;
+	payload = NULL;
+	complete = false;
+	mtime = 0;
+	fileSize = 0;
+	inode = 0;
+	refs = 0;
+	cached = false;
+	building = false;
+	released = 0;
+}
+
+Mp4PlayIndex::~Mp4PlayIndex()
+{
+	if (map) munmap(map, size);
+}
+
+bool Mp4PlayIndex::Build(const char * filename)
+{
+	Tracks tracks;
+	Frames frames;
+	Packets packets;
+	Payload payload;
+	std::set<MP4TrackId> indexed;
+
+	MP4FileHandle mp4 = MP4Read(filename);
+
+	if (mp4 == MP4_INVALID_FILE_HANDLE)
+		return Error("-Mp4PlayIndex: could not open %s\n", filename);
+
+	for (int i = 0; ; i++)
+	{
+		Track track;
+
+		MP4TrackId hintId = MP4FindTrackId(mp4, i, MP4_HINT_TRACK_TYPE, 0);
+
+		if (hintId == MP4_INVALID_TRACK_ID)
+			break;
+
+		if (!GetHintedTrack(mp4, hintId, track))
+			continue;
+
+		track.frame = frames.size();
+		ReadHintTrack(mp4, track, frames, packets, payload);
+		track.numFrames = frames.size() - track.frame;
+
+		tracks.push_back(track);
+		indexed.insert(track.mediaTrack);
+	}
+
+	// Tracks without hint are packetized here once, not on each play
+	for (u_int32_t i = 0; i < MP4GetNumberOfTracks(mp4, NULL, 0); i++)
+	{
+		Track track;
+
+		MP4TrackId trackId = MP4FindTrackId(mp4, i, NULL, 0);
+
+		if (indexed.find(trackId) != indexed.end() || !GetMediaTrack(mp4, trackId, track))
+			continue;
+
+		DWORD numFrames = frames.size();
+		DWORD numPackets = packets.size();
+		DWORD payloadSize = payload.size();
+
+		if (!ReadMediaTrack(mp4, track, frames, packets, payload))
+		{
+			// Played from the file
+			frames.resize(numFrames);
+			packets.resize(numPackets);
+			payload.resize(payloadSize);
+			continue;
+		}
+
+		track.frame = numFrames;
+		track.numFrames = frames.size() - numFrames;
+
+		tracks.push_back(track);
+		indexed.insert(track.mediaTrack);
+	}
+
+	// Text and tracks that could not be indexed are only played from the file
+	complete = true;
+	for (u_int32_t i = 0; i < MP4GetNumberOfTracks(mp4, NULL, 0); i++)
+	{
+		MP4TrackId trackId = MP4FindTrackId(mp4, i, NULL, 0);
+		const char * type = MP4GetTrackType(mp4, trackId);
+
+		if (type == NULL)
+			continue;
+
+		if (strcmp(type, MP4_AUDIO_TRACK_TYPE) == 0 || strcmp(type, MP4_VIDEO_TRACK_TYPE) == 0)
+		{
+			if (indexed.find(trackId) == indexed.end())
+				complete = false;
+		}
+		else if (strcmp(type, MP4_TEXT_TRACK_TYPE) == 0 || strcmp(type, MP4_SUBTITLE_TRACK_TYPE) == 0)
+		{
+			complete = false;
+		}
+	}
+
+	MP4Close(mp4, 0);
+
+	if (tracks.empty())
+		return Error("-Mp4PlayIndex: no audio or video track to index in %s\n", filename);
+
+	// One mapping with the tables and the payload
+	DWORD tracksSize = ALIGN8(tracks.size() * sizeof(Track));
+	DWORD framesSize = ALIGN8(frames.size() * sizeof(Frame));
+	DWORD packetsSize = ALIGN8(packets.size() * sizeof(Packet));
+
+	size = tracksSize + framesSize + packetsSize + payload.size();
+
+	BYTE * p = (BYTE *) mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED)
+		return Error("-Mp4PlayIndex: could not map %u bytes for %s\n", size, filename);
+
+	map = p;
+	this->tracks = (Track *) p;
+	this->frames = (Frame *) (p + tracksSize);
+	this->packets = (Packet *) (p + tracksSize + framesSize);
+	this->payload = p + tracksSize + framesSize + packetsSize;
+	numTracks = tracks.size();
+
+	memcpy(this->tracks, &tracks[0], tracks.size() * sizeof(Track));
+	if (!frames.empty())
+		memcpy(this->frames, &frames[0], frames.size() * sizeof(Frame));
+	if (!packets.empty())
+		memcpy(this->packets, &packets[0], packets.size() * sizeof(Packet));
+	if (!payload.empty())
+		memcpy(this->payload, &payload[0], payload.size());
+
+	// Shared by the players, nobody writes it
+	mprotect(map, size, PROT_READ);
+
+	Log("-Mp4PlayIndex: %s indexed, %u tracks, %u frames, %u packets, %u bytes%s\n", filename,
+	    numTracks, frames.size(), packets.size(), size, complete ? "" : ", incomplete");
+
+	return true;
+}
+
+void Mp4PlayIndex::Release()
+{
+	Mp4PlayIndexCache::Release(this);
+}
+
+pthread_mutex_t Mp4PlayIndexCache::lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t Mp4PlayIndexCache::built = PTHREAD_COND_INITIALIZER;
+Mp4PlayIndexCache::Indexes Mp4PlayIndexCache::indexes;
+Mp4PlayIndexCache::PlayedFiles Mp4PlayIndexCache::played;
+QWORD Mp4PlayIndexCache::maxUnused = MP4_INDEX_MAX_UNUSED;
+QWORD Mp4PlayIndexCache::unused = 0;
+
+Mp4PlayIndex * Mp4PlayIndexCache::Get(const char * filename)
+{
+	struct stat st;
+
+	if (stat(filename, &st) < 0)
+		return NULL;
+
+	pthread_mutex_lock(&lock);
+
+	Indexes::iterator it = indexes.find(filename);
+
+	while (it != indexes.end())
+	{
+		Mp4PlayIndex * index = it->second;
+
+		if (index->mtime == st.st_mtime && index->fileSize == st.st_size && index->inode == st.st_ino)
+		{
+			if (index->building)
+			{
+				// Wait for the player building it, look again as it is removed if it fails
+				pthread_cond_wait(&built, &lock);
+				it = indexes.find(filename);
+				continue;
+			}
+
+			if (index->refs++ == 0)
+				unused -= index->size;
+			pthread_mutex_unlock(&lock);
+			return index;
+		}
+
+		// File changed, the players of the old one keep it until they end
+		indexes.erase(it);
+		index->cached = false;
+		if (index->refs == 0)
+		{
+			unused -= index->size;
+			delete index;
+		}
+		break;
+	}
+
+	if (st.st_size > MP4_INDEX_MAX_FIRST)
+	{
+		PlayedFiles::iterator p = played.find(filename);
+
+		if (p == played.end() || p->second.mtime != st.st_mtime || p->second.fileSize != st.st_size || p->second.inode != st.st_ino)
+		{
+			// Not worth copying it for a single play
+			if (played.size() >= MP4_INDEX_MAX_PLAYED)
+				played.clear();
+
+			Played & file = played[filename];
+			file.mtime = st.st_mtime;
+			file.fileSize = st.st_size;
+			file.inode = st.st_ino;
+
+			pthread_mutex_unlock(&lock);
+			return NULL;
+		}
+
+		played.erase(p);
+	}
+
+	// Others playing it meanwhile wait for this build
+	Mp4PlayIndex * index = new Mp4PlayIndex();
+
+	index->filename = filename;
+	index->mtime = st.st_mtime;
+	index->fileSize = st.st_size;
+	index->inode = st.st_ino;
+	index->refs = 1;
+	index->cached = true;
+	index->building = true;
+	indexes[filename] = index;
+
+	pthread_mutex_unlock(&lock);
+
+	// Build it without the lock, other files are played meanwhile
+	bool ok = index->Build(filename);
+
+	pthread_mutex_lock(&lock);
+
+	index->building = false;
+
+	if (!ok)
+	{
+		if (index->cached)
+			indexes.erase(index->filename);
+		delete index;
+		index = NULL;
+	}
+
+	pthread_cond_broadcast(&built);
+	pthread_mutex_unlock(&lock);
+
+	return index;
+}
+
+void Mp4PlayIndexCache::Release(Mp4PlayIndex * index)
+{
+	pthread_mutex_lock(&lock);
+
+	if (--index->refs == 0)
+	{
+		if (index->cached)
+		{
+			index->released = getTime();
+			unused += index->size;
+			Evict();
+		}
+		else
+		{
+			delete index;
+		}
+	}
+
+	pthread_mutex_unlock(&lock);
+}
+
+// Free the indexes not played for the longest time until it fits, called with the lock
+void Mp4PlayIndexCache::Evict()
+{
+	while (unused > maxUnused)
+	{
+		Indexes::iterator oldest = indexes.end();
+
+		for (Indexes::iterator it = indexes.begin(); it != indexes.end(); ++it)
+			if (it->second->refs == 0 && (oldest == indexes.end() || it->second->released < oldest->second->released))
+				oldest = it;
+
+		if (oldest == indexes.end())
+			break;
+
+		Mp4PlayIndex * index = oldest->second;
+		indexes.erase(oldest);
+		unused -= index->size;
+		delete index;
+	}
+}
+
+void Mp4PlayIndexCache::SetMaxUnused(QWORD bytes)
+{
+	pthread_mutex_lock(&lock);
+	maxUnused = bytes;
+	Evict();
+	pthread_mutex_unlock(&lock);
+}
+
+void Mp4PlayIndexCache::Purge()
+{
+	pthread_mutex_lock(&lock);
+	QWORD max = maxUnused;
+	maxUnused = 0;
+	Evict();
+	maxUnused = max;
+	pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,134 @@
+#ifndef _MP4INDEX_H_
+#define _MP4INDEX_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <map>
+#include <string>
+#include <mp4v2/mp4v2.h>
+#include "medkit/config.h"
+
+/**
+ *  RTP packets of the audio and video tracks of an MP4 file, read once from
+ *  the hint tracks, or packetized once for tracks without hint, and kept in a
+ *  read only mapping shared by all the players of the file. The packets of a
+ *  frame are contiguous, so a frame is played straight from the mapping.
+ */
+class Mp4PlayIndex
+{
+public:
+	struct Packet
+	{
+		DWORD offset;		// in the payload
+		WORD  length;
+		BYTE  mark;
+	};
+
+	struct Frame
+	{
+		QWORD time;		// ms from the start, to schedule it
+		DWORD ts;		// in the RTP clock of the media
+		DWORD duration;
+		DWORD packet;		// first packet
+		WORD  numPackets;
+		BYTE  intra;
+	};
+
+	struct Track
+	{
+		char media;		// 'a' or 'v'
+		int codec;
+		MP4TrackId mediaTrack;
+		MP4TrackId hintTrack;	// invalid if packetized when indexed
+		DWORD frame;		// first frame
+		DWORD numFrames;
+	};
+
+	DWORD GetNumTracks()			{ return numTracks;			}
+	const Track * GetTrack(DWORD i)		{ return tracks + i;			}
+	const Frame * GetFrame(const Track * track, DWORD i) { return frames + track->frame + i; }
+	const Packet * GetPackets(const Frame * frame) { return packets + frame->packet;	}
+	const BYTE * GetPayload(DWORD offset)	{ return payload + offset;		}
+
+	// All the media of the file is in the index, there is no text nor track it could not packetize
+	bool IsComplete()			{ return complete;			}
+	DWORD GetSize()				{ return size;				}
+
+	// Given back to the cache
+	void Release();
+
+private:
+	friend class Mp4PlayIndexCache;
+
+	Mp4PlayIndex();
+	~Mp4PlayIndex();
+
+	bool Build(const char * filename);
+
+private:
+	BYTE *	 map;
+	DWORD	 size;
+	Track *	 tracks;
+	DWORD	 numTracks;
+	Frame *	 frames;
+	Packet * packets;
+	BYTE *	 payload;
+	bool	 complete;
+
+	// Cache entry
+	std::string filename;
+	time_t	 mtime;
+	off_t	 fileSize;
+	ino_t	 inode;
+	int	 refs;
+	bool	 cached;
+	bool	 building;
+	QWORD	 released;
+};
+
+/**
+ *  Process wide indexes by path. An index is built on the first play of a
+ *  small file, or on the second play of a big one which is played from the
+ *  file the first time. It is rebuilt when the file changes, and indexes not
+ *  played are kept up to a memory limit.
+ */
+class Mp4PlayIndexCache
+{
+public:
+	/**
+	 * Get the index of a file with a reference, building it if needed.
+	 * Waits for the build when another player is building it.
+	 * @return NULL if the file can not be read or is not indexed yet
+	 */
+	static Mp4PlayIndex * Get(const char * filename);
+
+	// Memory kept in indexes not played, 128MB by default
+	static void SetMaxUnused(QWORD bytes);
+	// Free all the indexes not played
+	static void Purge();
+
+private:
+	typedef std::map<std::string, Mp4PlayIndex *> Indexes;
+
+	struct Played
+	{
+		time_t mtime;
+		off_t  fileSize;
+		ino_t  inode;
+	};
+	typedef std::map<std::string, Played> PlayedFiles;
+
+	friend class Mp4PlayIndex;
+	static void Release(Mp4PlayIndex * index);
+	static void Evict();
+
+private:
+	static pthread_mutex_t lock;
+	static pthread_cond_t built;
+	static Indexes indexes;
+	static PlayedFiles played;
+	static QWORD maxUnused;
+	static QWORD unused;
+};
+
+#endif
@@ -0,0 +1,281 @@
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <algorithm>
+#include "medkit/log.h"
+#include "mp4scheduler.h"
+
+// Max time a thread sleeps, to check if it is stopped
+#define MP4_SCHEDULER_IDLE	100000
+
+pthread_mutex_t Mp4PlayScheduler::lock = PTHREAD_MUTEX_INITIALIZER;
+Mp4PlayScheduler::Thread * Mp4PlayScheduler::threads = NULL;
+int Mp4PlayScheduler::numThreads = 0;
+
+// Order the heap by the earliest deadline
+bool Mp4PlayScheduler::Later(const Deadline & a, const Deadline & b)
+{
+	return a.time > b.time;
+}
+
+// Monotonic time in us, not moved by clock changes
+static QWORD Now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((QWORD)ts.tv_sec)*1000000 + ts.tv_nsec/1000;
+}
+
+static void WaitUntil(pthread_cond_t * cond, pthread_mutex_t * mutex, QWORD time)
+{
+	struct timespec ts;
+	ts.tv_sec = time/1000000;
+	ts.tv_nsec = (time%1000000)*1000;
+	pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+bool Mp4PlayScheduler::Start(int num, bool pin)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	pthread_mutex_lock(&lock);
+
+	if (threads)
+	{
+		// Already running
+		pthread_mutex_unlock(&lock);
+		return true;
+	}
+
+	numThreads = num > 0 ? num : 1;
+	threads = new Thread[numThreads];
+
+	for (int i = 0; i < numThreads; i++)
+	{
+		pthread_condattr_t attr;
+
+		// Deadlines are in monotonic time
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&threads[i].cond, &attr);
+		pthread_condattr_destroy(&attr);
+
+		pthread_cond_init(&threads[i].played, NULL);
+		pthread_mutex_init(&threads[i].mutex, NULL);
+		threads[i].playing = NULL;
+		threads[i].num = 0;
+		threads[i].wakeups = 0;
+		threads[i].stop = false;
+		pthread_create(&threads[i].thread, NULL, Run, &threads[i]);
+
+		if (pin && cpus > 0)
+		{
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(i % cpus, &set);
+			if (pthread_setaffinity_np(threads[i].thread, sizeof(set), &set) != 0)
+				Error("-mp4player: failed to pin scheduler thread %d.\n", i);
+		}
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	Log("-mp4player: started %d scheduler threads.\n", numThreads);
+	return true;
+}
+
+void Mp4PlayScheduler::Stop()
+{
+	pthread_mutex_lock(&lock);
+
+	if (threads == NULL)
+	{
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+
+	for (int i = 0; i < numThreads; i++)
+	{
+		pthread_mutex_lock(&threads[i].mutex);
+		threads[i].stop = true;
+		pthread_cond_signal(&threads[i].cond);
+		pthread_mutex_unlock(&threads[i].mutex);
+
+		pthread_join(threads[i].thread, NULL);
+
+		// Nobody sends their frames anymore
+		for (Deadlines::iterator it = threads[i].heap.begin(); it != threads[i].heap.end(); ++it)
+			it->listener->onPlayEnd(MP4_SCHEDULER_STOPPED);
+
+		pthread_cond_destroy(&threads[i].played);
+		pthread_cond_destroy(&threads[i].cond);
+		pthread_mutex_destroy(&threads[i].mutex);
+	}
+
+	delete[] threads;
+	threads = NULL;
+	numThreads = 0;
+
+	pthread_mutex_unlock(&lock);
+}
+
+int Mp4PlayScheduler::Add(Listener * listener)
+{
+	int best = 0;
+
+	pthread_mutex_lock(&lock);
+
+	if (threads == NULL)
+	{
+		pthread_mutex_unlock(&lock);
+		return -1;
+	}
+
+	for (int i = 1; i < numThreads; i++)
+		if (threads[i].num < threads[best].num) best = i;
+
+	Thread * thread = &threads[best];
+	Deadline deadline = { Now(), listener };
+
+	pthread_mutex_lock(&thread->mutex);
+	thread->heap.push_back(deadline);
+	std::push_heap(thread->heap.begin(), thread->heap.end(), Later);
+	thread->num++;
+	pthread_cond_signal(&thread->cond);
+	pthread_mutex_unlock(&thread->mutex);
+
+	pthread_mutex_unlock(&lock);
+
+	return best;
+}
+
+void Mp4PlayScheduler::Remove(Listener * listener, int num)
+{
+	pthread_mutex_lock(&lock);
+
+	if (threads != NULL && num >= 0 && num < numThreads)
+	{
+		Thread * thread = &threads[num];
+
+		pthread_mutex_lock(&thread->mutex);
+
+		// Only wait for its own frames
+		while (thread->playing == listener)
+			pthread_cond_wait(&thread->played, &thread->mutex);
+
+		// Scheduled, or played in the current batch
+		Deadlines::iterator it;
+		for (it = thread->heap.begin(); it != thread->heap.end(); ++it)
+			if (it->listener == listener) break;
+
+		if (it != thread->heap.end())
+		{
+			thread->heap.erase(it);
+			std::make_heap(thread->heap.begin(), thread->heap.end(), Later);
+			thread->num--;
+		}
+		else
+		{
+			for (it = thread->batch.begin(); it != thread->batch.end(); ++it)
+			{
+				if (it->listener == listener)
+				{
+					thread->batch.erase(it);
+					thread->num--;
+					break;
+				}
+			}
+		}
+
+		pthread_mutex_unlock(&thread->mutex);
+	}
+
+	pthread_mutex_unlock(&lock);
+}
+
+void Mp4PlayScheduler::GetStats(DWORD & players, QWORD & wakeups)
+{
+	players = 0;
+	wakeups = 0;
+
+	pthread_mutex_lock(&lock);
+
+	for (int i = 0; i < numThreads; i++)
+	{
+		pthread_mutex_lock(&threads[i].mutex);
+		players += threads[i].num;
+		wakeups += threads[i].wakeups;
+		pthread_mutex_unlock(&threads[i].mutex);
+	}
+
+	pthread_mutex_unlock(&lock);
+}
+
+void * Mp4PlayScheduler::Run(void * arg)
+{
+	Thread * thread = (Thread *) arg;
+	Deadlines & heap = thread->heap;
+	Deadlines & batch = thread->batch;
+
+	pthread_mutex_lock(&thread->mutex);
+
+	while (!thread->stop)
+	{
+		QWORD now = Now();
+
+		if (heap.empty() || heap.front().time > now)
+		{
+			QWORD until = now + MP4_SCHEDULER_IDLE;
+
+			if (!heap.empty() && heap.front().time < until)
+				until = heap.front().time;
+
+			WaitUntil(&thread->cond, &thread->mutex, until);
+			continue;
+		}
+
+		thread->wakeups++;
+
+		// Send all the frames due in one go
+		while (!heap.empty() && heap.front().time <= now)
+		{
+			std::pop_heap(heap.begin(), heap.end(), Later);
+			Deadline deadline = heap.back();
+			heap.pop_back();
+
+			// Sent without the lock, Add and Remove of other players do not wait for the channel
+			thread->playing = deadline.listener;
+			pthread_mutex_unlock(&thread->mutex);
+
+			int ms = deadline.listener->onPlay();
+
+			if (ms < 0)
+				deadline.listener->onPlayEnd(ms);
+
+			pthread_mutex_lock(&thread->mutex);
+			thread->playing = NULL;
+			pthread_cond_broadcast(&thread->played);
+
+			if (ms < 0)
+			{
+				thread->num--;
+				continue;
+			}
+
+			// Scheduled after the batch, so it is not played twice in it
+			deadline.time = Now() + ((QWORD)ms)*1000;
+			batch.push_back(deadline);
+		}
+
+		for (Deadlines::iterator it = batch.begin(); it != batch.end(); ++it)
+		{
+			heap.push_back(*it);
+			std::push_heap(heap.begin(), heap.end(), Later);
+		}
+		batch.clear();
+	}
+
+	pthread_mutex_unlock(&thread->mutex);
+
+	return NULL;
+}
@@ -0,0 +1,93 @@
+#ifndef _MP4SCHEDULER_H_
+#define _MP4SCHEDULER_H_
+
+#include <pthread.h>
+#include <vector>
+#include "medkit/config.h"
+
+/**
+ *  Threads sending the frames of all the scheduled players. Each thread keeps
+ *  a min-heap of the time the next frame of its players is due, and sends all
+ *  the frames due at once when it wakes up, so a player costs no thread and
+ *  no timer of its own.
+ */
+class Mp4PlayScheduler
+{
+public:
+	class Listener
+	{
+	public:
+		/**
+		 * Send the frames due, called from a scheduler thread without its lock.
+		 * The other players of the thread wait for it, so it must not block.
+		 * @return ms until the next frame is due, negative to stop playing
+		 */
+		virtual int onPlay() = 0;
+
+		/**
+		 * Playing stopped with the code returned by onPlay, called from a scheduler thread
+		 */
+		virtual void onPlayEnd(int code) = 0;
+	};
+
+	/**
+	 * @param pin: bind each thread to a cpu
+	 */
+	static bool Start(int threads, bool pin);
+
+	/**
+	 * Stop the threads, players still scheduled end with MP4_SCHEDULER_STOPPED
+	 */
+	static void Stop();
+
+	/**
+	 * Add a player to the least loaded thread, its first frames are sent right away
+	 * @return the thread index, or -1 if not started
+	 */
+	static int Add(Listener * listener);
+
+	/**
+	 * Remove a player, once it returns the thread is not sending its frames.
+	 * Waits for its onPlay or onPlayEnd if running.
+	 */
+	static void Remove(Listener * listener, int thread);
+
+	static void GetStats(DWORD & players, QWORD & wakeups);
+
+private:
+	struct Deadline
+	{
+		QWORD time;
+		Listener * listener;
+	};
+
+	typedef std::vector<Deadline> Deadlines;
+
+	struct Thread
+	{
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		// Signalled when onPlay returns
+		pthread_cond_t played;
+		Listener * playing;
+		Deadlines heap;
+		Deadlines batch;
+		int num;
+		QWORD wakeups;
+		bool stop;
+	};
+
+	static void * Run(void * thread);
+	static bool Later(const Deadline & a, const Deadline & b);
+
+private:
+	static pthread_mutex_t lock;
+	static Thread * threads;
+	static int numThreads;
+};
+
+// Code passed to onPlayEnd for the players scheduled when stopping
+#define MP4_SCHEDULER_STOPPED	-7
+
+#endif
@@ -24,7 +24,9 @@ Mp4Basetrack::Mp4Basetrack(MP4FileHandle mp4, MP4TrackId mediaTrack, MP4TrackId
 	    timeScale = MP4GetTrackTimeScale(mp4, mediaTrack);
 
 	frame = NULL;
+	fragments = NULL;
 	numHintSamples = 0;
+	hintPacket = 0;
 	totalDuration = 0;
 }
 
@@ -38,6 +40,17 @@ Mp4Basetrack::Mp4Basetrack(MP4FileHandle mp4, unsigned long initialDelay)
 	this->initialDelay = initialDelay;
 	reading = false;
 	frame = NULL;
+	fragments = NULL;
+	numHintSamples = 0;
+	hintPacket = 0;
+}
+
+bool Mp4Basetrack::WriteSample(const BYTE * data, DWORD size, DWORD duration, bool sync)
+{
+	if (fragments)
+		return fragments->WriteSample(mediatrack, data, size, duration, sync);
+
+	return MP4WriteSample(mp4, mediatrack, data, size, duration, 0, sync);
 }
 
 	
@@ -50,6 +63,9 @@ QWORD Mp4Basetrack::GetNextFrameTime()
 	ts = MP4GetSampleTime(mp4, hinttrack, sampleId);
         if (ts==MP4_INVALID_TIMESTAMP)
 	    return ts;
+	// Next packet of an aggregated audio sample
+	if (hintPacket > 0)
+	    ts += MP4GetSampleDuration(mp4, hinttrack, sampleId) * hintPacket / numHintSamples;
         ts = MP4ConvertFromTrackTimestamp(mp4, hinttrack, ts, 1000);
     }
     else
@@ -63,6 +79,51 @@ QWORD Mp4Basetrack::GetNextFrameTime()
     return ts;
 }
 
+QWORD Mp4Basetrack::Seek(QWORD ms)
+{
+    return SeekSample(ms, true);
+}
+
+QWORD Mp4Basetrack::SeekAfter(QWORD ms)
+{
+    return SeekSample(ms, false);
+}
+
+QWORD Mp4Basetrack::SeekSample(QWORD ms, bool sync)
+{
+    // Sync sample of the media from its stss table, any sample if it has none
+    MP4Timestamp when = MP4ConvertToTrackTimestamp(mp4, mediatrack, ms, 1000);
+    MP4SampleId id = MP4GetSampleIdFromTime(mp4, mediatrack, when, sync);
+
+    hintPacket = 0;
+
+    // Or the one after the sample playing at that time
+    if (!sync && id != MP4_INVALID_SAMPLE_ID && MP4GetSampleTime(mp4, mediatrack, id) < when)
+    {
+	if (++id > MP4GetTrackNumberOfSamples(mp4, mediatrack))
+	    id = MP4_INVALID_SAMPLE_ID;
+    }
+
+    if (id != MP4_INVALID_SAMPLE_ID && hinttrack != MP4_INVALID_TRACK_ID)
+    {
+	// Hint sample sent at the same time
+	when = MP4GetSampleTime(mp4, mediatrack, id);
+	when = when * MP4GetTrackTimeScale(mp4, hinttrack) / MP4GetTrackTimeScale(mp4, mediatrack);
+	id = MP4GetSampleIdFromTime(mp4, hinttrack, when, false);
+    }
+
+    if (id == MP4_INVALID_SAMPLE_ID)
+    {
+	// After the end
+	sampleId = MP4GetTrackNumberOfSamples(mp4, hinttrack != MP4_INVALID_TRACK_ID ? hinttrack : mediatrack) + 1;
+	return MP4_INVALID_TIMESTAMP;
+    }
+
+    sampleId = id;
+
+    return GetNextFrameTime();
+}
+
 const MediaFrame * Mp4Basetrack::ReadFrame()
 {
     if (hinttrack != MP4_INVALID_TRACK_ID)
@@ -91,6 +152,10 @@ const MediaFrame * Mp4Basetrack::ReadFrameFromHint()
 	    return NULL;
 	}
 	
+	// Rest of an aggregated audio sample
+	if (hintPacket > 0)
+		return ReadHintPacket();
+	
 	// Get number of rtp packets for this sample
 	if (!MP4ReadRtpHint(mp4, hinttrack, sampleId, &numHintSamples))
 	{
@@ -100,6 +165,10 @@ const MediaFrame * Mp4Basetrack::ReadFrameFromHint()
 		return NULL;
 	}
 
+	// Aggregated audio frames are played one packet at a time
+	if (frame->GetType() == MediaFrame::Audio && numHintSamples > 1)
+		return ReadHintPacket();
+
 	// Get number of samples for this sample
 	frameSamples = MP4GetSampleDuration(mp4, hinttrack, sampleId);
 
@@ -207,6 +276,46 @@ const MediaFrame * Mp4Basetrack::ReadFrameFromHint()
 	return frame;
 }
 
+const MediaFrame * Mp4Basetrack::ReadHintPacket()
+{
+	BYTE * rtpdata = NULL;
+	u_int32_t rtpLen = 0;
+	
+	// Each packet holds one frame of the same duration
+	MP4Timestamp startTime = MP4GetSampleTime(mp4, hinttrack, sampleId);
+	MP4Duration duration = MP4GetSampleDuration(mp4, hinttrack, sampleId) / numHintSamples;
+	
+	frame->ClearRTPPacketizationInfo();
+	frame->SetLength(0);
+	frame->SetDuration(duration/timeScale);
+	frame->SetTimestamp((startTime + duration*hintPacket)*8000/timeScale);
+	
+	if ( !MP4ReadRtpPacket(mp4, hinttrack, hintPacket, (u_int8_t **) &rtpdata, &rtpLen, 0, 0, 1) )
+	{
+		Error("Error reading packet from hinttrack ID %d mediatrack %d index %d]\n", hinttrack, mediatrack, hintPacket);
+		// Skip the sample
+		hintPacket = 0;
+		sampleId++;
+		return NULL;
+	}
+	
+	if (rtpdata != NULL && rtpLen > 0)
+	{
+		frame->AppendMedia(rtpdata, rtpLen);
+		frame->AddRtpPacket(0, rtpLen, NULL, 0, true);
+		free(rtpdata);
+	}
+	
+	// Go to next sample after its last packet
+	if (++hintPacket == numHintSamples)
+	{
+		hintPacket = 0;
+		sampleId++;
+	}
+	
+	return frame;
+}
+
 const MediaFrame * Mp4Basetrack::ReadFrameWithoutHint()
 {
     	int last = 0;
@@ -225,15 +334,6 @@ const MediaFrame * Mp4Basetrack::ReadFrameWithoutHint()
 	    return NULL;
 	}
 	
-	// Get number of rtp packets for this sample
-	if (!MP4ReadRtpHint(mp4, hinttrack, sampleId, &numHintSamples))
-	{
-		//Print error
-		Error("Error reading hint track ID %d\n", hinttrack);
-		//Exit
-		return NULL;
-	}
-
 	// Get number of samples for this sample
 	frameSamples = MP4GetSampleDuration(mp4, mediatrack, sampleId);
 
@@ -307,6 +407,19 @@ int Mp4AudioTrack::Create(const char * trackName, int codec, DWORD samplerate)
     // Create audio track
     AACSpecificConfig config(samplerate,1);
     uint8_t type;
+    
+    if (fragments)
+    {
+	// No hint track on fragmented files
+	mediatrack = fragments->AddAudioTrack(codec, codec == AudioCodec::AMR ? samplerate : 8000, aggregation);
+	if ( !IsOpen() ) return 0;
+	Log("-mp4recorder: opened fragmented audio track [%s] id:%d codec %s.\n", 
+	    (trackName != NULL) ? trackName : "unnamed",
+	    mediatrack, AudioCodec::GetNameFor((AudioCodec::Type) codec));
+	this->codec = (AudioCodec::Type) codec;
+	return 1;
+    }
+    
     switch (codec)
     {
         case AudioCodec::PCMA:
@@ -346,7 +459,7 @@ int Mp4AudioTrack::Create(const char * trackName, int codec, DWORD samplerate)
 		break;
 
 	case AudioCodec::AMR:
-	    mediatrack = MP4AddAmrAudioTrack(mp4, samplerate, 0, 0, 1, 0);
+	    mediatrack = MP4AddAmrAudioTrack(mp4, samplerate, 0, 0, aggregation, 0);
 	    // Create audio hint track
 	    hinttrack = MP4AddHintTrack(mp4, mediatrack);
 			// Set payload type for hint track
@@ -358,6 +471,8 @@ int Mp4AudioTrack::Create(const char * trackName, int codec, DWORD samplerate)
 	
 	case AudioCodec::AAC:
 	    // TODO: complete AAC support
+	    // Each AAC frame must be its own sample
+	    aggregation = 1;
 	    mediatrack = MP4AddAudioTrack(mp4, samplerate, 1024, MP4_MPEG2_AAC_LC_AUDIO_TYPE);
 	    // Create no hint track
         
@@ -406,23 +521,8 @@ int Mp4AudioTrack::ProcessFrame( const MediaFrame * f )
 			    else
 				duration = initialDelay - d;
 			     duration = duration*f2->GetRate()/1000;
-			     MP4WriteSample(mp4, mediatrack, silence->GetData(), silence->GetLength(), duration, 0, 1 );
+			     WriteAudioSample(silence->GetData(), silence->GetLength(), duration);
 			     sampleId++;
-	    		    if (hinttrack != MP4_INVALID_TRACK_ID)
-	    		    {
-				// Add rtp hint
-				MP4AddRtpHint(mp4, hinttrack);
-
-				///Create packet
-				MP4AddRtpPacket(mp4, hinttrack, 0, 0);
-
-				// Set full frame as data
-				MP4AddRtpSampleData(mp4, hinttrack, sampleId, 0, f->GetLength());
-
-				// Write rtp hint
-				MP4WriteRtpHint(mp4, hinttrack, duration, 1);
-			    }
-	    
 			}
 		}
 		duration = 20*f2->GetRate()/1000;
@@ -437,25 +537,9 @@ int Mp4AudioTrack::ProcessFrame( const MediaFrame * f )
 			}
 	    }
 	    prevts = f2->GetTimeStamp();
-	    MP4WriteSample(mp4, mediatrack, f2->GetData(), f2->GetLength(), duration, 0, 1 );
+	    WriteAudioSample(f2->GetData(), f2->GetLength(), duration);
 	    sampleId++;
 		totalDuration += duration / ( f2->GetRate()/1000 ) ;
-		
-	    if (hinttrack != MP4_INVALID_TRACK_ID)
-	    {
-		// Add rtp hint
-		MP4AddRtpHint(mp4, hinttrack);
-
-		///Create packet
-		MP4AddRtpPacket(mp4, hinttrack, 0, 0);
-
-		// Set full frame as data
-		MP4AddRtpSampleData(mp4, hinttrack, sampleId, 0, f->GetLength());
-
-		// Write rtp hint
-		MP4WriteRtpHint(mp4, hinttrack, duration, 1);
-	    
-	    }
 	    
 	    if ( sampleId > 1 ) return 1;
 	    
@@ -475,10 +559,80 @@ int Mp4AudioTrack::ProcessFrame( const MediaFrame * f )
     return -2;
 }
 
+void Mp4AudioTrack::SetAggregation(DWORD frames)
+{
+	if (frames < 1) frames = 1;
+	if (frames > MP4_MAX_AGGREGATED_FRAMES) frames = MP4_MAX_AGGREGATED_FRAMES;
+	aggregation = frames;
+}
+
+void Mp4AudioTrack::WriteAudioSample(const BYTE * data, DWORD size, DWORD duration)
+{
+	// Frames of a sample must have the same duration to be played back
+	if (numPending > 0 && duration != pendingDuration)
+		WritePending();
+	
+	if (pending == NULL)
+		pending = new AudioFrame(codec, 8000);
+	
+	if (numPending == 0)
+		pending->SetLength(0);
+	
+	pending->AppendMedia(data, size);
+	pendingSizes[numPending++] = size;
+	pendingDuration = duration;
+	
+	if (numPending >= aggregation)
+		WritePending();
+}
+
+void Mp4AudioTrack::WritePending()
+{
+	DWORD pos = 0;
+	
+	if (numPending == 0) return;
+	
+	WriteSample(pending->GetData(), pending->GetLength(), pendingDuration*numPending, true);
+	stored++;
+	
+	if (hinttrack != MP4_INVALID_TRACK_ID)
+	{
+		// Add rtp hint
+		MP4AddRtpHint(mp4, hinttrack);
+		
+		for (DWORD i = 0; i < numPending; i++)
+		{
+			///Create one packet per frame, sent at its own time
+			MP4AddRtpPacket(mp4, hinttrack, 0, i*pendingDuration);
+			
+			// Set frame as data
+			MP4AddRtpSampleData(mp4, hinttrack, stored, pos, pendingSizes[i]);
+			pos += pendingSizes[i];
+		}
+		
+		// Write rtp hint
+		MP4WriteRtpHint(mp4, hinttrack, pendingDuration*numPending, 1);
+	}
+	
+	numPending = 0;
+}
+
 int Mp4VideoTrack::Create(const char * trackName, int codec, DWORD bitrate)
 {
 	BYTE type;
 	MP4Duration h264FrameDuration;
+	
+	if (fragments)
+	{
+		// No hint track, parameter sets are added when found
+		mediatrack = fragments->AddVideoTrack(codec, width, height);
+		if ( !IsOpen() ) return 0;
+		this->codec = (VideoCodec::Type) codec;
+		if ( trackName ) this->trackName = trackName; 
+		Log("-mp4recorder: created fragmented video track [%s] id:%d using codec %s.\n", 
+		    this->trackName.c_str(), mediatrack, VideoCodec::GetNameFor( (VideoCodec::Type) codec));
+		return 1;
+	}
 		
 	//Check the codec
 	switch (codec)
@@ -544,7 +698,9 @@ int Mp4VideoTrack::DoWritePrevFrame(DWORD duration)
 	sampleId++;
 	//Log("Process VIDEO frame sampleId: %d, ts:%lu, duration %u.\n", sampleId, frame->GetTimeStamp(), duration);
 	
-	MP4WriteSample(mp4, mediatrack, frame->GetData(), frame->GetLength(), duration, 0, ((VideoFrame *) frame)->IsIntra());
+	//Fragments need the parameter sets before the first sample
+	if (!fragments)
+		MP4WriteSample(mp4, mediatrack, frame->GetData(), frame->GetLength(), duration, 0, ((VideoFrame *) frame)->IsIntra());
 
 	//Check if we have rtp data
 	if (frame->HasRtpPacketizationInfo())
@@ -552,7 +708,8 @@ int Mp4VideoTrack::DoWritePrevFrame(DWORD duration)
 		//Get list
 		MediaFrame::RtpPacketizationInfo& rtpInfo = frame->GetRtpPacketizationInfo();
 		//Add hint for frame
-		MP4AddRtpHint(mp4, hinttrack);
+		if (hinttrack != MP4_INVALID_TRACK_ID)
+			MP4AddRtpHint(mp4, hinttrack);
 		//Get iterator
 		MediaFrame::RtpPacketizationInfo::iterator it = rtpInfo.begin();
 		
@@ -592,6 +749,14 @@ int Mp4VideoTrack::DoWritePrevFrame(DWORD duration)
 					width = sps.GetWidth();
 					height = sps.GetHeight();
 					
+					if (!hasSPS && fragments)
+					{
+						//Add it to the init segment
+						fragments->AddH264SequenceParameterSet(mediatrack,data,rtp->GetSize());
+						fragments->SetVideoSize(mediatrack,width,height);
+						hasSPS = true;
+					}
+					
 					if (!hasSPS)
 					{
 						//Add it
@@ -617,6 +782,13 @@ int Mp4VideoTrack::DoWritePrevFrame(DWORD duration)
 				//If it is a PPS NAL
 				if (nalType==0x08)
 				{
+					if (!hasPPS && fragments)
+					{
+						//Add it to the init segment
+						fragments->AddH264PictureParameterSet(mediatrack,data,rtp->GetSize());
+						hasPPS = true;
+					}
+					
 					if (!hasPPS)
 					{
 						//Add it
@@ -628,6 +800,10 @@ int Mp4VideoTrack::DoWritePrevFrame(DWORD duration)
 				}
 			}	
 			
+			//No hints on fragmented files
+			if (hinttrack == MP4_INVALID_TRACK_ID)
+				continue;
+			
 			// It was before AddH264Seq ....
 			MP4AddRtpPacket(mp4, hinttrack, rtp->IsMark(), 0);
 
@@ -642,8 +818,13 @@ int Mp4VideoTrack::DoWritePrevFrame(DWORD duration)
 		}
 		
 		//Save rtp
-		MP4WriteRtpHint(mp4, hinttrack, duration, ((VideoFrame *) frame)->IsIntra());
+		if (hinttrack != MP4_INVALID_TRACK_ID)
+			MP4WriteRtpHint(mp4, hinttrack, duration, ((VideoFrame *) frame)->IsIntra());
 	}
+	
+	if (fragments)
+		fragments->WriteSample(mediatrack, frame->GetData(), frame->GetLength(), duration, ((VideoFrame *) frame)->IsIntra());
+	
 	return 0;
 }
 
@@ -809,9 +990,14 @@ Mp4TextTrack::Mp4TextTrack(MP4FileHandle mp4, MP4TrackId mediaTrack) : Mp4Basetr
 
 int Mp4TextTrack::Create(const char * trackName, int codec, DWORD bitrate)
 {
-    mediatrack = MP4AddSubtitleTrack(mp4,1000,384,60);
-    if ( IsOpen() && trackName != NULL ) MP4SetTrackName( mp4, mediatrack, trackName );
-    if ( IsOpen() ) Log("-mp4recorder: created text track %d.\n", mediatrack);
+    if (fragments)
+	mediatrack = fragments->AddTextTrack(384,60);
+    else
+	mediatrack = MP4AddSubtitleTrack(mp4,1000,384,60);
+    if ( IsOpen() && trackName != NULL && !fragments ) MP4SetTrackName( mp4, mediatrack, trackName );
+    if ( !IsOpen() ) return 0;
+    Log("-mp4recorder: created text track %d.\n", mediatrack);
+    return 1;
 }
 
 int Mp4TextTrack::ProcessFrame( const MediaFrame * f )
@@ -835,7 +1021,7 @@ int Mp4TextTrack::ProcessFrame( const MediaFrame * f )
 			//Set size
 			silence[0] = 0;
 			silence[1] = 0;
-			MP4WriteSample( mp4, mediatrack, silence, 2, initialDelay, 0, true );
+			WriteSample( silence, 2, initialDelay, true );
 			Log("Adding %d ms of initial delay on text track id:%d.\n", initialDelay, mediatrack);
 		}
 		frameduration = 100; 
@@ -867,7 +1053,7 @@ int Mp4TextTrack::ProcessFrame( const MediaFrame * f )
 	
 	memcpy(data+2, subtitle.data(), subsize);
 	    
-	MP4WriteSample( mp4, mediatrack, data, subsize+2, frameduration, 0, true );
+	WriteSample( data, subsize+2, frameduration, true );
 	    
 	if (duration > MAX_SUBTITLE_DURATION)
 	{
@@ -878,7 +1064,7 @@ int Mp4TextTrack::ProcessFrame( const MediaFrame * f )
 		data[1] = 0;
 
 		//Write sample
-		MP4WriteSample( mp4, mediatrack, data, 2, frameduration, 0, false );
+		WriteSample( data, 2, frameduration, false );
 	}
 
 	sampleId++;
@@ -1059,3 +1245,116 @@ Mp4TextTrack::~Mp4TextTrack()
 	
 	if (conv1) delete conv1;
 }
+
+Mp4IndexTrack::Mp4IndexTrack(Mp4PlayIndex * index, DWORD track) : Mp4Basetrack(MP4_INVALID_FILE_HANDLE, 0)
+{
+	this->index = index;
+	this->track = index->GetTrack(track);
+	mediatrack = this->track->mediaTrack;
+	hinttrack = this->track->hintTrack;
+	reading = true;
+	next = 0;
+
+	// The frame does not own its data, it points to the index
+	if (this->track->media == 'v')
+		frame = new VideoFrame((VideoCodec::Type) this->track->codec, 0, false);
+	else
+		frame = new AudioFrame((AudioCodec::Type) this->track->codec, 8000, false);
+
+	Log("Opened indexed %s track ID %d Hint %d\n", this->track->media == 'v' ? "video" : "audio", mediatrack, hinttrack);
+}
+
+QWORD Mp4IndexTrack::GetNextFrameTime()
+{
+	if (next >= track->numFrames)
+		return MP4_INVALID_TIMESTAMP;
+
+	return index->GetFrame(track, next)->time;
+}
+
+QWORD Mp4IndexTrack::Seek(QWORD ms)
+{
+	DWORD first = 0;
+	DWORD last = track->numFrames;
+
+	// First frame starting after it
+	while (first < last)
+	{
+		DWORD mid = (first + last) / 2;
+
+		if (index->GetFrame(track, mid)->time <= ms)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+
+	// After the last frame started
+	if (first == track->numFrames && (first == 0 || index->GetFrame(track, first - 1)->time < ms))
+	{
+		next = track->numFrames;
+		return MP4_INVALID_TIMESTAMP;
+	}
+
+	next = first > 0 ? first - 1 : 0;
+
+	// Video can only start on an intra frame
+	if (track->media == 'v')
+		while (next > 0 && !index->GetFrame(track, next)->intra)
+			next--;
+
+	return GetNextFrameTime();
+}
+
+QWORD Mp4IndexTrack::SeekAfter(QWORD ms)
+{
+	DWORD first = 0;
+	DWORD last = track->numFrames;
+
+	// First frame starting at or after it
+	while (first < last)
+	{
+		DWORD mid = (first + last) / 2;
+
+		if (index->GetFrame(track, mid)->time < ms)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+
+	next = first;
+
+	return GetNextFrameTime();
+}
+
+const MediaFrame * Mp4IndexTrack::ReadFrame()
+{
+	if (next >= track->numFrames)
+		return NULL;
+
+	const Mp4PlayIndex::Frame * f = index->GetFrame(track, next++);
+	const Mp4PlayIndex::Packet * packets = index->GetPackets(f);
+
+	frame->ClearRTPPacketizationInfo();
+	frame->SetTimestamp(f->ts);
+	frame->SetDuration(f->duration);
+
+	if (frame->GetType() == MediaFrame::Video)
+		((VideoFrame *) frame)->SetIntra(f->intra);
+
+	if (f->numPackets == 0)
+	{
+		frame->SetMedia(NULL, 0);
+		return frame;
+	}
+
+	// Packets of a frame are contiguous in the index
+	DWORD first = packets[0].offset;
+	const Mp4PlayIndex::Packet & last = packets[f->numPackets-1];
+
+	frame->SetMedia(index->GetPayload(first), last.offset + last.length - first);
+
+	for (WORD i = 0; i < f->numPackets; i++)
+		frame->AddRtpPacket(packets[i].offset - first, packets[i].length, NULL, 0, packets[i].mark);
+
+	return frame;
+}
@@ -5,6 +5,8 @@
 #include "medkit/video.h"
 #include "medkit/text.h"
 #include "medkit/textencoder.h"
+#include "mp4fragment.h"
+#include "mp4index.h"
 
 
 class Mp4Basetrack
@@ -36,18 +38,39 @@ public:
     void SetInitialDelay(unsigned long delay) { initialDelay = delay; }
     void IncreateInitialDelay(unsigned long delay) { initialDelay = initialDelay + delay; }
     bool IsEmpty() { return (sampleId == 0 && frame == NULL); }
-	void Reset() { sampleId = 1; }
+	virtual void Reset() { sampleId = 1; hintPacket = 0; }
 
     virtual const MediaFrame * ReadFrame();
-    QWORD GetNextFrameTime();
+    virtual QWORD GetNextFrameTime();
+
+	/**
+	 * Read from the nearest sync sample at or before a time
+	 * @return time of the next frame in ms, MP4_INVALID_TIMESTAMP after the end
+	 */
+	virtual QWORD Seek(QWORD ms);
+
+	/**
+	 * Read from the first sample starting at or after a time, sync or not
+	 * @return time of the next frame in ms, MP4_INVALID_TIMESTAMP after the end
+	 */
+	virtual QWORD SeekAfter(QWORD ms);
 	DWORD GetRecordedDuration() { return totalDuration; }
 	int GetSampleId() { return sampleId; }
 	int GetTrackId() { return mediatrack; }
 	
+	/**
+	 * Write the samples to a fragmented file instead of the mp4 handle,
+	 * must be set before Create
+	 */
+	void SetFragmentWriter(Mp4FragmentWriter * fragments) { this->fragments = fragments; }
+	
 protected:
     
     const MediaFrame * ReadFrameFromHint();
     const MediaFrame * ReadFrameWithoutHint();
+    const MediaFrame * ReadHintPacket();
+    QWORD SeekSample(QWORD ms, bool sync);
+    bool WriteSample(const BYTE * data, DWORD size, DWORD duration, bool sync);
 
 protected:
     MP4FileHandle mp4;		
@@ -57,17 +80,28 @@ protected:
     unsigned long initialDelay;
     unsigned int timeScale;
     WORD numHintSamples;
+    WORD hintPacket;
      
     DWORD prevts;
 	DWORD totalDuration;
     bool reading;
     MediaFrame * frame;
+    Mp4FragmentWriter * fragments;
 };
 
+#define MP4_MAX_AGGREGATED_FRAMES	16
+
 class Mp4AudioTrack : public Mp4Basetrack
 {
 public:
-    Mp4AudioTrack(MP4FileHandle mp4, unsigned long delay) : Mp4Basetrack(mp4, delay) { }
+    Mp4AudioTrack(MP4FileHandle mp4, unsigned long delay) : Mp4Basetrack(mp4, delay) 
+    {
+	aggregation = 1;
+	pending = NULL;
+	numPending = 0;
+	pendingDuration = 0;
+	stored = 0;
+    }
     
     Mp4AudioTrack(MP4FileHandle mp4, MP4TrackId mediaTrack, MP4TrackId hintTrack, AudioCodec::Type codec) : Mp4Basetrack(mp4, mediaTrack, hintTrack) 
     {
@@ -75,15 +109,47 @@ public:
 	this->codec = codec;    
 	Log("Opened audio track %s ID %d Hint %d\n", nm, mediaTrack, hintTrack);
 	frame = new AudioFrame(codec,8000);
+	aggregation = 1;
+	pending = NULL;
+	numPending = 0;
+	pendingDuration = 0;
+	stored = 0;
+    }
+    
+    virtual ~Mp4AudioTrack()
+    {
+	if (pending) delete pending;
     }
     
     virtual int Create(const char * trackName, int codec, DWORD bitrate);
     virtual int ProcessFrame( const MediaFrame * f );
 	
 	AudioCodec::Type GetCodec() { return codec; }
+	
+	/**
+	 * Store up to frames consecutive frames of the same duration in one sample,
+	 * with one RTP packet per frame in its hint. Must be set before Create.
+	 */
+	void SetAggregation(DWORD frames);
+	
+	/**
+	 * Write the frames waiting to be aggregated
+	 */
+	void WritePending();
+
+private:
+	void WriteAudioSample(const BYTE * data, DWORD size, DWORD duration);
 
 private:
     AudioCodec::Type codec;
+    
+    // aggregation of frames in one sample
+    DWORD aggregation;
+    AudioFrame * pending;
+    DWORD numPending;
+    DWORD pendingDuration;
+    DWORD pendingSizes[MP4_MAX_AGGREGATED_FRAMES];
+    DWORD stored;
 
 };
 
@@ -212,3 +278,28 @@ private:
     virtual void onNewLine(std::string & prevline);
     virtual void onLineRemoved(std::string & prevline);
 };
+
+/**
+ *  Track played from a shared play index, its frames point to the index
+ */
+class Mp4IndexTrack : public Mp4Basetrack
+{
+public:
+	Mp4IndexTrack(Mp4PlayIndex * index, DWORD track);
+
+	virtual int Create(const char * trackName, int codec, DWORD bitrate) { return 0; }
+	virtual int ProcessFrame( const MediaFrame * f ) { return 0; }
+
+	virtual void Reset() { next = 0; }
+	virtual const MediaFrame * ReadFrame();
+	virtual QWORD GetNextFrameTime();
+	virtual QWORD Seek(QWORD ms);
+	virtual QWORD SeekAfter(QWORD ms);
+
+	int GetCodec() { return track->codec; }
+
+private:
+	Mp4PlayIndex * index;
+	const Mp4PlayIndex::Track * track;
+	DWORD next;
+};
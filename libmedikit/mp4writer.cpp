@@ -0,0 +1,303 @@
+#include <stdlib.h>
+#include <algorithm>
+#include "medkit/log.h"
+#include "astmedkit/mp4format.h"
+#include "mp4writer.h"
+
+// Frames written from a recorder before going to the next one
+#define MP4_WRITER_BATCH	64
+
+Mp4FrameQueue::Mp4FrameQueue(DWORD num)
+{
+	// Round up to a power of two
+	size = 1;
+	while (size < num) size <<= 1;
+	mask = size - 1;
+	items = (Item *) malloc(size * sizeof(Item));
+	head = 0;
+	tail = 0;
+}
+
+Mp4FrameQueue::~Mp4FrameQueue()
+{
+	Item item;
+
+	// Delete frames never written
+	while ( Pop(item) )
+		if (item.frame) delete item.frame;
+
+	free(items);
+}
+
+bool Mp4FrameQueue::Push(int track, MediaFrame * frame)
+{
+	DWORD t = tail;
+
+	// Get consumer position
+	DWORD h = head;
+	__sync_synchronize();
+
+	if (t - h >= size) return false;
+
+	items[t & mask].track = track;
+	items[t & mask].frame = frame;
+
+	// Publish
+	__sync_synchronize();
+	tail = t + 1;
+	return true;
+}
+
+bool Mp4FrameQueue::Pop(Item & item)
+{
+	DWORD h = head;
+
+	// Get producer position
+	DWORD t = tail;
+	__sync_synchronize();
+
+	if (t == h) return false;
+
+	item = items[h & mask];
+
+	// Release
+	__sync_synchronize();
+	head = h + 1;
+	return true;
+}
+
+pthread_mutex_t Mp4WriterPool::lock = PTHREAD_MUTEX_INITIALIZER;
+Mp4WriterPool::Writer * Mp4WriterPool::writers = NULL;
+int Mp4WriterPool::numWriters = 0;
+volatile int Mp4WriterPool::running = 0;
+volatile int Mp4WriterPool::sleeping = 0;
+
+bool Mp4WriterPool::Start(int threads)
+{
+	pthread_mutex_lock(&lock);
+
+	if (writers)
+	{
+		// Already running
+		pthread_mutex_unlock(&lock);
+		return true;
+	}
+
+	numWriters = threads > 0 ? threads : 1;
+	writers = new Writer[numWriters];
+	running = 1;
+
+	for (int i = 0; i < numWriters; i++)
+	{
+		writers[i].changed = 0;
+		writers[i].waiting = 0;
+		writers[i].num = 0;
+		pthread_mutex_init(&writers[i].mutex, NULL);
+		pthread_cond_init(&writers[i].cond, NULL);
+		pthread_cond_init(&writers[i].removed, NULL);
+		pthread_create(&writers[i].thread, NULL, Run, &writers[i]);
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	Log("-mp4recorder: started %d writer threads.\n", numWriters);
+	return true;
+}
+
+void Mp4WriterPool::Stop()
+{
+	pthread_mutex_lock(&lock);
+
+	if (writers == NULL)
+	{
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+
+	running = 0;
+
+	for (int i = 0; i < numWriters; i++)
+	{
+		pthread_mutex_lock(&writers[i].mutex);
+		pthread_cond_signal(&writers[i].cond);
+		pthread_mutex_unlock(&writers[i].mutex);
+	}
+
+	for (int i = 0; i < numWriters; i++)
+	{
+		pthread_join(writers[i].thread, NULL);
+
+		// Let the Remove calls released by the thread return
+		pthread_mutex_lock(&writers[i].mutex);
+		while (writers[i].waiting > 0)
+			pthread_cond_wait(&writers[i].removed, &writers[i].mutex);
+		pthread_mutex_unlock(&writers[i].mutex);
+
+		pthread_cond_destroy(&writers[i].removed);
+		pthread_cond_destroy(&writers[i].cond);
+		pthread_mutex_destroy(&writers[i].mutex);
+	}
+
+	// Recorders still added write their queue when destroyed
+	delete[] writers;
+	writers = NULL;
+	numWriters = 0;
+
+	pthread_mutex_unlock(&lock);
+}
+
+int Mp4WriterPool::Add(mp4recorder * r)
+{
+	int best = 0;
+
+	pthread_mutex_lock(&lock);
+
+	if (writers == NULL)
+	{
+		pthread_mutex_unlock(&lock);
+		return -1;
+	}
+
+	for (int i = 1; i < numWriters; i++)
+		if (writers[i].num < writers[best].num) best = i;
+
+	// Picked up by the thread before its next batch
+	pthread_mutex_lock(&writers[best].mutex);
+	writers[best].added.push_back(r);
+	writers[best].num++;
+	writers[best].changed = 1;
+	pthread_cond_signal(&writers[best].cond);
+	pthread_mutex_unlock(&writers[best].mutex);
+
+	pthread_mutex_unlock(&lock);
+
+	return best;
+}
+
+void Mp4WriterPool::Remove(mp4recorder * r, int writer)
+{
+	pthread_mutex_lock(&lock);
+
+	if (writers == NULL || writer < 0 || writer >= numWriters)
+	{
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+
+	Writer * w = &writers[writer];
+
+	// Stop waits for us once it gets the lock
+	pthread_mutex_lock(&w->mutex);
+	pthread_mutex_unlock(&lock);
+
+	w->num--;
+
+	Recorders::iterator it = std::find(w->added.begin(), w->added.end(), r);
+	if (it != w->added.end())
+	{
+		// Never written by the thread
+		w->added.erase(it);
+		pthread_mutex_unlock(&w->mutex);
+		return;
+	}
+
+	// The thread checks it after each recorder batch
+	w->removing.push_back(r);
+	w->changed = 1;
+	w->waiting++;
+	pthread_cond_signal(&w->cond);
+
+	while (std::find(w->removing.begin(), w->removing.end(), r) != w->removing.end())
+		pthread_cond_wait(&w->removed, &w->mutex);
+
+	w->waiting--;
+	if (w->waiting == 0) pthread_cond_broadcast(&w->removed);
+
+	pthread_mutex_unlock(&w->mutex);
+}
+
+void Mp4WriterPool::Wake(int writer)
+{
+	// Pairs with the increment in Run, either we see it or it sees the queued frame
+	__sync_synchronize();
+	if (sleeping == 0) return;
+
+	pthread_mutex_lock(&lock);
+
+	if (writers != NULL && writer >= 0 && writer < numWriters)
+	{
+		pthread_mutex_lock(&writers[writer].mutex);
+		pthread_cond_signal(&writers[writer].cond);
+		pthread_mutex_unlock(&writers[writer].mutex);
+	}
+
+	pthread_mutex_unlock(&lock);
+}
+
+void Mp4WriterPool::Update(Writer * writer)
+{
+	// Called with the writer mutex locked
+	writer->recorders.splice(writer->recorders.end(), writer->added);
+
+	if (!writer->removing.empty())
+	{
+		for (Recorders::iterator it = writer->removing.begin(); it != writer->removing.end(); ++it)
+			writer->recorders.remove(*it);
+		writer->removing.clear();
+		pthread_cond_broadcast(&writer->removed);
+	}
+
+	writer->changed = 0;
+}
+
+bool Mp4WriterPool::HasQueued(Writer * writer)
+{
+	for (Recorders::iterator it = writer->recorders.begin(); it != writer->recorders.end(); ++it)
+		if ((*it)->HasQueued()) return true;
+
+	return false;
+}
+
+void * Mp4WriterPool::Run(void * arg)
+{
+	Writer * writer = (Writer *) arg;
+
+	pthread_mutex_lock(&writer->mutex);
+
+	while (running)
+	{
+		Update(writer);
+		pthread_mutex_unlock(&writer->mutex);
+
+		int written = 0;
+
+		for (Recorders::iterator it = writer->recorders.begin(); it != writer->recorders.end(); ++it)
+		{
+			written += (*it)->WriteQueued(MP4_WRITER_BATCH);
+
+			// Do not keep Remove waiting for the other recorders, they go first next time
+			if (writer->changed)
+			{
+				writer->recorders.splice(writer->recorders.begin(), writer->recorders, ++it, writer->recorders.end());
+				break;
+			}
+		}
+
+		pthread_mutex_lock(&writer->mutex);
+
+		if (written == 0 && running && !writer->changed)
+		{
+			// Sleep until Wake, unless something was queued before it could see us
+			__sync_fetch_and_add(&sleeping, 1);
+			if (!HasQueued(writer))
+				pthread_cond_wait(&writer->cond, &writer->mutex);
+			__sync_fetch_and_sub(&sleeping, 1);
+		}
+	}
+
+	// Release the Remove calls waiting
+	Update(writer);
+	pthread_mutex_unlock(&writer->mutex);
+
+	return NULL;
+}
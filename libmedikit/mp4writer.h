@@ -0,0 +1,103 @@
+#ifndef _MP4WRITER_H_
+#define _MP4WRITER_H_
+
+#include <pthread.h>
+#include <list>
+#include "medkit/media.h"
+
+class mp4recorder;
+
+/**
+ *  Bounded queue of frames waiting to be written to a track. One thread pushes
+ *  and one thread pops, without locks.
+ */
+class Mp4FrameQueue
+{
+public:
+	struct Item
+	{
+		int track;
+		MediaFrame * frame;
+	};
+
+	Mp4FrameQueue(DWORD size);
+	~Mp4FrameQueue();
+
+	/**
+	 * Queue a frame, ownership is taken only if it returns true
+	 */
+	bool Push(int track, MediaFrame * frame);
+	bool Pop(Item & item);
+	DWORD Length() { return tail - head; }
+
+private:
+	Item * items;
+	DWORD size;
+	DWORD mask;
+	volatile DWORD head;
+	volatile DWORD tail;
+};
+
+/**
+ *  Writer threads shared by all the asynchronous recorders. Each recorder is
+ *  served by a single thread, which writes its queued frames in batches and
+ *  sleeps when no recorder has anything queued.
+ */
+class Mp4WriterPool
+{
+public:
+	static bool Start(int threads);
+	static void Stop();
+
+	/**
+	 * Add a recorder to the least loaded thread, which picks it up before
+	 * its next batch
+	 * @return the thread index, or -1 if not started
+	 */
+	static int Add(mp4recorder * r);
+
+	/**
+	 * Remove a recorder, once it returns the thread is not writing it.
+	 * Only waits for the batch of the recorder being written.
+	 */
+	static void Remove(mp4recorder * r, int writer);
+
+	/**
+	 * Wake up the thread after queuing something, does not lock if no
+	 * thread is sleeping
+	 */
+	static void Wake(int writer);
+
+private:
+	typedef std::list<mp4recorder *> Recorders;
+
+	struct Writer
+	{
+		pthread_t thread;
+		// Protects the pending lists, never held while writing
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		pthread_cond_t removed;
+		// Only used by the thread
+		Recorders recorders;
+		// Pending Add and Remove calls
+		Recorders added;
+		Recorders removing;
+		volatile int changed;
+		int waiting;
+		int num;
+	};
+
+	static void * Run(void * writer);
+	static void Update(Writer * writer);
+	static bool HasQueued(Writer * writer);
+
+private:
+	static pthread_mutex_t lock;
+	static Writer * writers;
+	static int numWriters;
+	static volatile int running;
+	static volatile int sleeping;
+};
+
+#endif
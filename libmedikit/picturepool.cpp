@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include "medkit/picturepool.h"
+
+// Free pictures kept by default
+#define PICTURE_POOL_MAX_FREE	(64*1024*1024)
+
+// Align to 32
+#define ALIGN32(x)	((((x)+31)>>5)<<5)
+
+pthread_mutex_t YUVPicturePool::lock = PTHREAD_MUTEX_INITIALIZER;
+YUVPicturePool::Pictures YUVPicturePool::pictures;
+QWORD YUVPicturePool::maxFree = PICTURE_POOL_MAX_FREE;
+YUVPicturePool::Stats YUVPicturePool::stats = { 0, 0, 0, 0, 0 };
+
+// Pictures released after exiting are freed, the pool map may be gone
+static volatile bool exiting = false;
+
+// Free the pictures kept when exiting, destroyed before the pool map
+static struct YUVPicturePoolCleanup
+{
+	~YUVPicturePoolCleanup()
+	{
+		YUVPicturePool::Purge();
+		exiting = true;
+	}
+} cleanup;
+
+void YUVPicture::AddRef()
+{
+	__sync_add_and_fetch(&refs, 1);
+}
+
+void YUVPicture::Release()
+{
+	if (__sync_sub_and_fetch(&refs, 1) == 0)
+		YUVPicturePool::Recycle(this);
+}
+
+YUVPicture * YUVPicturePool::Acquire(DWORD width, DWORD height, bool packed, DWORD minSize)
+{
+	YUVPicture * picture = NULL;
+	int strides[3];
+	DWORD offsets[3];
+	DWORD size;
+
+	if (packed)
+	{
+		// Same layout as the decoders output
+		strides[0] = width;
+		strides[1] = width/2;
+		strides[2] = width/2;
+		offsets[0] = 0;
+		offsets[1] = width*height;
+		offsets[2] = width*height*5/4;
+		size = width*height*3/2;
+	}
+	else
+	{
+		// Aligned lines and planes
+		strides[0] = ALIGN32(width);
+		strides[1] = ALIGN32(width/2);
+		strides[2] = ALIGN32(width/2);
+		offsets[0] = 0;
+		offsets[1] = strides[0]*height;
+		offsets[2] = offsets[1] + strides[1]*((height+1)/2);
+		size = offsets[2] + strides[2]*((height+1)/2);
+	}
+
+	if (size < minSize) size = minSize;
+
+	pthread_mutex_lock(&lock);
+
+	// Smallest free picture big enough, not wasting more than its size
+	Pictures::iterator it = pictures.lower_bound(size);
+
+	if (it != pictures.end() && it->first <= size*2)
+	{
+		picture = it->second;
+		pictures.erase(it);
+		stats.free--;
+		stats.freeBytes -= picture->capacity;
+		stats.reuses++;
+	}
+	else
+	{
+		stats.allocs++;
+	}
+
+	stats.used++;
+
+	pthread_mutex_unlock(&lock);
+
+	if (picture == NULL)
+	{
+		picture = new YUVPicture();
+		picture->buffer = (BYTE *) malloc(size+32);
+		picture->capacity = size;
+	}
+
+	// Set layout
+	BYTE * data = ALIGNTO32(picture->buffer);
+	for (int i=0; i<3; i++)
+	{
+		picture->planes[i] = data + offsets[i];
+		picture->strides[i] = strides[i];
+	}
+	picture->width = width;
+	picture->height = height;
+	picture->size = size;
+	picture->refs = 1;
+
+	return picture;
+}
+
+void YUVPicturePool::Recycle(YUVPicture * picture)
+{
+	if (exiting)
+	{
+		free(picture->buffer);
+		delete picture;
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+
+	pictures.insert(Pictures::value_type(picture->capacity, picture));
+	stats.used--;
+	stats.free++;
+	stats.freeBytes += picture->capacity;
+
+	Evict();
+
+	pthread_mutex_unlock(&lock);
+}
+
+// Free the biggest pictures until it fits, called with the lock
+void YUVPicturePool::Evict()
+{
+	while ( stats.freeBytes > maxFree && !pictures.empty() )
+	{
+		Pictures::iterator it = --pictures.end();
+		YUVPicture * picture = it->second;
+		pictures.erase(it);
+		stats.free--;
+		stats.freeBytes -= picture->capacity;
+		free(picture->buffer);
+		delete picture;
+	}
+}
+
+void YUVPicturePool::SetMaxFree(QWORD bytes)
+{
+	pthread_mutex_lock(&lock);
+	maxFree = bytes;
+	Evict();
+	pthread_mutex_unlock(&lock);
+}
+
+void YUVPicturePool::GetStats(Stats & stats)
+{
+	pthread_mutex_lock(&lock);
+	stats = YUVPicturePool::stats;
+	pthread_mutex_unlock(&lock);
+}
+
+void YUVPicturePool::Purge()
+{
+	pthread_mutex_lock(&lock);
+	QWORD max = maxFree;
+	maxFree = 0;
+	Evict();
+	maxFree = max;
+	pthread_mutex_unlock(&lock);
+}
@@ -1,41 +1,100 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <map>
+#include <vector>
 #include "medkit/picturestreamer.h"
 #include "medkit/log.h"
 
+// Max number of frames encoded for a picture, the sequence starts again with an I frame after them
+#define PICTURESTREAMER_MAX_FRAMES	250
+
+struct PictureSequence
+{
+	std::string key;
+	std::vector<VideoFrame *> frames;
+	int refs;
+	// Still being encoded, without the lock
+	bool ready;
+};
+
+typedef std::map<std::string, PictureSequence *> Sequences;
+
+static Sequences sequences;
+static pthread_mutex_t sequencesLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sequencesReady = PTHREAD_COND_INITIALIZER;
 
 PictureStreamer::PictureStreamer() : Logo()
 {
-	encoder = NULL;
+	hasCodec = false;
+	codec = VideoCodec::H264;
+	fps = 0;
+	kbits = 0;
+	intraPeriod = 0;
+	sequence = NULL;
+	pos = 0;
 }
 
 PictureStreamer::~PictureStreamer()
 {
-	if (encoder) delete encoder;
+	Release();
 }
 
 
-bool PictureStreamer::SetCodec(VideoCodec::Type codec, const Properties &properties)
+int PictureStreamer::Load(const char *filename, unsigned int pwidth, unsigned int pheight)
 {
-	if (encoder) delete encoder;
+	char buffer[64];
+	struct stat st;
+	
+	if (!Logo::Load(filename, pwidth, pheight)) return 0;
+	
+	// A file replaced on disk gets a new encoding
+	if (stat(filename, &st) == 0)
+		snprintf(buffer, sizeof(buffer), "|%lu|%lu", (unsigned long) st.st_mtime, (unsigned long) st.st_size);
+	else
+		buffer[0] = 0;
+	
+	source = std::string(filename) + buffer;
 	
-	encoder = VideoCodecFactory::CreateEncoder(codec, properties);
+	if ( HandleSizeChange() ) return 1;
 	
-	if (encoder != NULL)
+	return 0;
+}
+
+bool PictureStreamer::SetCodec(VideoCodec::Type codec, const Properties &properties)
+{
+	switch (codec)
 	{
-		HandleSizeChange();
-		return true;
+		case VideoCodec::H263_1996:
+		case VideoCodec::H263_1998:
+		case VideoCodec::MPEG4:
+		case VideoCodec::H264:
+			break;
+		default:
+			Error("-PictureStreamer: no encoder for codec %s.\n", VideoCodec::GetNameFor(codec));
+			return false;
 	}
-	return false;
+	
+	// Encoder is created when the picture is not already encoded
+	Release();
+	this->codec = codec;
+	this->properties = properties;
+	hasCodec = true;
+	
+	return true;
 }
 
 
 bool PictureStreamer::SetFrameRate(int fps,int kbits,int intraPeriod)
 {
-	if (encoder)
-	{
-		return encoder->SetFrameRate(fps, kbits, intraPeriod);
-	}
+	if (!hasCodec) return false;
 	
-	return false;
+	Release();
+	this->fps = fps;
+	this->kbits = kbits;
+	this->intraPeriod = intraPeriod;
+	
+	return true;
 }
 
 VideoFrame* PictureStreamer::Stream(bool askiframe)
@@ -47,30 +106,158 @@ VideoFrame* PictureStreamer::Stream(bool askiframe)
 		return NULL;
 	}
 	
-	if (encoder == NULL)
+	if (!hasCodec)
 	{
 		// No encoder
 		Error("-PictureStreamer: no video encoder configured. Cannot stream.\n");
 		return NULL;
 	}
 	
-	VideoFrame * f = encoder->EncodeFrame( GetFrame(), (GetWidth()*GetHeight()*3)/2 );
+	if (sequence == NULL && !Acquire())
+	{
+		Error("-PictureStreamer: fail to encode picture. Cannot stream.\n");
+		return NULL;
+	}
+	
+	// Start again from the I frame
+	if (askiframe) pos = 0;
 	
-	if (f == NULL) Error("-PictureStreamer: fail to encode picture. Cannot stream.\n");
+	VideoFrame * f = sequence->frames[pos];
+	
+	if (++pos == sequence->frames.size()) pos = 0;
 	
 	return f;
 }
 
 bool PictureStreamer::HandleSizeChange()
 {
+	// Encoded frames are not valid anymore
+	Release();
+	
 	if (GetWidth() == 0 || GetHeight() == 0) return false;
 	
-	if (encoder)
+	return true;
+}
+
+bool PictureStreamer::Acquire()
+{
+	char buffer[256];
+	
+	snprintf(buffer, sizeof(buffer), "|%dx%d|%d|%d|%d|%d", GetWidth(), GetHeight(), codec, fps, kbits, intraPeriod);
+	
+	std::string key = source + buffer;
+	
+	for (Properties::const_iterator it = properties.begin(); it != properties.end(); ++it)
+		key += "|" + it->first + "=" + it->second;
+	
+	pthread_mutex_lock(&sequencesLock);
+	
+	Sequences::iterator it = sequences.find(key);
+	
+	// Others asking for the same picture wait for it to be encoded, look again as it is removed if it fails
+	while (it != sequences.end() && !it->second->ready)
 	{
-		return encoder->SetSize(GetWidth(), GetHeight());
+		pthread_cond_wait(&sequencesReady, &sequencesLock);
+		it = sequences.find(key);
 	}
-	else
+	
+	if (it != sequences.end())
 	{
+		sequence = it->second;
+		sequence->refs++;
+		pthread_mutex_unlock(&sequencesLock);
+		pos = 0;
 		return true;
 	}
+	
+	// Encoded without the lock, other pictures are not blocked
+	PictureSequence * s = new PictureSequence();
+	s->key = key;
+	s->refs = 1;
+	s->ready = false;
+	sequences[key] = s;
+	
+	pthread_mutex_unlock(&sequencesLock);
+	
+	if ( !Encode(s) )
+	{
+		pthread_mutex_lock(&sequencesLock);
+		sequences.erase(key);
+		pthread_cond_broadcast(&sequencesReady);
+		pthread_mutex_unlock(&sequencesLock);
+		
+		for (DWORD i = 0; i < s->frames.size(); i++)
+			delete s->frames[i];
+		delete s;
+		return false;
+	}
+	
+	// Publish
+	pthread_mutex_lock(&sequencesLock);
+	s->ready = true;
+	pthread_cond_broadcast(&sequencesReady);
+	pthread_mutex_unlock(&sequencesLock);
+	
+	Log("-PictureStreamer: encoded %u frames for [%s].\n", (DWORD) s->frames.size(), key.c_str());
+	
+	sequence = s;
+	pos = 0;
+	
+	return true;
+}
+
+bool PictureStreamer::Encode(PictureSequence * s)
+{
+	VideoEncoder * encoder = VideoCodecFactory::CreateEncoder(codec, properties);
+	
+	if (encoder == NULL) return false;
+	
+	encoder->SetFrameRate(fps, kbits, intraPeriod);
+	
+	if ( !encoder->SetSize(GetWidth(), GetHeight()) )
+	{
+		delete encoder;
+		return false;
+	}
+	
+	// One I frame followed by the P frames until the next one
+	DWORD num = (intraPeriod > 0 && intraPeriod < PICTURESTREAMER_MAX_FRAMES) ? intraPeriod : PICTURESTREAMER_MAX_FRAMES;
+	
+	encoder->FastPictureUpdate();
+	
+	for (DWORD i = 0; i < num; i++)
+	{
+		VideoFrame * f = encoder->EncodeFrame( GetFrame(), (GetWidth()*GetHeight()*3)/2 );
+		
+		if (f == NULL) break;
+		
+		// Encoder reuses its frame
+		s->frames.push_back( (VideoFrame *) f->Clone() );
+	}
+	
+	delete encoder;
+	
+	return !s->frames.empty() && s->frames[0]->IsIntra();
+}
+
+void PictureStreamer::Release()
+{
+	if (sequence == NULL) return;
+	
+	pthread_mutex_lock(&sequencesLock);
+	
+	// Last streamer using it
+	if (--sequence->refs == 0)
+	{
+		sequences.erase(sequence->key);
+		
+		for (DWORD i = 0; i < sequence->frames.size(); i++)
+			delete sequence->frames[i];
+		
+		delete sequence;
+	}
+	
+	pthread_mutex_unlock(&sequencesLock);
+	
+	sequence = NULL;
 }
@@ -1,86 +1,289 @@
+#include <list>
+#include <deque>
+#include <vector>
 #include "medkit/transcoder.h"
 #include "medkit/video.h"
 #include "medkit/framescaler.h"
+#include "medkit/log.h"
+#include "medkit/tools.h"
+#include "medkit/picturepool.h"
+#include "astmedkit/frameutils.h"
 
-struct VideoTranscoder
-{    
-    VideoTranscoder(void  * ctxdata, unsigned int width_out, unsigned int height_out,
-		    VideoCodec::Type outputcodec, 
-		    unsigned int bitrate, unsigned int fps, unsigned gob_size);
-				 
-    ~VideoTranscoder();
-    
-    bool EncoderOpen();
-    bool ComputeFps(time_t t)    { return false; }
+/**
+ * Scaler and encoder for one output format. Outputs asking for the same
+ * codec, size, bitrate, fps and gop share it, so each picture is scaled
+ * and encoded once per format.
+ */
+struct VideoTranscoderEncoder
+{
+    VideoTranscoderEncoder(unsigned int width_out, unsigned int height_out, VideoCodec::Type codec,
+			   int bitrate, int fps, int gob_size);
+    ~VideoTranscoderEncoder();
+
+    bool Open();
+    bool Matches(unsigned int width_out, unsigned int height_out, VideoCodec::Type codec,
+		 int bitrate, int fps, int gob_size);
+    int  HandleResize(unsigned int width, unsigned int height);
+    VideoFrame * Encode(BYTE * pic, unsigned int width, unsigned int height, QWORD & scaleTime, QWORD & encodeTime);
 
-    bool SetInputCodec(VideoCodec::Type codec);
-    
-    bool ProcessFrame(VideoFrame * f, int lost, int last);
-    int  HandleResize();
-    void SetListener(MediaFrame::Listener * listener) { this->listener = listener; }
-    
-    bool GetDecodedPicParams( VideoCodec::Type * codec, DWORD * width, DWORD * height);
-    
-    
-    VideoDecoder *decoder;
-    FrameScaler  *scaler;
     VideoEncoder *encoder;
+    FrameScaler  *scaler;
+    VideoCodec::Type codec;
+
+    int bitrate_out;
+    int gob_size;
 
-    unsigned int bitrate_out; 
-    unsigned int bitrate_in;
-    unsigned int bitrate_in_tmp;
-    
     unsigned int numPixSrc;
     unsigned int numPixDst;
-    
-    unsigned int gob_size;
+
     unsigned int width_out;
     unsigned int height_out;
     unsigned int resizeWidth;
     unsigned int resizeHeight;
-    unsigned int fps_in;
-    unsigned int fps_in_tmp;
     unsigned int fps_out;
-    unsigned int fps_out_max;
-    
+    int fps_out_max;
+
+    /* Scaled picture, 32 aligned so the scaler writes it directly */
+    YUVPicture * scaledPic;
     BYTE * decodedPic;
     DWORD  decodedPicSize;
-    
+
+    /* Encoded frame, reused for every picture */
+    VideoFrame * out;
+
+    /* Number of outputs using it */
+    int refs;
+};
+
+/**
+ * Destination of the encoded frames
+ */
+struct VideoTranscoderOutput
+{
+    int id;
+    VideoTranscoderEncoder * enc;
     MediaFrame::Listener * listener;
-    
     VideoTranscoderCb cb;
     void * ctxdata;
 };
 
+/**
+ * Decoded picture waiting for the encoder thread
+ */
+struct VideoTranscoderPicture
+{
+    YUVPicture * yuv;
+    bool   adjust;
+    QWORD  queued;
+};
+
+struct VideoTranscoder
+{
+    VideoTranscoder();
+    ~VideoTranscoder();
+
+    bool ComputeFps(time_t t)    { return false; }
+
+    bool SetInputCodec(VideoCodec::Type codec);
+
+    int  ProcessFrame(VideoFrame * f, int lost, int last);
+    void EncodePicture(BYTE * pic, unsigned int width, unsigned int height, bool needAdjust);
+
+    bool SetPipeline(int pictures);
+    void StopPipeline();
+    void QueuePicture(BYTE * pic, unsigned int width, unsigned int height, bool needAdjust);
+    void Encoding();
+    static void * Run(void * vtc);
+
+    void GetStats(VideoTranscoderStats & stats);
+    void SetListener(MediaFrame::Listener * listener) { SetListener(0, listener); }
+    bool SetListener(int output, MediaFrame::Listener * listener);
+
+    int  AddOutput(void * ctxdata, VideoTranscoderCb cb, unsigned int width_out, unsigned int height_out,
+		   VideoCodec::Type outputcodec, int bitrate, int fps, int gob_size);
+    bool RemoveOutput(int output);
+
+    bool GetDecodedPicParams( VideoCodec::Type * codec, DWORD * width, DWORD * height);
+
+    typedef std::vector<VideoTranscoderEncoder *> Encoders;
+    typedef std::list<VideoTranscoderOutput> Outputs;
+    typedef std::deque<VideoTranscoderPicture *> Pictures;
+
+    VideoDecoder *decoder;
+
+    unsigned int bitrate_in;
+    unsigned int bitrate_in_tmp;
+    unsigned int fps_in;
+    unsigned int fps_in_tmp;
+
+    Encoders encoders;
+    Outputs  outputs;
+    int      nextOutput;
+    /* Held while encoding, outputs can be changed from another thread */
+    pthread_mutex_t outputsMutex;
+
+    /* Pipeline, the mutex also protects the stats */
+    Pictures freePictures;
+    Pictures queuedPictures;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool running;
+
+    VideoTranscoderStats stats;
+};
+
 
-VideoTranscoder::VideoTranscoder(void  * ctxdata, unsigned int width_out, unsigned int height_out, VideoCodec::Type outputcodec, 
-				 unsigned int bitrate, unsigned int fps, unsigned gob_size)
+VideoTranscoderEncoder::VideoTranscoderEncoder(unsigned int width_out, unsigned int height_out, VideoCodec::Type codec,
+					       int bitrate, int fps, int gob_size)
 {
-    this->ctxdata	= ctxdata;
+    this->codec		= codec;
     bitrate_out         = bitrate;
-    bitrate_in          = 0;
     this->gob_size      = gob_size;
-    this->width_out = width_out;
-    this->height_out = height_out;
-    
-    /* we will measure it */
-    fps_in = 0;
-    fps_in_tmp = 0;
-    
+    this->width_out	= width_out;
+    this->height_out	= height_out;
+
     fps_out = 15;
     fps_out_max = fps;
-    
-    encoder = VideoCodecFactory::CreateEncoder(outputcodec);
-    decoder = NULL;
+
+    encoder = VideoCodecFactory::CreateEncoder(codec);
+    out = new VideoFrame(codec, 0);
     scaler = NULL;
-    listener = NULL;
+    scaledPic = NULL;
     decodedPic = NULL;
     decodedPicSize = 0;
-    
+
     numPixSrc = 0;
     numPixDst = width_out * height_out;
     resizeWidth = 0;
     resizeHeight = 0;
+    refs = 0;
+}
+
+VideoTranscoderEncoder::~VideoTranscoderEncoder()
+{
+    if (encoder) delete encoder;
+    if (scaler) delete scaler;
+    if (scaledPic) scaledPic->Release();
+    delete out;
+}
+
+bool VideoTranscoderEncoder::Open()
+{
+    if (encoder)
+    {
+	encoder->SetSize(width_out, height_out);
+	encoder->SetFrameRate(fps_out, bitrate_out, gob_size);
+	return true;
+    }
+    return false;
+}
+
+bool VideoTranscoderEncoder::Matches(unsigned int width_out, unsigned int height_out, VideoCodec::Type codec,
+				     int bitrate, int fps, int gob_size)
+{
+    return this->codec == codec && this->width_out == width_out && this->height_out == height_out
+	&& bitrate_out == bitrate && fps_out_max == fps && this->gob_size == gob_size;
+}
+
+int VideoTranscoderEncoder::HandleResize(unsigned int width, unsigned int height)
+{
+    if (encoder == NULL) return 0;
+
+    /* If already resizing that size */
+    if (scaler != NULL && width == resizeWidth && height == resizeHeight)
+	return 1;
+
+    numPixSrc = width * height;
+    /* if encoder and decoder have the same format */
+    if (width == width_out && height == height_out )
+    {
+	/* Nothing to do */
+        return 2;
+    }
+    else
+    {
+	/* Invalid picture or decoder context. Ignore */
+	if (width == 0 || height == 0) return 0;
+
+	if ( scaler == NULL ) scaler = new FrameScaler();
+
+	if ( scaler->SetResize( width, height, width,
+				(int) width_out, (int) height_out, (int) width_out ) )
+	{
+	    resizeWidth = width;
+	    resizeHeight = height;
+
+	    /* Scaled picture has the output size, only taken once */
+	    if (scaledPic == NULL)
+	    {
+		scaledPic = YUVPicturePool::Acquire(width_out, height_out);
+		decodedPic = scaledPic->GetData();
+		decodedPicSize = scaledPic->GetSize();
+	    }
+
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+VideoFrame * VideoTranscoderEncoder::Encode(BYTE * pic, unsigned int width, unsigned int height,
+					     QWORD & scaleTime, QWORD & encodeTime)
+{
+    BYTE * srcY, * srcU, * srcV;
+    BYTE * dstY, * dstU, * dstV;
+    QWORD ini = getTime();
+
+    switch ( HandleResize(width, height) )
+    {
+	case 1:
+	    srcY = pic;
+	    srcU = srcY + numPixSrc;
+	    srcV = srcU + numPixSrc/4;
+	    dstY = decodedPic;
+	    dstU = decodedPic + numPixDst;
+	    dstV = dstU + numPixDst/4;
+	    scaler->Resize(srcY,srcU,srcV,dstY,dstU,dstV);
+	    break;
+
+	case 2:
+	    dstY = pic;
+	    break;
+
+	default:
+	    return NULL; // drop frame
+    }
+
+    QWORD scaled = getTime();
+    scaleTime += scaled - ini;
+
+    /* Encode in our frame, its buffer and packets are kept for the next one */
+    bool encoded = encoder->EncodeFrame( dstY, numPixDst + numPixDst/2, *out );
+
+    encodeTime += getTime() - scaled;
+
+    return encoded ? out : NULL;
+}
+
+
+VideoTranscoder::VideoTranscoder()
+{
+    bitrate_in          = 0;
+    bitrate_in_tmp      = 0;
+
+    /* we will measure it */
+    fps_in = 0;
+    fps_in_tmp = 0;
+
+    decoder = NULL;
+    nextOutput = 0;
+    running = false;
+    memset(&stats, 0, sizeof(stats));
+
+    pthread_mutex_init(&outputsMutex, NULL);
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
 }
 
 #if 0
@@ -94,7 +297,7 @@ void av_log_asterisk_callback(void* ptr, int level, const char* fmt, va_list vl)
         AVClass* avc= ptr ? *(AVClass**)ptr : NULL;
         if (avc)
 	    ast_log(LOG_DEBUG,"[%s @ %p] %s",avc->item_name(ptr), avc, msg);
-        else 
+        else
 	    ast_log(LOG_DEBUG, msg);
     }
 }
@@ -108,20 +311,15 @@ int VideoTranscoderDestroy(struct VideoTranscoder *vtc)
 
 VideoTranscoder::~VideoTranscoder()
 {
-    if (encoder) delete encoder;
+    StopPipeline();
+
+    for (Encoders::iterator it = encoders.begin(); it != encoders.end(); ++it)
+	delete *it;
     if (decoder) delete decoder;
-    if (scaler) delete scaler;
-}
 
-bool VideoTranscoder::EncoderOpen()
-{
-    if (encoder)
-    {
-	encoder->SetSize(width_out, height_out);
-	encoder->SetFrameRate(fps_out, bitrate_out, gob_size);
-	return true;
-    }
-    return false;
+    pthread_mutex_destroy(&outputsMutex);
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&cond);
 }
 
 bool VideoTranscoder::SetInputCodec(VideoCodec::Type codec)
@@ -130,149 +328,353 @@ bool VideoTranscoder::SetInputCodec(VideoCodec::Type codec)
     {
 	// If no change is needed, just return.
 	if ( decoder->type == codec ) return true;
-	
+
 	delete decoder;
 	decoder = NULL;
     }
-    
+
     decoder = VideoCodecFactory::CreateDecoder(codec);
-    
+
     return (decoder != NULL);
 }
 
-bool VideoTranscoder::ProcessFrame(VideoFrame * f, int lost, int last)
+int VideoTranscoder::AddOutput(void * ctxdata, VideoTranscoderCb cb, unsigned int width_out, unsigned int height_out,
+			       VideoCodec::Type outputcodec, int bitrate, int fps, int gob_size)
 {
-    VideoFrame * f_out = NULL;
-    time_t t = time(NULL);
-    bool needAdjust = false;
-    BYTE * srcY, * srcU, * srcV;
-    BYTE * dstY, * dstU, * dstV;    
-    
-    if ( decoder == NULL || decoder->type != f->GetCodec() )
+    VideoTranscoderEncoder * enc = NULL;
+
+    pthread_mutex_lock(&outputsMutex);
+
+    /* Look for an encoder with the same output */
+    for (Encoders::iterator it = encoders.begin(); it != encoders.end(); ++it)
     {
-	SetInputCodec( f->GetCodec() );
+	if ( (*it)->Matches(width_out, height_out, outputcodec, bitrate, fps, gob_size) )
+	{
+	    enc = *it;
+	    break;
+	}
     }
-        
-    if ( decoder != NULL )
+
+    if (enc == NULL)
     {
-	int res = decoder->DecodePacket(f->GetData(), f->GetLength(), lost, last);
-	
-	if (res == 2) /* 2 means image complete */
+	enc = new VideoTranscoderEncoder(width_out, height_out, outputcodec, bitrate, fps, gob_size);
+
+	if ( ! enc->Open() )
 	{
-	    if ( ComputeFps( t ) )
-	    {
-		needAdjust = true;
-	    }
-	    
-	    switch ( HandleResize() )
+	    pthread_mutex_unlock(&outputsMutex);
+	    delete enc;
+	    return -1;
+	}
+	encoders.push_back(enc);
+    }
+
+    VideoTranscoderOutput output;
+    output.id		= nextOutput++;
+    output.enc		= enc;
+    output.listener	= NULL;
+    output.cb		= cb;
+    output.ctxdata	= ctxdata;
+
+    enc->refs++;
+    outputs.push_back(output);
+
+    pthread_mutex_unlock(&outputsMutex);
+
+    return output.id;
+}
+
+bool VideoTranscoder::RemoveOutput(int output)
+{
+    pthread_mutex_lock(&outputsMutex);
+
+    for (Outputs::iterator it = outputs.begin(); it != outputs.end(); ++it)
+    {
+	if (it->id != output) continue;
+
+	VideoTranscoderEncoder * enc = it->enc;
+	outputs.erase(it);
+
+	/* Last output of that format */
+	if ( --enc->refs == 0 )
+	{
+	    for (Encoders::iterator e = encoders.begin(); e != encoders.end(); ++e)
 	    {
-	        case 0:
-		    delete f_out;
-		    return false; // drop frame
-		    
-		case 1:
-		    srcY = decoder->GetFrame();
-		    srcU = srcY + numPixSrc;
-		    srcV = srcU + numPixSrc/4;
-		    dstY = decodedPic;
-		    dstU = decodedPic + numPixDst;
-		    dstV = dstU + numPixDst/4;
-		    scaler->Resize(srcY,srcU,srcV,dstY,dstU,dstV);
-		    break;
-		
-		case 2:
-		    dstY = decoder->GetFrame();
-		    decodedPicSize = numPixDst + numPixDst/4;
+		if (*e == enc)
+		{
+		    encoders.erase(e);
 		    break;
-		    
-		default:
-		    delete f_out;
-		    return false; // drop frame
-		
-	    
-	    }
-	    if ( needAdjust )
-		EncoderOpen();
-	    
-	    if ( encoder != NULL && ( listener != NULL || cb != NULL ))
-	    {
-		f_out = encoder->EncodeFrame( dstV, decodedPicSize );
-	    }
-	    
-	    if (listener)
-	    {
-		listener->onMediaFrame( *f_out );
+		}
 	    }
-	    
-	    if ( cb != NULL ) cb( ctxdata, f_out->GetCodec(), (const char *) f_out->GetData(),
-				  f_out->GetLength() );
-	    
-	    delete f_out;
+	    delete enc;
 	}
+	pthread_mutex_unlock(&outputsMutex);
+	return true;
     }
+
+    pthread_mutex_unlock(&outputsMutex);
+    return false;
 }
 
+bool VideoTranscoder::SetListener(int output, MediaFrame::Listener * listener)
+{
+    bool found = false;
 
-bool VideoTranscoder::GetDecodedPicParams( VideoCodec::Type * codec, DWORD * width, DWORD * height)
+    pthread_mutex_lock(&outputsMutex);
+
+    for (Outputs::iterator it = outputs.begin(); it != outputs.end(); ++it)
+    {
+	if (it->id == output)
+	{
+	    it->listener = listener;
+	    found = true;
+	    break;
+	}
+    }
+
+    pthread_mutex_unlock(&outputsMutex);
+
+    return found;
+}
+
+int VideoTranscoder::ProcessFrame(VideoFrame * f, int lost, int last)
 {
-    if ( decoder != NULL)
+    time_t t = time(NULL);
+
+    if ( decoder == NULL || decoder->type != f->GetCodec() )
     {
-        if ( decoder->GetWidth() > 0 && decoder->GetHeight() > 0 )
+	SetInputCodec( f->GetCodec() );
+    }
+
+    if ( decoder == NULL ) return -1;
+
+    QWORD ini = getTime();
+
+    int res = decoder->DecodePacket(f->GetData(), f->GetLength(), lost, last);
+
+    pthread_mutex_lock(&mutex);
+    stats.decodeTime += getTime() - ini;
+    if (res == 2) stats.decoded++;
+    pthread_mutex_unlock(&mutex);
+
+    if (res != 2) return 0; /* 2 means image complete */
+
+    bool needAdjust = ComputeFps( t );
+
+    /* Invalid picture or decoder context. Ignore */
+    if (decoder->GetWidth() <= 0 || decoder->GetHeight() <= 0) return 0;
+
+    if ( running )
+	QueuePicture(decoder->GetFrame(), decoder->GetWidth(), decoder->GetHeight(), needAdjust);
+    else
+	EncodePicture(decoder->GetFrame(), decoder->GetWidth(), decoder->GetHeight(), needAdjust);
+
+    return 1;
+}
+
+void VideoTranscoder::EncodePicture(BYTE * pic, unsigned int width, unsigned int height, bool needAdjust)
+{
+    QWORD scaleTime = 0;
+    QWORD encodeTime = 0;
+    unsigned int encoded = 0;
+
+    pthread_mutex_lock(&outputsMutex);
+
+    /* Decoded once, scale and encode once per output format */
+    for (Encoders::iterator it = encoders.begin(); it != encoders.end(); ++it)
+    {
+	VideoTranscoderEncoder * enc = *it;
+
+	if ( needAdjust )
+	    enc->Open();
+
+	VideoFrame * f_out = enc->Encode(pic, width, height, scaleTime, encodeTime);
+
+	if ( f_out == NULL ) continue;
+
+	encoded++;
+
+	for (Outputs::iterator o = outputs.begin(); o != outputs.end(); ++o)
 	{
-	    (*codec) = decoder->type;
-	    *width = decoder->GetWidth();
-	    *height = decoder->GetHeight();
-	    return true;
+	    if (o->enc != enc) continue;
+
+	    if (o->listener)
+	    {
+		o->listener->onMediaFrame( *f_out );
+	    }
+
+	    if ( o->cb != NULL ) o->cb( o->ctxdata, f_out->GetCodec(), (const char *) f_out->GetData(),
+					f_out->GetLength() );
 	}
     }
-    return false;
+
+    pthread_mutex_unlock(&outputsMutex);
+
+    pthread_mutex_lock(&mutex);
+    stats.encoded += encoded;
+    stats.scaleTime += scaleTime;
+    stats.encodeTime += encodeTime;
+    pthread_mutex_unlock(&mutex);
 }
 
-int VideoTranscoder::HandleResize()
+bool VideoTranscoder::SetPipeline(int pictures)
 {
-    if (decoder == NULL || encoder == NULL) return 0;
-    
-    /* If already resizing that size */
-    if (scaler != NULL && decoder->GetWidth() == resizeWidth && decoder->GetHeight() == resizeHeight)
-	return 1;
+    StopPipeline();
 
-   numPixSrc = decoder->GetWidth() * decoder->GetHeight();
-    /* if encoder and decoder have the same format */
-    if (decoder->GetWidth() == width_out && decoder->GetHeight() == height_out )
+    if (pictures <= 0) return true;
+
+    /* One being encoded and one being filled */
+    if (pictures < 2) pictures = 2;
+
+    for (int i = 0; i < pictures; i++)
     {
-	/* Nothing to do */
-        return 2;
-    }    
+	VideoTranscoderPicture * pic = new VideoTranscoderPicture;
+	pic->yuv = NULL;
+	freePictures.push_back(pic);
+    }
+
+    running = true;
+
+    if ( pthread_create(&thread, NULL, Run, this) != 0 )
+    {
+	Error("-Transcoder: could not start encoder thread\n");
+	running = false;
+	StopPipeline();
+	return false;
+    }
+
+    return true;
+}
+
+void VideoTranscoder::StopPipeline()
+{
+    if ( running )
+    {
+	pthread_mutex_lock(&mutex);
+	running = false;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+
+	pthread_join(thread, NULL);
+    }
+
+    /* Pictures not encoded yet are lost */
+    while ( ! queuedPictures.empty() )
+    {
+	freePictures.push_back(queuedPictures.front());
+	queuedPictures.pop_front();
+    }
+
+    for (Pictures::iterator it = freePictures.begin(); it != freePictures.end(); ++it)
+    {
+	if ((*it)->yuv) (*it)->yuv->Release();
+	delete *it;
+    }
+    freePictures.clear();
+}
+
+void VideoTranscoder::QueuePicture(BYTE * data, unsigned int width, unsigned int height, bool needAdjust)
+{
+    VideoTranscoderPicture * pic;
+    DWORD size = width * height * 3 / 2;
+
+    pthread_mutex_lock(&mutex);
+
+    if ( ! freePictures.empty() )
+    {
+	pic = freePictures.back();
+	freePictures.pop_back();
+    }
     else
     {
-	/* Invalid picture or decoder context. Ignore */
-	if (decoder->GetWidth() == 0 || decoder->GetHeight() == 0) return 0;
-	
-	if ( scaler == NULL ) scaler = new FrameScaler();
+	/* Encoder is behind, replace the oldest picture not encoded yet */
+	pic = queuedPictures.front();
+	queuedPictures.pop_front();
+	/* Keep the adjust request */
+	needAdjust |= pic->adjust;
+	stats.dropped++;
+    }
 
-	if ( scaler->SetResize( decoder->GetWidth(), decoder->GetHeight(), decoder->GetWidth(),
-				(int) width_out, (int) height_out, (int) width_out ) )
+    pthread_mutex_unlock(&mutex);
+
+    /* Change the buffer with the decoded size */
+    if (pic->yuv == NULL || pic->yuv->GetWidth() != width || pic->yuv->GetHeight() != height)
+    {
+	if (pic->yuv) pic->yuv->Release();
+	pic->yuv = YUVPicturePool::Acquire(width, height);
+    }
+
+    memcpy(pic->yuv->GetData(), data, size);
+    pic->adjust = needAdjust;
+    pic->queued = getTime();
+
+    pthread_mutex_lock(&mutex);
+    queuedPictures.push_back(pic);
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+void * VideoTranscoder::Run(void * vtc)
+{
+    ((VideoTranscoder *) vtc)->Encoding();
+    return NULL;
+}
+
+void VideoTranscoder::Encoding()
+{
+    pthread_mutex_lock(&mutex);
+
+    while ( running )
+    {
+	if ( queuedPictures.empty() )
 	{
-	    resizeWidth = decoder->GetWidth();
-	    resizeHeight = decoder->GetHeight();
-	    
-	    if (decodedPic) free(decodedPic);
-	    decodedPicSize = resizeWidth*resizeHeight + (resizeWidth*resizeHeight) / 2;
-
-	    decodedPic = (BYTE *) malloc(decodedPicSize);
-	    
-	    return 1;
+	    pthread_cond_wait(&cond, &mutex);
+	    continue;
 	}
-    }	
-    return 0;
+
+	VideoTranscoderPicture * pic = queuedPictures.front();
+	queuedPictures.pop_front();
+
+	stats.queueTime += getTime() - pic->queued;
+
+	pthread_mutex_unlock(&mutex);
+
+	EncodePicture(pic->yuv->GetData(), pic->yuv->GetWidth(), pic->yuv->GetHeight(), pic->adjust);
+
+	pthread_mutex_lock(&mutex);
+
+	/* Recycle it */
+	freePictures.push_back(pic);
+    }
+
+    pthread_mutex_unlock(&mutex);
 }
 
-struct VideoTranscoder * VideoTranscoderCreate(struct ast_channel *channel,char *format)
+void VideoTranscoder::GetStats(VideoTranscoderStats & stats)
+{
+    pthread_mutex_lock(&mutex);
+    stats = this->stats;
+    pthread_mutex_unlock(&mutex);
+}
+
+
+bool VideoTranscoder::GetDecodedPicParams( VideoCodec::Type * codec, DWORD * width, DWORD * height)
+{
+    if ( decoder != NULL)
+    {
+        if ( decoder->GetWidth() > 0 && decoder->GetHeight() > 0 )
+	{
+	    (*codec) = decoder->type;
+	    *width = decoder->GetWidth();
+	    *height = decoder->GetHeight();
+	    return true;
+	}
+    }
+    return false;
+}
+
+static bool ParseFormat(const char *format, VideoCodec::Type & output, unsigned int & width_out, unsigned int & height_out,
+			int & bitrate, int & fps, int & gob_size_out)
 {
-    /* Check params */
-    VideoCodec::Type output;
-    struct VideoTranscoder *vtc;
-    
     if ( strncasecmp(format,"h263",4) == 0 )
     {
         output = VideoCodec::H263_1996;
@@ -284,14 +686,19 @@ struct VideoTranscoder * VideoTranscoderCreate(struct ast_channel *channel,char
     else
     {
  	/* Only h263 or h264 output by now*/
-	return NULL;
+	return false;
     }
 
     /* Get first parameter */
-    char *i = strchr(format,'@');
-    int picsize = 0, qMin = -1, qMax = -1, fps = -1, bitrate = -1;
-    int gob_size_out;
-    unsigned int width_out = 352, height_out = 288;
+    const char *i = strchr(format,'@');
+    int qMin = -1, qMax = -1;
+
+    fps = -1;
+    bitrate = -1;
+    gob_size_out = -1;
+    width_out = 352;
+    height_out = 288;
+
     /* Parse params */
     while (i)
     {
@@ -304,33 +711,30 @@ struct VideoTranscoder * VideoTranscoderCreate(struct ast_channel *channel,char
 	    /* Set qcif */
 	    width_out = 176;
 	    height_out = 144;
-	    picsize = 0;
-	} 
-	else if (strncasecmp(i,"cif",3)==0) 
+	}
+	else if (strncasecmp(i,"cif",3)==0)
 	{
 			/* Set cif */
 	    width_out = 352;
 	    height_out = 288;
-	    picsize = 1;
-	} 
-	else if (strncasecmp(i,"vga",3)==0) 
+	}
+	else if (strncasecmp(i,"vga",3)==0)
 	{
 	    /* Set VGA */
 	    width_out = 640;
 	    height_out = 480;
-	    picsize = 2;
 	}
-	else if (strncasecmp(i,"fps=",4)==0) 
+	else if (strncasecmp(i,"fps=",4)==0)
 	{
 	    /* Set fps */
 	    fps = atoi(i+4);
-	} 
+	}
 	else if (strncasecmp(i,"kb=",3)==0)
 	{
-	    /* Set bitrate */
-	    bitrate = atoi(i+3)*1024;
-	} 
-	else if (strncasecmp(i,"qmin=",5) == 0) 
+	    /* Set bitrate, encoders take kbits */
+	    bitrate = atoi(i+3);
+	}
+	else if (strncasecmp(i,"qmin=",5) == 0)
 	{
 		/* Set qMin */
 		qMin = atoi(i+5);
@@ -338,7 +742,7 @@ struct VideoTranscoder * VideoTranscoderCreate(struct ast_channel *channel,char
 	else if (strncasecmp(i,"qmax=",5)==0) {
 			/* Set qMax */
 		qMax = atoi(i+5);
-	} 
+	}
 	else if (strncasecmp(i,"gs=",3)==0) {
 			/* Set gop size */
 		gob_size_out = atoi(i+3);
@@ -348,37 +752,77 @@ struct VideoTranscoder * VideoTranscoderCreate(struct ast_channel *channel,char
 	i = strchr(i,'/');
     }
 
-    /* Create transcoder */
-    // VideoTranscoder(void  * ctxdata, unsigned int width_out, unsigned int height_out,
-    //                VideoCodec::Type outputcodec,
-    //                unsigned int bitrate, unsigned gob_size)
-    vtc = new VideoTranscoder(channel, width_out, height_out, output, fps, bitrate, gob_size_out);
+    return true;
+}
 
-    if ( vtc == NULL ) 
-    {
-    	ast_log(LOG_ERROR,"-Transcoder allocation failed\n" );
-         return NULL ; 
-    }
+struct VideoTranscoder * VideoTranscoderCreate(void * ctxdata,char *format, VideoTranscoderCb cb)
+{
+    /* Create transcoder */
+    struct VideoTranscoder *vtc = new VideoTranscoder();
 
-    /* If not opened correctly */
-    if (! vtc->EncoderOpen() )
+    /* First output is 0 */
+    if ( VideoTranscoderAddOutput(vtc, ctxdata, format, cb) < 0 )
     {
 	/* Error */
-	ast_log(LOG_ERROR,"-Transcoder: Error opening encoder\n");
+	Error("-Transcoder: Error opening encoder for %s\n", format);
 	/* Destroy it */
 	delete vtc;
 	/* Exit */
-	return NULL;	
+	return NULL;
     }
 
     /* Return encoder */
     return vtc;
 }
 
+int VideoTranscoderAddOutput(struct VideoTranscoder *vtc, void * ctxdata, char *format, VideoTranscoderCb cb)
+{
+    VideoCodec::Type output;
+    unsigned int width_out, height_out;
+    int bitrate, fps, gob_size_out;
+
+    /* Check params */
+    if ( ! ParseFormat(format, output, width_out, height_out, bitrate, fps, gob_size_out) )
+	return -1;
+
+    return vtc->AddOutput(ctxdata, cb, width_out, height_out, output, bitrate, fps, gob_size_out);
+}
+
+int VideoTranscoderRemoveOutput(struct VideoTranscoder *vtc, int output)
+{
+    return vtc->RemoveOutput(output);
+}
+
+int VideoTranscoderProcessFrame(struct VideoTranscoder *vtc, const ast_frame * f)
+{
+    VideoCodec::Type codec;
+
+    if ( f->frametype != AST_FRAME_VIDEO ) return -2;
+
+    if ( ! AstFormatToCodecList(f->subclass & ~0x1, &codec) ) return -2;
+
+    /* Decode from the frame buffer */
+    VideoFrame vf(codec, f->datalen, false);
+    vf.SetMedia( AST_FRAME_GET_BUFFER(f), f->datalen );
+
+    return vtc->ProcessFrame( &vf, 0, f->subclass & 0x1 );
+}
+
+int VideoTranscoderSetPipeline(struct VideoTranscoder *vtc, int pictures)
+{
+    return vtc->SetPipeline(pictures);
+}
+
+int VideoTranscoderGetStats(struct VideoTranscoder *vtc, struct VideoTranscoderStats * stats)
+{
+    vtc->GetStats(*stats);
+    return 1;
+}
+
 int VideoTranscoderGetDecodedPicParams( struct VideoTranscoder *vtc, int * codec, DWORD * width, DWORD *height )
 {
     VideoCodec::Type c2;
-    
+
     int ret = vtc->GetDecodedPicParams(&c2, width, height );
     if (ret)
     {
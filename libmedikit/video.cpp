@@ -4,6 +4,31 @@
 #include "h263/mpeg4codec.h"
 #include "h264/h264encoder.h"
 #include "h264/h264decoder.h"
+#include "h264/h264startcode.h"
+
+bool VideoEncoder::EncodeFrame(BYTE *in,DWORD len,VideoFrame &out)
+{
+	//Encode in the encoder frame
+	VideoFrame *frame = EncodeFrame(in,len);
+
+	//Check
+	if (!frame)
+		//Error
+		return false;
+
+	//Copy media
+	out.SetMedia(frame->GetData(),frame->GetLength());
+	out.SetWidth(frame->GetWidth());
+	out.SetHeight(frame->GetHeight());
+	out.SetIntra(frame->IsIntra());
+
+	//Copy packetization
+	out.ClearRTPPacketizationInfo();
+	for (MediaFrame::RtpPacketizationInfo::iterator it = frame->GetRtpPacketizationInfo().begin();it!=frame->GetRtpPacketizationInfo().end();++it)
+		out.AddRtpPacket((*it)->GetPos(),(*it)->GetSize(),(*it)->GetPrefixData(),(*it)->GetPrefixLen(),(*it)->IsMark());
+
+	return true;
+}
 
 
 bool VideoFrame::Packetize(unsigned int mtu)
@@ -98,74 +123,53 @@ DWORD VideoFrame::ReadNaluSize(BYTE * data)
 	}
 }
 
-DWORD VideoFrame::DetectNaluBoundary(BYTE * p, DWORD sz)
-{
-	DWORD l;
-	
-	for (l = 0; l+4 < sz; l++)
-	{
-		if (p[l] == 0 && p[l+1] == 0)
-		{
-			if (p[l+2] == 1)
-			{
-				return l;
-			}
-		}
-		else if(p[l+2] == 0 && p[l+3] == 1)
-		{
-			return l;;
-		}
-	}
-	
-	if (l+3 < sz)
-	{
-		if (p[l] == 0 && p[l+1] == 0)
-		{
-			if (p[l+2] == 1)
-			{
-				return l;
-			}
-		}
-	}
-	
-	return 0;	
-}
 #define H264_FUA_HEADER_SIZE				2
 
 bool VideoFrame::PacketizeH264(unsigned int mtu)
 {
 	BYTE * p = GetData();
-	unsigned int l = 0;
-	DWORD naluSz;
+	DWORD len = GetLength();
+	DWORD l;
 		
 	ClearRTPPacketizationInfo();
 
-	// Skip header (if needed)
-	if (p[l] == 0 && p[l+1] == 0)
+	if (useStartCode)
 	{
-		if (p[l+2] == 1)
+		// Skip anything before the first NALU
+		l = H264FindStartCode(p, len);
+
+		while (l < len)
 		{
-			l+= 3;
+			// Skip start code
+			while (p[l] == 0) l++;
+			l++;
+
+			// Up to the next one
+			DWORD naluSz = H264FindStartCode(p + l, len - l);
+
+			if (naluSz == 0) return false;
+			PacketizeH264Nalu(mtu, l, naluSz, l + naluSz >= len);
+			l += naluSz;
 		}
 	}
-	else if(p[l+2] == 0 && p[l+3] == 1)
+	else
 	{
-		l+= 4;
-	}
+		l = 0;
 
-	while (l < GetLength() )
-	{
-		if (useStartCode)
-			naluSz = DetectNaluBoundary(p + l, GetLength() - l );
-		else
-			naluSz = ReadNaluSize(p + l);
-		
-		if (naluSz == 0 || naluSz > GetLength() ) return false;
-		bool last = (l + naluSz >= GetLength());
-		PacketizeH264Nalu(mtu, l, naluSz, last);
-		l += naluSz;
+		while (l + naluSizeLen <= len)
+		{
+			DWORD naluSz = ReadNaluSize(p + l);
+
+			// Skip size
+			l += naluSizeLen;
+
+			if (naluSz == 0 || naluSz > len - l) return false;
+			PacketizeH264Nalu(mtu, l, naluSz, l + naluSz >= len);
+			l += naluSz;
+		}
 	}
-	return true;
+
+	return HasRtpPacketizationInfo();
 }
 
 void VideoFrame::PacketizeH264Nalu(unsigned int mtu, DWORD offset, DWORD naluSz, bool last)
@@ -177,7 +181,7 @@ void VideoFrame::PacketizeH264Nalu(unsigned int mtu, DWORD offset, DWORD naluSz,
 	// Single NAL packet
 	if ( naluSz <= mtu )
 	{
-		AddRtpPacket(l, naluSz, 0L, 0, last );
+		AddRtpPacket(offset, naluSz, 0L, 0, last );
 		return;	
 	}
 	
@@ -187,6 +191,9 @@ void VideoFrame::PacketizeH264Nalu(unsigned int mtu, DWORD offset, DWORD naluSz,
 	fua_hdr[1] = 0x80; /* S=1,E=0,R=0 */
 	fua_hdr[1] |= p[l] & 0x1f; /* type */
 
+	// NAL header is in the FU headers
+	l++;
+
 	while (l < naluSz )
 	{
 		unsigned long pktSize = naluSz - l;
@@ -202,7 +209,7 @@ void VideoFrame::PacketizeH264Nalu(unsigned int mtu, DWORD offset, DWORD naluSz,
 		}
 		
 		AddRtpPacket(offset + l, pktSize, fua_hdr, H264_FUA_HEADER_SIZE,
-			     pktSize + l >= naluSz); 
+			     last && pktSize + l >= naluSz); 
 		
 		// reset "S" bit (that marks the first fragment)
 		fua_hdr[1] &= 0x7F;